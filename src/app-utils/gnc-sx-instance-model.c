@@ -1234,7 +1234,11 @@ gnc_sx_instance_model_effect_change(GncSxInstanceModel *model,
                                     GList **created_transaction_guids,
                                     GList **creation_errors)
 {
+    QofBook *book = gnc_get_current_book();
     GList *iter;
+
+    // Write all of the created transactions and SX updates together.
+    qof_book_begin_batch(book);
     for (iter = model->sx_instance_list; iter != NULL; iter = iter->next)
     {
         GList *instance_iter;
@@ -1310,6 +1314,7 @@ gnc_sx_instance_model_effect_change(GncSxInstanceModel *model,
         gnc_sx_set_instance_count(instances->sx, instance_count);
         xaccSchedXactionSetRemOccur(instances->sx, remain_occur_count);
     }
+    qof_book_end_batch(book);
 }
 
 void
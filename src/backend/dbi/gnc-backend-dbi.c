@@ -39,6 +39,7 @@
 #include <dbi/dbi.h>
 
 #include "gnc-backend-sql.h"
+#include "gnc-commodity-sql.h"
 
 #include "qof.h"
 #include "qofquery-p.h"
@@ -72,20 +73,25 @@ typedef gchar* (*CREATE_TABLE_DDL_FN)( GncSqlConnection* conn,
                                        const gchar* table_name,
                                        const GList* col_info_list );
 typedef GSList* (*GET_TABLE_LIST_FN)( dbi_conn conn, const gchar* dbname );
+typedef gchar* (*MULTI_ROW_INSERT_SQL_FN)( const gchar* insert_sql, const GPtrArray* rows );
 typedef struct
 {
     CREATE_TABLE_DDL_FN		create_table_ddl;
     GET_TABLE_LIST_FN		get_table_list;
+    MULTI_ROW_INSERT_SQL_FN	multi_row_insert_sql;
 } provider_functions_t;
 
 static /*@ null @*/ gchar* conn_create_table_ddl_sqlite3( GncSqlConnection* conn,
         const gchar* table_name,
         const GList* col_info_list );
 static GSList* conn_get_table_list( dbi_conn conn, const gchar* dbname );
+static gchar* multi_row_insert_sql_sqlite3( const gchar* insert_sql, const GPtrArray* rows );
+static gchar* multi_row_insert_sql( const gchar* insert_sql, const GPtrArray* rows );
 static provider_functions_t provider_sqlite3 =
 {
     conn_create_table_ddl_sqlite3,
-    conn_get_table_list
+    conn_get_table_list,
+    multi_row_insert_sql_sqlite3
 };
 #define SQLITE3_TIMESPEC_STR_FORMAT "%04d%02d%02d%02d%02d%02d"
 
@@ -95,7 +101,8 @@ static /*@ null @*/ gchar* conn_create_table_ddl_mysql( GncSqlConnection* conn,
 static provider_functions_t provider_mysql =
 {
     conn_create_table_ddl_mysql,
-    conn_get_table_list
+    conn_get_table_list,
+    multi_row_insert_sql
 };
 #define MYSQL_TIMESPEC_STR_FORMAT "%04d%02d%02d%02d%02d%02d"
 
@@ -106,7 +113,8 @@ static GSList* conn_get_table_list_pgsql( dbi_conn conn, const gchar* dbname );
 static provider_functions_t provider_pgsql =
 {
     conn_create_table_ddl_pgsql,
-    conn_get_table_list_pgsql
+    conn_get_table_list_pgsql,
+    multi_row_insert_sql
 };
 #define PGSQL_TIMESPEC_STR_FORMAT "%04d%02d%02d %02d%02d%02d"
 
@@ -115,6 +123,9 @@ static /*@ null @*/ gchar* create_index_ddl( GncSqlConnection* conn,
         const gchar* table_name,
         const GncSqlColumnTableEntry* col_table );
 static GncSqlConnection* create_dbi_connection( /*@ observer @*/ provider_functions_t* provider, /*@ observer @*/ QofBackend* qbe, /*@ observer @*/ dbi_conn conn );
+static void start_async_writer( QofBackend* qbe, const gchar* driver, const gchar* host, gint port,
+                                const gchar* dbname, const gchar* username, const gchar* password );
+static gboolean drain_async_writer( /*@ null @*/ GncSqlConnection* conn );
 
 #define GNC_DBI_PROVIDER_SQLITE (&provider_sqlite3)
 #define GNC_DBI_PROVIDER_MYSQL (&provider_mysql)
@@ -140,6 +151,8 @@ struct GncDbiBackend_struct
 };
 typedef struct GncDbiBackend_struct GncDbiBackend;
 
+typedef struct GncDbiAsyncWriter GncDbiAsyncWriter;
+
 typedef struct
 {
     GncSqlConnection base;
@@ -156,6 +169,11 @@ typedef struct
     // be used to prevent infinite loops.
     gboolean retry;         // Signals the calling function that it should retry (the error handler detected
     // transient error and managed to resolve it, but it can't run the original query)
+    /*@ null @*/ /*@ owned @*/
+    GncDbiAsyncWriter* writer;  // Background writer for db transactions, or NULL to write synchronously
+    /*@ null @*/ /*@ owned @*/
+    GPtrArray* async_tx;    // SQL of the db transaction being collected for the writer, or NULL
+    gboolean tx_failed;     // SQL replayed from async_tx failed, so the db transaction must be rolled back
 } GncDbiSqlConnection;
 
 #define DBI_MAX_CONN_ATTEMPTS 5
@@ -294,6 +312,7 @@ gnc_dbi_sqlite3_session_begin( QofBackend *qbe, QofSession *session,
 
     if ( be->sql_be.conn != NULL )
     {
+        gnc_sql_clear_statement_cache( &be->sql_be );
         gnc_sql_connection_dispose( be->sql_be.conn );
     }
     be->sql_be.conn = create_dbi_connection( GNC_DBI_PROVIDER_SQLITE, qbe, be->conn );
@@ -529,9 +548,11 @@ gnc_dbi_mysql_session_begin( QofBackend* qbe, QofSession *session,
 
         if ( be->sql_be.conn != NULL )
         {
+            gnc_sql_clear_statement_cache( &be->sql_be );
             gnc_sql_connection_dispose( be->sql_be.conn );
         }
         be->sql_be.conn = create_dbi_connection( GNC_DBI_PROVIDER_MYSQL, qbe, be->conn );
+        start_async_writer( qbe, "mysql", host, portnum, dbname, username, password );
     }
     be->sql_be.timespec_format = MYSQL_TIMESPEC_STR_FORMAT;
 
@@ -691,9 +712,11 @@ gnc_dbi_postgres_session_begin( QofBackend *qbe, QofSession *session,
     {
         if ( be->sql_be.conn != NULL )
         {
+            gnc_sql_clear_statement_cache( &be->sql_be );
             gnc_sql_connection_dispose( be->sql_be.conn );
         }
         be->sql_be.conn = create_dbi_connection( GNC_DBI_PROVIDER_PGSQL, qbe, be->conn );
+        start_async_writer( qbe, "pgsql", host, portnum, dbname, username, password );
     }
     be->sql_be.timespec_format = PGSQL_TIMESPEC_STR_FORMAT;
 exit:
@@ -717,6 +740,11 @@ gnc_dbi_session_end( QofBackend *be_start )
 
     ENTER (" ");
 
+    if ( be->sql_be.conn != NULL )
+    {
+        gnc_sql_commit_group( &be->sql_be );
+        (void)drain_async_writer( be->sql_be.conn );
+    }
     if ( be->conn != NULL )
     {
         dbi_conn_close( be->conn );
@@ -724,9 +752,11 @@ gnc_dbi_session_end( QofBackend *be_start )
     }
     if ( be->sql_be.conn != NULL )
     {
+        gnc_sql_clear_statement_cache( &be->sql_be );
         gnc_sql_connection_dispose( be->sql_be.conn );
         be->sql_be.conn = NULL;
     }
+    gnc_sql_forget_saved_commodities( &be->sql_be );
     gnc_sql_finalize_version_info( &be->sql_be );
 
     LEAVE (" ");
@@ -737,6 +767,7 @@ gnc_dbi_destroy_backend( /*@ only @*/ QofBackend *be )
 {
     g_return_if_fail( be != NULL );
 
+    gnc_sql_clear_statement_cache( &((GncDbiBackend*)be)->sql_be );
     qof_backend_destroy( be );
 
     g_free( be );
@@ -783,6 +814,7 @@ gnc_dbi_save_may_clobber_data( QofBackend* qbe )
     gint status;
 
     /* Data may be clobbered iff the number of tables != 0 */
+    (void)drain_async_writer( be->sql_be.conn );
     dbname = dbi_conn_get_option( be->conn, "dbname" );
     table_name_list = ((GncDbiSqlConnection*)(be->sql_be.conn))->provider->get_table_list( be->conn, dbname );
     if ( table_name_list != NULL )
@@ -812,6 +844,9 @@ gnc_dbi_sync_all( QofBackend* qbe, /*@ dependent @*/ QofBook *book )
 
     ENTER( "book=%p, primary=%p", book, be->primary_book );
 
+    gnc_sql_commit_group( &be->sql_be );
+    (void)drain_async_writer( be->sql_be.conn );
+
     /* Destroy the current contents of the database */
     dbname = dbi_conn_get_option( be->conn, "dbname" );
     table_name_list = ((GncDbiSqlConnection*)(be->sql_be.conn))->provider->get_table_list( be->conn, dbname );
@@ -848,6 +883,10 @@ gnc_dbi_sync_all( QofBackend* qbe, /*@ dependent @*/ QofBook *book )
     be->is_pristine_db = TRUE;
     be->primary_book = book;
     gnc_sql_sync_all( &be->sql_be, book );
+    if ( !drain_async_writer( be->sql_be.conn ) )
+    {
+        qof_backend_set_error( qbe, ERR_BACKEND_SERVER_ERR );
+    }
 
     LEAVE( "book=%p", book );
 }
@@ -886,6 +925,26 @@ gnc_dbi_commit_edit( QofBackend *qbe, QofInstance *inst )
     gnc_sql_commit_edit( &be->sql_be, inst );
 }
 
+static void
+gnc_dbi_begin_batch( QofBackend *qbe )
+{
+    GncDbiBackend* be = (GncDbiBackend*)qbe;
+
+    g_return_if_fail( be != NULL );
+
+    gnc_sql_begin_batch( &be->sql_be );
+}
+
+static void
+gnc_dbi_end_batch( QofBackend *qbe )
+{
+    GncDbiBackend* be = (GncDbiBackend*)qbe;
+
+    g_return_if_fail( be != NULL );
+
+    gnc_sql_end_batch( &be->sql_be );
+}
+
 /* ================================================================= */
 
 static void
@@ -905,6 +964,8 @@ init_sql_backend( GncDbiBackend* dbi_be )
     be->begin = gnc_dbi_begin_edit;
     be->commit = gnc_dbi_commit_edit;
     be->rollback = gnc_dbi_rollback_edit;
+    be->begin_batch = gnc_dbi_begin_batch;
+    be->end_batch = gnc_dbi_end_batch;
 
     be->counter = NULL;
 
@@ -1147,6 +1208,423 @@ gnc_module_finalize_backend_dbi( void )
     dbi_shutdown();
 }
 
+/* --------------------------------------------------------- */
+/* Asynchronous commits.
+
+   When the "sql_async_commit" preference is set, a mysql or postgres
+   backend opens a second connection to the database and gives it to a
+   worker thread.  The SQL sent between the start and end of a db
+   transaction is collected as text on the main thread, and the whole db
+   transaction is queued for the worker when it is committed, so
+   gnc_sql_commit_edit() returns without waiting for the server.  The
+   engine's on_done callback therefore runs as soon as the SQL has been
+   built, before the data has reached the database.
+
+   SELECTs only ever run on the main connection.  The backend sets
+   commits_are_queued so that the SQL backend's commits don't read the db:
+   it remembers which commodities are saved, rewrites an object's slots
+   instead of comparing them with the saved ones, and leaves the balance
+   checkpoints to be rebuilt when they are next read.  Should a SELECT
+   still come inside a db transaction, it needs that transaction's earlier
+   rows, so the collected SQL is replayed on the main connection and the
+   rest of the db transaction is written synchronously.  Anything outside
+   a db transaction runs on the main connection after the queue has
+   drained, so reads see every earlier write.
+
+   If the worker's connection to a mysql server is lost, it reconnects and
+   runs the db transaction again, as the main connection does for single
+   statements.  If a statement fails for any other reason, the db
+   transaction is rolled back.  The engine can no longer undo the edit, so
+   the failure is reported on the main thread by marking the book dirty, so
+   that the next save writes everything again, and by signalling the
+   engine's commit error handler.  If the worker's connection can't be
+   restored, the backend stops using it and writes synchronously.
+*/
+
+typedef enum
+{
+    ASYNC_TX,
+    ASYNC_QUIT
+} async_item_type;
+
+typedef struct
+{
+    async_item_type type;
+    /*@ only @*/ /*@ null @*/
+    GPtrArray* sql;         /* gchar*, the statements of one db transaction */
+} async_item;
+
+struct GncDbiAsyncWriter
+{
+    /*@ observer @*/
+    QofBackend* qbe;
+    /*@ owned @*/
+    dbi_conn conn;          /* Used only by the worker thread */
+    gboolean is_mysql;
+    gint error_repeat;      /* Reconnection attempts, worker thread only */
+    gboolean retry;         /* The connection was restored, worker thread only */
+    GThread* thread;
+    GAsyncQueue* queue;     /* async_item*, oldest first */
+    GMutex* lock;           /* Protects the fields below */
+    GCond* cond;            /* Signalled as each item is finished */
+    guint pending;          /* Items queued and not yet finished */
+    guint failed_tx;        /* Db transactions rolled back and not yet reported */
+    guint idle_id;          /* Main loop source reporting failed_tx, or 0 */
+    gboolean is_broken;     /* The connection is lost and couldn't be restored */
+};
+
+#define KEY_ASYNC_COMMIT "sql_async_commit"
+
+static void
+async_error_fn( dbi_conn conn, void* user_data )
+{
+    GncDbiAsyncWriter* writer = (GncDbiAsyncWriter*)user_data;
+    const gchar* msg;
+    gint err_num;
+
+    err_num = dbi_conn_error( conn, &msg );
+    if ( writer->is_mysql && err_num == 2006 )     // Server has gone away
+    {
+        if ( writer->error_repeat >= DBI_MAX_CONN_ATTEMPTS )
+        {
+            PERR( "DBI error (background writer): %s - Failed to reconnect after %d attempts.\n", msg, DBI_MAX_CONN_ATTEMPTS );
+            writer->retry = FALSE;
+        }
+        else
+        {
+            PINFO( "DBI error (background writer): %s - Reconnecting...\n", msg );
+            writer->error_repeat++;
+            writer->retry = TRUE;
+
+            (void)dbi_conn_connect( conn );
+        }
+    }
+    else
+    {
+        PERR( "DBI error (background writer): %s\n", msg );
+    }
+}
+
+/* Runs one statement on the writer's connection */
+static gboolean
+async_exec( dbi_conn conn, const gchar* sql )
+{
+    dbi_result result;
+
+    DEBUG( "SQL (background): %s\n", sql );
+    result = dbi_conn_query( conn, sql );
+    if ( result == NULL )
+    {
+        PERR( "Error executing SQL %s\n", sql );
+        return FALSE;
+    }
+    (void)dbi_result_free( result );
+    return TRUE;
+}
+
+/* Worker thread: runs one db transaction, running it again from the start
+   if the connection had to be restored part way through. */
+static gboolean
+async_run_tx( GncDbiAsyncWriter* writer, GPtrArray* sql )
+{
+    gboolean is_ok;
+    guint i;
+
+    writer->error_repeat = 0;
+    do
+    {
+        writer->retry = FALSE;
+        is_ok = async_exec( writer->conn, "BEGIN" );
+        for ( i = 0; is_ok && i < sql->len; i++ )
+        {
+            is_ok = async_exec( writer->conn, g_ptr_array_index( sql, i ) );
+        }
+        if ( is_ok )
+        {
+            is_ok = async_exec( writer->conn, "COMMIT" );
+        }
+        else if ( !writer->retry )
+        {
+            (void)async_exec( writer->conn, "ROLLBACK" );
+            writer->retry = FALSE;
+        }
+    }
+    while ( !is_ok && writer->retry );
+
+    return is_ok;
+}
+
+static void
+free_async_sql( /*@ only @*/ GPtrArray* sql )
+{
+    guint i;
+
+    for ( i = 0; i < sql->len; i++ )
+    {
+        g_free( g_ptr_array_index( sql, i ) );
+    }
+    (void)g_ptr_array_free( sql, TRUE );
+}
+
+/* Main thread: takes and reports the failures recorded by the worker */
+static guint
+report_async_failures( GncDbiAsyncWriter* writer )
+{
+    GncSqlBackend* be = (GncSqlBackend*)writer->qbe;
+    guint failed_tx;
+
+    g_mutex_lock( writer->lock );
+    failed_tx = writer->failed_tx;
+    writer->failed_tx = 0;
+    if ( writer->idle_id != 0 )
+    {
+        (void)g_source_remove( writer->idle_id );
+        writer->idle_id = 0;
+    }
+    g_mutex_unlock( writer->lock );
+
+    if ( failed_tx != 0 )
+    {
+        PERR( "%u background db transactions were rolled back\n", failed_tx );
+        gnc_sql_forget_saved_commodities( be );
+        if ( be->primary_book != NULL )
+        {
+            qof_book_mark_dirty( be->primary_book );
+        }
+        gnc_engine_signal_commit_error( ERR_BACKEND_SERVER_ERR );
+    }
+
+    return failed_tx;
+}
+
+static gboolean
+report_async_failures_cb( gpointer data )
+{
+    GncDbiAsyncWriter* writer = (GncDbiAsyncWriter*)data;
+
+    g_mutex_lock( writer->lock );
+    writer->idle_id = 0;
+    g_mutex_unlock( writer->lock );
+    (void)report_async_failures( writer );
+
+    return FALSE;
+}
+
+/* Worker thread: marks an item as finished and frees it */
+static void
+finish_async_item( GncDbiAsyncWriter* writer, /*@ only @*/ async_item* item,
+                   gboolean tx_failed, gboolean is_broken )
+{
+    g_mutex_lock( writer->lock );
+    if ( tx_failed )
+    {
+        writer->failed_tx++;
+        if ( writer->idle_id == 0 )
+        {
+            writer->idle_id = g_idle_add( report_async_failures_cb, writer );
+        }
+    }
+    if ( is_broken )
+    {
+        writer->is_broken = TRUE;
+    }
+    writer->pending--;
+    g_cond_broadcast( writer->cond );
+    g_mutex_unlock( writer->lock );
+
+    if ( item->sql != NULL )
+    {
+        free_async_sql( item->sql );
+    }
+    g_free( item );
+}
+
+static gpointer
+async_writer_thread( gpointer data )
+{
+    GncDbiAsyncWriter* writer = (GncDbiAsyncWriter*)data;
+    gboolean is_broken = FALSE;
+    gboolean quit = FALSE;
+
+    while ( !quit )
+    {
+        async_item* item = g_async_queue_pop( writer->queue );
+        gboolean tx_failed = FALSE;
+
+        switch ( item->type )
+        {
+        case ASYNC_TX:
+            // Once the connection is gone, whatever is still queued fails
+            tx_failed = is_broken || !async_run_tx( writer, item->sql );
+            if ( tx_failed && !is_broken )
+            {
+                is_broken = ( dbi_conn_ping( writer->conn ) == 0 );
+            }
+            break;
+
+        case ASYNC_QUIT:
+            quit = TRUE;
+            break;
+        }
+
+        finish_async_item( writer, item, tx_failed, is_broken );
+    }
+
+    return NULL;
+}
+
+static void
+push_async_item( GncDbiAsyncWriter* writer, async_item_type type,
+                 /*@ only @*/ /*@ null @*/ GPtrArray* sql )
+{
+    async_item* item;
+
+    item = g_new0( async_item, 1 );
+    g_assert( item != NULL );
+    item->type = type;
+    item->sql = sql;
+
+    g_mutex_lock( writer->lock );
+    writer->pending++;
+    g_mutex_unlock( writer->lock );
+    g_async_queue_push( writer->queue, item );
+}
+
+static gboolean
+async_writer_is_broken( GncDbiAsyncWriter* writer )
+{
+    gboolean is_broken;
+
+    g_mutex_lock( writer->lock );
+    is_broken = writer->is_broken;
+    g_mutex_unlock( writer->lock );
+
+    return is_broken;
+}
+
+static void
+free_async_writer( /*@ only @*/ GncDbiAsyncWriter* writer )
+{
+    push_async_item( writer, ASYNC_QUIT, NULL );
+    (void)g_thread_join( writer->thread );
+    (void)report_async_failures( writer );
+    ((GncSqlBackend*)writer->qbe)->commits_are_queued = FALSE;
+
+    dbi_conn_close( writer->conn );
+    g_async_queue_unref( writer->queue );
+    g_mutex_free( writer->lock );
+    g_cond_free( writer->cond );
+    g_free( writer );
+}
+
+/* Waits until the worker has finished everything queued so far.  Returns
+   FALSE if any db transaction had to be rolled back.  A writer whose
+   connection has failed is shut down here, once no db transaction is being
+   collected for it. */
+static gboolean
+drain_async_writer( /*@ null @*/ GncSqlConnection* conn )
+{
+    GncDbiSqlConnection* dbi_conn = (GncDbiSqlConnection*)conn;
+    GncDbiAsyncWriter* writer;
+    gboolean is_ok;
+
+    if ( conn == NULL ) return TRUE;
+    writer = dbi_conn->writer;
+    if ( writer == NULL ) return TRUE;
+
+    g_mutex_lock( writer->lock );
+    while ( writer->pending > 0 )
+    {
+        g_cond_wait( writer->cond, writer->lock );
+    }
+    g_mutex_unlock( writer->lock );
+
+    is_ok = ( report_async_failures( writer ) == 0 );
+
+    if ( dbi_conn->async_tx == NULL && async_writer_is_broken( writer ) )
+    {
+        PWARN( "Background writer's connection failed - writing synchronously\n" );
+        free_async_writer( writer );
+        dbi_conn->writer = NULL;
+    }
+
+    return is_ok;
+}
+
+/* Opens the writer's connection and starts its thread if the preference is
+   set.  If anything fails, the backend keeps writing synchronously. */
+static void
+start_async_writer( QofBackend* qbe, const gchar* driver, const gchar* host, gint port,
+                    const gchar* dbname, const gchar* username, const gchar* password )
+{
+    GncDbiBackend* be = (GncDbiBackend*)qbe;
+    GncDbiSqlConnection* sql_conn = (GncDbiSqlConnection*)be->sql_be.conn;
+    GncDbiAsyncWriter* writer;
+    dbi_conn conn;
+    GError* error = NULL;
+
+    g_return_if_fail( sql_conn != NULL );
+
+    if ( !gnc_gconf_get_bool( GCONF_GENERAL, KEY_ASYNC_COMMIT, NULL ) ) return;
+    if ( !g_thread_supported() )
+    {
+        PWARN( "Threads are not initialized - writing synchronously\n" );
+        return;
+    }
+
+    conn = dbi_conn_new( driver );
+    if ( conn == NULL )
+    {
+        PWARN( "Unable to create %s dbi connection - writing synchronously\n", driver );
+        return;
+    }
+    writer = g_new0( GncDbiAsyncWriter, 1 );
+    g_assert( writer != NULL );
+    writer->qbe = qbe;
+    writer->conn = conn;
+    writer->is_mysql = ( strcmp( driver, "mysql" ) == 0 );
+    dbi_conn_error_handler( conn, async_error_fn, writer );
+    if ( !set_standard_connection_options( qbe, conn, host, port, dbname, username, password ) )
+    {
+        dbi_conn_close( conn );
+        g_free( writer );
+        return;
+    }
+    if ( dbi_conn_connect( conn ) < 0 )
+    {
+        PWARN( "Unable to open second connection to '%s' - writing synchronously\n", dbname );
+        dbi_conn_close( conn );
+        g_free( writer );
+        return;
+    }
+    if ( writer->is_mysql && !async_exec( conn, "SET NAMES 'utf8'" ) )
+    {
+        PWARN( "Unable to set connection char set - writing synchronously\n" );
+        dbi_conn_close( conn );
+        g_free( writer );
+        return;
+    }
+
+    writer->queue = g_async_queue_new();
+    writer->lock = g_mutex_new();
+    writer->cond = g_cond_new();
+    writer->thread = g_thread_create( async_writer_thread, writer, TRUE, &error );
+    if ( writer->thread == NULL )
+    {
+        PWARN( "Unable to start background writer: %s\n", error->message );
+        g_error_free( error );
+        g_async_queue_unref( writer->queue );
+        g_mutex_free( writer->lock );
+        g_cond_free( writer->cond );
+        g_free( writer );
+        dbi_conn_close( conn );
+        return;
+    }
+
+    sql_conn->writer = writer;
+    be->sql_be.commits_are_queued = TRUE;
+}
+
 /* --------------------------------------------------------- */
 typedef struct
 {
@@ -1388,6 +1866,15 @@ typedef struct
     GString* sql;
     /*@ observer @*/
     GncSqlConnection* conn;
+
+    /* libdbi has no prepared statements of its own, so a prepared
+       statement keeps its SQL split at each '?' marker, and the bound
+       values are quoted and put in place when the SQL is needed. */
+    /*@ null @*/
+    gchar** fragments;
+    /*@ null @*/
+    gchar** params;
+    guint n_params;
 } GncDbiSqlStatement;
 
 static void
@@ -1399,6 +1886,8 @@ stmt_dispose( /*@ only @*/ GncSqlStatement* stmt )
     {
         (void)g_string_free( dbi_stmt->sql, TRUE );
     }
+    g_strfreev( dbi_stmt->fragments );
+    g_strfreev( dbi_stmt->params );
     g_free( stmt );
 }
 
@@ -1406,10 +1895,36 @@ static gchar*
 stmt_to_sql( GncSqlStatement* stmt )
 {
     GncDbiSqlStatement* dbi_stmt = (GncDbiSqlStatement*)stmt;
+    guint i;
+
+    if ( dbi_stmt->fragments != NULL )
+    {
+        g_string_truncate( dbi_stmt->sql, 0 );
+        for ( i = 0; dbi_stmt->fragments[i] != NULL; i++ )
+        {
+            (void)g_string_append( dbi_stmt->sql, dbi_stmt->fragments[i] );
+            if ( i < dbi_stmt->n_params )
+            {
+                (void)g_string_append( dbi_stmt->sql,
+                                       dbi_stmt->params[i] != NULL ? dbi_stmt->params[i] : "NULL" );
+            }
+        }
+    }
 
     return dbi_stmt->sql->str;
 }
 
+static void
+stmt_bind_value( GncSqlStatement* stmt, guint index, const GValue* value )
+{
+    GncDbiSqlStatement* dbi_stmt = (GncDbiSqlStatement*)stmt;
+
+    g_return_if_fail( index < dbi_stmt->n_params );
+
+    g_free( dbi_stmt->params[index] );
+    dbi_stmt->params[index] = gnc_sql_get_sql_value( dbi_stmt->conn, value );
+}
+
 static void
 stmt_add_where_cond( GncSqlStatement* stmt, /*@ unused @*/ QofIdTypeConst type_name,
                      /*@ unused @*/ gpointer obj, const GncSqlColumnTableEntry* table_row, GValue* value )
@@ -1437,37 +1952,124 @@ create_dbi_statement( /*@ observer @*/ GncSqlConnection* conn, const gchar* sql
     stmt->base.dispose = stmt_dispose;
     stmt->base.toSql = stmt_to_sql;
     stmt->base.addWhereCond = stmt_add_where_cond;
+    stmt->base.bindValue = stmt_bind_value;
     stmt->sql = g_string_new( sql );
     stmt->conn = conn;
 
     return (GncSqlStatement*)stmt;
 }
+
+static GncSqlStatement*
+create_dbi_prepared_statement( /*@ observer @*/ GncSqlConnection* conn, const gchar* sql )
+{
+    GncDbiSqlStatement* stmt;
+
+    stmt = (GncDbiSqlStatement*)create_dbi_statement( conn, sql );
+    stmt->fragments = g_strsplit( sql, "?", -1 );
+    stmt->n_params = g_strv_length( stmt->fragments ) - 1;
+    stmt->params = g_new0( gchar*, stmt->n_params + 1 );
+
+    return (GncSqlStatement*)stmt;
+}
 /* --------------------------------------------------------- */
 static void
 conn_dispose( /*@ only @*/ GncSqlConnection* conn )
 {
-    //GncDbiSqlConnection* dbi_conn = (GncDbiSqlConnection*)conn;
+    GncDbiSqlConnection* dbi_conn = (GncDbiSqlConnection*)conn;
 
+    if ( dbi_conn->async_tx != NULL )
+    {
+        free_async_sql( dbi_conn->async_tx );
+    }
+    if ( dbi_conn->writer != NULL )
+    {
+        free_async_writer( dbi_conn->writer );
+    }
     g_free( conn );
 }
 
+/* Runs one statement of a db transaction on the main connection */
+static gboolean
+exec_on_main_conn( GncDbiSqlConnection* dbi_conn, const gchar* sql )
+{
+    dbi_result result;
+    gint status;
+
+    DEBUG( "SQL: %s\n", sql );
+    do
+    {
+        gnc_dbi_init_error( dbi_conn );
+        result = dbi_conn_query( dbi_conn->conn, sql );
+    }
+    while ( dbi_conn->retry );
+    if ( result == NULL )
+    {
+        PERR( "Error executing SQL %s\n", sql );
+        return FALSE;
+    }
+    status = dbi_result_free( result );
+    if ( status < 0 )
+    {
+        PERR( "Error in dbi_result_free() result\n" );
+        qof_backend_set_error( dbi_conn->qbe, ERR_BACKEND_SERVER_ERR );
+    }
+    return TRUE;
+}
+
+/* Takes the db transaction being collected for the writer and starts it
+   again on the main connection, so that the rest of it is written
+   synchronously.  Returns FALSE if any of its SQL failed. */
+static gboolean
+replay_async_tx( GncDbiSqlConnection* dbi_conn )
+{
+    GPtrArray* sql = dbi_conn->async_tx;
+    gboolean is_ok;
+    guint i;
+
+    g_return_val_if_fail( sql != NULL, FALSE );
+
+    dbi_conn->async_tx = NULL;
+    (void)drain_async_writer( (GncSqlConnection*)dbi_conn );
+
+    is_ok = exec_on_main_conn( dbi_conn, "BEGIN" );
+    for ( i = 0; is_ok && i < sql->len; i++ )
+    {
+        is_ok = exec_on_main_conn( dbi_conn, g_ptr_array_index( sql, i ) );
+    }
+    free_async_sql( sql );
+    dbi_conn->tx_failed = !is_ok;
+
+    return is_ok;
+}
+
 static /*@ null @*/ GncSqlResult*
 conn_execute_select_statement( GncSqlConnection* conn, GncSqlStatement* stmt )
 {
     GncDbiSqlConnection* dbi_conn = (GncDbiSqlConnection*)conn;
-    GncDbiSqlStatement* dbi_stmt = (GncDbiSqlStatement*)stmt;
+    const gchar* sql = gnc_sql_statement_to_sql( stmt );
     dbi_result result;
 
-    DEBUG( "SQL: %s\n", dbi_stmt->sql->str );
+    if ( dbi_conn->async_tx != NULL )
+    {
+        (void)replay_async_tx( dbi_conn );
+    }
+    if ( dbi_conn->tx_failed )
+    {
+        // Once a statement has failed the db transaction can only be rolled back
+        return NULL;
+    }
+    (void)drain_async_writer( conn );
+
+    DEBUG( "SQL: %s\n", sql );
     do
     {
         gnc_dbi_init_error( dbi_conn );
-        result = dbi_conn_query( dbi_conn->conn, dbi_stmt->sql->str );
+        result = dbi_conn_query( dbi_conn->conn, sql );
     }
     while ( dbi_conn->retry );
     if ( result == NULL )
     {
-        PERR( "Error executing SQL %s\n", dbi_stmt->sql->str );
+        PERR( "Error executing SQL %s\n", sql );
         return NULL;
     }
     return create_dbi_result( dbi_conn, result );
@@ -1477,21 +2079,33 @@ static gint
 conn_execute_nonselect_statement( GncSqlConnection* conn, GncSqlStatement* stmt )
 {
     GncDbiSqlConnection* dbi_conn = (GncDbiSqlConnection*)conn;
-    GncDbiSqlStatement* dbi_stmt = (GncDbiSqlStatement*)stmt;
+    const gchar* sql = gnc_sql_statement_to_sql( stmt );
     dbi_result result;
     gint num_rows;
     gint status;
 
-    DEBUG( "SQL: %s\n", dbi_stmt->sql->str );
+    if ( dbi_conn->async_tx != NULL )
+    {
+        // The number of rows affected isn't known yet
+        g_ptr_array_add( dbi_conn->async_tx, g_strdup( sql ) );
+        return 0;
+    }
+    if ( dbi_conn->tx_failed )
+    {
+        return -1;
+    }
+    (void)drain_async_writer( conn );
+
+    DEBUG( "SQL: %s\n", sql );
     do
     {
         gnc_dbi_init_error( dbi_conn );
-        result = dbi_conn_query( dbi_conn->conn, dbi_stmt->sql->str );
+        result = dbi_conn_query( dbi_conn->conn, sql );
     }
     while ( dbi_conn->retry );
     if ( result == NULL )
     {
-        PERR( "Error executing SQL %s\n", dbi_stmt->sql->str );
+        PERR( "Error executing SQL %s\n", sql );
         return -1;
     }
     num_rows = (gint)dbi_result_get_numrows_affected( result );
@@ -1512,6 +2126,30 @@ conn_create_statement_from_sql( /*@ observer @*/ GncSqlConnection* conn, const g
     return create_dbi_statement( conn, sql );
 }
 
+static GncSqlStatement*
+conn_prepare_statement( /*@ observer @*/ GncSqlConnection* conn, const gchar* sql )
+{
+    return create_dbi_prepared_statement( conn, sql );
+}
+
+static gint
+conn_execute_multi_row_insert( GncSqlConnection* conn, const gchar* insert_sql,
+                               const GPtrArray* rows )
+{
+    GncDbiSqlConnection* dbi_conn = (GncDbiSqlConnection*)conn;
+    GncSqlStatement* stmt;
+    gchar* sql;
+    gint result;
+
+    sql = dbi_conn->provider->multi_row_insert_sql( insert_sql, rows );
+    stmt = create_dbi_statement( conn, sql );
+    g_free( sql );
+    result = conn_execute_nonselect_statement( conn, stmt );
+    stmt_dispose( stmt );
+
+    return result;
+}
+
 static GValue*
 create_gvalue_from_string( /*@ only @*/ gchar* s )
 {
@@ -1538,6 +2176,7 @@ conn_does_table_exist( GncSqlConnection* conn, const gchar* table_name )
     g_return_val_if_fail( conn != NULL, FALSE );
     g_return_val_if_fail( table_name != NULL, FALSE );
 
+    (void)drain_async_writer( conn );
     dbname = dbi_conn_get_option( dbi_conn->conn, "dbname" );
     tables = dbi_conn_get_table_list( dbi_conn->conn, dbname, table_name );
     nTables = (gint)dbi_result_get_numrows( tables );
@@ -1565,6 +2204,17 @@ conn_begin_transaction( /*@ unused @*/ GncSqlConnection* conn )
     dbi_result result;
     gint status;
 
+    dbi_conn->tx_failed = FALSE;
+    if ( dbi_conn->writer != NULL && async_writer_is_broken( dbi_conn->writer ) )
+    {
+        (void)drain_async_writer( conn );
+    }
+    if ( dbi_conn->writer != NULL )
+    {
+        dbi_conn->async_tx = g_ptr_array_new();
+        return TRUE;
+    }
+
     DEBUG( "BEGIN\n" );
 
     do
@@ -1591,6 +2241,15 @@ conn_rollback_transaction( /*@ unused @*/ GncSqlConnection* conn )
     dbi_result result;
     gint status;
 
+    if ( dbi_conn->async_tx != NULL )
+    {
+        // Nothing has been sent to the server yet
+        free_async_sql( dbi_conn->async_tx );
+        dbi_conn->async_tx = NULL;
+        return TRUE;
+    }
+    dbi_conn->tx_failed = FALSE;
+
     DEBUG( "ROLLBACK\n" );
     result = dbi_conn_queryf( dbi_conn->conn, "ROLLBACK" );
     status = dbi_result_free( result );
@@ -1610,6 +2269,22 @@ conn_commit_transaction( /*@ unused @*/ GncSqlConnection* conn )
     dbi_result result;
     gint status;
 
+    if ( dbi_conn->async_tx != NULL && !async_writer_is_broken( dbi_conn->writer ) )
+    {
+        push_async_item( dbi_conn->writer, ASYNC_TX, dbi_conn->async_tx );
+        dbi_conn->async_tx = NULL;
+        return TRUE;
+    }
+    if ( dbi_conn->async_tx != NULL )
+    {
+        (void)replay_async_tx( dbi_conn );
+    }
+    if ( dbi_conn->tx_failed )
+    {
+        (void)conn_rollback_transaction( conn );
+        return FALSE;
+    }
+
     DEBUG( "COMMIT\n" );
     result = dbi_conn_queryf( dbi_conn->conn, "COMMIT" );
     status = dbi_result_free( result );
@@ -1915,6 +2590,7 @@ conn_create_table( GncSqlConnection* conn, const gchar* table_name,
     {
         gint status;
 
+        (void)drain_async_writer( conn );
         DEBUG( "SQL: %s\n", ddl );
         result = dbi_conn_query( dbi_conn->conn, ddl );
         g_free( ddl );
@@ -1952,6 +2628,7 @@ conn_create_index( /*@ unused @*/ GncSqlConnection* conn, /*@ unused @*/ const g
     {
         gint status;
 
+        (void)drain_async_writer( conn );
         DEBUG( "SQL: %s\n", ddl );
         result = dbi_conn_query( dbi_conn->conn, ddl );
         g_free( ddl );
@@ -1970,6 +2647,42 @@ conn_create_index( /*@ unused @*/ GncSqlConnection* conn, /*@ unused @*/ const g
     return TRUE;
 }
 
+/* Multi-row VALUES lists only arrived in sqlite 3.7.11, so the rows are
+   given as a compound SELECT instead. */
+static gchar*
+multi_row_insert_sql_sqlite3( const gchar* insert_sql, const GPtrArray* rows )
+{
+    GString* sql;
+    guint i;
+
+    sql = g_string_new( insert_sql );
+    for ( i = 0; i < rows->len; i++ )
+    {
+        (void)g_string_append( sql, i == 0 ? " SELECT " : " UNION ALL SELECT " );
+        (void)g_string_append( sql, (const gchar*)g_ptr_array_index( rows, i ) );
+    }
+
+    return g_string_free( sql, FALSE );
+}
+
+static gchar*
+multi_row_insert_sql( const gchar* insert_sql, const GPtrArray* rows )
+{
+    GString* sql;
+    guint i;
+
+    sql = g_string_new( insert_sql );
+    (void)g_string_append( sql, " VALUES" );
+    for ( i = 0; i < rows->len; i++ )
+    {
+        (void)g_string_append( sql, i == 0 ? "(" : ",(" );
+        (void)g_string_append( sql, (const gchar*)g_ptr_array_index( rows, i ) );
+        (void)g_string_append( sql, ")" );
+    }
+
+    return g_string_free( sql, FALSE );
+}
+
 static /*@ null @*/ gchar*
 conn_quote_string( const GncSqlConnection* conn, gchar* unquoted_str )
 {
@@ -2064,6 +2777,8 @@ create_dbi_connection( /*@ observer @*/ provider_functions_t* provider,
     dbi_conn->base.createTable = conn_create_table;
     dbi_conn->base.createIndex = conn_create_index;
     dbi_conn->base.quoteString = conn_quote_string;
+    dbi_conn->base.prepareStatement = conn_prepare_statement;
+    dbi_conn->base.executeMultiRowInsert = conn_execute_multi_row_insert;
     dbi_conn->qbe = qbe;
     dbi_conn->conn = conn;
     dbi_conn->provider = provider;
@@ -33,7 +33,10 @@
 #include "Account.h"
 #include "Split.h"
 #include "Transaction.h"
+#include "Query.h"
 #include "gnc-commodity.h"
+#include "gnc-backend-sql.h"
+#include "gnc-transaction-sql.h"
 
 static QofLogModule log_module = "test-dbi";
 
@@ -141,6 +144,231 @@ compare_books( QofBook* book_1, QofBook* book_2 )
     compare_lots( book_1, book_2 );
 }
 
+static gboolean
+balances_match( const acct_balances_t* bal, Account* acct )
+{
+    return gnc_numeric_equal( bal->balance, xaccAccountGetBalance( acct ) )
+           && gnc_numeric_equal( bal->cleared_balance, xaccAccountGetClearedBalance( acct ) )
+           && gnc_numeric_equal( bal->reconciled_balance, xaccAccountGetReconciledBalance( acct ) );
+}
+
+static gboolean
+checkpoints_match_accounts( GncSqlBackend* be )
+{
+    GSList* bal_slist = gnc_sql_get_account_balances_slist( be );
+    GSList* node;
+    gboolean result = TRUE;
+
+    for ( node = bal_slist; node != NULL; node = node->next )
+    {
+        acct_balances_t* bal = (acct_balances_t*)node->data;
+
+        if ( !balances_match( bal, bal->acct ) )
+        {
+            result = FALSE;
+        }
+        g_free( bal );
+    }
+    g_slist_free( bal_slist );
+
+    return result;
+}
+
+static void
+test_balance_checkpoints( QofSession* session )
+{
+    GncSqlBackend* be = (GncSqlBackend*)qof_session_get_backend( session );
+    Account* root = gnc_book_get_root_account( qof_session_get_book( session ) );
+    GList* accounts = gnc_account_get_descendants( root );
+    GList* node;
+    Account* acct = NULL;
+    Split* split;
+    Transaction* tx;
+    Timespec date;
+    acct_balances_t bal;
+
+    do_test( checkpoints_match_accounts( be ), "Balance checkpoints match loaded balances" );
+
+    for ( node = accounts; node != NULL && acct == NULL; node = node->next )
+    {
+        if ( xaccAccountGetSplitList( node->data ) != NULL )
+        {
+            acct = node->data;
+        }
+    }
+    g_list_free( accounts );
+    if ( acct == NULL ) return;
+
+    // Balances as of the date of the account's last split
+    split = (Split*)g_list_last( xaccAccountGetSplitList( acct ) )->data;
+    tx = xaccSplitGetParent( split );
+    date = xaccTransRetDatePostedTS( tx );
+    do_test( gnc_sql_get_account_balances_as_of( be, acct, date, &bal )
+             && gnc_numeric_equal( bal.balance,
+                                   xaccAccountGetBalanceAsOfDate( acct, timespecToTime_t( date ) ) ),
+             "Balance as of date matches" );
+
+    // Move the transaction back two months
+    xaccTransBeginEdit( tx );
+    xaccTransSetDatePostedSecs( tx, timespecToTime_t( date ) - 60 * 24 * 60 * 60 );
+    xaccTransCommitEdit( tx );
+    do_test( checkpoints_match_accounts( be ), "Balance checkpoints are rebuilt after a date change" );
+
+    // Keep them up to date as each transaction is committed from now on
+    be->load_tx_as_needed = TRUE;
+
+    // Move the transaction forward a month
+    xaccTransBeginEdit( tx );
+    xaccTransSetDatePostedSecs( tx, timespecToTime_t( date ) - 30 * 24 * 60 * 60 );
+    xaccTransCommitEdit( tx );
+    do_test( checkpoints_match_accounts( be ), "Balance checkpoints follow a date change" );
+
+    // Change the reconcile state of one split
+    xaccTransBeginEdit( tx );
+    xaccSplitSetReconcile( split, ( xaccSplitGetReconcile( split ) == NREC ) ? YREC : NREC );
+    xaccTransCommitEdit( tx );
+    do_test( checkpoints_match_accounts( be ), "Balance checkpoints follow a reconcile change" );
+
+    // Delete it
+    xaccTransBeginEdit( tx );
+    xaccTransDestroy( tx );
+    xaccTransCommitEdit( tx );
+    do_test( checkpoints_match_accounts( be ), "Balance checkpoints follow a deletion" );
+}
+
+static gboolean
+query_results_match( QofQuery* query, QofBook* book_1, QofBook* book_2 )
+{
+    QofQuery* q_1 = qof_query_copy( query );
+    QofQuery* q_2 = qof_query_copy( query );
+    GList* results_1;
+    GList* results_2;
+    GList* node;
+    gboolean result;
+
+    qof_query_set_book( q_1, book_1 );
+    qof_query_set_book( q_2, book_2 );
+    results_1 = qof_query_run( q_1 );
+    results_2 = qof_query_run( q_2 );
+
+    result = ( g_list_length( results_1 ) == g_list_length( results_2 ) );
+    for ( node = results_1; node != NULL && result; node = node->next )
+    {
+        const GncGUID* guid = qof_instance_get_guid( QOF_INSTANCE(node->data) );
+
+        result = ( xaccSplitLookup( guid, book_2 ) != NULL
+                   && g_list_find( results_2, xaccSplitLookup( guid, book_2 ) ) != NULL );
+    }
+
+    qof_query_destroy( q_1 );
+    qof_query_destroy( q_2 );
+
+    return result;
+}
+
+/* Runs a query in a new session which loads transactions as needed, and
+   returns the number of transactions it loaded */
+static guint
+count_loaded_transactions( QofQuery* query, const gchar* url )
+{
+    QofSession* session = qof_session_new();
+    QofQuery* q = qof_query_copy( query );
+    GncSqlBackend* be;
+    QofBook* book;
+    guint count;
+
+    qof_session_begin( session, url, FALSE, FALSE );
+    be = (GncSqlBackend*)qof_session_get_backend( session );
+    be->load_tx_as_needed = TRUE;
+    qof_session_load( session, NULL );
+    book = qof_session_get_book( session );
+
+    qof_query_set_book( q, book );
+    (void)qof_query_run( q );
+    count = qof_collection_count( qof_book_get_collection( book, GNC_ID_TRANS ) );
+
+    qof_query_destroy( q );
+    qof_session_end( session );
+    qof_session_destroy( session );
+
+    return count;
+}
+
+static void
+test_query_pushdown( QofSession* session_1, const gchar* url )
+{
+    QofSession* session_2;
+    QofBook* book_1 = qof_session_get_book( session_1 );
+    QofBook* book_2;
+    GncSqlBackend* be;
+    Account* root = gnc_book_get_root_account( book_1 );
+    GList* accounts = gnc_account_get_descendants( root );
+    GList* node;
+    Account* acct = NULL;
+    Account* busiest = NULL;
+    Split* split;
+    Timespec date;
+    QofQuery* query;
+    guint n_loaded;
+
+    for ( node = accounts; node != NULL; node = node->next )
+    {
+        if ( xaccAccountGetSplitList( node->data ) == NULL ) continue;
+        if ( acct == NULL )
+        {
+            acct = node->data;
+        }
+        if ( busiest == NULL || g_list_length( xaccAccountGetSplitList( node->data ) )
+                > g_list_length( xaccAccountGetSplitList( busiest ) ) )
+        {
+            busiest = node->data;
+        }
+    }
+    g_list_free( accounts );
+    if ( acct == NULL ) return;
+    split = (Split*)xaccAccountGetSplitList( acct )->data;
+    date = xaccTransRetDatePostedTS( xaccSplitGetParent( split ) );
+
+    // Load the same data again, with transactions loaded by the queries
+    session_2 = qof_session_new();
+    qof_session_begin( session_2, url, FALSE, FALSE );
+    be = (GncSqlBackend*)qof_session_get_backend( session_2 );
+    be->load_tx_as_needed = TRUE;
+    qof_session_load( session_2, NULL );
+    book_2 = qof_session_get_book( session_2 );
+
+    query = qof_query_create_for( GNC_ID_SPLIT );
+    xaccQueryAddSingleAccountMatch( query, acct, QOF_QUERY_AND );
+    xaccQueryAddDateMatchTS( query, TRUE, date, FALSE, date, QOF_QUERY_AND );
+    do_test( query_results_match( query, book_1, book_2 ), "Account and date query matches" );
+
+    qof_query_set_max_results( query, 2 );
+    do_test( query_results_match( query, book_1, book_2 ), "Query with max results matches" );
+    qof_query_destroy( query );
+
+    // Only the transactions of the last splits should have to be loaded
+    if ( g_list_length( xaccAccountGetSplitList( busiest ) ) > 2 )
+    {
+        query = qof_query_create_for( GNC_ID_SPLIT );
+        xaccQueryAddSingleAccountMatch( query, busiest, QOF_QUERY_AND );
+        n_loaded = count_loaded_transactions( query, url );
+        qof_query_set_max_results( query, 2 );
+        do_test( count_loaded_transactions( query, url ) < n_loaded,
+                 "Query with max results loads fewer transactions" );
+        qof_query_destroy( query );
+    }
+
+    query = qof_query_create_for( GNC_ID_SPLIT );
+    xaccQueryAddMemoMatch( query, "A", FALSE, FALSE, QOF_QUERY_AND );
+    xaccQueryAddValueMatch( query, xaccSplitGetValue( split ), QOF_NUMERIC_MATCH_ANY,
+                            QOF_COMPARE_GTE, QOF_QUERY_OR );
+    do_test( query_results_match( query, book_1, book_2 ), "Memo or value query matches" );
+    qof_query_destroy( query );
+
+    qof_session_end( session_2 );
+    qof_session_destroy( session_2 );
+}
+
 void
 test_dbi_store_and_reload( const gchar* driver, QofSession* session_1, const gchar* url )
 {
@@ -162,6 +390,8 @@ test_dbi_store_and_reload( const gchar* driver, QofSession* session_1, const gch
 
     // Compare with the original data
     compare_books( qof_session_get_book( session_2 ), qof_session_get_book( session_3 ) );
+    test_query_pushdown( session_2, url );
+    test_balance_checkpoints( session_3 );
     qof_session_end( session_1 );
     qof_session_destroy( session_1 );
     qof_session_end( session_2 );
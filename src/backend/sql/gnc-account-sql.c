@@ -278,22 +278,26 @@ load_all_accounts( GncSqlBackend* be )
             }
         }
 
-        /* Load starting balances */
-        bal_slist = gnc_sql_get_account_balances_slist( be );
-        for ( bal = bal_slist; bal != NULL; bal = bal->next )
+        /* If the splits aren't loaded yet, start from their total balances */
+        if ( be->load_tx_as_needed )
         {
-            acct_balances_t* balances = (acct_balances_t*)bal->data;
-
-            g_object_set( balances->acct,
-                          "start-balance", &balances->balance,
-                          "start-cleared-balance", &balances->cleared_balance,
-                          "start-reconciled-balance", &balances->reconciled_balance,
-                          NULL);
-
-        }
-        if ( bal_slist != NULL )
-        {
-            g_slist_free( bal_slist );
+            bal_slist = gnc_sql_get_account_balances_slist( be );
+            for ( bal = bal_slist; bal != NULL; bal = bal->next )
+            {
+                acct_balances_t* balances = (acct_balances_t*)bal->data;
+
+                g_object_set( balances->acct,
+                              "start-balance", &balances->balance,
+                              "start-cleared-balance", &balances->cleared_balance,
+                              "start-reconciled-balance", &balances->reconciled_balance,
+                              NULL);
+                gnc_account_set_splits_incomplete( balances->acct, TRUE );
+                g_free( balances );
+            }
+            if ( bal_slist != NULL )
+            {
+                g_slist_free( bal_slist );
+            }
         }
     }
 
@@ -345,7 +349,7 @@ gnc_sql_save_account( GncSqlBackend* be, QofInstance* inst )
     {
         op = OP_DB_DELETE;
     }
-    else if ( be->is_pristine_db || is_infant )
+    else if ( gnc_sql_instance_needs_insert( be, inst ) )
     {
         op = OP_DB_INSERT;
     }
@@ -97,43 +97,39 @@ static GncSqlStatement* build_delete_statement( GncSqlBackend* be,
         const gchar* table_name,
         QofIdTypeConst obj_name, gpointer pObject,
         const GncSqlColumnTableEntry* table );
+static GSList* create_gslist_from_values( GncSqlBackend* be,
+        QofIdTypeConst obj_name, gpointer pObject,
+        const GncSqlColumnTableEntry* table );
+static void free_gvalue_list( GSList* list );
+static void begin_insert_batches( GncSqlBackend* be );
+static void end_insert_batches( GncSqlBackend* be );
+static void flush_insert_batches( GncSqlBackend* be );
 
 #define TRANSACTION_NAME "trans"
 
 typedef struct
 {
     /*@ dependent @*/ QofIdType searchObj;
+    /*@ dependent @*/ /*@ null @*/
+    GncSqlObjectBackend* pHandler;
     /*@ dependent @*/
     gpointer pCompiledQuery;
 } gnc_sql_query_info;
 
-/* callback structure */
-typedef struct
-{
-    gboolean is_known;
-    gboolean is_ok;
-    /*@ dependent @*/
-    GncSqlBackend* be;
-    /*@ dependent @*/
-    QofInstance* inst;
-    /*@ dependent @*/
-    QofQuery* pQuery;
-    /*@ dependent @*/
-    gpointer pCompiledQuery;
-    /*@ owned @*/
-    gnc_sql_query_info* pQueryInfo;
-} sql_backend;
-
 static QofLogModule log_module = G_LOG_DOMAIN;
 
 #define SQLITE_PROVIDER_NAME "SQLite"
 
 /* ================================================================= */
 
+#define KEY_COMMIT_WINDOW "sql_commit_window"
+#define KEY_LOAD_TX_AS_NEEDED "sql_load_transactions_as_needed"
+
 void
-gnc_sql_init( /*@ unused @*/ GncSqlBackend* be )
+gnc_sql_init( GncSqlBackend* be )
 {
     static gboolean initialized = FALSE;
+    gint commit_window;
 
     if ( !initialized )
     {
@@ -141,6 +137,13 @@ gnc_sql_init( /*@ unused @*/ GncSqlBackend* be )
         gnc_sql_init_object_handlers();
         initialized = TRUE;
     }
+
+    if ( be != NULL )
+    {
+        commit_window = gnc_gconf_get_int( GCONF_GENERAL, KEY_COMMIT_WINDOW, NULL );
+        be->commit_window = ( commit_window > 0 ) ? (guint)commit_window : 0;
+        be->load_tx_as_needed = gnc_gconf_get_bool( GCONF_GENERAL, KEY_LOAD_TX_AS_NEEDED, NULL );
+    }
 }
 
 /* ================================================================= */
@@ -216,6 +219,8 @@ gnc_sql_load( GncSqlBackend* be, /*@ dependent @*/ QofBook *book, QofBackendLoad
 
     ENTER( "be=%p, book=%p", be, book );
 
+    gnc_sql_commit_group( be );
+
     be->loading = TRUE;
 
     if ( loadType == LOAD_TYPE_INITIAL_LOAD )
@@ -438,17 +443,17 @@ write_schedXactions( GncSqlBackend* be )
 }
 
 static void
-write_cb( const gchar* type, gpointer data_p, gpointer be_p )
+write_cb( const gchar* type, gpointer data_p, gpointer user_data )
 {
     GncSqlObjectBackend* pData = data_p;
-    GncSqlBackend* be = (GncSqlBackend*)be_p;
+    write_objects_t* s = (write_objects_t*)user_data;
 
-    g_return_if_fail( type != NULL && data_p != NULL && be_p != NULL );
+    g_return_if_fail( type != NULL && data_p != NULL && user_data != NULL );
     g_return_if_fail( pData->version == GNC_SQL_BACKEND_VERSION );
 
-    if ( pData->write != NULL )
+    if ( s->is_ok && pData->write != NULL )
     {
-        (void)(pData->write)( be );
+        s->is_ok = (pData->write)( s->be );
     }
 }
 
@@ -469,6 +474,15 @@ update_save_progress( GncSqlBackend* be )
     }
 }
 
+static void
+rollback_transaction( GncSqlBackend* be )
+{
+    (void)gnc_sql_connection_rollback_transaction( be->conn );
+
+    // Commodities saved in the db transaction aren't in the db after all
+    gnc_sql_forget_saved_commodities( be );
+}
+
 void
 gnc_sql_sync_all( GncSqlBackend* be, /*@ dependent @*/ QofBook *book )
 {
@@ -479,7 +493,10 @@ gnc_sql_sync_all( GncSqlBackend* be, /*@ dependent @*/ QofBook *book )
 
     ENTER( "book=%p, primary=%p", book, be->primary_book );
 
+    gnc_sql_commit_group( be );
+
     (void)reset_version_info( be );
+    gnc_sql_forget_saved_commodities( be );
 
     /* Create new tables */
     be->is_pristine_db = TRUE;
@@ -494,6 +511,8 @@ gnc_sql_sync_all( GncSqlBackend* be, /*@ dependent @*/ QofBook *book )
 
     (void)gnc_sql_connection_begin_transaction( be->conn );
 
+    begin_insert_batches( be );
+
     // FIXME: should write the set of commodities that are used
     //write_commodities( be, book );
     is_ok = gnc_sql_save_book( be, QOF_INSTANCE(book) );
@@ -515,14 +534,35 @@ gnc_sql_sync_all( GncSqlBackend* be, /*@ dependent @*/ QofBook *book )
     }
     if ( is_ok )
     {
-        qof_object_foreach_backend( GNC_SQL_BACKEND, write_cb, be );
+        write_objects_t data;
+
+        data.be = be;
+        data.is_ok = TRUE;
+        qof_object_foreach_backend( GNC_SQL_BACKEND, write_cb, &data );
+        is_ok = data.is_ok;
     }
+    end_insert_batches( be );
 
-    (void)gnc_sql_connection_commit_transaction( be->conn );
+    if ( is_ok )
+    {
+        is_ok = gnc_sql_connection_commit_transaction( be->conn );
+    }
+    else
+    {
+        rollback_transaction( be );
+    }
     be->is_pristine_db = FALSE;
 
-    // Mark the book as clean
-    qof_book_mark_saved( book );
+    if ( is_ok )
+    {
+        // Mark the book as clean
+        qof_book_mark_saved( book );
+    }
+    else
+    {
+        PERR( "Error saving the book\n" );
+        qof_backend_set_error( &be->be, ERR_BACKEND_SERVER_ERR );
+    }
 
     LEAVE( "book=%p", book );
 }
@@ -550,23 +590,309 @@ gnc_sql_rollback_edit( GncSqlBackend *be, QofInstance *inst )
     LEAVE( "" );
 }
 
+/* Calls the commit handler for the object's type.  If force_insert is
+ * TRUE, the object's rows are inserted even if it isn't new.  Sets
+ * *is_known to FALSE if there is no handler for the type.
+ */
+static gboolean
+write_instance( GncSqlBackend* be, QofInstance* inst, gboolean force_insert,
+                /*@ out @*/ gboolean* is_known )
+{
+    GncSqlObjectBackend* pData = qof_object_lookup_backend( inst->e_type, GNC_SQL_BACKEND );
+    gboolean is_ok;
+
+    if ( pData == NULL || pData->version != GNC_SQL_BACKEND_VERSION || pData->commit == NULL )
+    {
+        *is_known = FALSE;
+        return TRUE;
+    }
+
+    *is_known = TRUE;
+    be->force_insert = force_insert;
+    is_ok = (pData->commit)( be, inst );
+    be->force_insert = FALSE;
+    return is_ok;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Group commit
+
+   Normally every commit_edit is written in its own db transaction, which
+   means one round of fsync()s per edited object.  When a batch scope is
+   open (qof_book_begin_batch()) or a commit window is configured, commits
+   instead share one open db transaction, which is committed when the
+   outermost batch scope ends or when the window expires.  The objects
+   written are remembered until then.
+
+   If any write in the group fails, the whole db transaction is rolled
+   back and each object in the group is written again in its own db
+   transaction so that one bad object can't lose the others' changes.
+   Objects which were new when first written in the group are inserted
+   again, since their rows were rolled back too.  The engine has already
+   marked the grouped objects clean when their commit_edit returned, so
+   any that can't be rewritten are marked dirty again, as is the book.
+
+   Anything that reads or writes the db outside commit_edit, and closing
+   the connection, must call gnc_sql_commit_group() first.  Deleting an
+   object commits the open group first and is then written on its own.
+*/
+
+typedef struct
+{
+    /*@ owned @*/
+    QofInstance* inst;
+    gboolean was_infant;
+} group_entry;
+
+struct GncSqlGroupCommit
+{
+    /*@ owned @*/
+    GPtrArray* entries;		/* group_entry*, oldest first */
+    /*@ owned @*/
+    GHashTable* by_inst;	/* QofInstance* -> group_entry* */
+    GTimeVal start;
+    guint timer_id;
+};
+
+static void
+mark_saved_if_done( QofInstance* inst )
+{
+    if ( qof_instance_get_editlevel( inst ) == 0 )
+    {
+        qof_instance_mark_clean( inst );
+    }
+}
+
 static void
-commit_cb( const gchar* type, gpointer data_p, gpointer be_data_p )
+free_group_commit( GncSqlBackend* be )
 {
-    GncSqlObjectBackend* pData = data_p;
-    sql_backend* be_data = be_data_p;
+    GncSqlGroupCommit* group = be->group_commit;
+    guint i;
 
-    g_return_if_fail( type != NULL && pData != NULL && be_data != NULL );
-    g_return_if_fail( pData->version == GNC_SQL_BACKEND_VERSION );
+    if ( group == NULL ) return;
+
+    if ( group->timer_id != 0 )
+    {
+        (void)g_source_remove( group->timer_id );
+    }
+    for ( i = 0; i < group->entries->len; i++ )
+    {
+        group_entry* entry = g_ptr_array_index( group->entries, i );
+        g_object_unref( entry->inst );
+        g_free( entry );
+    }
+    (void)g_ptr_array_free( group->entries, TRUE );
+    g_hash_table_destroy( group->by_inst );
+    g_free( group );
+    be->group_commit = NULL;
+}
+
+/* The shared db transaction failed.  Roll it back and write each object in
+   the group again on its own. */
+static void
+rewrite_group( GncSqlBackend* be )
+{
+    GncSqlGroupCommit* group = be->group_commit;
+    gboolean all_ok = TRUE;
+    gboolean is_known;
+    gboolean is_ok;
+    guint i;
+
+    g_return_if_fail( group != NULL );
+
+    ENTER( "%d objects", group->entries->len );
+
+    rollback_transaction( be );
+
+    for ( i = 0; i < group->entries->len; i++ )
+    {
+        group_entry* entry = g_ptr_array_index( group->entries, i );
+
+        (void)gnc_sql_connection_begin_transaction( be->conn );
+        is_ok = write_instance( be, entry->inst, entry->was_infant, &is_known );
+        if ( is_ok )
+        {
+            is_ok = gnc_sql_connection_commit_transaction( be->conn );
+        }
+        else
+        {
+            rollback_transaction( be );
+        }
+
+        if ( is_ok )
+        {
+            mark_saved_if_done( entry->inst );
+        }
+        else
+        {
+            PERR( "Error writing %s object\n", entry->inst->e_type );
+            qof_instance_set_dirty( entry->inst );
+            all_ok = FALSE;
+        }
+    }
+
+    free_group_commit( be );
+    if ( all_ok )
+    {
+        qof_book_mark_saved( be->primary_book );
+    }
+    else
+    {
+        qof_book_mark_dirty( be->primary_book );
+        qof_backend_set_error( &be->be, ERR_BACKEND_SERVER_ERR );
+    }
+
+    LEAVE( "" );
+}
+
+void
+gnc_sql_commit_group( GncSqlBackend* be )
+{
+    GncSqlGroupCommit* group;
+    guint i;
+
+    g_return_if_fail( be != NULL );
+
+    group = be->group_commit;
+    if ( group == NULL ) return;
+
+    ENTER( "%d objects", group->entries->len );
+
+    if ( !gnc_sql_connection_commit_transaction( be->conn ) )
+    {
+        rewrite_group( be );
+        LEAVE( "Rewritten - database error" );
+        return;
+    }
+
+    for ( i = 0; i < group->entries->len; i++ )
+    {
+        group_entry* entry = g_ptr_array_index( group->entries, i );
+        mark_saved_if_done( entry->inst );
+    }
+    free_group_commit( be );
+    qof_book_mark_saved( be->primary_book );
+
+    LEAVE( "" );
+}
+
+static gboolean
+group_commit_timeout_cb( gpointer data )
+{
+    GncSqlBackend* be = (GncSqlBackend*)data;
+
+    if ( be->group_commit != NULL )
+    {
+        be->group_commit->timer_id = 0;
+        if ( be->batch_depth == 0 )
+        {
+            gnc_sql_commit_group( be );
+        }
+    }
+
+    return FALSE;
+}
+
+static GncSqlGroupCommit*
+begin_group_commit( GncSqlBackend* be )
+{
+    GncSqlGroupCommit* group;
+
+    group = g_new0( GncSqlGroupCommit, 1 );
+    g_assert( group != NULL );
+    group->entries = g_ptr_array_new();
+    group->by_inst = g_hash_table_new( g_direct_hash, g_direct_equal );
+    g_get_current_time( &group->start );
+    if ( be->commit_window > 0 )
+    {
+        group->timer_id = g_timeout_add( be->commit_window, group_commit_timeout_cb, be );
+    }
+
+    (void)gnc_sql_connection_begin_transaction( be->conn );
+    be->group_commit = group;
+
+    return group;
+}
+
+static gboolean
+group_window_expired( const GncSqlBackend* be )
+{
+    GTimeVal now;
+    glong elapsed_ms;
+
+    g_get_current_time( &now );
+    elapsed_ms = ( now.tv_sec - be->group_commit->start.tv_sec ) * 1000
+                 + ( now.tv_usec - be->group_commit->start.tv_usec ) / 1000;
+
+    return elapsed_ms >= (glong)be->commit_window;
+}
+
+/* Writes the object inside the shared db transaction */
+static void
+group_commit_edit( GncSqlBackend* be, QofInstance* inst, gboolean is_infant )
+{
+    GncSqlGroupCommit* group = be->group_commit;
+    group_entry* entry;
+    gboolean is_known;
+    gboolean is_ok;
+
+    if ( group == NULL )
+    {
+        group = begin_group_commit( be );
+    }
+
+    is_ok = write_instance( be, inst, FALSE, &is_known );
+    if ( !is_known )
+    {
+        PERR( "gnc_sql_commit_edit(): Unknown object type '%s'\n", inst->e_type );
+
+        // Don't let unknown items still mark the book as being dirty
+        qof_instance_mark_clean( inst );
+        return;
+    }
+    if ( !is_ok )
+    {
+        // The others in the group can be saved.  The error keeps this
+        // object dirty, since it isn't in the group.
+        rewrite_group( be );
+        qof_backend_set_error( &be->be, ERR_BACKEND_SERVER_ERR );
+        return;
+    }
+
+    if ( g_hash_table_lookup( group->by_inst, inst ) == NULL )
+    {
+        entry = g_new0( group_entry, 1 );
+        g_assert( entry != NULL );
+        entry->inst = g_object_ref( inst );
+        entry->was_infant = is_infant;
+        g_ptr_array_add( group->entries, entry );
+        g_hash_table_insert( group->by_inst, inst, entry );
+    }
+
+    if ( be->batch_depth == 0 && group_window_expired( be ) )
+    {
+        gnc_sql_commit_group( be );
+    }
+}
+
+void
+gnc_sql_begin_batch( GncSqlBackend* be )
+{
+    g_return_if_fail( be != NULL );
 
-    /* If this has already been handled, or is not the correct handler, return */
-    if ( strcmp( pData->type_name, be_data->inst->e_type ) != 0 ) return;
-    if ( be_data->is_known ) return;
+    be->batch_depth++;
+}
+
+void
+gnc_sql_end_batch( GncSqlBackend* be )
+{
+    g_return_if_fail( be != NULL );
+    g_return_if_fail( be->batch_depth > 0 );
 
-    if ( pData->commit != NULL )
+    be->batch_depth--;
+    if ( be->batch_depth == 0 )
     {
-        be_data->is_ok = (pData->commit)( be_data->be, be_data->inst );
-        be_data->is_known = TRUE;
+        gnc_sql_commit_group( be );
     }
 }
 
@@ -576,10 +902,11 @@ commit_cb( const gchar* type, gpointer data_p, gpointer be_data_p )
 void
 gnc_sql_commit_edit( GncSqlBackend *be, QofInstance *inst )
 {
-    sql_backend be_data;
     gboolean is_dirty;
     gboolean is_destroying;
     gboolean is_infant;
+    gboolean is_known;
+    gboolean is_ok;
 
     g_return_if_fail( be != NULL );
     g_return_if_fail( inst != NULL );
@@ -616,18 +943,25 @@ gnc_sql_commit_edit( GncSqlBackend *be, QofInstance *inst )
         return;
     }
 
+    if ( is_destroying )
+    {
+        gnc_sql_commit_group( be );
+    }
+    else if ( be->batch_depth > 0 || be->commit_window > 0 )
+    {
+        group_commit_edit( be, inst, is_infant );
+        LEAVE( "grouped" );
+        return;
+    }
+
     (void)gnc_sql_connection_begin_transaction( be->conn );
 
-    be_data.is_known = FALSE;
-    be_data.be = be;
-    be_data.inst = inst;
-    be_data.is_ok = TRUE;
-    qof_object_foreach_backend( GNC_SQL_BACKEND, commit_cb, &be_data );
+    is_ok = write_instance( be, inst, FALSE, &is_known );
 
-    if ( !be_data.is_known )
+    if ( !is_known )
     {
         PERR( "gnc_sql_commit_edit(): Unknown object type '%s'\n", inst->e_type );
-        (void)gnc_sql_connection_rollback_transaction( be->conn );
+        rollback_transaction( be );
 
         // Don't let unknown items still mark the book as being dirty
         qof_instance_mark_clean(inst);
@@ -635,10 +969,10 @@ gnc_sql_commit_edit( GncSqlBackend *be, QofInstance *inst )
         LEAVE( "Rolled back - unknown object type" );
         return;
     }
-    if ( !be_data.is_ok )
+    if ( !is_ok )
     {
         // Error - roll it back
-        (void)gnc_sql_connection_rollback_transaction( be->conn );
+        rollback_transaction( be );
 
         // This *should* leave things marked dirty
         LEAVE( "Rolled back - database error" );
@@ -803,28 +1137,6 @@ handle_and_term( QofQueryTerm* pTerm, GString* sql )
     g_string_append( sql, ")" );
 }
 
-static void
-compile_query_cb( const gchar* type, gpointer data_p, gpointer be_data_p )
-{
-    GncSqlObjectBackend* pData = data_p;
-    sql_backend* be_data = be_data_p;
-
-    g_return_if_fail( type != NULL && pData != NULL && be_data != NULL );
-    g_return_if_fail( pData->version == GNC_SQL_BACKEND_VERSION );
-
-    // Is this the right item?
-    if ( strcmp( type, be_data->pQueryInfo->searchObj ) != 0 ) return;
-    if ( be_data->is_ok ) return;
-
-    if ( pData->compile_query != NULL )
-    {
-        be_data->pQueryInfo->pCompiledQuery = (pData->compile_query)(
-            be_data->be,
-            be_data->pQuery );
-        be_data->is_ok = TRUE;
-    }
-}
-
 gchar* gnc_sql_compile_query_to_sql( GncSqlBackend* be, QofQuery* query );
 
 /*@ null @*/
@@ -833,8 +1145,8 @@ gnc_sql_compile_query( QofBackend* pBEnd, QofQuery* pQuery )
 {
     GncSqlBackend *be = (GncSqlBackend*)pBEnd;
     QofIdType searchObj;
-    sql_backend be_data;
     gnc_sql_query_info* pQueryInfo;
+    GncSqlObjectBackend* pData;
 
     g_return_val_if_fail( pBEnd != NULL, NULL );
     g_return_val_if_fail( pQuery != NULL, NULL );
@@ -849,17 +1161,16 @@ gnc_sql_compile_query( QofBackend* pBEnd, QofQuery* pQuery )
     pQueryInfo->pCompiledQuery = NULL;
     pQueryInfo->searchObj = searchObj;
 
-    // Try various objects first
-    be_data.is_ok = FALSE;
-    be_data.be = be;
-    be_data.pQuery = pQuery;
-    be_data.pQueryInfo = pQueryInfo;
-
-    qof_object_foreach_backend( GNC_SQL_BACKEND, compile_query_cb, &be_data );
-    if ( be_data.is_ok )
+    // The run and free handlers are those of the same object type
+    pData = qof_object_lookup_backend( searchObj, GNC_SQL_BACKEND );
+    if ( pData != NULL && pData->version != GNC_SQL_BACKEND_VERSION )
     {
-        LEAVE( "" );
-        return be_data.pQueryInfo;
+        pData = NULL;
+    }
+    pQueryInfo->pHandler = pData;
+    if ( pData != NULL && pData->compile_query != NULL )
+    {
+        pQueryInfo->pCompiledQuery = (pData->compile_query)( be, pQuery );
     }
 
     LEAVE( "" );
@@ -921,45 +1232,23 @@ gnc_sql_compile_query_to_sql( GncSqlBackend* be, QofQuery* query )
     return g_string_free( sql, FALSE );
 }
 
-static void
-free_query_cb( const gchar* type, gpointer data_p, gpointer be_data_p )
-{
-    GncSqlObjectBackend* pData = data_p;
-    sql_backend* be_data = be_data_p;
-
-    g_return_if_fail( type != NULL && pData != NULL && be_data != NULL );
-    g_return_if_fail( pData->version == GNC_SQL_BACKEND_VERSION );
-    if ( be_data->is_ok ) return;
-    if ( strcmp( type, be_data->pQueryInfo->searchObj ) != 0 ) return;
-
-    if ( pData->free_query != NULL )
-    {
-        (pData->free_query)( be_data->be, be_data->pCompiledQuery );
-        be_data->is_ok = TRUE;
-    }
-}
-
 void
 gnc_sql_free_query( QofBackend* pBEnd, gpointer pQuery )
 {
     GncSqlBackend *be = (GncSqlBackend*)pBEnd;
     gnc_sql_query_info* pQueryInfo = (gnc_sql_query_info*)pQuery;
-    sql_backend be_data;
+    GncSqlObjectBackend* pData;
 
     g_return_if_fail( pBEnd != NULL );
     g_return_if_fail( pQuery != NULL );
 
     ENTER( " " );
 
-    // Try various objects first
-    be_data.is_ok = FALSE;
-    be_data.be = be;
-    be_data.pCompiledQuery = pQuery;
-    be_data.pQueryInfo = pQueryInfo;
-
-    qof_object_foreach_backend( GNC_SQL_BACKEND, free_query_cb, &be_data );
-    if ( be_data.is_ok )
+    pData = pQueryInfo->pHandler;
+    if ( pData != NULL && pData->free_query != NULL )
     {
+        (pData->free_query)( be, pQueryInfo->pCompiledQuery );
+        g_free( pQueryInfo );
         LEAVE( "" );
         return;
     }
@@ -974,32 +1263,12 @@ gnc_sql_free_query( QofBackend* pBEnd, gpointer pQuery )
     LEAVE( "" );
 }
 
-static void
-run_query_cb( const gchar* type, gpointer data_p, gpointer be_data_p )
-{
-    GncSqlObjectBackend* pData = data_p;
-    sql_backend* be_data = be_data_p;
-
-    g_return_if_fail( type != NULL && pData != NULL && be_data != NULL );
-    g_return_if_fail( pData->version == GNC_SQL_BACKEND_VERSION );
-    if ( be_data->is_ok ) return;
-
-    // Is this the right item?
-    if ( strcmp( type, be_data->pQueryInfo->searchObj ) != 0 ) return;
-
-    if ( pData->run_query != NULL )
-    {
-        (pData->run_query)( be_data->be, be_data->pCompiledQuery );
-        be_data->is_ok = TRUE;
-    }
-}
-
 void
 gnc_sql_run_query( QofBackend* pBEnd, gpointer pQuery )
 {
     GncSqlBackend *be = (GncSqlBackend*)pBEnd;
     gnc_sql_query_info* pQueryInfo = (gnc_sql_query_info*)pQuery;
-    sql_backend be_data;
+    GncSqlObjectBackend* pData;
 
     g_return_if_fail( pBEnd != NULL );
     g_return_if_fail( pQuery != NULL );
@@ -1012,13 +1281,11 @@ gnc_sql_run_query( QofBackend* pBEnd, gpointer pQuery )
 
     qof_event_suspend();
 
-    // Try various objects first
-    be_data.is_ok = FALSE;
-    be_data.be = be;
-    be_data.pCompiledQuery = pQueryInfo->pCompiledQuery;
-    be_data.pQueryInfo = pQueryInfo;
-
-    qof_object_foreach_backend( GNC_SQL_BACKEND, run_query_cb, &be_data );
+    pData = pQueryInfo->pHandler;
+    if ( pData != NULL && pData->run_query != NULL )
+    {
+        (pData->run_query)( be, pQueryInfo->pCompiledQuery );
+    }
     be->loading = FALSE;
     be->in_query = FALSE;
     qof_event_resume();
@@ -2469,6 +2736,7 @@ gnc_sql_execute_select_statement( GncSqlBackend* be, GncSqlStatement* stmt )
     g_return_val_if_fail( be != NULL, NULL );
     g_return_val_if_fail( stmt != NULL, NULL );
 
+    flush_insert_batches( be );
     result = gnc_sql_connection_execute_select_statement( be->conn, stmt );
     if ( result == NULL )
     {
@@ -2511,6 +2779,7 @@ gnc_sql_execute_select_sql( GncSqlBackend* be, const gchar* sql )
     {
         return NULL;
     }
+    flush_insert_batches( be );
     result = gnc_sql_connection_execute_select_statement( be->conn, stmt );
     gnc_sql_statement_dispose( stmt );
     if ( result == NULL )
@@ -2536,6 +2805,7 @@ gnc_sql_execute_nonselect_sql( GncSqlBackend* be, const gchar* sql )
     {
         return -1;
     }
+    flush_insert_batches( be );
     result = gnc_sql_connection_execute_nonselect_statement( be->conn, stmt );
     gnc_sql_statement_dispose( stmt );
     return result;
@@ -2589,13 +2859,507 @@ gnc_sql_append_guid_list_to_sql( GString* sql, GList* list, guint maxCount )
     return count;
 }
 /* ================================================================= */
+/* Prepared statements
+
+   The INSERT, UPDATE and DELETE statements for a table, and the SELECT
+   which checks whether an object is already there, only differ from
+   object to object in their values.  Each one is therefore prepared
+   once, with a '?' marker for every value, and kept in be->stmt_cache
+   keyed by table and operation.  Running it only needs the values
+   bound.
+
+   Some column types (e.g. addresses) don't produce a value for every
+   column of every object.  When the values don't match the markers,
+   get_bound_statement() returns NULL and the caller builds a one-off
+   statement as before.
+ */
 
-gboolean
-gnc_sql_object_is_it_in_db( GncSqlBackend* be, const gchar* table_name,
-                            QofIdTypeConst obj_name, gpointer pObject,
-                            const GncSqlColumnTableEntry* table )
+/* Operation code for the "is it in the db" SELECT, alongside E_DB_OPERATION */
+#define STMT_OP_EXISTS (-1)
+
+typedef struct
 {
-    GncSqlStatement* sqlStmt;
+    gint op;
+    /*@ owned @*/
+    gchar* table_name;
+    /*@ dependent @*/
+    const GncSqlColumnTableEntry* table;
+} stmt_cache_key;
+
+typedef struct
+{
+    /*@ owned @*/
+    GncSqlStatement* stmt;
+    guint n_params;
+} stmt_cache_entry;
+
+static guint
+stmt_cache_key_hash( gconstpointer p )
+{
+    const stmt_cache_key* key = (const stmt_cache_key*)p;
+
+    return g_str_hash( key->table_name ) ^ g_direct_hash( key->table ) ^ (guint)key->op;
+}
+
+static gboolean
+stmt_cache_key_equal( gconstpointer a, gconstpointer b )
+{
+    const stmt_cache_key* key_a = (const stmt_cache_key*)a;
+    const stmt_cache_key* key_b = (const stmt_cache_key*)b;
+
+    return key_a->op == key_b->op && key_a->table == key_b->table &&
+           strcmp( key_a->table_name, key_b->table_name ) == 0;
+}
+
+static void
+stmt_cache_key_free( gpointer p )
+{
+    stmt_cache_key* key = (stmt_cache_key*)p;
+
+    g_free( key->table_name );
+    g_free( key );
+}
+
+static void
+stmt_cache_entry_free( gpointer p )
+{
+    stmt_cache_entry* entry = (stmt_cache_entry*)p;
+
+    if ( entry->stmt != NULL )
+    {
+        gnc_sql_statement_dispose( entry->stmt );
+    }
+    g_free( entry );
+}
+
+void
+gnc_sql_clear_statement_cache( GncSqlBackend* be )
+{
+    g_return_if_fail( be != NULL );
+
+    if ( be->stmt_cache != NULL )
+    {
+        g_hash_table_destroy( be->stmt_cache );
+        be->stmt_cache = NULL;
+    }
+}
+
+/* Returns the names of the columns written for a table, in the order of
+   the values from create_gslist_from_values(). */
+static GList*
+get_column_names( const GncSqlColumnTableEntry* table )
+{
+    GList* colnames = NULL;
+    const GncSqlColumnTableEntry* table_row;
+
+    for ( table_row = table; table_row->col_name != NULL; table_row++ )
+    {
+        if (( table_row->flags & COL_AUTOINC ) == 0 )
+        {
+            GncSqlColumnTypeHandler* pHandler;
+
+            pHandler = get_handler( table_row );
+            g_assert( pHandler != NULL );
+            pHandler->add_colname_to_list_fn( table_row, &colnames );
+        }
+    }
+    g_assert( colnames != NULL );
+
+    return colnames;
+}
+
+static void
+free_column_names( GList* colnames )
+{
+    GList* colname;
+
+    for ( colname = colnames; colname != NULL; colname = colname->next )
+    {
+        g_free( colname->data );
+    }
+    g_list_free( colnames );
+}
+
+/* Builds the SQL for an operation, with '?' for each value, and returns
+   the number of values it needs. */
+static gchar*
+build_prepared_sql( gint op, const gchar* table_name,
+                    const GncSqlColumnTableEntry* table, guint* pNumParams )
+{
+    GString* sql;
+    GList* colnames;
+    GList* colname;
+    guint n_params = 0;
+
+    if ( op == OP_DB_DELETE )
+    {
+        *pNumParams = 1;
+        return g_strdup_printf( "DELETE FROM %s WHERE %s = ?", table_name, table->col_name );
+    }
+    if ( op == STMT_OP_EXISTS )
+    {
+        *pNumParams = 1;
+        return g_strdup_printf( "SELECT %s FROM %s WHERE %s = ?",
+                                table->col_name, table_name, table->col_name );
+    }
+
+    colnames = get_column_names( table );
+
+    sql = g_string_new( NULL );
+    if ( op == OP_DB_INSERT )
+    {
+        g_string_append_printf( sql, "INSERT INTO %s(", table_name );
+        for ( colname = colnames; colname != NULL; colname = colname->next )
+        {
+            if ( colname != colnames )
+            {
+                (void)g_string_append( sql, "," );
+            }
+            (void)g_string_append( sql, (gchar*)colname->data );
+            n_params++;
+        }
+        (void)g_string_append( sql, ") VALUES(" );
+        for ( colname = colnames; colname != NULL; colname = colname->next )
+        {
+            (void)g_string_append( sql, colname != colnames ? ",?" : "?" );
+        }
+        (void)g_string_append( sql, ")" );
+    }
+    else
+    {
+        /* The first column is the key, and goes last, in the WHERE clause */
+        g_string_append_printf( sql, "UPDATE %s SET ", table_name );
+        for ( colname = colnames->next; colname != NULL; colname = colname->next )
+        {
+            if ( colname != colnames->next )
+            {
+                (void)g_string_append( sql, "," );
+            }
+            g_string_append_printf( sql, "%s=?", (gchar*)colname->data );
+            n_params++;
+        }
+        g_string_append_printf( sql, " WHERE %s = ?", table->col_name );
+        n_params++;
+    }
+    free_column_names( colnames );
+
+    *pNumParams = n_params;
+    return g_string_free( sql, FALSE );
+}
+
+/*@ null @*/ static stmt_cache_entry*
+get_prepared_statement( GncSqlBackend* be, gint op, const gchar* table_name,
+                        const GncSqlColumnTableEntry* table )
+{
+    stmt_cache_key lookup_key;
+    stmt_cache_key* key;
+    stmt_cache_entry* entry;
+    gchar* sql;
+
+    if ( be->conn == NULL || be->conn->prepareStatement == NULL )
+    {
+        return NULL;
+    }
+
+    if ( be->stmt_cache == NULL )
+    {
+        be->stmt_cache = g_hash_table_new_full( stmt_cache_key_hash, stmt_cache_key_equal,
+                                                stmt_cache_key_free, stmt_cache_entry_free );
+    }
+
+    lookup_key.op = op;
+    lookup_key.table_name = (gchar*)table_name;
+    lookup_key.table = table;
+    entry = g_hash_table_lookup( be->stmt_cache, &lookup_key );
+    if ( entry != NULL )
+    {
+        return entry->stmt != NULL ? entry : NULL;
+    }
+
+    /* A failed prepare is cached too, so it isn't retried for every object */
+    entry = g_new0( stmt_cache_entry, 1 );
+    sql = build_prepared_sql( op, table_name, table, &entry->n_params );
+    entry->stmt = gnc_sql_connection_prepare_statement( be->conn, sql );
+    if ( entry->stmt == NULL )
+    {
+        PWARN( "Unable to prepare %s\n", sql );
+    }
+    g_free( sql );
+
+    key = g_new0( stmt_cache_key, 1 );
+    key->op = op;
+    key->table_name = g_strdup( table_name );
+    key->table = table;
+    g_hash_table_insert( be->stmt_cache, key, entry );
+
+    return entry->stmt != NULL ? entry : NULL;
+}
+
+/* Returns the prepared statement for an operation on an object with the
+   object's values bound, or NULL if there is none. */
+/*@ null @*/ /*@ dependent @*/ static GncSqlStatement*
+get_bound_statement( GncSqlBackend* be, gint op, const gchar* table_name,
+                     QofIdTypeConst obj_name, gpointer pObject,
+                     const GncSqlColumnTableEntry* table )
+{
+    stmt_cache_entry* entry;
+    GSList* values = NULL;
+    GSList* node;
+    guint param;
+
+    entry = get_prepared_statement( be, op, table_name, table );
+    if ( entry == NULL )
+    {
+        return NULL;
+    }
+
+    if ( op == OP_DB_INSERT || op == OP_DB_UPDATE )
+    {
+        values = create_gslist_from_values( be, obj_name, pObject, table );
+    }
+    else
+    {
+        GncSqlColumnTypeHandler* pHandler = get_handler( table );
+        g_assert( pHandler != NULL );
+        pHandler->add_gvalue_to_slist_fn( be, obj_name, pObject, table, &values );
+        g_assert( values != NULL );
+    }
+
+    if ( op == OP_DB_INSERT || op == OP_DB_UPDATE )
+    {
+        if ( g_slist_length( values ) != entry->n_params )
+        {
+            free_gvalue_list( values );
+            return NULL;
+        }
+    }
+
+    if ( op == OP_DB_UPDATE )
+    {
+        for ( node = values->next, param = 0; node != NULL; node = node->next, param++ )
+        {
+            gnc_sql_statement_bind_value( entry->stmt, param, (GValue*)(node->data) );
+        }
+        gnc_sql_statement_bind_value( entry->stmt, param, (GValue*)(values->data) );
+    }
+    else if ( op == OP_DB_INSERT )
+    {
+        for ( node = values, param = 0; node != NULL; node = node->next, param++ )
+        {
+            gnc_sql_statement_bind_value( entry->stmt, param, (GValue*)(node->data) );
+        }
+    }
+    else
+    {
+        gnc_sql_statement_bind_value( entry->stmt, 0, (GValue*)(values->data) );
+    }
+    free_gvalue_list( values );
+
+    return entry->stmt;
+}
+
+/* ================================================================= */
+/* Multi-row inserts
+
+   While gnc_sql_sync_all() writes a book to a pristine database, the
+   rows for each table are queued in be->insert_batches and written
+   MAX_BATCH_ROWS at a time with one multi-row INSERT.  Any other
+   statement run through this file writes the queued rows first, so
+   reads and updates always see them.
+ */
+
+#define MAX_BATCH_ROWS 500
+#define MAX_BATCH_SIZE (512*1024)
+
+typedef struct
+{
+    /*@ owned @*/
+    gchar* insert_sql;		/* INSERT INTO table(columns) */
+    guint n_cols;
+    /*@ owned @*/
+    GPtrArray* rows;		/* Comma-separated SQL values of each row */
+    gsize size;				/* Total length of the rows */
+} insert_batch;
+
+static void
+insert_batch_free( gpointer p )
+{
+    insert_batch* batch = (insert_batch*)p;
+    guint i;
+
+    for ( i = 0; i < batch->rows->len; i++ )
+    {
+        g_free( g_ptr_array_index( batch->rows, i ) );
+    }
+    (void)g_ptr_array_free( batch->rows, TRUE );
+    g_free( batch->insert_sql );
+    g_free( batch );
+}
+
+static gboolean
+flush_insert_batch( GncSqlBackend* be, insert_batch* batch )
+{
+    gint result;
+    guint i;
+
+    if ( batch->rows->len == 0 )
+    {
+        return TRUE;
+    }
+
+    result = gnc_sql_connection_execute_multi_row_insert( be->conn, batch->insert_sql,
+             batch->rows );
+    if ( result == -1 )
+    {
+        PERR( "SQL error: %s (%u rows)\n", batch->insert_sql, batch->rows->len );
+        qof_backend_set_error( &be->be, ERR_BACKEND_SERVER_ERR );
+    }
+
+    for ( i = 0; i < batch->rows->len; i++ )
+    {
+        g_free( g_ptr_array_index( batch->rows, i ) );
+    }
+    g_ptr_array_set_size( batch->rows, 0 );
+    batch->size = 0;
+
+    return result != -1;
+}
+
+static void
+flush_insert_batch_cb( /*@ unused @*/ gpointer key, gpointer value, gpointer data )
+{
+    GncSqlBackend* be = (GncSqlBackend*)data;
+
+    (void)flush_insert_batch( be, (insert_batch*)value );
+}
+
+/* Writes all queued rows.  Errors are reported through the backend. */
+static void
+flush_insert_batches( GncSqlBackend* be )
+{
+    if ( be->insert_batches != NULL )
+    {
+        g_hash_table_foreach( be->insert_batches, flush_insert_batch_cb, be );
+    }
+}
+
+static void
+begin_insert_batches( GncSqlBackend* be )
+{
+    if ( be->conn->executeMultiRowInsert != NULL )
+    {
+        be->insert_batches = g_hash_table_new_full( stmt_cache_key_hash, stmt_cache_key_equal,
+                             stmt_cache_key_free, insert_batch_free );
+    }
+}
+
+static void
+end_insert_batches( GncSqlBackend* be )
+{
+    if ( be->insert_batches != NULL )
+    {
+        flush_insert_batches( be );
+        g_hash_table_destroy( be->insert_batches );
+        be->insert_batches = NULL;
+    }
+}
+
+/* Queues an object's row for a multi-row INSERT.  Returns FALSE if the
+   row can't be queued and should be inserted on its own. */
+static gboolean
+queue_insert( GncSqlBackend* be, const gchar* table_name,
+              QofIdTypeConst obj_name, gpointer pObject,
+              const GncSqlColumnTableEntry* table, gboolean* pOk )
+{
+    stmt_cache_key lookup_key;
+    insert_batch* batch;
+    GSList* values;
+    GSList* node;
+    GString* row;
+
+    if ( be->insert_batches == NULL )
+    {
+        return FALSE;
+    }
+
+    lookup_key.op = OP_DB_INSERT;
+    lookup_key.table_name = (gchar*)table_name;
+    lookup_key.table = table;
+    batch = g_hash_table_lookup( be->insert_batches, &lookup_key );
+    if ( batch == NULL )
+    {
+        stmt_cache_key* key;
+        GList* colnames;
+        GList* colname;
+        GString* sql;
+
+        batch = g_new0( insert_batch, 1 );
+        batch->rows = g_ptr_array_new();
+
+        colnames = get_column_names( table );
+        sql = g_string_new( NULL );
+        g_string_append_printf( sql, "INSERT INTO %s(", table_name );
+        for ( colname = colnames; colname != NULL; colname = colname->next )
+        {
+            if ( colname != colnames )
+            {
+                (void)g_string_append( sql, "," );
+            }
+            (void)g_string_append( sql, (gchar*)colname->data );
+            batch->n_cols++;
+        }
+        (void)g_string_append( sql, ")" );
+        free_column_names( colnames );
+        batch->insert_sql = g_string_free( sql, FALSE );
+
+        key = g_new0( stmt_cache_key, 1 );
+        key->op = OP_DB_INSERT;
+        key->table_name = g_strdup( table_name );
+        key->table = table;
+        g_hash_table_insert( be->insert_batches, key, batch );
+    }
+
+    values = create_gslist_from_values( be, obj_name, pObject, table );
+    if ( g_slist_length( values ) != batch->n_cols )
+    {
+        free_gvalue_list( values );
+        return FALSE;
+    }
+
+    row = g_string_new( NULL );
+    for ( node = values; node != NULL; node = node->next )
+    {
+        gchar* value_str;
+
+        if ( node != values )
+        {
+            (void)g_string_append( row, "," );
+        }
+        value_str = gnc_sql_get_sql_value( be->conn, (GValue*)(node->data) );
+        (void)g_string_append( row, value_str );
+        g_free( value_str );
+    }
+    free_gvalue_list( values );
+
+    batch->size += row->len;
+    g_ptr_array_add( batch->rows, g_string_free( row, FALSE ) );
+
+    *pOk = TRUE;
+    if ( batch->rows->len >= MAX_BATCH_ROWS || batch->size >= MAX_BATCH_SIZE )
+    {
+        *pOk = flush_insert_batch( be, batch );
+    }
+    return TRUE;
+}
+
+/* ================================================================= */
+
+gboolean
+gnc_sql_object_is_it_in_db( GncSqlBackend* be, const gchar* table_name,
+                            QofIdTypeConst obj_name, gpointer pObject,
+                            const GncSqlColumnTableEntry* table )
+{
+    GncSqlStatement* sqlStmt;
     guint count;
     GncSqlColumnTypeHandler* pHandler;
     GSList* list = NULL;
@@ -2606,6 +3370,14 @@ gnc_sql_object_is_it_in_db( GncSqlBackend* be, const gchar* table_name,
     g_return_val_if_fail( pObject != NULL, FALSE );
     g_return_val_if_fail( table != NULL, FALSE );
 
+    flush_insert_batches( be );
+    sqlStmt = get_bound_statement( be, STMT_OP_EXISTS, table_name, obj_name, pObject, table );
+    if ( sqlStmt != NULL )
+    {
+        count = execute_statement_get_count( be, sqlStmt );
+        return count != 0;
+    }
+
     /* SELECT * FROM */
     sqlStmt = create_single_col_select_statement( be, table_name, table );
     g_assert( sqlStmt != NULL );
@@ -2616,6 +3388,7 @@ gnc_sql_object_is_it_in_db( GncSqlBackend* be, const gchar* table_name,
     pHandler->add_gvalue_to_slist_fn( be, obj_name, pObject, table, &list );
     g_assert( list != NULL );
     gnc_sql_statement_add_where_cond( sqlStmt, obj_name, pObject, &table[0], (GValue*)(list->data) );
+    free_gvalue_list( list );
 
     count = execute_statement_get_count( be, sqlStmt );
     gnc_sql_statement_dispose( sqlStmt );
@@ -2637,6 +3410,7 @@ gnc_sql_do_db_operation( GncSqlBackend* be,
                          const GncSqlColumnTableEntry* table )
 {
     GncSqlStatement* stmt = NULL;
+    gboolean is_cached;
     gboolean ok = FALSE;
 
     g_return_val_if_fail( be != NULL, FALSE );
@@ -2645,7 +3419,19 @@ gnc_sql_do_db_operation( GncSqlBackend* be,
     g_return_val_if_fail( pObject != NULL, FALSE );
     g_return_val_if_fail( table != NULL, FALSE );
 
-    if ( op == OP_DB_INSERT )
+    if ( op == OP_DB_INSERT && queue_insert( be, table_name, obj_name, pObject, table, &ok ) )
+    {
+        return ok;
+    }
+    flush_insert_batches( be );
+
+    stmt = get_bound_statement( be, op, table_name, obj_name, pObject, table );
+    is_cached = ( stmt != NULL );
+    if ( is_cached )
+    {
+        /* Bound to a prepared statement */
+    }
+    else if ( op == OP_DB_INSERT )
     {
         stmt = build_insert_statement( be, table_name, obj_name, pObject, table );
     }
@@ -2675,7 +3461,10 @@ gnc_sql_do_db_operation( GncSqlBackend* be,
         {
             ok = TRUE;
         }
-        gnc_sql_statement_dispose( stmt );
+        if ( !is_cached )
+        {
+            gnc_sql_statement_dispose( stmt );
+        }
     }
 
     return ok;
@@ -2972,6 +3761,15 @@ build_delete_statement( GncSqlBackend* be,
 }
 
 /* ================================================================= */
+gboolean
+gnc_sql_instance_needs_insert( const GncSqlBackend* be, QofInstance* inst )
+{
+    g_return_val_if_fail( be != NULL, FALSE );
+    g_return_val_if_fail( inst != NULL, FALSE );
+
+    return be->is_pristine_db || be->force_insert || qof_instance_get_infant( inst );
+}
+
 gboolean
 gnc_sql_commit_standard_item( GncSqlBackend* be, QofInstance* inst, const gchar* tableName,
                               QofIdTypeConst obj_name, const GncSqlColumnTableEntry* col_table )
@@ -2986,7 +3784,7 @@ gnc_sql_commit_standard_item( GncSqlBackend* be, QofInstance* inst, const gchar*
     {
         op = OP_DB_DELETE;
     }
-    else if ( be->is_pristine_db || is_infant )
+    else if ( gnc_sql_instance_needs_insert( be, inst ) )
     {
         op = OP_DB_INSERT;
     }
@@ -44,6 +44,7 @@
 #include <gmodule.h>
 
 typedef struct GncSqlConnection GncSqlConnection;
+typedef struct GncSqlGroupCommit GncSqlGroupCommit;
 
 /**
  * @struct GncSqlBackend
@@ -59,10 +60,22 @@ struct GncSqlBackend
     gboolean loading;				/**< We are performing an initial load */
     gboolean in_query;			/**< We are processing a query */
     gboolean is_pristine_db;		/**< Are we saving to a new pristine db? */
+    gboolean force_insert;		/**< Insert the rows of the object being written, even if it isn't new */
+    gboolean load_tx_as_needed;	/**< Load transactions only when queried, not at startup */
+    gboolean commits_are_queued;	/**< Commits are written later by the connection, so they must not read the db */
+    GHashTable* commodities_in_db;	/**< Commodities known to have a row, so saving them needs no SELECT */
+    gboolean rebuild_balance_checkpoints;	/**< Balance checkpoints are out of date and are rebuilt before being read */
+    GHashTable* unwritten_splits;	/**< Changed splits of committed transactions which haven't been written yet */
+    GSList* balance_periods;		/**< Balance checkpoints to recompute once those splits are written */
     gint obj_total;				/**< Total # of objects (for percentage calculation) */
     gint operations_done;			/**< Number of operations (save/load) done */
     GHashTable* versions;			/**< Version number for each table */
     const gchar* timespec_format;	/**< Format string for SQL for timespec values */
+    GHashTable* stmt_cache;		/**< Prepared statements for each table and operation */
+    GHashTable* insert_batches;	/**< Rows queued for multi-row INSERTs while saving to a pristine db */
+    gint batch_depth;				/**< Nesting of qof_book_begin_batch() scopes */
+    guint commit_window;			/**< Commits within this many ms share a db transaction; 0 for none */
+    GncSqlGroupCommit* group_commit;	/**< Open db transaction shared by several commits, or NULL */
 };
 typedef struct GncSqlBackend GncSqlBackend;
 
@@ -113,6 +126,31 @@ void gnc_sql_rollback_edit( GncSqlBackend* qbe, QofInstance *inst );
  */
 void gnc_sql_commit_edit( GncSqlBackend* qbe, QofInstance *inst );
 
+/**
+ * Starts a group of edits whose commits are written in one db transaction.
+ * Groups may be nested.
+ *
+ * @param be SQL backend
+ */
+void gnc_sql_begin_batch( GncSqlBackend* be );
+
+/**
+ * Ends a group of edits started by gnc_sql_begin_batch().  When the
+ * outermost group ends, its db transaction is committed.
+ *
+ * @param be SQL backend
+ */
+void gnc_sql_end_batch( GncSqlBackend* be );
+
+/**
+ * Commits the db transaction shared by recent commits, if there is one.
+ * Must be called before the db is read or written other than through
+ * gnc_sql_commit_edit(), and before the connection is closed.
+ *
+ * @param be SQL backend
+ */
+void gnc_sql_commit_group( GncSqlBackend* be );
+
 /**
  */
 typedef struct GncSqlColumnTableEntry GncSqlColumnTableEntry;
@@ -132,6 +170,7 @@ struct GncSqlStatement
     /*@ dependent @*/
     gchar* (*toSql)( GncSqlStatement* );
     void (*addWhereCond)( GncSqlStatement*, QofIdTypeConst, gpointer, const GncSqlColumnTableEntry*, GValue* );
+    void (*bindValue)( GncSqlStatement*, guint, const GValue* ); /**< Binds a value to a '?' marker of a prepared statement */
 };
 #define gnc_sql_statement_dispose(STMT) \
 		(STMT)->dispose(STMT)
@@ -139,6 +178,8 @@ struct GncSqlStatement
 		(STMT)->toSql(STMT)
 #define gnc_sql_statement_add_where_cond(STMT,TYPENAME,OBJ,COLDESC,VALUE) \
 		(STMT)->addWhereCond(STMT, TYPENAME, OBJ, COLDESC, VALUE)
+#define gnc_sql_statement_bind_value(STMT,INDEX,VALUE) \
+		(STMT)->bindValue(STMT, INDEX, VALUE)
 
 /**
  * @struct GncSqlConnection
@@ -159,6 +200,8 @@ struct GncSqlConnection
     gboolean (*createTable)( GncSqlConnection*, const gchar*, GList* ); /**< Returns TRUE if successful, FALSE if error */
     gboolean (*createIndex)( GncSqlConnection*, const gchar*, const gchar*, const GncSqlColumnTableEntry* ); /**< Returns TRUE if successful, FALSE if error */
     gchar* (*quoteString)( const GncSqlConnection*, gchar* );
+    GncSqlStatement* (*prepareStatement)( /*@ observer @*/ GncSqlConnection*, const gchar* ); /**< SQL has a '?' marker for each value.  Returns NULL if error */
+    gint (*executeMultiRowInsert)( GncSqlConnection*, const gchar*, const GPtrArray* ); /**< Inserts rows of comma-separated values.  Returns -1 if error */
 };
 #define gnc_sql_connection_dispose(CONN) (CONN)->dispose(CONN)
 #define gnc_sql_connection_execute_select_statement(CONN,STMT) \
@@ -181,6 +224,10 @@ struct GncSqlConnection
 		(CONN)->createIndex(CONN,INDEXNAME,TABLENAME,COLTABLE)
 #define gnc_sql_connection_quote_string(CONN,STR) \
 		(CONN)->quoteString(CONN,STR)
+#define gnc_sql_connection_prepare_statement(CONN,SQL) \
+		(CONN)->prepareStatement(CONN,SQL)
+#define gnc_sql_connection_execute_multi_row_insert(CONN,INSERT_SQL,ROWS) \
+		(CONN)->executeMultiRowInsert(CONN,INSERT_SQL,ROWS)
 
 /**
  * @struct GncSqlRow
@@ -439,6 +486,15 @@ gboolean gnc_sql_do_db_operation( GncSqlBackend* be,
                                   gpointer pObject,
                                   const GncSqlColumnTableEntry* table );
 
+/**
+ * Disposes of the prepared statements kept for gnc_sql_do_db_operation()
+ * and gnc_sql_object_is_it_in_db().  Must be called before the backend's
+ * connection is disposed of or replaced.
+ *
+ * @param be SQL backend struct
+ */
+void gnc_sql_clear_statement_cache( GncSqlBackend* be );
+
 /**
  * Executes an SQL SELECT statement and returns the result rows.  If an error
  * occurs, an entry is added to the log, an error status is returned to qof and
@@ -672,6 +728,17 @@ void gnc_sql_init_version_info( GncSqlBackend* be );
  */
 void gnc_sql_finalize_version_info( GncSqlBackend* be );
 
+/**
+ * Checks whether an object's rows should be inserted rather than updated,
+ * because the db is pristine, the object is new, or its rows are being
+ * written again after a rollback.
+ *
+ * @param be SQL backend
+ * @param inst Instance
+ * @return TRUE if the rows should be inserted, FALSE if updated
+ */
+gboolean gnc_sql_instance_needs_insert( const GncSqlBackend* be, QofInstance* inst );
+
 /**
  * Commits a "standard" item to the database.  In most cases, a commit of one object vs
  * another differs only in the table name and column table.
@@ -126,6 +126,32 @@ load_single_commodity( GncSqlBackend* be, GncSqlRow* row )
     return pCommodity;
 }
 
+/* Commodities known to have a row in the db, so that saving one with a
+   transaction doesn't need a SELECT.  A commit which is queued for later
+   can't read the db at all, so a commodity this session hasn't loaded or
+   saved is then taken to be new. */
+static void
+remember_saved_commodity( GncSqlBackend* be, gnc_commodity* pCommodity )
+{
+    if ( be->commodities_in_db == NULL )
+    {
+        be->commodities_in_db = g_hash_table_new( g_direct_hash, g_direct_equal );
+    }
+    g_hash_table_insert( be->commodities_in_db, pCommodity, pCommodity );
+}
+
+void
+gnc_sql_forget_saved_commodities( GncSqlBackend* be )
+{
+    g_return_if_fail( be != NULL );
+
+    if ( be->commodities_in_db != NULL )
+    {
+        g_hash_table_destroy( be->commodities_in_db );
+        be->commodities_in_db = NULL;
+    }
+}
+
 static void
 load_all_commodities( GncSqlBackend* be )
 {
@@ -155,6 +181,7 @@ load_all_commodities( GncSqlBackend* be )
                 guid = *qof_instance_get_guid( QOF_INSTANCE(pCommodity) );
                 pCommodity = gnc_commodity_table_insert( pTable, pCommodity );
                 qof_instance_set_guid( QOF_INSTANCE(pCommodity), &guid );
+                remember_saved_commodity( be, pCommodity );
             }
             row = gnc_sql_result_get_next_row( result );
         }
@@ -195,7 +222,7 @@ do_commit_commodity( GncSqlBackend* be, QofInstance* inst, gboolean force_insert
     {
         op = OP_DB_DELETE;
     }
-    else if ( be->is_pristine_db || is_infant || force_insert )
+    else if ( gnc_sql_instance_needs_insert( be, inst ) || force_insert )
     {
         op = OP_DB_INSERT;
     }
@@ -219,6 +246,15 @@ do_commit_commodity( GncSqlBackend* be, QofInstance* inst, gboolean force_insert
         }
     }
 
+    if ( is_ok && !qof_instance_get_destroying( inst ) )
+    {
+        remember_saved_commodity( be, GNC_COMMODITY(inst) );
+    }
+    else if ( be->commodities_in_db != NULL )
+    {
+        (void)g_hash_table_remove( be->commodities_in_db, inst );
+    }
+
     return is_ok;
 }
 
@@ -238,6 +274,16 @@ is_commodity_in_db( GncSqlBackend* be, gnc_commodity* pCommodity )
     g_return_val_if_fail( be != NULL, FALSE );
     g_return_val_if_fail( pCommodity != NULL, FALSE );
 
+    if ( be->commodities_in_db != NULL &&
+            g_hash_table_lookup( be->commodities_in_db, pCommodity ) != NULL )
+    {
+        return TRUE;
+    }
+    if ( be->commits_are_queued )
+    {
+        return FALSE;
+    }
+
     return gnc_sql_object_is_it_in_db( be, COMMODITIES_TABLE, GNC_ID_COMMODITY,
                                        pCommodity, col_table );
 }
@@ -254,6 +300,10 @@ gnc_sql_save_commodity( GncSqlBackend* be, gnc_commodity* pCommodity )
     {
         is_ok = do_commit_commodity( be, QOF_INSTANCE(pCommodity), TRUE );
     }
+    else
+    {
+        remember_saved_commodity( be, pCommodity );
+    }
 
     return is_ok;
 }
@@ -35,4 +35,12 @@
 void gnc_sql_init_commodity_handler( void );
 gboolean gnc_sql_save_commodity( GncSqlBackend* be, gnc_commodity* pCommodity );
 
+/**
+ * Forgets which commodities are known to be in the db, after a db
+ * transaction which may have saved some of them has been rolled back.
+ *
+ * @param be SQL backend
+ */
+void gnc_sql_forget_saved_commodities( GncSqlBackend* be );
+
 #endif /* GNC_COMMODITY_SQL_H_ */
@@ -178,7 +178,7 @@ save_employee( GncSqlBackend* be, QofInstance* inst )
     {
         op = OP_DB_DELETE;
     }
-    else if ( be->is_pristine_db || is_infant )
+    else if ( gnc_sql_instance_needs_insert( be, inst ) )
     {
         op = OP_DB_INSERT;
     }
@@ -157,19 +157,17 @@ save_price( GncSqlBackend* be, QofInstance* inst )
 {
     GNCPrice* pPrice = GNC_PRICE(inst);
     gint op;
-    gboolean is_infant;
     gboolean is_ok = TRUE;
 
     g_return_val_if_fail( be != NULL, FALSE );
     g_return_val_if_fail( inst != NULL, FALSE );
     g_return_val_if_fail( GNC_IS_PRICE(inst), FALSE );
 
-    is_infant = qof_instance_get_infant( inst );
     if ( qof_instance_get_destroying( inst ) )
     {
         op = OP_DB_DELETE;
     }
-    else if ( be->is_pristine_db || is_infant )
+    else if ( gnc_sql_instance_needs_insert( be, inst ) )
     {
         op = OP_DB_INSERT;
     }
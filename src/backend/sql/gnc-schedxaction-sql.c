@@ -182,7 +182,7 @@ gnc_sql_save_schedxaction( GncSqlBackend* be, QofInstance* inst )
     {
         op = OP_DB_DELETE;
     }
-    else if ( be->is_pristine_db || is_infant )
+    else if ( gnc_sql_instance_needs_insert( be, inst ) )
     {
         op = OP_DB_INSERT;
     }
@@ -58,6 +58,11 @@ typedef struct
     /*@ dependent @*/
     KvpValue* pKvpValue;
     GString* path;
+    gint id;
+    /*@ null @*/
+    KvpFrame* saved_frame;      // Slots already in the db, when saving changes
+    /*@ null @*/
+    GHashTable* saved_ids;      // Path -> row id of each slot already in the db
 } slot_info_t;
 
 static /*@ null @*/ gpointer get_obj_guid( gpointer pObject );
@@ -78,6 +83,8 @@ static /*@ null @*/ gpointer get_guid_val( gpointer pObject );
 static void set_guid_val( gpointer pObject, /*@ null @*/ gpointer pValue );
 static gnc_numeric get_numeric_val( gpointer pObject );
 static void set_numeric_val( gpointer pObject, gnc_numeric value );
+static gint get_slot_id( gpointer pObject );
+static void set_slot_id( gpointer pObject, gint value );
 
 #define SLOT_MAX_PATHNAME_LEN 4096
 #define SLOT_MAX_STRINGVAL_LEN 4096
@@ -136,6 +143,60 @@ static const GncSqlColumnTableEntry obj_guid_col_table[] =
     /*@ +full_init_block @*/
 };
 
+/* Special column table to access a single slot by its row id */
+static const GncSqlColumnTableEntry slot_id_col_table[] =
+{
+    /*@ -full_init_block @*/
+    { "id", CT_INT, 0, 0, NULL, NULL, (QofAccessFunc)get_slot_id, (QofSetterFunc)set_slot_id },
+    { NULL }
+    /*@ +full_init_block @*/
+};
+
+/* The columns of col_table, with the row id as key, to update a single slot */
+static const GncSqlColumnTableEntry update_col_table[] =
+{
+    /*@ -full_init_block @*/
+    { "id", CT_INT, 0, 0, NULL, NULL, (QofAccessFunc)get_slot_id, (QofSetterFunc)set_slot_id },
+    {
+        "obj_guid",     CT_GUID,     0,                     COL_NNUL, NULL, NULL,
+        (QofAccessFunc)get_obj_guid,     (QofSetterFunc)set_obj_guid
+    },
+    {
+        "name",         CT_STRING,   SLOT_MAX_PATHNAME_LEN, COL_NNUL, NULL, NULL,
+        (QofAccessFunc)get_path,         set_path
+    },
+    {
+        "slot_type",    CT_INT,      0,                     COL_NNUL, NULL, NULL,
+        (QofAccessFunc)get_slot_type,    set_slot_type,
+    },
+    {
+        "int64_val",    CT_INT64,    0,                     0,        NULL, NULL,
+        (QofAccessFunc)get_int64_val,    (QofSetterFunc)set_int64_val
+    },
+    {
+        "string_val",   CT_STRING,   SLOT_MAX_PATHNAME_LEN, 0,        NULL, NULL,
+        (QofAccessFunc)get_string_val,   set_string_val
+    },
+    {
+        "double_val",   CT_DOUBLE,   0,                     0,        NULL, NULL,
+        (QofAccessFunc)get_double_val,   set_double_val
+    },
+    {
+        "timespec_val", CT_TIMESPEC, 0,                     0,        NULL, NULL,
+        (QofAccessFunc)get_timespec_val, (QofSetterFunc)set_timespec_val
+    },
+    {
+        "guid_val",     CT_GUID,     0,                     0,        NULL, NULL,
+        (QofAccessFunc)get_guid_val,     set_guid_val
+    },
+    {
+        "numeric_val",  CT_NUMERIC,  0,                     0,        NULL, NULL,
+        (QofAccessFunc)get_numeric_val, (QofSetterFunc)set_numeric_val
+    },
+    { NULL }
+    /*@ +full_init_block @*/
+};
+
 /* ================================================================= */
 
 static /*@ null @*/ gpointer
@@ -376,6 +437,129 @@ set_numeric_val( gpointer pObject, gnc_numeric value )
     }
 }
 
+static gint
+get_slot_id( gpointer pObject )
+{
+    slot_info_t* pInfo = (slot_info_t*)pObject;
+
+    g_return_val_if_fail( pObject != NULL, 0 );
+
+    return pInfo->id;
+}
+
+static void
+set_slot_id( gpointer pObject, gint value )
+{
+    slot_info_t* pInfo = (slot_info_t*)pObject;
+
+    g_return_if_fail( pObject != NULL );
+
+    pInfo->id = value;
+}
+
+/* Writes the slot at pInfo->path: an update if the db already has a
+   different value for it, nothing if the value is the same, and an
+   insert otherwise. */
+static gboolean
+write_slot( slot_info_t* pInfo )
+{
+    gpointer id;
+
+    if ( pInfo->saved_ids != NULL &&
+            g_hash_table_lookup_extended( pInfo->saved_ids, pInfo->path->str, NULL, &id ) )
+    {
+        KvpValue* saved_value = kvp_frame_get_value( pInfo->saved_frame, pInfo->path->str );
+
+        (void)g_hash_table_remove( pInfo->saved_ids, pInfo->path->str );
+        if ( saved_value != NULL && kvp_value_compare( saved_value, pInfo->pKvpValue ) == 0 )
+        {
+            return TRUE;
+        }
+        pInfo->id = GPOINTER_TO_INT(id);
+        return gnc_sql_do_db_operation( pInfo->be, OP_DB_UPDATE, TABLE_NAME,
+                                        TABLE_NAME, pInfo, update_col_table );
+    }
+
+    return gnc_sql_do_db_operation( pInfo->be, OP_DB_INSERT, TABLE_NAME,
+                                    TABLE_NAME, pInfo, col_table );
+}
+
+static void
+delete_saved_slot( /*@ unused @*/ gpointer key, gpointer value, gpointer data )
+{
+    slot_info_t* pInfo = (slot_info_t*)data;
+
+    if ( !pInfo->is_ok )
+    {
+        return;
+    }
+
+    pInfo->id = GPOINTER_TO_INT(value);
+    pInfo->is_ok = gnc_sql_do_db_operation( pInfo->be, OP_DB_DELETE, TABLE_NAME,
+                                            TABLE_NAME, pInfo, slot_id_col_table );
+}
+
+/* Reads the slots already saved for pInfo->guid into pInfo->saved_frame,
+   and their row ids into pInfo->saved_ids.  Extra rows for a path are
+   returned so they can be deleted. */
+static GSList*
+load_saved_slots( slot_info_t* pInfo )
+{
+    gchar* buf;
+    gchar guid_buf[GUID_ENCODING_LENGTH+1];
+    GncSqlStatement* stmt;
+    GncSqlResult* result;
+    GSList* duplicate_ids = NULL;
+
+    pInfo->saved_frame = kvp_frame_new();
+    pInfo->saved_ids = g_hash_table_new_full( g_str_hash, g_str_equal, g_free, NULL );
+
+    (void)guid_to_string_buff( pInfo->guid, guid_buf );
+    buf = g_strdup_printf( "SELECT * FROM %s WHERE obj_guid='%s'", TABLE_NAME, guid_buf );
+    stmt = gnc_sql_create_statement_from_sql( pInfo->be, buf );
+    g_free( buf );
+    if ( stmt == NULL )
+    {
+        return NULL;
+    }
+    result = gnc_sql_execute_select_statement( pInfo->be, stmt );
+    gnc_sql_statement_dispose( stmt );
+    if ( result != NULL )
+    {
+        GncSqlRow* row = gnc_sql_result_get_first_row( result );
+
+        while ( row != NULL )
+        {
+            slot_info_t saved_info;
+
+            saved_info.be = pInfo->be;
+            saved_info.pKvpFrame = pInfo->saved_frame;
+            saved_info.path = NULL;
+            saved_info.id = 0;
+            gnc_sql_load_object( pInfo->be, row, TABLE_NAME, &saved_info, col_table );
+            gnc_sql_load_object( pInfo->be, row, TABLE_NAME, &saved_info, slot_id_col_table );
+
+            if ( saved_info.path != NULL )
+            {
+                if ( g_hash_table_lookup_extended( pInfo->saved_ids, saved_info.path->str, NULL, NULL ) )
+                {
+                    duplicate_ids = g_slist_prepend( duplicate_ids, GINT_TO_POINTER(saved_info.id) );
+                }
+                else
+                {
+                    g_hash_table_insert( pInfo->saved_ids, g_strdup( saved_info.path->str ),
+                                         GINT_TO_POINTER(saved_info.id) );
+                }
+                (void)g_string_free( saved_info.path, TRUE );
+            }
+            row = gnc_sql_result_get_next_row( result );
+        }
+        gnc_sql_result_dispose( result );
+    }
+
+    return duplicate_ids;
+}
+
 static void
 save_slot( const gchar* key, KvpValue* value, gpointer data )
 {
@@ -407,10 +591,7 @@ save_slot( const gchar* key, KvpValue* value, gpointer data )
     }
     else
     {
-        pSlot_info->is_ok = gnc_sql_do_db_operation( pSlot_info->be,
-                            OP_DB_INSERT, TABLE_NAME,
-                            TABLE_NAME, pSlot_info,
-                            col_table );
+        pSlot_info->is_ok = write_slot( pSlot_info );
     }
 
     (void)g_string_truncate( pSlot_info->path, curlen );
@@ -420,24 +601,47 @@ gboolean
 gnc_sql_slots_save( GncSqlBackend* be, const GncGUID* guid, gboolean is_infant, KvpFrame* pFrame )
 {
     slot_info_t slot_info;
+    GSList* duplicate_ids = NULL;
+    GSList* node;
 
     g_return_val_if_fail( be != NULL, FALSE );
     g_return_val_if_fail( guid != NULL, FALSE );
     g_return_val_if_fail( pFrame != NULL, FALSE );
 
-    // If this is not saving into a new db, clear out the old saved slots first
-    if ( !be->is_pristine_db && !is_infant )
-    {
-        (void)gnc_sql_slots_delete( be, guid );
-    }
-
     slot_info.be = be;
     slot_info.guid = guid;
     slot_info.path = g_string_new( "" );
     slot_info.is_ok = TRUE;
+    slot_info.saved_frame = NULL;
+    slot_info.saved_ids = NULL;
+
+    // If this is not saving into a new db, only write the slots which changed.
+    // A queued commit can't read the saved slots, so it replaces them all.
+    if ( !be->is_pristine_db && !is_infant && be->commits_are_queued )
+    {
+        slot_info.is_ok = gnc_sql_slots_delete( be, guid );
+    }
+    else if ( !be->is_pristine_db && !is_infant )
+    {
+        duplicate_ids = load_saved_slots( &slot_info );
+    }
+
     kvp_frame_for_each_slot( pFrame, save_slot, &slot_info );
     (void)g_string_free( slot_info.path, TRUE );
 
+    // Whatever is left in the db is no longer in the frame
+    if ( slot_info.saved_ids != NULL )
+    {
+        g_hash_table_foreach( slot_info.saved_ids, delete_saved_slot, &slot_info );
+        for ( node = duplicate_ids; node != NULL; node = node->next )
+        {
+            delete_saved_slot( NULL, node->data, &slot_info );
+        }
+        g_slist_free( duplicate_ids );
+        g_hash_table_destroy( slot_info.saved_ids );
+        kvp_frame_delete( slot_info.saved_frame );
+    }
+
     return slot_info.is_ok;
 }
 
@@ -693,6 +897,70 @@ void gnc_sql_slots_load_for_sql_subquery( GncSqlBackend* be, const gchar* subque
     }
 }
 
+/**
+ * gnc_sql_slots_load_for_instances - Loads slots for the objects whose guid is
+ * supplied by a subquery, in a single pass ordered by object guid.  Each
+ * object is looked up once, however many slots it has, and objects which
+ * aren't in the hash table are skipped.
+ *
+ * @param be SQL backend
+ * @param subquery Subquery SQL string
+ * @param instances Hash table from GncGUID* to the QofInstance to load into
+ */
+void gnc_sql_slots_load_for_instances( GncSqlBackend* be, const gchar* subquery,
+                                       GHashTable* instances )
+{
+    gchar* sql;
+    GncSqlResult* result;
+
+    g_return_if_fail( be != NULL );
+    g_return_if_fail( instances != NULL );
+
+    // Ignore empty subquery
+    if ( subquery == NULL ) return;
+
+    sql = g_strdup_printf( "SELECT * FROM %s WHERE %s IN (%s) ORDER BY %s",
+                           TABLE_NAME, obj_guid_col_table[0].col_name,
+                           subquery, obj_guid_col_table[0].col_name );
+    result = gnc_sql_execute_select_sql( be, sql );
+    g_free( sql );
+    if ( result != NULL )
+    {
+        GncSqlRow* row;
+        GncGUID cur_guid;
+        QofInstance* inst = NULL;
+        gboolean have_guid = FALSE;
+
+        for ( row = gnc_sql_result_get_first_row( result ); row != NULL;
+                row = gnc_sql_result_get_next_row( result ) )
+        {
+            const GncGUID* guid = load_obj_guid( be, row );
+            slot_info_t slot_info;
+
+            if ( guid == NULL ) continue;
+            if ( !have_guid || !guid_equal( guid, &cur_guid ) )
+            {
+                cur_guid = *guid;
+                have_guid = TRUE;
+                inst = g_hash_table_lookup( instances, &cur_guid );
+            }
+            if ( inst == NULL ) continue;
+
+            slot_info.be = be;
+            slot_info.pKvpFrame = qof_instance_get_slots( inst );
+            slot_info.path = NULL;
+
+            gnc_sql_load_object( be, row, TABLE_NAME, &slot_info, col_table );
+
+            if ( slot_info.path != NULL )
+            {
+                (void)g_string_free( slot_info.path, TRUE );
+            }
+        }
+        gnc_sql_result_dispose( result );
+    }
+}
+
 /* ================================================================= */
 static void
 create_slots_tables( GncSqlBackend* be )
@@ -33,7 +33,9 @@
 #include <gmodule.h>
 
 /**
- * gnc_sql_slots_save - Saves slots for an object to the db.
+ * gnc_sql_slots_save - Saves slots for an object to the db.  Unless the
+ * object is new, only the slots which differ from those already in the db
+ * are inserted, updated or deleted.
  *
  * @param be SQL backend
  * @param guid Object guid
@@ -84,6 +86,19 @@ typedef QofInstance* (*BookLookupFn)( const GncGUID* guid, const QofBook* book )
 void gnc_sql_slots_load_for_sql_subquery( GncSqlBackend* be, const gchar* subquery,
         BookLookupFn lookup_fn );
 
+/**
+ * gnc_sql_slots_load_for_instances - Loads slots for the objects whose guid is
+ * supplied by a subquery, in a single pass ordered by object guid.  Each
+ * object is looked up once, however many slots it has, and objects which
+ * aren't in the hash table are skipped.
+ *
+ * @param be SQL backend
+ * @param subquery Subquery SQL string
+ * @param instances Hash table from GncGUID* to the QofInstance to load into
+ */
+void gnc_sql_slots_load_for_instances( GncSqlBackend* be, const gchar* subquery,
+                                       GHashTable* instances );
+
 void gnc_sql_init_slots_handler( void );
 
 #endif /* GNC_SLOTS_SQL_H_ */
@@ -47,21 +47,19 @@
 
 #include "gnc-engine.h"
 
-#include "escape.h"
-
 #ifdef S_SPLINT_S
 #include "splint-defs.h"
 #endif
 
-#define SIMPLE_QUERY_COMPILATION 1
-#define LOAD_TRANSACTIONS_AS_NEEDED 0
-
 /*@ unused @*/ static QofLogModule log_module = G_LOG_DOMAIN;
 
 #define TRANSACTION_TABLE "transactions"
 #define TX_TABLE_VERSION 3
 #define SPLIT_TABLE "splits"
 #define SPLIT_TABLE_VERSION 4
+#define BALANCE_TABLE "balance_checkpoints"
+#define BALANCE_TABLE_VERSION 2
+#define TX_LOAD_TABLE "tx_load_guids"
 
 typedef struct
 {
@@ -118,6 +116,30 @@ static const GncSqlColumnTableEntry split_col_table[] =
     /*@ +full_init_block @*/
 };
 
+/* The split columns without tx_guid, for loading splits whose transaction
+   is already known */
+static const GncSqlColumnTableEntry split_load_col_table[] =
+{
+    /*@ -full_init_block @*/
+    { "guid",            CT_GUID,         0,                    COL_NNUL | COL_PKEY, "guid" },
+    { "account_guid",    CT_ACCOUNTREF,   0,                    COL_NNUL,          "account" },
+    { "memo",            CT_STRING,       SPLIT_MAX_MEMO_LEN,   COL_NNUL,          "memo" },
+    { "action",          CT_STRING,       SPLIT_MAX_ACTION_LEN, COL_NNUL,          "action" },
+    {
+        "reconcile_state", CT_STRING,       1,                    COL_NNUL,          NULL, NULL,
+        (QofAccessFunc)get_split_reconcile_state, set_split_reconcile_state
+    },
+    { "reconcile_date",  CT_TIMESPEC,     0,                    0,                 "reconcile-date" },
+    { "value",           CT_NUMERIC,      0,                    COL_NNUL,          "value" },
+    { "quantity",        CT_NUMERIC,      0,                    COL_NNUL,          "amount" },
+    {
+        "lot_guid",        CT_LOTREF,       0,                    0,                 NULL, NULL,
+        (QofAccessFunc)xaccSplitGetLot, set_split_lot
+    },
+    { NULL }
+    /*@ +full_init_block @*/
+};
+
 static const GncSqlColumnTableEntry post_date_col_table[] =
 {
     /*@ -full_init_block @*/
@@ -197,7 +219,7 @@ set_split_lot( gpointer pObject, /*@ null @*/ gpointer pLot )
 }
 
 static /*@ null @*/ Split*
-load_single_split( GncSqlBackend* be, GncSqlRow* row )
+load_single_split( GncSqlBackend* be, GncSqlRow* row, Transaction* pTx )
 {
     const GncGUID* guid;
     GncGUID split_guid;
@@ -205,6 +227,7 @@ load_single_split( GncSqlBackend* be, GncSqlRow* row )
 
     g_return_val_if_fail( be != NULL, NULL );
     g_return_val_if_fail( row != NULL, NULL );
+    g_return_val_if_fail( pTx != NULL, NULL );
 
     guid = gnc_sql_load_guid( be, row );
     if ( guid == NULL ) return NULL;
@@ -219,7 +242,8 @@ load_single_split( GncSqlBackend* be, GncSqlRow* row )
     /* If the split is dirty, don't overwrite it */
     if ( !qof_instance_is_dirty( QOF_INSTANCE(pSplit) ) )
     {
-        gnc_sql_load_object( be, row, GNC_ID_SPLIT, pSplit, split_col_table );
+        gnc_sql_load_object( be, row, GNC_ID_SPLIT, pSplit, split_load_col_table );
+        xaccSplitSetParent( pSplit, pTx );
     }
 
     /*# -ifempty */g_assert( pSplit == xaccSplitLookup( &split_guid, be->primary_book ) );
@@ -227,49 +251,71 @@ load_single_split( GncSqlBackend* be, GncSqlRow* row )
     return pSplit;
 }
 
+/**
+ * Loads the splits, and their slots, of the transactions whose guids are in
+ * a table.  The splits are read in a single pass ordered by transaction, so
+ * each transaction is looked up once however many splits it has.  Only the
+ * splits of the transactions being loaded are loaded.
+ *
+ * @param be SQL backend
+ * @param tx_table Table holding the transaction guids
+ * @param txs Hash table from guid to each transaction being loaded
+ */
 static void
-load_splits_for_tx_list( GncSqlBackend* be, GList* list )
+load_splits_for_tx_table( GncSqlBackend* be, const gchar* tx_table, GHashTable* txs )
 {
-    GString* sql;
+    gchar* sql;
     GncSqlResult* result;
 
     g_return_if_fail( be != NULL );
 
-    if ( list == NULL ) return;
-
-    sql = g_string_sized_new( 40 + (GUID_ENCODING_LENGTH + 3) * g_list_length( list ) );
-    g_string_append_printf( sql, "SELECT * FROM %s WHERE %s IN (", SPLIT_TABLE, tx_guid_col_table[0].col_name );
-    (void)gnc_sql_append_guid_list_to_sql( sql, list, G_MAXUINT );
-    (void)g_string_append( sql, ")" );
-
-    // Execute the query and load the splits
-    result = gnc_sql_execute_select_sql( be, sql->str );
+    sql = g_strdup_printf( "SELECT s.* FROM %s AS s, %s AS l WHERE s.%s=l.guid ORDER BY s.%s",
+                           SPLIT_TABLE, tx_table, tx_guid_col_table[0].col_name,
+                           tx_guid_col_table[0].col_name );
+    result = gnc_sql_execute_select_sql( be, sql );
+    g_free( sql );
     if ( result != NULL )
     {
-        GList* split_list = NULL;
+        GHashTable* splits = g_hash_table_new( guid_hash_to_guint, guid_g_hash_table_equal );
         GncSqlRow* row;
+        GncGUID cur_tx_guid;
+        Transaction* pTx = NULL;
+        gboolean have_tx_guid = FALSE;
 
-        row = gnc_sql_result_get_first_row( result );
-        while ( row != NULL )
+        for ( row = gnc_sql_result_get_first_row( result ); row != NULL;
+                row = gnc_sql_result_get_next_row( result ) )
         {
+            const GncGUID* tx_guid = gnc_sql_load_tx_guid( be, row );
             Split* s;
-            s = load_single_split( be, row );
+
+            if ( tx_guid == NULL ) continue;
+            if ( !have_tx_guid || !guid_equal( tx_guid, &cur_tx_guid ) )
+            {
+                cur_tx_guid = *tx_guid;
+                have_tx_guid = TRUE;
+                pTx = g_hash_table_lookup( txs, &cur_tx_guid );
+            }
+
+            // The splits of transactions which were already in memory are too
+            if ( pTx == NULL ) continue;
+
+            s = load_single_split( be, row, pTx );
             if ( s != NULL )
             {
-                split_list = g_list_prepend( split_list, s );
+                g_hash_table_insert( splits, (gpointer)qof_instance_get_guid( QOF_INSTANCE(s) ), s );
             }
-            row = gnc_sql_result_get_next_row( result );
         }
+        gnc_sql_result_dispose( result );
 
-        if ( split_list != NULL )
+        if ( g_hash_table_size( splits ) != 0 )
         {
-            gnc_sql_slots_load_for_list( be, split_list );
-            g_list_free( split_list );
+            sql = g_strdup_printf( "SELECT s.guid FROM %s AS s, %s AS l WHERE s.%s=l.guid",
+                                   SPLIT_TABLE, tx_table, tx_guid_col_table[0].col_name );
+            gnc_sql_slots_load_for_instances( be, sql, splits );
+            g_free( sql );
         }
-
-        gnc_sql_result_dispose( result );
+        g_hash_table_destroy( splits );
     }
-    (void)g_string_free( sql, TRUE );
 }
 
 static /*@ null @*/ Transaction*
@@ -366,24 +412,48 @@ save_account_balances( Account* acc, gpointer pData )
 }
 
 /**
- * Executes a transaction query statement and loads the transactions and all
- * of the splits.
+ * Loads the transactions selected by an SQL query, with all of their splits
+ * and slots.  The guids of the transactions are first collected in a
+ * temporary table, so the query is only run once and the splits and slots
+ * are loaded by joining with it.
  *
  * @param be SQL backend
- * @param stmt SQL statement
+ * @param sql SQL query selecting (at least) the guid column of transactions
  */
 static void
-query_transactions( GncSqlBackend* be, GncSqlStatement* stmt )
+query_transactions( GncSqlBackend* be, const gchar* sql )
 {
+    // Loading other objects can load their transactions, so this can be re-entered
+    static guint depth = 0;
     GncSqlResult* result;
+    gchar* tx_table;
+    gchar* query_sql;
 
     g_return_if_fail( be != NULL );
-    g_return_if_fail( stmt != NULL );
+    g_return_if_fail( sql != NULL );
 
-    result = gnc_sql_execute_select_statement( be, stmt );
+    tx_table = g_strdup_printf( "%s%u", TX_LOAD_TABLE, depth );
+    query_sql = g_strdup_printf( "CREATE TEMPORARY TABLE %s AS SELECT guid FROM (%s) AS tx_query",
+                                 tx_table, sql );
+    if ( gnc_sql_execute_nonselect_sql( be, query_sql ) < 0 )
+    {
+        PERR( "Unable to collect the transactions to load\n" );
+        qof_backend_set_error( &be->be, ERR_BACKEND_SERVER_ERR );
+        g_free( query_sql );
+        g_free( tx_table );
+        return;
+    }
+    g_free( query_sql );
+    depth++;
+
+    query_sql = g_strdup_printf( "SELECT t.* FROM %s AS t, %s AS l WHERE t.guid=l.guid",
+                                 TRANSACTION_TABLE, tx_table );
+    result = gnc_sql_execute_select_sql( be, query_sql );
+    g_free( query_sql );
     if ( result != NULL )
     {
         GList* tx_list = NULL;
+        GHashTable* txs = g_hash_table_new( guid_hash_to_guint, guid_g_hash_table_equal );
         GList* node;
         GncSqlRow* row;
         Transaction* tx;
@@ -391,16 +461,17 @@ query_transactions( GncSqlBackend* be, GncSqlStatement* stmt )
         GSList* nextbal;
         Account* root = gnc_book_get_root_account( be->primary_book );
 
-#if LOAD_TRANSACTIONS_AS_NEEDED
-        qof_event_suspend();
-        xaccAccountBeginEdit( root );
-
-        // Save the start/ending balances (balance, cleared and reconciled) for
-        // every account.
-        gnc_account_foreach_descendant( gnc_book_get_root_account( be->primary_book ),
-                                        save_account_balances,
-                                        &bal_list );
-#endif
+        if ( be->load_tx_as_needed )
+        {
+            qof_event_suspend();
+            xaccAccountBeginEdit( root );
+
+            // Save the start/ending balances (balance, cleared and reconciled) for
+            // every account.
+            gnc_account_foreach_descendant( gnc_book_get_root_account( be->primary_book ),
+                                            save_account_balances,
+                                            &bal_list );
+        }
 
         // Load the transactions
         row = gnc_sql_result_get_first_row( result );
@@ -410,6 +481,7 @@ query_transactions( GncSqlBackend* be, GncSqlStatement* stmt )
             if ( tx != NULL )
             {
                 tx_list = g_list_prepend( tx_list, tx );
+                g_hash_table_insert( txs, (gpointer)qof_instance_get_guid( QOF_INSTANCE(tx) ), tx );
             }
             row = gnc_sql_result_get_next_row( result );
         }
@@ -418,9 +490,12 @@ query_transactions( GncSqlBackend* be, GncSqlStatement* stmt )
         // Load all splits and slots for the transactions
         if ( tx_list != NULL )
         {
-            gnc_sql_slots_load_for_list( be, tx_list );
-            load_splits_for_tx_list( be, tx_list );
+            query_sql = g_strdup_printf( "SELECT guid FROM %s", tx_table );
+            gnc_sql_slots_load_for_instances( be, query_sql, txs );
+            g_free( query_sql );
+            load_splits_for_tx_table( be, tx_table, txs );
         }
+        g_hash_table_destroy( txs );
 
         // Commit all of the transactions
         for ( node = tx_list; node != NULL; node = node->next )
@@ -430,260 +505,1230 @@ query_transactions( GncSqlBackend* be, GncSqlStatement* stmt )
         }
         g_list_free( tx_list );
 
-#if LOAD_TRANSACTIONS_AS_NEEDED
-        // Update the account balances based on the loaded splits.  If the end
-        // balance has changed, update the start balance so that the end
-        // balance is the same as it was before the splits were loaded.
-        // Repeat for cleared and reconciled balances.
-        for ( nextbal = bal_list; nextbal != NULL; nextbal = nextbal->next )
+        if ( be->load_tx_as_needed )
         {
-            full_acct_balances_t* balns = (full_acct_balances_t*)nextbal->data;
-            gnc_numeric* pnew_end_bal;
-            gnc_numeric* pnew_end_c_bal;
-            gnc_numeric* pnew_end_r_bal;
-            gnc_numeric adj;
-
-            g_object_get( balns->acc,
-                          "end-balance", &pnew_end_bal,
-                          "end-cleared-balance", &pnew_end_c_bal,
-                          "end-reconciled-balance", &pnew_end_r_bal,
-                          NULL );
-
-            if ( !gnc_numeric_eq( *pnew_end_bal, balns->end_bal ) )
+            // Update the account balances based on the loaded splits.  If the end
+            // balance has changed, update the start balance so that the end
+            // balance is the same as it was before the splits were loaded.
+            // Repeat for cleared and reconciled balances.
+            for ( nextbal = bal_list; nextbal != NULL; nextbal = nextbal->next )
             {
-                adj = gnc_numeric_sub( balns->end_bal, *pnew_end_bal,
-                                       GNC_DENOM_AUTO, GNC_HOW_DENOM_LCD );
-                balns->start_bal = gnc_numeric_add( balns->start_bal, adj,
-                                                    GNC_DENOM_AUTO, GNC_HOW_DENOM_LCD );
-                g_object_set( balns->acc, "start-balance", &balns->start_bal, NULL );
-            }
-            if ( !gnc_numeric_eq( *pnew_end_c_bal, balns->end_cleared_bal ) )
-            {
-                adj = gnc_numeric_sub( balns->end_cleared_bal, *pnew_end_c_bal,
-                                       GNC_DENOM_AUTO, GNC_HOW_DENOM_LCD );
-                balns->start_cleared_bal = gnc_numeric_add( balns->start_cleared_bal, adj,
+                full_acct_balances_t* balns = (full_acct_balances_t*)nextbal->data;
+                gnc_numeric* pnew_end_bal;
+                gnc_numeric* pnew_end_c_bal;
+                gnc_numeric* pnew_end_r_bal;
+                gnc_numeric adj;
+
+                g_object_get( balns->acc,
+                              "end-balance", &pnew_end_bal,
+                              "end-cleared-balance", &pnew_end_c_bal,
+                              "end-reconciled-balance", &pnew_end_r_bal,
+                              NULL );
+
+                if ( !gnc_numeric_eq( *pnew_end_bal, balns->end_bal ) )
+                {
+                    adj = gnc_numeric_sub( balns->end_bal, *pnew_end_bal,
+                                           GNC_DENOM_AUTO, GNC_HOW_DENOM_LCD );
+                    balns->start_bal = gnc_numeric_add( balns->start_bal, adj,
+                                                        GNC_DENOM_AUTO, GNC_HOW_DENOM_LCD );
+                    g_object_set( balns->acc, "start-balance", &balns->start_bal, NULL );
+                }
+                if ( !gnc_numeric_eq( *pnew_end_c_bal, balns->end_cleared_bal ) )
+                {
+                    adj = gnc_numeric_sub( balns->end_cleared_bal, *pnew_end_c_bal,
+                                           GNC_DENOM_AUTO, GNC_HOW_DENOM_LCD );
+                    balns->start_cleared_bal = gnc_numeric_add( balns->start_cleared_bal, adj,
+                                               GNC_DENOM_AUTO, GNC_HOW_DENOM_LCD );
+                    g_object_set( balns->acc, "start-cleared-balance", &balns->start_cleared_bal, NULL );
+                }
+                if ( !gnc_numeric_eq( *pnew_end_r_bal, balns->end_reconciled_bal ) )
+                {
+                    adj = gnc_numeric_sub( balns->end_reconciled_bal, *pnew_end_r_bal,
                                            GNC_DENOM_AUTO, GNC_HOW_DENOM_LCD );
-                g_object_set( balns->acc, "start-cleared-balance", &balns->start_cleared_bal, NULL );
+                    balns->start_reconciled_bal = gnc_numeric_add( balns->start_reconciled_bal, adj,
+                                                  GNC_DENOM_AUTO, GNC_HOW_DENOM_LCD );
+                    g_object_set( balns->acc, "start-reconciled-balance", &balns->start_reconciled_bal, NULL );
+                }
+                xaccAccountRecomputeBalance( balns->acc );
+                g_free( pnew_end_bal );
+                g_free( pnew_end_c_bal );
+                g_free( pnew_end_r_bal );
+                g_free( balns );
             }
-            if ( !gnc_numeric_eq( *pnew_end_r_bal, balns->end_reconciled_bal ) )
+            if ( bal_list != NULL )
             {
-                adj = gnc_numeric_sub( balns->end_reconciled_bal, *pnew_end_r_bal,
-                                       GNC_DENOM_AUTO, GNC_HOW_DENOM_LCD );
-                balns->start_reconciled_bal = gnc_numeric_add( balns->start_reconciled_bal, adj,
-                                              GNC_DENOM_AUTO, GNC_HOW_DENOM_LCD );
-                g_object_set( balns->acc, "start-reconciled-balance", &balns->start_reconciled_bal, NULL );
+                g_slist_free( bal_list );
             }
-            xaccAccountRecomputeBalance( balns->acc );
-            g_free( pnew_end_bal );
-            g_free( pnew_end_c_bal );
-            g_free( pnew_end_r_bal );
-            g_free( balns );
-        }
-        if ( bal_list != NULL )
-        {
-            g_slist_free( bal_list );
-        }
 
-        xaccAccountCommitEdit( root );
-        qof_event_resume();
-#endif
+            xaccAccountCommitEdit( root );
+            qof_event_resume();
+        }
+    }
+    else
+    {
+        PERR( "Unable to load the transactions\n" );
+        qof_backend_set_error( &be->be, ERR_BACKEND_SERVER_ERR );
     }
+
+    depth--;
+    query_sql = g_strdup_printf( "DROP TABLE %s", tx_table );
+    (void)gnc_sql_execute_nonselect_sql( be, query_sql );
+    g_free( query_sql );
+    g_free( tx_table );
 }
 
 /* ================================================================= */
-/**
- * Creates the transaction and split tables.
- *
- * @param be SQL backend
- */
-static void
-create_transaction_tables( GncSqlBackend* be )
+/* Balance checkpoints
+
+   The balance_checkpoints table holds, for each account and UTC calendar
+   month, the total quantity of the account's splits posted in that month
+   for each reconcile state.  An account's balances, now or as of any date,
+   are the sum of the checkpoints before that date's month plus a scan of
+   the splits posted earlier in the month, instead of an aggregate over the
+   whole splits table.
+
+   The checkpoints are monthly totals rather than running totals so that
+   changing a split only rewrites the rows for its own months instead of
+   every later checkpoint.
+
+   Only a session which loads transactions as needed reads the checkpoints
+   while it runs, so only such a session keeps them up to date as objects
+   are committed.  Any other session marks the table out of date with a row
+   for the null account when it opens the book, and the table is rebuilt
+   from the splits if it is read.
+
+   Committing a transaction collects each account and month its splits were
+   in before the commit and are in after it.  The engine commits the
+   transaction before its splits, so those checkpoints are recomputed once
+   all of its changed splits have been written.  A split committed on its
+   own recomputes the checkpoints for its own months.  When a whole book is
+   written to a pristine db, the table is rebuilt once after all of the
+   splits have been written instead.
+*/
+
+typedef struct
 {
-    gint version;
-    gboolean ok;
+    GncGUID account_guid;
+    Timespec period_start;		/* Start of the month */
+    gchar reconcile_state[2];
+    gnc_numeric quantity;
+} balance_checkpoint_t;
+
+/* The months are UTC months, so that the rows don't depend on the time
+   zone of the session which wrote them. */
+#define SECS_PER_DAY 86400
+
+static GDate
+balance_period_epoch( void )
+{
+    GDate epoch;
 
-    g_return_if_fail( be != NULL );
+    g_date_clear( &epoch, 1 );
+    g_date_set_dmy( &epoch, 1, G_DATE_JANUARY, 1970 );
+    return epoch;
+}
 
-    version = gnc_sql_get_table_version( be, TRANSACTION_TABLE );
-    if ( version == 0 )
-    {
-        (void)gnc_sql_create_table( be, TRANSACTION_TABLE, TX_TABLE_VERSION, tx_col_table );
-        ok = gnc_sql_create_index( be, "tx_post_date_index", TRANSACTION_TABLE, post_date_col_table );
-        if ( !ok )
-        {
-            PERR( "Unable to create index\n" );
-        }
-    }
-    else if ( version < TX_TABLE_VERSION )
-    {
-        /* Upgrade:
-            1->2: 64 bit int handling
-        	2->3: allow dates to be NULL
-        */
-        gnc_sql_upgrade_table( be, TRANSACTION_TABLE, tx_col_table );
-        (void)gnc_sql_set_table_version( be, TRANSACTION_TABLE, TX_TABLE_VERSION );
-    }
+static GDate
+balance_period_utc_date( Timespec ts )
+{
+    GDate d = balance_period_epoch();
+    gint64 days = ts.tv_sec / SECS_PER_DAY;
 
-    version = gnc_sql_get_table_version( be, SPLIT_TABLE );
-    if ( version == 0 )
+    if ( ts.tv_sec % SECS_PER_DAY < 0 ) days--;
+    if ( days >= 0 )
     {
-        (void)gnc_sql_create_table( be, SPLIT_TABLE, SPLIT_TABLE_VERSION, split_col_table );
-        ok = gnc_sql_create_index( be, "splits_tx_guid_index", SPLIT_TABLE, tx_guid_col_table );
-        if ( !ok )
-        {
-            PERR( "Unable to create index\n" );
-        }
-        ok = gnc_sql_create_index( be, "splits_account_guid_index", SPLIT_TABLE, account_guid_col_table );
-        if ( !ok )
-        {
-            PERR( "Unable to create index\n" );
-        }
+        g_date_add_days( &d, (guint)days );
     }
-    else if ( version < SPLIT_TABLE_VERSION )
+    else
     {
-
-        /* Upgrade:
-           1->2: 64 bit int handling
-           3->4: Split reconcile date can be NULL */
-        gnc_sql_upgrade_table( be, SPLIT_TABLE, split_col_table );
-        ok = gnc_sql_create_index( be, "splits_tx_guid_index", SPLIT_TABLE, tx_guid_col_table );
-        if ( !ok )
-        {
-            PERR( "Unable to create index\n" );
-        }
-        ok = gnc_sql_create_index( be, "splits_account_guid_index", SPLIT_TABLE, account_guid_col_table );
-        if ( !ok )
-        {
-            PERR( "Unable to create index\n" );
-        }
-        (void)gnc_sql_set_table_version( be, SPLIT_TABLE, SPLIT_TABLE_VERSION );
+        g_date_subtract_days( &d, (guint)-days );
     }
+    return d;
 }
-/* ================================================================= */
-/**
- * Callback function to delete slots for a split
- *
- * @param data Split
- * @param user_data split_info_t structure contain operation info
- */
-static void
-delete_split_slots_cb( gpointer data, gpointer user_data )
-{
-    split_info_t* split_info = (split_info_t*)user_data;
-    Split* pSplit = GNC_SPLIT(data);
 
-    g_return_if_fail( data != NULL );
-    g_return_if_fail( GNC_IS_SPLIT(data) );
-    g_return_if_fail( user_data != NULL );
+static Timespec
+balance_period_utc_timespec( const GDate* d )
+{
+    GDate epoch = balance_period_epoch();
+    Timespec ts;
 
-    if ( split_info->is_ok )
-    {
-        split_info->is_ok = gnc_sql_slots_delete( split_info->be,
-                            qof_instance_get_guid( QOF_INSTANCE(pSplit) ) );
-    }
+    ts.tv_sec = (gint64)g_date_days_between( &epoch, d ) * SECS_PER_DAY;
+    ts.tv_nsec = 0;
+    return ts;
 }
 
-/**
- * Deletes all of the splits for a transaction
- *
- * @param be SQL backend
- * @param pTx Transaction
- * @return TRUE if successful, FALSE if unsuccessful
- */
-static gboolean
-delete_splits( GncSqlBackend* be, Transaction* pTx )
+static Timespec
+balance_period_start( Timespec date )
 {
-    split_info_t split_info;
+    GDate d = balance_period_utc_date( date );
 
-    g_return_val_if_fail( be != NULL, FALSE );
-    g_return_val_if_fail( pTx != NULL, FALSE );
+    g_date_set_day( &d, 1 );
+    return balance_period_utc_timespec( &d );
+}
 
-    if ( !gnc_sql_do_db_operation( be, OP_DB_DELETE, SPLIT_TABLE,
-                                   SPLIT_TABLE, pTx, tx_guid_col_table ) )
-    {
-        return FALSE;
-    }
-    split_info.be = be;
-    split_info.is_ok = TRUE;
+static Timespec
+balance_period_end( Timespec period_start )
+{
+    GDate d = balance_period_utc_date( period_start );
 
-    g_list_foreach( xaccTransGetSplitList( pTx ), delete_split_slots_cb, &split_info );
+    g_date_add_months( &d, 1 );
+    return balance_period_utc_timespec( &d );
+}
 
-    return split_info.is_ok;
+/* A transaction with no post date is treated as posted at the epoch */
+static Timespec
+balance_period_undated( void )
+{
+    Timespec epoch = { 0, 0 };
+
+    return balance_period_start( epoch );
 }
 
-/**
- * Commits a split to the database
- *
- * @param be SQL backend
- * @param inst Split
- * @return TRUE if successful, FALSE if error
- */
-static gboolean
-commit_split( GncSqlBackend* be, QofInstance* inst )
+static gpointer
+get_checkpoint_account_guid( gpointer pObject )
 {
-    gint op;
-    gboolean is_infant;
-    gboolean is_ok;
+    return &((balance_checkpoint_t*)pObject)->account_guid;
+}
 
-    g_return_val_if_fail( inst != NULL, FALSE );
-    g_return_val_if_fail( be != NULL, FALSE );
+static void
+set_checkpoint_account_guid( gpointer pObject, gpointer pValue )
+{
+    g_return_if_fail( pValue != NULL );
 
-    is_infant = qof_instance_get_infant( inst );
-    if ( qof_instance_get_destroying( inst ) )
-    {
-        op = OP_DB_DELETE;
-    }
-    else if ( be->is_pristine_db || is_infant )
-    {
-        op = OP_DB_INSERT;
-    }
-    else
-    {
-        op = OP_DB_UPDATE;
-    }
-    is_ok = gnc_sql_do_db_operation( be, op, SPLIT_TABLE, GNC_ID_SPLIT, inst, split_col_table );
-    if ( is_ok )
-    {
-        is_ok = gnc_sql_slots_save( be,
-                                    qof_instance_get_guid( inst ),
-                                    is_infant,
-                                    qof_instance_get_slots( inst ) );
-    }
+    ((balance_checkpoint_t*)pObject)->account_guid = *(const GncGUID*)pValue;
+}
 
-    return is_ok;
+static Timespec
+get_checkpoint_period_start( gpointer pObject )
+{
+    return ((balance_checkpoint_t*)pObject)->period_start;
 }
 
 static void
-save_split_cb( gpointer data, gpointer user_data )
+set_checkpoint_period_start( gpointer pObject, Timespec ts )
 {
-    split_info_t* split_info = (split_info_t*)user_data;
-    Split* pSplit = GNC_SPLIT(data);
-
-    g_return_if_fail( data != NULL );
-    g_return_if_fail( GNC_IS_SPLIT(data) );
-    g_return_if_fail( user_data != NULL );
+    ((balance_checkpoint_t*)pObject)->period_start = ts;
+}
 
-    if ( split_info->is_ok )
-    {
-        split_info->is_ok = commit_split( split_info->be, QOF_INSTANCE(pSplit) );
-    }
+static void
+set_checkpoint_period_from_date( gpointer pObject, Timespec ts )
+{
+    ((balance_checkpoint_t*)pObject)->period_start = balance_period_start( ts );
 }
 
-static gboolean
-save_splits( GncSqlBackend* be, const GncGUID* tx_guid, SplitList* pSplitList )
+static gpointer
+get_checkpoint_reconcile_state( gpointer pObject )
 {
-    split_info_t split_info;
+    return ((balance_checkpoint_t*)pObject)->reconcile_state;
+}
 
-    g_return_val_if_fail( be != NULL, FALSE );
-    g_return_val_if_fail( tx_guid != NULL, FALSE );
-    g_return_val_if_fail( pSplitList != NULL, FALSE );
+static void
+set_checkpoint_reconcile_state( gpointer pObject, gpointer pValue )
+{
+    balance_checkpoint_t* cp = (balance_checkpoint_t*)pObject;
 
-    split_info.be = be;
-    split_info.guid = tx_guid;
-    split_info.is_ok = TRUE;
-    g_list_foreach( pSplitList, save_split_cb, &split_info );
+    g_return_if_fail( pValue != NULL );
 
-    return split_info.is_ok;
+    cp->reconcile_state[0] = ((const gchar*)pValue)[0];
+    cp->reconcile_state[1] = '\0';
+}
+
+static gnc_numeric
+get_checkpoint_quantity( gpointer pObject )
+{
+    return ((balance_checkpoint_t*)pObject)->quantity;
+}
+
+static void
+set_checkpoint_quantity( gpointer pObject, gnc_numeric value )
+{
+    ((balance_checkpoint_t*)pObject)->quantity = value;
+}
+
+static const GncSqlColumnTableEntry balance_col_table[] =
+{
+    /*@ -full_init_block @*/
+    {
+        "account_guid",    CT_GUID,     0, COL_NNUL, NULL, NULL,
+        (QofAccessFunc)get_checkpoint_account_guid, (QofSetterFunc)set_checkpoint_account_guid
+    },
+    {
+        "period_start",    CT_TIMESPEC, 0, COL_NNUL, NULL, NULL,
+        (QofAccessFunc)get_checkpoint_period_start, (QofSetterFunc)set_checkpoint_period_start
+    },
+    {
+        "reconcile_state", CT_STRING,   1, COL_NNUL, NULL, NULL,
+        (QofAccessFunc)get_checkpoint_reconcile_state, (QofSetterFunc)set_checkpoint_reconcile_state
+    },
+    {
+        "quantity",        CT_NUMERIC,  0, COL_NNUL, NULL, NULL,
+        (QofAccessFunc)get_checkpoint_quantity, (QofSetterFunc)set_checkpoint_quantity
+    },
+    { NULL }
+    /*@ +full_init_block @*/
+};
+
+/* Loads a split row, with its transaction's post date, as a checkpoint */
+static const GncSqlColumnTableEntry split_balance_col_table[] =
+{
+    /*@ -full_init_block @*/
+    { "account_guid",    CT_GUID,     0, 0, NULL, NULL, NULL, (QofSetterFunc)set_checkpoint_account_guid },
+    { "reconcile_state", CT_STRING,   1, 0, NULL, NULL, NULL, (QofSetterFunc)set_checkpoint_reconcile_state },
+    { "quantity",        CT_NUMERIC,  0, 0, NULL, NULL, NULL, (QofSetterFunc)set_checkpoint_quantity },
+    { "post_date",       CT_TIMESPEC, 0, 0, NULL, NULL, NULL, (QofSetterFunc)set_checkpoint_period_from_date },
+    { NULL }
+    /*@ +full_init_block @*/
+};
+
+/* Loads a split row as a checkpoint, keeping a transaction without a post date in the epoch's month */
+static void
+load_split_balance( GncSqlBackend* be, GncSqlRow* row, balance_checkpoint_t* split_bal )
+{
+    memset( split_bal, 0, sizeof(*split_bal) );
+    split_bal->period_start = balance_period_undated();
+    split_bal->quantity = gnc_numeric_zero();
+    gnc_sql_load_object( be, row, NULL, split_bal, split_balance_col_table );
+}
+
+#define SPLIT_BALANCE_SQL "SELECT s.account_guid, s.reconcile_state, s.quantity_num, s.quantity_denom, t.post_date FROM " \
+    SPLIT_TABLE " AS s, " TRANSACTION_TABLE " AS t WHERE s.tx_guid=t.guid"
+
+static guint
+checkpoint_hash( gconstpointer key )
+{
+    const balance_checkpoint_t* cp = (const balance_checkpoint_t*)key;
+
+    return guid_hash_to_guint( &cp->account_guid )
+           ^ (guint)cp->period_start.tv_sec
+           ^ (guint)cp->reconcile_state[0];
+}
+
+static gboolean
+checkpoint_equal( gconstpointer key_1, gconstpointer key_2 )
+{
+    const balance_checkpoint_t* cp_1 = (const balance_checkpoint_t*)key_1;
+    const balance_checkpoint_t* cp_2 = (const balance_checkpoint_t*)key_2;
+
+    return guid_equal( &cp_1->account_guid, &cp_2->account_guid )
+           && cp_1->period_start.tv_sec == cp_2->period_start.tv_sec
+           && cp_1->reconcile_state[0] == cp_2->reconcile_state[0];
+}
+
+static GHashTable*
+new_checkpoint_table( void )
+{
+    return g_hash_table_new_full( checkpoint_hash, checkpoint_equal, g_free, NULL );
+}
+
+/**
+ * Runs a query returning split rows (see SPLIT_BALANCE_SQL) and adds the
+ * quantities to the checkpoint for each split's account, month and
+ * reconcile state.
+ *
+ * @param be SQL backend
+ * @param sql Query
+ * @param sums Checkpoints to add to
+ * @return TRUE if successful, FALSE if error
+ */
+static gboolean
+sum_split_balances( GncSqlBackend* be, const gchar* sql, GHashTable* sums )
+{
+    GncSqlResult* result;
+    GncSqlRow* row;
+
+    result = gnc_sql_execute_select_sql( be, sql );
+    if ( result == NULL ) return FALSE;
+
+    for ( row = gnc_sql_result_get_first_row( result ); row != NULL;
+            row = gnc_sql_result_get_next_row( result ) )
+    {
+        balance_checkpoint_t split_bal;
+        balance_checkpoint_t* cp;
+
+        load_split_balance( be, row, &split_bal );
+
+        cp = g_hash_table_lookup( sums, &split_bal );
+        if ( cp == NULL )
+        {
+            cp = g_memdup( &split_bal, sizeof(split_bal) );
+            g_hash_table_insert( sums, cp, cp );
+        }
+        else
+        {
+            cp->quantity = gnc_numeric_add( cp->quantity, split_bal.quantity,
+                                            GNC_DENOM_AUTO, GNC_HOW_DENOM_LCD );
+        }
+    }
+    gnc_sql_result_dispose( result );
+
+    return TRUE;
+}
+
+typedef struct
+{
+    /*@ dependent @*/ GncSqlBackend* be;
+    gboolean is_ok;
+} write_checkpoints_t;
+
+static void
+write_checkpoint_cb( gpointer key, gpointer value, gpointer user_data )
+{
+    balance_checkpoint_t* cp = (balance_checkpoint_t*)value;
+    write_checkpoints_t* s = (write_checkpoints_t*)user_data;
+
+    if ( !s->is_ok || gnc_numeric_zero_p( cp->quantity ) ) return;
+
+    s->is_ok = gnc_sql_do_db_operation( s->be, OP_DB_INSERT, BALANCE_TABLE,
+                                        BALANCE_TABLE, cp, balance_col_table );
+}
+
+static gboolean
+write_checkpoints( GncSqlBackend* be, GHashTable* sums )
+{
+    write_checkpoints_t s;
+
+    s.be = be;
+    s.is_ok = TRUE;
+    g_hash_table_foreach( sums, write_checkpoint_cb, &s );
+
+    return s.is_ok;
+}
+
+/**
+ * Recomputes the checkpoints for one account and month from the splits.
+ *
+ * @param be SQL backend
+ * @param period Account and start of month
+ * @return TRUE if successful, FALSE if error
+ */
+static gboolean
+update_balance_checkpoint( GncSqlBackend* be, const balance_checkpoint_t* period )
+{
+    gchar guid_buf[GUID_ENCODING_LENGTH+1];
+    Timespec period_end;
+    gchar* start_str;
+    gchar* end_str;
+    gchar* sql;
+    GHashTable* sums;
+    gboolean is_ok;
+
+    (void)guid_to_string_buff( &period->account_guid, guid_buf );
+    period_end = balance_period_end( period->period_start );
+    start_str = gnc_sql_convert_timespec_to_string( be, period->period_start );
+    end_str = gnc_sql_convert_timespec_to_string( be, period_end );
+
+    sql = g_strdup_printf( "DELETE FROM %s WHERE account_guid='%s' AND period_start='%s'",
+                           BALANCE_TABLE, guid_buf, start_str );
+    is_ok = ( gnc_sql_execute_nonselect_sql( be, sql ) >= 0 );
+    g_free( sql );
+
+    if ( is_ok )
+    {
+        sql = g_strdup_printf( "%s AND s.account_guid='%s' AND ((t.post_date>='%s' AND t.post_date<'%s')%s)",
+                               SPLIT_BALANCE_SQL, guid_buf, start_str, end_str,
+                               ( period->period_start.tv_sec == balance_period_undated().tv_sec ) ?
+                               " OR t.post_date IS NULL" : "" );
+        sums = new_checkpoint_table();
+        is_ok = sum_split_balances( be, sql, sums );
+        if ( is_ok )
+        {
+            is_ok = write_checkpoints( be, sums );
+        }
+        g_hash_table_destroy( sums );
+        g_free( sql );
+    }
+
+    g_free( start_str );
+    g_free( end_str );
+
+    return is_ok;
+}
+
+/**
+ * Adds an account and month to a list of checkpoints to be recomputed.
+ *
+ * @param periods List of balance_checkpoint_t
+ * @param acct_guid Account
+ * @param period_start Start of month
+ */
+static void
+add_balance_period( GSList** periods, const GncGUID* acct_guid, Timespec period_start )
+{
+    balance_checkpoint_t* period;
+    GSList* node;
+
+    for ( node = *periods; node != NULL; node = node->next )
+    {
+        period = (balance_checkpoint_t*)node->data;
+        if ( guid_equal( &period->account_guid, acct_guid )
+                && period->period_start.tv_sec == period_start.tv_sec ) return;
+    }
+
+    period = g_new0( balance_checkpoint_t, 1 );
+    g_assert( period != NULL );
+    period->account_guid = *acct_guid;
+    period->period_start = period_start;
+    *periods = g_slist_prepend( *periods, period );
+}
+
+/**
+ * Adds the account and month of each split in the db which matches a
+ * condition to a list of checkpoints to be recomputed.
+ *
+ * @param be SQL backend
+ * @param col_name Column to match (s.guid or t.guid)
+ * @param guid Value to match
+ * @param periods List of balance_checkpoint_t
+ * @return TRUE if successful, FALSE if error
+ */
+static gboolean
+add_saved_balance_periods( GncSqlBackend* be, const gchar* col_name,
+                           const GncGUID* guid, GSList** periods )
+{
+    gchar guid_buf[GUID_ENCODING_LENGTH+1];
+    gchar* sql;
+    GncSqlResult* result;
+    GncSqlRow* row;
+
+    (void)guid_to_string_buff( guid, guid_buf );
+    sql = g_strdup_printf( "%s AND %s='%s'", SPLIT_BALANCE_SQL, col_name, guid_buf );
+    result = gnc_sql_execute_select_sql( be, sql );
+    g_free( sql );
+    if ( result == NULL ) return FALSE;
+
+    for ( row = gnc_sql_result_get_first_row( result ); row != NULL;
+            row = gnc_sql_result_get_next_row( result ) )
+    {
+        balance_checkpoint_t split_bal;
+
+        load_split_balance( be, row, &split_bal );
+        add_balance_period( periods, &split_bal.account_guid, split_bal.period_start );
+    }
+    gnc_sql_result_dispose( result );
+
+    return TRUE;
+}
+
+/**
+ * Recomputes the checkpoints in a list and frees the list.
+ *
+ * @param be SQL backend
+ * @param periods List of balance_checkpoint_t
+ * @return TRUE if successful, FALSE if error
+ */
+static gboolean
+update_balance_periods( GncSqlBackend* be, /*@ only @*/ GSList* periods )
+{
+    GSList* node;
+    gboolean is_ok = TRUE;
+
+    for ( node = periods; node != NULL; node = node->next )
+    {
+        if ( is_ok )
+        {
+            is_ok = update_balance_checkpoint( be, (balance_checkpoint_t*)node->data );
+        }
+        g_free( node->data );
+    }
+    g_slist_free( periods );
+
+    return is_ok;
+}
+
+/**
+ * Checks whether this session's commits can keep the checkpoints up to
+ * date.  Only a session which loads transactions as needed reads them,
+ * and its commits must be able to read the db to find where the changed
+ * splits used to be, which a queued commit can't.
+ *
+ * @param be SQL backend
+ * @return TRUE if commits update the checkpoints they change
+ */
+static gboolean
+commits_keep_balance_checkpoints( const GncSqlBackend* be )
+{
+    return be->load_tx_as_needed && !be->commits_are_queued;
+}
+
+/**
+ * Adds the row which marks the checkpoints as out of date for other
+ * sessions.
+ *
+ * @param be SQL backend
+ * @return TRUE if successful, FALSE if error
+ */
+static gboolean
+add_stale_checkpoints_marker( GncSqlBackend* be )
+{
+    balance_checkpoint_t marker;
+
+    memset( &marker, 0, sizeof(marker) );
+    marker.account_guid = *guid_null();
+    marker.reconcile_state[0] = NREC;
+    marker.quantity = gnc_numeric_zero();
+
+    return gnc_sql_do_db_operation( be, OP_DB_INSERT, BALANCE_TABLE,
+                                    BALANCE_TABLE, &marker, balance_col_table );
+}
+
+/**
+ * Checks whether the checkpoints have been marked as out of date.
+ *
+ * @param be SQL backend
+ * @return TRUE if they are out of date or can't be read
+ */
+static gboolean
+balance_checkpoints_are_stale( GncSqlBackend* be )
+{
+    gchar guid_buf[GUID_ENCODING_LENGTH+1];
+    gchar* sql;
+    GncSqlResult* result;
+    gboolean is_stale;
+
+    (void)guid_to_string_buff( guid_null(), guid_buf );
+    sql = g_strdup_printf( "SELECT account_guid FROM %s WHERE account_guid='%s'",
+                           BALANCE_TABLE, guid_buf );
+    result = gnc_sql_execute_select_sql( be, sql );
+    g_free( sql );
+    if ( result == NULL ) return TRUE;
+
+    is_stale = ( gnc_sql_result_get_first_row( result ) != NULL );
+    gnc_sql_result_dispose( result );
+
+    return is_stale;
+}
+
+/**
+ * Recomputes all of the checkpoints from the splits.
+ *
+ * @param be SQL backend
+ * @return TRUE if successful, FALSE if error
+ */
+static gboolean
+rebuild_balance_checkpoints( GncSqlBackend* be )
+{
+    gchar* sql;
+    GHashTable* sums;
+    gboolean is_ok;
+
+    ENTER( " " );
+
+    sql = g_strdup_printf( "DELETE FROM %s", BALANCE_TABLE );
+    is_ok = ( gnc_sql_execute_nonselect_sql( be, sql ) >= 0 );
+    g_free( sql );
+
+    if ( is_ok )
+    {
+        sums = new_checkpoint_table();
+        is_ok = sum_split_balances( be, SPLIT_BALANCE_SQL, sums );
+        if ( is_ok )
+        {
+            is_ok = write_checkpoints( be, sums );
+        }
+        g_hash_table_destroy( sums );
+    }
+    if ( is_ok && !commits_keep_balance_checkpoints( be ) )
+    {
+        // This session's commits won't keep them up to date
+        is_ok = add_stale_checkpoints_marker( be );
+    }
+    if ( is_ok )
+    {
+        be->rebuild_balance_checkpoints = FALSE;
+    }
+    else
+    {
+        // The rows may have been deleted; make other sessions rebuild them too
+        (void)add_stale_checkpoints_marker( be );
+    }
+
+    LEAVE( "" );
+
+    return is_ok;
+}
+
+static void
+free_balance_periods( /*@ only @*/ GSList* periods )
+{
+    g_slist_foreach( periods, (GFunc)g_free, NULL );
+    g_slist_free( periods );
+}
+
+/**
+ * Forgets the checkpoints collected from a committed transaction and the
+ * splits still to be written.
+ *
+ * @param be SQL backend
+ */
+static void
+forget_balance_periods( GncSqlBackend* be )
+{
+    free_balance_periods( be->balance_periods );
+    be->balance_periods = NULL;
+    if ( be->unwritten_splits != NULL )
+    {
+        g_hash_table_destroy( be->unwritten_splits );
+        be->unwritten_splits = NULL;
+    }
+}
+
+/**
+ * Recomputes the checkpoints collected from a committed transaction.  Any
+ * of its splits which haven't been written yet update their own
+ * checkpoints when they are.
+ *
+ * @param be SQL backend
+ * @return TRUE if successful, FALSE if error
+ */
+static gboolean
+flush_balance_periods( GncSqlBackend* be )
+{
+    GSList* periods = be->balance_periods;
+
+    be->balance_periods = NULL;
+    forget_balance_periods( be );
+    if ( be->rebuild_balance_checkpoints )
+    {
+        free_balance_periods( periods );
+        return TRUE;
+    }
+    if ( !update_balance_periods( be, periods ) )
+    {
+        // Rebuild them before they are read again
+        be->rebuild_balance_checkpoints = TRUE;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Decides whether a commit keeps the checkpoints up to date.  Otherwise
+ * the commit only notes that they are now out of date.
+ *
+ * @param be SQL backend
+ * @return TRUE if the commit should update the checkpoints it changes
+ */
+static gboolean
+keep_balance_checkpoints( GncSqlBackend* be )
+{
+    if ( !commits_keep_balance_checkpoints( be ) )
+    {
+        be->rebuild_balance_checkpoints = TRUE;
+    }
+
+    return !be->rebuild_balance_checkpoints;
+}
+
+/**
+ * Brings the checkpoints up to date before they are read.
+ *
+ * @param be SQL backend
+ * @return TRUE if successful, FALSE if error
+ */
+static gboolean
+refresh_balance_checkpoints( GncSqlBackend* be )
+{
+    gboolean is_ok;
+
+    is_ok = flush_balance_periods( be );
+    if ( be->rebuild_balance_checkpoints )
+    {
+        is_ok = rebuild_balance_checkpoints( be );
+    }
+
+    return is_ok;
+}
+
+/**
+ * Writes the checkpoints after a whole book has been saved, if this
+ * session reads them.
+ *
+ * @param be SQL backend
+ * @return TRUE if successful, FALSE if error
+ */
+static gboolean
+write_balance_checkpoints( GncSqlBackend* be )
+{
+    g_return_val_if_fail( be != NULL, FALSE );
+
+    if ( !be->rebuild_balance_checkpoints || !be->load_tx_as_needed ) return TRUE;
+
+    return rebuild_balance_checkpoints( be );
+}
+
+/**
+ * Adds a split's quantity to balances using the same rules as
+ * xaccAccountRecomputeBalance().
+ */
+static void
+add_to_account_balances( acct_balances_t* bal, gchar reconcile_state, gnc_numeric quantity )
+{
+    bal->balance = gnc_numeric_add( bal->balance, quantity,
+                                    GNC_DENOM_AUTO, GNC_HOW_DENOM_LCD );
+    if ( reconcile_state != NREC )
+    {
+        bal->cleared_balance = gnc_numeric_add( bal->cleared_balance, quantity,
+                                                GNC_DENOM_AUTO, GNC_HOW_DENOM_LCD );
+    }
+    if ( reconcile_state == YREC || reconcile_state == FREC )
+    {
+        bal->reconciled_balance = gnc_numeric_add( bal->reconciled_balance, quantity,
+                                  GNC_DENOM_AUTO, GNC_HOW_DENOM_LCD );
+    }
+}
+
+static void
+add_checkpoint_to_balances_cb( gpointer key, gpointer value, gpointer user_data )
+{
+    balance_checkpoint_t* cp = (balance_checkpoint_t*)value;
+
+    add_to_account_balances( (acct_balances_t*)user_data, cp->reconcile_state[0], cp->quantity );
+}
+
+gboolean
+gnc_sql_get_account_balances_as_of( GncSqlBackend* be, Account* acct,
+                                    Timespec date, acct_balances_t* bal )
+{
+    gchar guid_buf[GUID_ENCODING_LENGTH+1];
+    Timespec period_start;
+    gchar* start_str;
+    gchar* date_str;
+    gchar* sql;
+    GncSqlResult* result;
+    GHashTable* sums;
+    gboolean is_ok = TRUE;
+
+    g_return_val_if_fail( be != NULL, FALSE );
+    g_return_val_if_fail( acct != NULL, FALSE );
+    g_return_val_if_fail( bal != NULL, FALSE );
+
+    bal->acct = acct;
+    bal->balance = gnc_numeric_zero();
+    bal->cleared_balance = gnc_numeric_zero();
+    bal->reconciled_balance = gnc_numeric_zero();
+
+    if ( !refresh_balance_checkpoints( be ) ) return FALSE;
+
+    (void)guid_to_string_buff( qof_instance_get_guid( QOF_INSTANCE(acct) ), guid_buf );
+    period_start = balance_period_start( date );
+    start_str = gnc_sql_convert_timespec_to_string( be, period_start );
+    date_str = gnc_sql_convert_timespec_to_string( be, date );
+
+    // The months before the date's month
+    sql = g_strdup_printf( "SELECT * FROM %s WHERE account_guid='%s' AND period_start<'%s'",
+                           BALANCE_TABLE, guid_buf, start_str );
+    result = gnc_sql_execute_select_sql( be, sql );
+    g_free( sql );
+    if ( result != NULL )
+    {
+        GncSqlRow* row;
+
+        for ( row = gnc_sql_result_get_first_row( result ); row != NULL;
+                row = gnc_sql_result_get_next_row( result ) )
+        {
+            balance_checkpoint_t cp;
+
+            memset( &cp, 0, sizeof(cp) );
+            cp.quantity = gnc_numeric_zero();
+            gnc_sql_load_object( be, row, NULL, &cp, balance_col_table );
+            add_to_account_balances( bal, cp.reconcile_state[0], cp.quantity );
+        }
+        gnc_sql_result_dispose( result );
+    }
+    else
+    {
+        is_ok = FALSE;
+    }
+
+    // The splits earlier in the date's month
+    if ( is_ok )
+    {
+        sql = g_strdup_printf( "%s AND s.account_guid='%s' AND ((t.post_date>='%s' AND t.post_date<'%s')%s)",
+                               SPLIT_BALANCE_SQL, guid_buf, start_str, date_str,
+                               ( period_start.tv_sec == balance_period_undated().tv_sec
+                                 && date.tv_sec > 0 ) ?
+                               " OR t.post_date IS NULL" : "" );
+        sums = new_checkpoint_table();
+        is_ok = sum_split_balances( be, sql, sums );
+        g_hash_table_foreach( sums, add_checkpoint_to_balances_cb, bal );
+        g_hash_table_destroy( sums );
+        g_free( sql );
+    }
+
+    g_free( start_str );
+    g_free( date_str );
+
+    return is_ok;
+}
+
+/* ================================================================= */
+/**
+ * Creates the transaction, split and balance checkpoint tables.
+ *
+ * @param be SQL backend
+ */
+static void
+create_transaction_tables( GncSqlBackend* be )
+{
+    gint version;
+    gboolean ok;
+
+    g_return_if_fail( be != NULL );
+
+    version = gnc_sql_get_table_version( be, TRANSACTION_TABLE );
+    if ( version == 0 )
+    {
+        (void)gnc_sql_create_table( be, TRANSACTION_TABLE, TX_TABLE_VERSION, tx_col_table );
+        ok = gnc_sql_create_index( be, "tx_post_date_index", TRANSACTION_TABLE, post_date_col_table );
+        if ( !ok )
+        {
+            PERR( "Unable to create index\n" );
+        }
+    }
+    else if ( version < TX_TABLE_VERSION )
+    {
+        /* Upgrade:
+            1->2: 64 bit int handling
+        	2->3: allow dates to be NULL
+        */
+        gnc_sql_upgrade_table( be, TRANSACTION_TABLE, tx_col_table );
+        (void)gnc_sql_set_table_version( be, TRANSACTION_TABLE, TX_TABLE_VERSION );
+    }
+
+    version = gnc_sql_get_table_version( be, SPLIT_TABLE );
+    if ( version == 0 )
+    {
+        (void)gnc_sql_create_table( be, SPLIT_TABLE, SPLIT_TABLE_VERSION, split_col_table );
+        ok = gnc_sql_create_index( be, "splits_tx_guid_index", SPLIT_TABLE, tx_guid_col_table );
+        if ( !ok )
+        {
+            PERR( "Unable to create index\n" );
+        }
+        ok = gnc_sql_create_index( be, "splits_account_guid_index", SPLIT_TABLE, account_guid_col_table );
+        if ( !ok )
+        {
+            PERR( "Unable to create index\n" );
+        }
+    }
+    else if ( version < SPLIT_TABLE_VERSION )
+    {
+
+        /* Upgrade:
+           1->2: 64 bit int handling
+           3->4: Split reconcile date can be NULL */
+        gnc_sql_upgrade_table( be, SPLIT_TABLE, split_col_table );
+        ok = gnc_sql_create_index( be, "splits_tx_guid_index", SPLIT_TABLE, tx_guid_col_table );
+        if ( !ok )
+        {
+            PERR( "Unable to create index\n" );
+        }
+        ok = gnc_sql_create_index( be, "splits_account_guid_index", SPLIT_TABLE, account_guid_col_table );
+        if ( !ok )
+        {
+            PERR( "Unable to create index\n" );
+        }
+        (void)gnc_sql_set_table_version( be, SPLIT_TABLE, SPLIT_TABLE_VERSION );
+    }
+
+    version = gnc_sql_get_table_version( be, BALANCE_TABLE );
+    if ( version == 0 )
+    {
+        (void)gnc_sql_create_table( be, BALANCE_TABLE, BALANCE_TABLE_VERSION, balance_col_table );
+        ok = gnc_sql_create_index( be, "balance_checkpoints_account_guid_index", BALANCE_TABLE, account_guid_col_table );
+        if ( !ok )
+        {
+            PERR( "Unable to create index\n" );
+        }
+
+        /* A book being saved to a pristine db gets its checkpoints once all
+           of the splits have been written.  An existing db gets them when
+           they are first read. */
+        be->rebuild_balance_checkpoints = TRUE;
+        (void)add_stale_checkpoints_marker( be );
+    }
+    else if ( version < BALANCE_TABLE_VERSION )
+    {
+        /* Upgrade:
+           1->2: months are UTC instead of local time */
+        be->rebuild_balance_checkpoints = TRUE;
+        (void)add_stale_checkpoints_marker( be );
+        (void)gnc_sql_set_table_version( be, BALANCE_TABLE, BALANCE_TABLE_VERSION );
+    }
+    else
+    {
+        be->rebuild_balance_checkpoints = balance_checkpoints_are_stale( be );
+        if ( !be->rebuild_balance_checkpoints && !commits_keep_balance_checkpoints( be ) )
+        {
+            // This session's commits won't keep them up to date
+            (void)add_stale_checkpoints_marker( be );
+        }
+    }
+}
+/* ================================================================= */
+/**
+ * Callback function to delete slots for a split
+ *
+ * @param data Split
+ * @param user_data split_info_t structure contain operation info
+ */
+static void
+delete_split_slots_cb( gpointer data, gpointer user_data )
+{
+    split_info_t* split_info = (split_info_t*)user_data;
+    Split* pSplit = GNC_SPLIT(data);
+
+    g_return_if_fail( data != NULL );
+    g_return_if_fail( GNC_IS_SPLIT(data) );
+    g_return_if_fail( user_data != NULL );
+
+    if ( split_info->is_ok )
+    {
+        split_info->is_ok = gnc_sql_slots_delete( split_info->be,
+                            qof_instance_get_guid( QOF_INSTANCE(pSplit) ) );
+    }
+}
+
+/**
+ * Deletes all of the splits for a transaction
+ *
+ * @param be SQL backend
+ * @param pTx Transaction
+ * @return TRUE if successful, FALSE if unsuccessful
+ */
+static gboolean
+delete_splits( GncSqlBackend* be, Transaction* pTx )
+{
+    split_info_t split_info;
+
+    g_return_val_if_fail( be != NULL, FALSE );
+    g_return_val_if_fail( pTx != NULL, FALSE );
+
+    if ( !gnc_sql_do_db_operation( be, OP_DB_DELETE, SPLIT_TABLE,
+                                   SPLIT_TABLE, pTx, tx_guid_col_table ) )
+    {
+        return FALSE;
+    }
+    split_info.be = be;
+    split_info.is_ok = TRUE;
+
+    g_list_foreach( xaccTransGetSplitList( pTx ), delete_split_slots_cb, &split_info );
+
+    return split_info.is_ok;
+}
+
+/**
+ * Collects the checkpoints to recompute for a transaction being committed:
+ * each account and month its splits are in now and were in the db before
+ * the commit, including splits which have moved from another transaction.
+ * The splits which the engine will commit next are remembered so that the
+ * checkpoints are recomputed once they have all been written.
+ *
+ * @param be SQL backend
+ * @param pTx Transaction
+ * @param op Operation being done to the transaction
+ * @return TRUE if successful, FALSE if error
+ */
+static gboolean
+add_transaction_balance_periods( GncSqlBackend* be, Transaction* pTx, gint op )
+{
+    gchar guid_buf[GUID_ENCODING_LENGTH+1];
+    GString* sql;
+    GList* node;
+    Timespec period_start;
+    gboolean has_saved_splits = ( op != OP_DB_INSERT );
+    gboolean is_ok = TRUE;
+
+    period_start = balance_period_start( xaccTransRetDatePostedTS( pTx ) );
+    (void)guid_to_string_buff( qof_instance_get_guid( QOF_INSTANCE(pTx) ), guid_buf );
+    sql = g_string_new( NULL );
+    g_string_printf( sql, "%s AND (t.guid='%s' OR s.guid IN (''", SPLIT_BALANCE_SQL, guid_buf );
+
+    be->unwritten_splits = g_hash_table_new( g_direct_hash, g_direct_equal );
+    for ( node = xaccTransGetSplitList( pTx ); node != NULL; node = node->next )
+    {
+        Split* pSplit = GNC_SPLIT(node->data);
+        QofInstance* split_inst = QOF_INSTANCE(pSplit);
+        Account* acct = xaccSplitGetAccount( pSplit );
+
+        if ( xaccSplitGetParent( pSplit ) != pTx ) continue;
+
+        if ( op != OP_DB_DELETE && !qof_instance_get_destroying( split_inst ) && acct != NULL )
+        {
+            add_balance_period( &be->balance_periods,
+                                qof_instance_get_guid( QOF_INSTANCE(acct) ), period_start );
+        }
+
+        // Destroying a transaction destroys all of its splits
+        if ( op == OP_DB_DELETE || qof_instance_is_dirty( split_inst ) )
+        {
+            g_hash_table_insert( be->unwritten_splits, pSplit, pSplit );
+            if ( !qof_instance_get_infant( split_inst ) )
+            {
+                (void)guid_to_string_buff( qof_instance_get_guid( split_inst ), guid_buf );
+                g_string_append_printf( sql, ",'%s'", guid_buf );
+                has_saved_splits = TRUE;
+            }
+        }
+    }
+    g_string_append( sql, "))" );
+
+    if ( has_saved_splits )
+    {
+        GncSqlResult* result = gnc_sql_execute_select_sql( be, sql->str );
+
+        if ( result != NULL )
+        {
+            GncSqlRow* row;
+
+            for ( row = gnc_sql_result_get_first_row( result ); row != NULL;
+                    row = gnc_sql_result_get_next_row( result ) )
+            {
+                balance_checkpoint_t split_bal;
+
+                load_split_balance( be, row, &split_bal );
+                add_balance_period( &be->balance_periods, &split_bal.account_guid,
+                                    split_bal.period_start );
+            }
+            gnc_sql_result_dispose( result );
+        }
+        else
+        {
+            is_ok = FALSE;
+        }
+    }
+    (void)g_string_free( sql, TRUE );
+
+    return is_ok;
+}
+
+/**
+ * Commits a split to the database
+ *
+ * @param be SQL backend
+ * @param inst Split
+ * @return TRUE if successful, FALSE if error
+ */
+static gboolean
+commit_split( GncSqlBackend* be, QofInstance* inst )
+{
+    gint op;
+    gboolean is_infant;
+    gboolean is_ok = TRUE;
+    gboolean is_tx_split = FALSE;
+    gboolean keep_checkpoints = FALSE;
+    GSList* periods = NULL;
+
+    g_return_val_if_fail( inst != NULL, FALSE );
+    g_return_val_if_fail( be != NULL, FALSE );
+
+    is_infant = qof_instance_get_infant( inst );
+    if ( qof_instance_get_destroying( inst ) )
+    {
+        op = OP_DB_DELETE;
+    }
+    else if ( gnc_sql_instance_needs_insert( be, inst ) )
+    {
+        op = OP_DB_INSERT;
+    }
+    else
+    {
+        op = OP_DB_UPDATE;
+    }
+
+    // A split of a committed transaction was collected with the transaction
+    if ( be->unwritten_splits != NULL )
+    {
+        is_tx_split = g_hash_table_remove( be->unwritten_splits, inst );
+    }
+    if ( !is_tx_split )
+    {
+        keep_checkpoints = keep_balance_checkpoints( be );
+    }
+
+    // Remember where the split was so that its old checkpoint can be updated
+    if ( keep_checkpoints && op != OP_DB_INSERT )
+    {
+        is_ok = add_saved_balance_periods( be, "s.guid", qof_instance_get_guid( inst ), &periods );
+    }
+    if ( is_ok )
+    {
+        is_ok = gnc_sql_do_db_operation( be, op, SPLIT_TABLE, GNC_ID_SPLIT, inst, split_col_table );
+    }
+    if ( is_ok )
+    {
+        is_ok = gnc_sql_slots_save( be,
+                                    qof_instance_get_guid( inst ),
+                                    is_infant,
+                                    qof_instance_get_slots( inst ) );
+    }
+    if ( keep_checkpoints )
+    {
+        Split* pSplit = GNC_SPLIT(inst);
+        Account* acct = xaccSplitGetAccount( pSplit );
+        Transaction* pTx = xaccSplitGetParent( pSplit );
+
+        if ( is_ok && op != OP_DB_DELETE && acct != NULL && pTx != NULL )
+        {
+            add_balance_period( &periods, qof_instance_get_guid( QOF_INSTANCE(acct) ),
+                                balance_period_start( xaccTransRetDatePostedTS( pTx ) ) );
+        }
+        if ( is_ok )
+        {
+            is_ok = update_balance_periods( be, periods );
+        }
+        else
+        {
+            free_balance_periods( periods );
+        }
+    }
+    else if ( is_tx_split && g_hash_table_size( be->unwritten_splits ) == 0 )
+    {
+        if ( is_ok )
+        {
+            is_ok = flush_balance_periods( be );
+        }
+        else
+        {
+            forget_balance_periods( be );
+            be->rebuild_balance_checkpoints = TRUE;
+        }
+    }
+
+    return is_ok;
+}
+
+static void
+save_split_cb( gpointer data, gpointer user_data )
+{
+    split_info_t* split_info = (split_info_t*)user_data;
+    Split* pSplit = GNC_SPLIT(data);
+
+    g_return_if_fail( data != NULL );
+    g_return_if_fail( GNC_IS_SPLIT(data) );
+    g_return_if_fail( user_data != NULL );
+
+    if ( split_info->is_ok )
+    {
+        split_info->is_ok = commit_split( split_info->be, QOF_INSTANCE(pSplit) );
+    }
+}
+
+static gboolean
+save_splits( GncSqlBackend* be, const GncGUID* tx_guid, SplitList* pSplitList )
+{
+    split_info_t split_info;
+
+    g_return_val_if_fail( be != NULL, FALSE );
+    g_return_val_if_fail( tx_guid != NULL, FALSE );
+    g_return_val_if_fail( pSplitList != NULL, FALSE );
+
+    split_info.be = be;
+    split_info.guid = tx_guid;
+    split_info.is_ok = TRUE;
+    g_list_foreach( pSplitList, save_split_cb, &split_info );
+
+    return split_info.is_ok;
 }
 
 static gboolean
@@ -704,7 +1749,7 @@ save_transaction( GncSqlBackend* be, Transaction* pTx, gboolean do_save_splits )
     {
         op = OP_DB_DELETE;
     }
-    else if ( be->is_pristine_db || is_infant )
+    else if ( gnc_sql_instance_needs_insert( be, inst ) )
     {
         op = OP_DB_INSERT;
     }
@@ -719,6 +1764,18 @@ save_transaction( GncSqlBackend* be, Transaction* pTx, gboolean do_save_splits )
         is_ok = gnc_sql_save_commodity( be, xaccTransGetCurrency( pTx ) );
     }
 
+    // Finish with the previous transaction, even if its splits weren't all committed
+    if ( is_ok )
+    {
+        is_ok = flush_balance_periods( be );
+    }
+
+    // Remember where the splits were so that their old checkpoints can be updated
+    if ( is_ok && keep_balance_checkpoints( be ) )
+    {
+        is_ok = add_transaction_balance_periods( be, pTx, op );
+    }
+
     if ( is_ok )
     {
         is_ok = gnc_sql_do_db_operation( be, op, TRANSACTION_TABLE, GNC_ID_TRANS, pTx, tx_col_table );
@@ -746,6 +1803,16 @@ save_transaction( GncSqlBackend* be, Transaction* pTx, gboolean do_save_splits )
         }
     }
 
+    if ( !is_ok )
+    {
+        forget_balance_periods( be );
+    }
+    else if ( be->unwritten_splits != NULL && g_hash_table_size( be->unwritten_splits ) == 0 )
+    {
+        // None of the splits will be committed, so recompute the checkpoints now
+        is_ok = flush_balance_periods( be );
+    }
+
     return is_ok;
 }
 
@@ -812,7 +1879,6 @@ void gnc_sql_transaction_load_tx_for_account( GncSqlBackend* be, Account* accoun
     const GncGUID* guid;
     gchar guid_buf[GUID_ENCODING_LENGTH+1];
     gchar* query_sql;
-    GncSqlStatement* stmt;
 
     g_return_if_fail( be != NULL );
     g_return_if_fail( account != NULL );
@@ -820,451 +1886,944 @@ void gnc_sql_transaction_load_tx_for_account( GncSqlBackend* be, Account* accoun
     guid = qof_instance_get_guid( QOF_INSTANCE(account) );
     (void)guid_to_string_buff( guid, guid_buf );
     query_sql = g_strdup_printf(
-                    "SELECT DISTINCT t.* FROM %s AS t, %s AS s WHERE s.tx_guid=t.guid AND s.account_guid ='%s'",
+                    "SELECT DISTINCT t.guid FROM %s AS t, %s AS s WHERE s.tx_guid=t.guid AND s.account_guid ='%s'",
                     TRANSACTION_TABLE, SPLIT_TABLE, guid_buf );
-    stmt = gnc_sql_create_statement_from_sql( be, query_sql );
+    query_transactions( be, query_sql );
+    g_free( query_sql );
+}
+
+static void
+mark_account_splits_complete( Account* acc, gpointer data )
+{
+    gnc_account_set_splits_incomplete( acc, FALSE );
+}
+
+/**
+ * Loads all transactions.  This might be used during a save-as operation to ensure that
+ * all data is in memory and ready to be saved.
+ *
+ * @param be SQL backend
+ */
+void gnc_sql_transaction_load_all_tx( GncSqlBackend* be )
+{
+    gchar* query_sql;
+
+    g_return_if_fail( be != NULL );
+
+    query_sql = g_strdup_printf( "SELECT guid FROM %s", TRANSACTION_TABLE );
+    query_transactions( be, query_sql );
     g_free( query_sql );
-    if ( stmt != NULL )
+
+    // Every account now has all of its splits
+    if ( be->load_tx_as_needed )
+    {
+        gnc_account_foreach_descendant( gnc_book_get_root_account( be->primary_book ),
+                                        mark_account_splits_complete, NULL );
+    }
+}
+
+/* ----------------------------------------------------------------- */
+/*
+ * Query compilation
+ *
+ * Split and transaction queries are compiled into a SELECT of the
+ * transactions which can have matching objects.  The engine still runs
+ * the query itself over the objects in memory afterwards, so the SELECT
+ * may load more transactions than match, but it must never load fewer.
+ * Each term is therefore converted either exactly or into a condition
+ * which accepts a superset of what the engine accepts, and a term which
+ * can't be converted either way is left out.  A term which every row
+ * satisfies, such as the book term added by qof_query_set_book(), is left
+ * out too but still counts as exact.  When every term is converted
+ * exactly, max_results can be applied in the database too.
+ */
+#define SLOTS_TABLE "slots"
+
+typedef enum
+{
+    TERM_NOT_CONVERTED,
+    TERM_SUPERSET,
+    TERM_EXACT,
+    TERM_ALWAYS_TRUE
+} term_conversion_t;
+
+typedef term_conversion_t (*TermConverter)( const GncSqlBackend* be, /*@ null @*/ GSList* paramPath,
+        QofQueryTerm* term, GString* sql );
+
+typedef struct
+{
+    /*@ null @*/
+    gchar* sql;
+    gboolean has_been_run;
+} tx_query_info_t;
+
+static QofQueryCompare
+get_effective_comparison( QofQueryCompare how, gboolean isInverted )
+{
+    if ( !isInverted ) return how;
+
+    switch ( how )
+    {
+    case QOF_COMPARE_LT:
+        return QOF_COMPARE_GTE;
+    case QOF_COMPARE_LTE:
+        return QOF_COMPARE_GT;
+    case QOF_COMPARE_EQUAL:
+        return QOF_COMPARE_NEQ;
+    case QOF_COMPARE_GT:
+        return QOF_COMPARE_LTE;
+    case QOF_COMPARE_GTE:
+        return QOF_COMPARE_LT;
+    case QOF_COMPARE_NEQ:
+        return QOF_COMPARE_EQUAL;
+    default:
+        return how;
+    }
+}
+
+static /*@ null @*/ const gchar*
+convert_query_comparison_to_sql( QofQueryCompare how )
+{
+    switch ( how )
+    {
+    case QOF_COMPARE_LT:
+        return "<";
+    case QOF_COMPARE_LTE:
+        return "<=";
+    case QOF_COMPARE_EQUAL:
+        return "=";
+    case QOF_COMPARE_GT:
+        return ">";
+    case QOF_COMPARE_GTE:
+        return ">=";
+    case QOF_COMPARE_NEQ:
+        return "<>";
+    default:
+        PERR( "Unknown comparison type %d\n", how );
+        return NULL;
+    }
+}
+
+static gboolean
+comparison_matches( QofQueryCompare how, gint compare )
+{
+    switch ( how )
+    {
+    case QOF_COMPARE_LT:
+        return compare < 0;
+    case QOF_COMPARE_LTE:
+        return compare <= 0;
+    case QOF_COMPARE_EQUAL:
+        return compare == 0;
+    case QOF_COMPARE_GT:
+        return compare > 0;
+    case QOF_COMPARE_GTE:
+        return compare >= 0;
+    case QOF_COMPARE_NEQ:
+        return compare != 0;
+    default:
+        return FALSE;
+    }
+}
+
+static void
+append_double( GString* sql, gdouble d )
+{
+    gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+    // Not printf(), which would use the locale's decimal point
+    g_string_append( sql, g_ascii_dtostr( buf, (gint)sizeof(buf), d ) );
+}
+
+static term_conversion_t
+convert_guid_term_to_sql( const gchar* fieldName, QofQueryTerm* term, GString* sql )
+{
+    query_guid_t guid_data = (query_guid_t)qof_query_term_get_pred_data( term );
+    gboolean match_any;
+    GList* guid_entry;
+
+    switch ( guid_data->options )
+    {
+    case QOF_GUID_MATCH_ANY:
+        match_any = TRUE;
+        break;
+
+    case QOF_GUID_MATCH_NONE:
+        match_any = FALSE;
+        break;
+
+    default:
+        return TERM_NOT_CONVERTED;
+    }
+    if ( qof_query_term_is_inverted( term ) ) match_any = !match_any;
+    if ( guid_data->guids == NULL ) return TERM_NOT_CONVERTED;
+
+    g_string_append_printf( sql, "%s %s (", fieldName, match_any ? "IN" : "NOT IN" );
+    for ( guid_entry = guid_data->guids; guid_entry != NULL; guid_entry = guid_entry->next )
+    {
+        gchar guid_buf[GUID_ENCODING_LENGTH+1];
+
+        if ( guid_entry != guid_data->guids ) g_string_append( sql, "," );
+        (void)guid_to_string_buff( guid_entry->data, guid_buf );
+        g_string_append_printf( sql, "'%s'", guid_buf );
+    }
+    g_string_append( sql, ")" );
+
+    return TERM_EXACT;
+}
+
+/**
+ * Checks a term on the object's book.  Everything in the db belongs to
+ * the primary book, so a match on that book is true for every row.
+ *
+ * @param be SQL backend
+ * @param paramPath Path of the field, starting from the book
+ * @param term Query term
+ * @return TERM_ALWAYS_TRUE if the term matches the primary book
+ */
+static term_conversion_t
+convert_book_term_to_sql( const GncSqlBackend* be, GSList* paramPath, QofQueryTerm* term )
+{
+    query_guid_t guid_data = (query_guid_t)qof_query_term_get_pred_data( term );
+    GList* guid_entry;
+
+    if ( be->primary_book == NULL || paramPath->next == NULL || paramPath->next->next != NULL
+            || strcmp( paramPath->next->data, QOF_PARAM_GUID ) != 0
+            || !term_has_type( term, QOF_TYPE_GUID ) )
+    {
+        return TERM_NOT_CONVERTED;
+    }
+    if ( guid_data->options != QOF_GUID_MATCH_ANY || qof_query_term_is_inverted( term ) )
+    {
+        return TERM_NOT_CONVERTED;
+    }
+
+    for ( guid_entry = guid_data->guids; guid_entry != NULL; guid_entry = guid_entry->next )
+    {
+        if ( guid_equal( guid_entry->data, qof_instance_get_guid( QOF_INSTANCE(be->primary_book) ) ) )
+        {
+            return TERM_ALWAYS_TRUE;
+        }
+    }
+
+    return TERM_NOT_CONVERTED;
+}
+
+static term_conversion_t
+convert_char_term_to_sql( const gchar* fieldName, QofQueryTerm* term, GString* sql )
+{
+    query_char_t char_data = (query_char_t)qof_query_term_get_pred_data( term );
+    gboolean match_any;
+    const gchar* c;
+
+    switch ( char_data->options )
+    {
+    case QOF_CHAR_MATCH_ANY:
+        match_any = TRUE;
+        break;
+
+    case QOF_CHAR_MATCH_NONE:
+        match_any = FALSE;
+        break;
+
+    default:
+        return TERM_NOT_CONVERTED;
+    }
+    if ( qof_query_term_is_inverted( term ) ) match_any = !match_any;
+    if ( char_data->char_list == NULL || char_data->char_list[0] == '\0' ) return TERM_NOT_CONVERTED;
+    for ( c = char_data->char_list; *c != '\0'; c++ )
+    {
+        if ( !g_ascii_isalnum( *c ) ) return TERM_NOT_CONVERTED;
+    }
+
+    g_string_append_printf( sql, "%s %s (", fieldName, match_any ? "IN" : "NOT IN" );
+    for ( c = char_data->char_list; *c != '\0'; c++ )
+    {
+        if ( c != char_data->char_list ) g_string_append( sql, "," );
+        g_string_append_printf( sql, "'%c'", *c );
+    }
+    g_string_append( sql, ")" );
+
+    return TERM_EXACT;
+}
+
+static term_conversion_t
+convert_date_term_to_sql( const GncSqlBackend* be, const gchar* fieldName, QofQueryTerm* term, GString* sql )
+{
+    QofQueryPredData* pPredData = qof_query_term_get_pred_data( term );
+    query_date_t date_data = (query_date_t)pPredData;
+    QofQueryCompare how;
+    Timespec date;
+    Timespec epoch = { 0, 0 };
+    const gchar* op;
+    gchar* datebuf;
+
+    if ( date_data->options != QOF_DATE_MATCH_NORMAL ) return TERM_NOT_CONVERTED;
+
+    how = get_effective_comparison( pPredData->how, qof_query_term_is_inverted( term ) );
+    date = date_data->date;
+    if ( date.tv_nsec < 0 ) return TERM_NOT_CONVERTED;
+
+    // Dates are stored in whole seconds, so a fraction of a second moves
+    // the boundary up to the next whole second
+    if ( date.tv_nsec > 0 )
+    {
+        if ( how == QOF_COMPARE_EQUAL || how == QOF_COMPARE_NEQ ) return TERM_NOT_CONVERTED;
+        if ( how == QOF_COMPARE_LT ) how = QOF_COMPARE_LTE;
+        if ( how == QOF_COMPARE_GTE ) how = QOF_COMPARE_GT;
+        date.tv_nsec = 0;
+    }
+
+    op = convert_query_comparison_to_sql( how );
+    if ( op == NULL ) return TERM_NOT_CONVERTED;
+
+    // A missing date is the epoch to the engine
+    datebuf = gnc_sql_convert_timespec_to_string( be, date );
+    g_string_append_printf( sql, "(%s %s %s %s '%s')", fieldName,
+                            comparison_matches( how, timespec_cmp( &epoch, &date ) ) ? "IS NULL OR" : "IS NOT NULL AND",
+                            fieldName, op, datebuf );
+    g_free( datebuf );
+
+    return TERM_EXACT;
+}
+
+static term_conversion_t
+convert_string_term_to_sql( const GncSqlBackend* be, const gchar* fieldName, QofQueryTerm* term, GString* sql )
+{
+    QofQueryPredData* pPredData = qof_query_term_get_pred_data( term );
+    query_string_t string_data = (query_string_t)pPredData;
+    QofQueryCompare how;
+    const gchar* c;
+    gchar* pattern;
+    gchar* quoted_pattern;
+
+    // A regular expression can't be matched portably, and NOT LIKE would
+    // leave out strings which only differ in case from the match string
+    how = get_effective_comparison( pPredData->how, qof_query_term_is_inverted( term ) );
+    if ( string_data->is_regex || how != QOF_COMPARE_EQUAL ) return TERM_NOT_CONVERTED;
+
+    // Every string contains the empty string
+    if ( string_data->matchstring == NULL || string_data->matchstring[0] == '\0' ) return TERM_NOT_CONVERTED;
+    for ( c = string_data->matchstring; *c != '\0'; c++ )
+    {
+        if ( !g_ascii_isprint( *c ) || *c == '%' || *c == '_' || *c == '\\' ) return TERM_NOT_CONVERTED;
+    }
+
+    // Matching LOWER() of the column is case insensitive whatever the
+    // collation, which is a superset of a case sensitive match
+    pattern = g_ascii_strdown( string_data->matchstring, -1 );
+    quoted_pattern = g_strdup_printf( "%%%s%%", pattern );
+    g_free( pattern );
+    pattern = gnc_sql_connection_quote_string( be->conn, quoted_pattern );
+    g_free( quoted_pattern );
+    if ( pattern == NULL ) return TERM_NOT_CONVERTED;
+
+    g_string_append_printf( sql, "LOWER(%s) LIKE %s", fieldName, pattern );
+    g_free( pattern );
+
+    return TERM_SUPERSET;
+}
+
+static term_conversion_t
+convert_numeric_term_to_sql( const gchar* numField, const gchar* denomField, QofQueryTerm* term, GString* sql )
+{
+    QofQueryPredData* pPredData = qof_query_term_get_pred_data( term );
+    query_numeric_t numeric_data = (query_numeric_t)pPredData;
+    QofQueryCompare how;
+    gdouble amount;
+    gdouble slack;
+    gchar* value_sql;
+
+    // Inverting a CREDIT or DEBIT match also inverts its sign test
+    if ( qof_query_term_is_inverted( term ) && numeric_data->options != QOF_NUMERIC_MATCH_ANY )
+    {
+        return TERM_NOT_CONVERTED;
+    }
+    if ( gnc_numeric_check( numeric_data->amount ) != GNC_ERROR_OK ) return TERM_NOT_CONVERTED;
+    how = get_effective_comparison( pPredData->how, qof_query_term_is_inverted( term ) );
+
+    // The values are compared as doubles, with enough slack either way to
+    // keep this a superset of the engine's exact comparison.  A zero denom
+    // would be a division by zero, which PostgreSQL reports as an error, so
+    // NULLIF turns it into NULL and those rows are passed on to the engine.
+    amount = gnc_numeric_to_double( numeric_data->amount );
+    slack = 1e-9 * ( 1.0 + ( amount < 0 ? -amount : amount ) );
+    value_sql = g_strdup_printf( "ABS(%s*1.0/NULLIF(%s,0))", numField, denomField );
+
+    g_string_append_printf( sql, "(%s = 0 OR (", denomField );
+    if ( numeric_data->options == QOF_NUMERIC_MATCH_CREDIT )
+    {
+        g_string_append_printf( sql, "%s <= 0 AND ", numField );
+    }
+    else if ( numeric_data->options == QOF_NUMERIC_MATCH_DEBIT )
+    {
+        g_string_append_printf( sql, "%s >= 0 AND ", numField );
+    }
+
+    switch ( how )
+    {
+    case QOF_COMPARE_LT:
+    case QOF_COMPARE_LTE:
+        g_string_append_printf( sql, "%s %s ", value_sql, convert_query_comparison_to_sql( how ) );
+        append_double( sql, amount + slack );
+        break;
+
+    case QOF_COMPARE_GT:
+    case QOF_COMPARE_GTE:
+        g_string_append_printf( sql, "%s %s ", value_sql, convert_query_comparison_to_sql( how ) );
+        append_double( sql, amount - slack );
+        break;
+
+    // The engine takes values within 1/10000 of each other, after rounding
+    // the difference to 1/100000, to be equal
+    case QOF_COMPARE_EQUAL:
+        if ( amount < 0 ) amount = -amount;
+        g_string_append_printf( sql, "%s BETWEEN ", value_sql );
+        append_double( sql, amount - 1.1e-4 - slack );
+        g_string_append( sql, " AND " );
+        append_double( sql, amount + 1.1e-4 + slack );
+        break;
+
+    case QOF_COMPARE_NEQ:
+        if ( amount < 0 ) amount = -amount;
+        g_string_append_printf( sql, "(%s < ", value_sql );
+        append_double( sql, amount - 0.9e-4 + slack );
+        g_string_append_printf( sql, " OR %s > ", value_sql );
+        append_double( sql, amount + 0.9e-4 - slack );
+        g_string_append( sql, ")" );
+        break;
+
+    default:
+        g_free( value_sql );
+        return TERM_NOT_CONVERTED;
+    }
+    g_string_append( sql, "))" );
+    g_free( value_sql );
+
+    return TERM_SUPERSET;
+}
+
+static term_conversion_t
+convert_kvp_term_to_sql( const GncSqlBackend* be, const gchar* guidField, QofQueryTerm* term, GString* sql )
+{
+    QofQueryPredData* pPredData = qof_query_term_get_pred_data( term );
+    query_kvp_t kvp_data = (query_kvp_t)pPredData;
+    term_conversion_t conversion = TERM_EXACT;
+    GString* path;
+    GSList* node;
+    gchar* quoted_path;
+    gchar* value_sql;
+    KvpValueType type;
+
+    if ( qof_query_term_is_inverted( term ) || pPredData->how != QOF_COMPARE_EQUAL ) return TERM_NOT_CONVERTED;
+    if ( kvp_data->path == NULL || kvp_data->value == NULL ) return TERM_NOT_CONVERTED;
+
+    type = kvp_value_get_type( kvp_data->value );
+    switch ( type )
+    {
+    case KVP_TYPE_GINT64:
+        value_sql = g_strdup_printf( "int64_val=%" G_GINT64_FORMAT, kvp_value_get_gint64( kvp_data->value ) );
+        break;
+
+    case KVP_TYPE_STRING:
+    {
+        gchar* quoted_value = gnc_sql_connection_quote_string( be->conn, kvp_value_get_string( kvp_data->value ) );
+
+        if ( quoted_value == NULL ) return TERM_NOT_CONVERTED;
+        value_sql = g_strdup_printf( "string_val=%s", quoted_value );
+        g_free( quoted_value );
+
+        // The collation may ignore case or trailing spaces
+        conversion = TERM_SUPERSET;
+        break;
+    }
+
+    case KVP_TYPE_GUID:
+    {
+        gchar guid_buf[GUID_ENCODING_LENGTH+1];
+
+        (void)guid_to_string_buff( kvp_value_get_guid( kvp_data->value ), guid_buf );
+        value_sql = g_strdup_printf( "guid_val='%s'", guid_buf );
+        break;
+    }
+
+    default:
+        return TERM_NOT_CONVERTED;
+    }
+
+    // Slots in sub-frames are stored under their full path
+    path = g_string_new( "" );
+    for ( node = kvp_data->path; node != NULL; node = node->next )
+    {
+        if ( node != kvp_data->path ) g_string_append( path, "/" );
+        g_string_append( path, (gchar*)node->data );
+    }
+    quoted_path = gnc_sql_connection_quote_string( be->conn, path->str );
+    (void)g_string_free( path, TRUE );
+    if ( quoted_path == NULL )
     {
-        query_transactions( be, stmt );
-        gnc_sql_statement_dispose( stmt );
+        g_free( value_sql );
+        return TERM_NOT_CONVERTED;
     }
+
+    g_string_append_printf( sql, "EXISTS (SELECT 1 FROM %s WHERE obj_guid=%s AND name=%s AND slot_type=%d AND %s)",
+                            SLOTS_TABLE, guidField, quoted_path, (gint)type, value_sql );
+    g_free( quoted_path );
+    g_free( value_sql );
+
+    return conversion;
+}
+
+static gboolean
+term_has_type( QofQueryTerm* term, const gchar* type_name )
+{
+    return safe_strcmp( qof_query_term_get_pred_data( term )->type_name, type_name ) == 0;
 }
 
 /**
- * Loads all transactions.  This might be used during a save-as operation to ensure that
- * all data is in memory and ready to be saved.
+ * Converts a term on a transaction field to SQL.
  *
  * @param be SQL backend
+ * @param paramPath Path of the field, starting from the transaction
+ * @param term Query term
+ * @param sql String to append the SQL to
+ * @return How the term was converted
  */
-void gnc_sql_transaction_load_all_tx( GncSqlBackend* be )
+static term_conversion_t
+convert_trans_term_to_sql( const GncSqlBackend* be, /*@ null @*/ GSList* paramPath, QofQueryTerm* term, GString* sql )
 {
-    gchar* query_sql;
-    GncSqlStatement* stmt;
+    const gchar* param;
 
-    g_return_if_fail( be != NULL );
+    if ( paramPath == NULL ) return TERM_NOT_CONVERTED;
+    param = (const gchar*)paramPath->data;
 
-    query_sql = g_strdup_printf( "SELECT * FROM %s", TRANSACTION_TABLE );
-    stmt = gnc_sql_create_statement_from_sql( be, query_sql );
-    g_free( query_sql );
-    if ( stmt != NULL )
+    if ( strcmp( param, QOF_PARAM_BOOK ) == 0 )
     {
-        query_transactions( be, stmt );
-        gnc_sql_statement_dispose( stmt );
+        return convert_book_term_to_sql( be, paramPath, term );
     }
-}
+    if ( paramPath->next != NULL ) return TERM_NOT_CONVERTED;
 
-static void
-convert_query_comparison_to_sql( QofQueryPredData* pPredData, gboolean isInverted, GString* sql )
-{
-    if ( pPredData->how == QOF_COMPARE_LT
-            || ( isInverted && pPredData->how == QOF_COMPARE_GTE ) )
+    if ( strcmp( param, QOF_PARAM_GUID ) == 0 && term_has_type( term, QOF_TYPE_GUID ) )
     {
-        g_string_append( sql, "<" );
+        return convert_guid_term_to_sql( "t.guid", term, sql );
     }
-    else if ( pPredData->how == QOF_COMPARE_LTE
-              || ( isInverted && pPredData->how == QOF_COMPARE_GT ) )
+    if ( strcmp( param, TRANS_DATE_POSTED ) == 0 && term_has_type( term, QOF_TYPE_DATE ) )
     {
-        g_string_append( sql, "<=" );
+        return convert_date_term_to_sql( be, "t.post_date", term, sql );
     }
-    else if ( pPredData->how == QOF_COMPARE_EQUAL
-              || ( isInverted && pPredData->how == QOF_COMPARE_NEQ ) )
+    if ( strcmp( param, TRANS_DATE_ENTERED ) == 0 && term_has_type( term, QOF_TYPE_DATE ) )
     {
-        g_string_append( sql, "=" );
+        return convert_date_term_to_sql( be, "t.enter_date", term, sql );
     }
-    else if ( pPredData->how == QOF_COMPARE_GT
-              || ( isInverted && pPredData->how == QOF_COMPARE_LTE ) )
+    if ( strcmp( param, TRANS_DESCRIPTION ) == 0 && term_has_type( term, QOF_TYPE_STRING ) )
     {
-        g_string_append( sql, ">" );
+        return convert_string_term_to_sql( be, "t.description", term, sql );
     }
-    else if ( pPredData->how == QOF_COMPARE_GTE
-              || ( isInverted && pPredData->how == QOF_COMPARE_LT ) )
+    if ( strcmp( param, TRANS_NUM ) == 0 && term_has_type( term, QOF_TYPE_STRING ) )
     {
-        g_string_append( sql, ">=" );
+        return convert_string_term_to_sql( be, "t.num", term, sql );
     }
-    else if ( pPredData->how == QOF_COMPARE_NEQ
-              || ( isInverted && pPredData->how == QOF_COMPARE_EQUAL ) )
+    if ( strcmp( param, TRANS_KVP ) == 0 && term_has_type( term, QOF_TYPE_KVP ) )
     {
-        g_string_append( sql, "~=" );
-    }
-    else
-    {
-        PERR( "Unknown comparison type\n" );
-        g_string_append( sql, "??" );
+        return convert_kvp_term_to_sql( be, "t.guid", term, sql );
     }
+
+    return TERM_NOT_CONVERTED;
 }
 
-static void
-convert_query_term_to_sql( const GncSqlBackend* be, const gchar* fieldName, QofQueryTerm* pTerm, GString* sql )
+/**
+ * Converts a term on a split field to SQL.  Terms on the split's
+ * transaction are converted as transaction terms.
+ *
+ * @param be SQL backend
+ * @param paramPath Path of the field, starting from the split
+ * @param term Query term
+ * @param sql String to append the SQL to
+ * @return How the term was converted
+ */
+static term_conversion_t
+convert_split_term_to_sql( const GncSqlBackend* be, /*@ null @*/ GSList* paramPath, QofQueryTerm* term, GString* sql )
 {
-    GSList* pParamPath;
-    QofQueryPredData* pPredData;
-    gboolean isInverted;
-    GSList* name;
-
-    g_return_if_fail( pTerm != NULL );
-    g_return_if_fail( sql != NULL );
+    const gchar* param;
 
-    pParamPath = qof_query_term_get_param_path( pTerm );
-    pPredData = qof_query_term_get_pred_data( pTerm );
-    isInverted = qof_query_term_is_inverted( pTerm );
+    if ( paramPath == NULL ) return TERM_NOT_CONVERTED;
+    param = (const gchar*)paramPath->data;
 
-    if ( safe_strcmp( pPredData->type_name, QOF_TYPE_GUID ) == 0 )
+    if ( strcmp( param, SPLIT_TRANS ) == 0 )
     {
-        query_guid_t guid_data = (query_guid_t)pPredData;
-        GList* guid_entry;
-
-        g_string_append( sql, "(" );
-        g_string_append( sql, fieldName );
-
-        switch ( guid_data->options )
-        {
-        case QOF_GUID_MATCH_ANY:
-            if ( isInverted ) g_string_append( sql, " NOT IN (" );
-            else g_string_append( sql, " IN (" );
-            break;
-
-        case QOF_GUID_MATCH_NONE:
-            if ( isInverted ) g_string_append( sql, " IN (" );
-            else g_string_append( sql, " NOT IN (" );
-            break;
-
-        default:
-            PERR( "Unexpected GncGUID match type: %d\n", guid_data->options );
-        }
-
-        for ( guid_entry = guid_data->guids; guid_entry != NULL; guid_entry = guid_entry->next )
-        {
-            gchar guid_buf[GUID_ENCODING_LENGTH+1];
-
-            if ( guid_entry != guid_data->guids ) g_string_append( sql, "," );
-            (void)guid_to_string_buff( guid_entry->data, guid_buf );
-            g_string_append_printf( sql, "'%s'", guid_buf );
-        }
-        g_string_append( sql, "))" );
-
+        return convert_trans_term_to_sql( be, paramPath->next, term, sql );
     }
-    else if ( safe_strcmp( pPredData->type_name, QOF_TYPE_CHAR ) == 0 )
+    if ( strcmp( param, SPLIT_ACCOUNT ) == 0 )
     {
-        query_char_t char_data = (query_char_t)pPredData;
-        int i;
-
-        if ( isInverted )
-        {
-            g_string_append( sql, "NOT(" );
-        }
-        if ( char_data->options == QOF_CHAR_MATCH_NONE )
-        {
-            g_string_append( sql, "NOT " );
-        }
-        g_string_append( sql, "(" );
-        for ( i = 0; char_data->char_list[i] != '\0'; i++ )
-        {
-            if ( i != 0 )
-            {
-                g_string_append( sql, " OR " );
-            }
-            g_string_append( sql, fieldName );
-            g_string_append( sql, " = '" );
-            g_string_append_c( sql, char_data->char_list[i] );
-            g_string_append( sql, "'" );
-        }
-        g_string_append( sql, ") " );
-        if ( isInverted )
+        if ( paramPath->next != NULL && paramPath->next->next == NULL
+                && strcmp( paramPath->next->data, QOF_PARAM_GUID ) == 0
+                && term_has_type( term, QOF_TYPE_GUID ) )
         {
-            g_string_append( sql, ") " );
+            return convert_guid_term_to_sql( "s.account_guid", term, sql );
         }
-
+        return TERM_NOT_CONVERTED;
     }
-    else if ( safe_strcmp( pPredData->type_name, QOF_TYPE_STRING ) == 0 )
+    if ( strcmp( param, QOF_PARAM_BOOK ) == 0 )
     {
-        query_string_t string_data = (query_string_t)pPredData;
-        sqlEscape* escape = sqlEscape_new();
-
-        if ( isInverted )
-        {
-            g_string_append( sql, "NOT(" );
-        }
-        if ( pPredData->how == QOF_COMPARE_NEQ )
-        {
-            g_string_append( sql, "NOT(" );
-        }
-        g_string_append( sql, fieldName );
-        if ( string_data->is_regex || string_data->options == QOF_STRING_MATCH_CASEINSENSITIVE )
-        {
-            PWARN( "String is_regex || option = QOF_STRING_MATCH_INSENSITIVE\n" );
-        }
-//			g_string_append( sql, " ~" );
-//		} else {
-        g_string_append( sql, " =" );
-//		}
-//		if( string_data->options == QOF_STRING_MATCH_CASEINSENSITIVE ) {
-//			g_string_append( sql, "*" );
-//		}
-        g_string_append( sql, "'" );
-        g_string_append( sql, sqlEscapeString( escape, string_data->matchstring ) );
-        g_string_append( sql, "'" );
-        if ( pPredData->how == QOF_COMPARE_NEQ )
-        {
-            g_string_append( sql, ")" );
-        }
-        if ( isInverted )
-        {
-            g_string_append( sql, ")" );
-        }
-        sqlEscape_destroy( escape );
+        return convert_book_term_to_sql( be, paramPath, term );
+    }
+    if ( paramPath->next != NULL ) return TERM_NOT_CONVERTED;
 
+    if ( strcmp( param, QOF_PARAM_GUID ) == 0 && term_has_type( term, QOF_TYPE_GUID ) )
+    {
+        return convert_guid_term_to_sql( "s.guid", term, sql );
     }
-    else
+    if ( strcmp( param, SPLIT_ACCOUNT_GUID ) == 0 && term_has_type( term, QOF_TYPE_GUID ) )
     {
-        g_string_append( sql, "(" );
-        g_string_append( sql, fieldName );
-        convert_query_comparison_to_sql( pPredData, isInverted, sql );
-
-        if ( strcmp( pPredData->type_name, QOF_TYPE_NUMERIC ) == 0 )
-        {
-            query_numeric_t pData = (query_numeric_t)pPredData;
-            double d = gnc_numeric_to_double( pData->amount );
-
-            g_string_append_printf( sql, "%f", d );
+        return convert_guid_term_to_sql( "s.account_guid", term, sql );
+    }
+    if ( strcmp( param, SPLIT_MEMO ) == 0 && term_has_type( term, QOF_TYPE_STRING ) )
+    {
+        return convert_string_term_to_sql( be, "s.memo", term, sql );
+    }
+    if ( strcmp( param, SPLIT_ACTION ) == 0 && term_has_type( term, QOF_TYPE_STRING ) )
+    {
+        return convert_string_term_to_sql( be, "s.action", term, sql );
+    }
+    if ( strcmp( param, SPLIT_RECONCILE ) == 0 && term_has_type( term, QOF_TYPE_CHAR ) )
+    {
+        return convert_char_term_to_sql( "s.reconcile_state", term, sql );
+    }
+    if ( strcmp( param, SPLIT_VALUE ) == 0 && term_has_type( term, QOF_TYPE_NUMERIC ) )
+    {
+        return convert_numeric_term_to_sql( "s.value_num", "s.value_denom", term, sql );
+    }
+    if ( strcmp( param, SPLIT_AMOUNT ) == 0 && term_has_type( term, QOF_TYPE_NUMERIC ) )
+    {
+        return convert_numeric_term_to_sql( "s.quantity_num", "s.quantity_denom", term, sql );
+    }
+    if ( strcmp( param, SPLIT_KVP ) == 0 && term_has_type( term, QOF_TYPE_KVP ) )
+    {
+        return convert_kvp_term_to_sql( be, "s.guid", term, sql );
+    }
 
-        }
-        else if ( safe_strcmp( pPredData->type_name, QOF_TYPE_DATE ) == 0 )
-        {
-            query_date_t date_data = (query_date_t)pPredData;
-            gchar* datebuf;
+    return TERM_NOT_CONVERTED;
+}
 
-            datebuf = gnc_sql_convert_timespec_to_string( be, date_data->date );
-            g_string_append_printf( sql, "'%s'", datebuf );
+/**
+ * Converts the terms of a query to an SQL condition.
+ *
+ * @param be SQL backend
+ * @param query Query
+ * @param convert_term Converter for a single term
+ * @param is_exact Set to TRUE if the condition matches the query exactly
+ * @return Condition, or NULL if nothing narrows the query down
+ */
+static /*@ null @*/ gchar*
+convert_query_terms_to_sql( const GncSqlBackend* be, QofQuery* query,
+                            TermConverter convert_term, /*@ out @*/ gboolean* is_exact )
+{
+    GString* sql;
+    GList* orTerm;
 
-        }
-        else if ( strcmp( pPredData->type_name, QOF_TYPE_INT32 ) == 0 )
-        {
-            query_int32_t pData = (query_int32_t)pPredData;
+    *is_exact = TRUE;
+    if ( !qof_query_has_terms( query ) ) return NULL;
 
-            g_string_append_printf( sql, "%d", pData->val );
+    sql = g_string_new( "" );
+    for ( orTerm = qof_query_get_terms( query ); orTerm != NULL; orTerm = orTerm->next )
+    {
+        GList* andTerm;
+        gboolean has_term = FALSE;
 
-        }
-        else if ( strcmp( pPredData->type_name, QOF_TYPE_INT64 ) == 0 )
+        if ( sql->len != 0 )
         {
-            query_int64_t pData = (query_int64_t)pPredData;
-
-            g_string_append_printf( sql, "%" G_GINT64_FORMAT, pData->val );
-
+            g_string_append( sql, " OR " );
         }
-        else if ( strcmp( pPredData->type_name, QOF_TYPE_DOUBLE ) == 0 )
+        g_string_append( sql, "(" );
+        for ( andTerm = (GList*)orTerm->data; andTerm != NULL; andTerm = andTerm->next )
         {
-            query_double_t pData = (query_double_t)pPredData;
-
-            g_string_append_printf( sql, "%f", pData->val );
+            QofQueryTerm* term = (QofQueryTerm*)andTerm->data;
+            gsize term_start = sql->len;
+            term_conversion_t conversion;
 
+            if ( has_term )
+            {
+                g_string_append( sql, " AND " );
+            }
+            conversion = (*convert_term)( be, qof_query_term_get_param_path( term ), term, sql );
+            if ( conversion == TERM_NOT_CONVERTED )
+            {
+                g_string_truncate( sql, term_start );
+                *is_exact = FALSE;
+            }
+            else if ( conversion == TERM_ALWAYS_TRUE )
+            {
+                g_string_truncate( sql, term_start );
+            }
+            else
+            {
+                has_term = TRUE;
+                if ( conversion == TERM_SUPERSET ) *is_exact = FALSE;
+            }
         }
-        else if ( strcmp( pPredData->type_name, QOF_TYPE_BOOLEAN ) == 0 )
-        {
-            query_boolean_t pData = (query_boolean_t)pPredData;
-
-            g_string_append_printf( sql, "%d", pData->val );
+        g_string_append( sql, ")" );
 
-        }
-        else
+        // Nothing narrows this OR term down, so everything has to be loaded
+        if ( !has_term )
         {
-            PERR( "Unknown query predicate type: %s\n", pPredData->type_name );
+            (void)g_string_free( sql, TRUE );
+            return NULL;
         }
-
-        g_string_append( sql, ")" );
     }
-}
 
-typedef struct
-{
-    GncSqlStatement* stmt;
-    gboolean has_been_run;
-} split_query_info_t;
+    return g_string_free( sql, FALSE );
+}
 
-static /*@ null @*/ gpointer
-compile_split_query( GncSqlBackend* be, QofQuery* query )
+/**
+ * Checks whether the primary sort of a query is on the date posted.  The
+ * default sort of both splits and transactions starts with it.
+ */
+static gboolean
+is_sorted_by_date_posted( QofQuery* query, gboolean is_split_query, /*@ out @*/ gboolean* increasing )
 {
-    const GncGUID* acct_guid;
-    gchar guid_buf[GUID_ENCODING_LENGTH+1];
-    split_query_info_t* query_info = NULL;
-    gchar* query_sql;
-
-    g_return_val_if_fail( be != NULL, NULL );
-    g_return_val_if_fail( query != NULL, NULL );
+    QofQuerySort* primary;
+    QofQuerySort* secondary;
+    QofQuerySort* tertiary;
+    GSList* path;
 
-    query_info = g_malloc( (gsize)sizeof(split_query_info_t) );
-    g_assert( query_info != NULL );
-    query_info->has_been_run = FALSE;
+    qof_query_get_sorts( query, &primary, &secondary, &tertiary );
+    path = qof_query_sort_get_param_path( primary );
+    *increasing = qof_query_sort_get_increasing( primary );
+    if ( path == NULL ) return FALSE;
 
-    if ( qof_query_has_terms( query ) )
+    if ( strcmp( path->data, QUERY_DEFAULT_SORT ) == 0 )
+    {
+        return path->next == NULL;
+    }
+    if ( is_split_query )
     {
-        GList* orterms = qof_query_get_terms( query );
-        GList* orTerm;
-        GString* sql = g_string_new( "" );
-        gboolean need_OR = FALSE;
+        if ( strcmp( path->data, SPLIT_TRANS ) != 0 || path->next == NULL ) return FALSE;
+        path = path->next;
+    }
 
-        for ( orTerm = orterms; orTerm != NULL; orTerm = orTerm->next )
-        {
-            GList* andterms = (GList*)orTerm->data;
-            GList* andTerm;
-            gboolean need_AND = FALSE;
-            gboolean has_tx_guid_check = FALSE;
+    return strcmp( path->data, TRANS_DATE_POSTED ) == 0 && path->next == NULL
+           && qof_query_sort_get_sort_options( primary ) == 0;
+}
 
-            if ( need_OR )
-            {
-                g_string_append( sql, " OR " );
-            }
-            g_string_append( sql, "(" );
-            for ( andTerm = andterms; andTerm != NULL; andTerm = andTerm->next )
-            {
-                QofQueryTerm* term;
-                GSList* paramPath;
-                gboolean unknownPath = FALSE;
+static void
+set_threshold_date( gpointer pObject, Timespec ts )
+{
+    *(Timespec*)pObject = ts;
+}
 
-                term = (QofQueryTerm*)andTerm->data;
-                paramPath = qof_query_term_get_param_path( term );
+static const GncSqlColumnTableEntry threshold_col_table[] =
+{
+    /*@ -full_init_block @*/
+    { "post_date", CT_TIMESPEC, 0, 0, NULL, NULL, NULL, (QofSetterFunc)set_threshold_date },
+    { NULL }
+    /*@ +full_init_block @*/
+};
 
-                if ( strcmp( paramPath->data, QOF_PARAM_BOOK ) == 0 ) continue;
+/**
+ * Finds the date posted of the last of the max_results results of a query,
+ * i.e. the latest date when sorting decreasingly and the earliest one when
+ * sorting increasingly.  Only the objects posted from that date on can be
+ * among the results the engine keeps.
+ *
+ * @param be SQL backend
+ * @param from_sql Tables to select from
+ * @param where_sql Condition which matches the query exactly
+ * @param max_results Maximum number of results
+ * @param increasing TRUE if the query is sorted increasingly
+ * @param threshold Set to the date
+ * @return TRUE if there are more than max_results results, FALSE if not
+ */
+static gboolean
+get_max_results_threshold( GncSqlBackend* be, const gchar* from_sql, const gchar* where_sql,
+                           gint max_results, gboolean increasing, /*@ out @*/ Timespec* threshold )
+{
+    GncSqlResult* result;
+    GncSqlRow* row;
+    gchar* sql;
+    gint num_rows = 0;
+
+    sql = g_strdup_printf( "SELECT t.post_date FROM %s WHERE %s%st.post_date IS NOT NULL ORDER BY t.post_date %s LIMIT %d",
+                           from_sql, where_sql, where_sql[0] != '\0' ? " AND " : "",
+                           increasing ? "DESC" : "ASC", max_results );
+    result = gnc_sql_execute_select_sql( be, sql );
+    g_free( sql );
+    if ( result == NULL ) return FALSE;
+
+    for ( row = gnc_sql_result_get_first_row( result ); row != NULL;
+            row = gnc_sql_result_get_next_row( result ) )
+    {
+        gnc_sql_load_object( be, row, NULL, threshold, threshold_col_table );
+        num_rows++;
+    }
+    gnc_sql_result_dispose( result );
 
-#if SIMPLE_QUERY_COMPILATION
-                if ( strcmp( paramPath->data, SPLIT_ACCOUNT ) != 0
-                        || strcmp( paramPath->next->data, QOF_PARAM_GUID ) != 0 ) continue;
-#endif
+    return num_rows == max_results;
+}
 
-                if ( need_AND ) g_string_append( sql, " AND " );
+static void
+append_condition( GString* where, const gchar* condition )
+{
+    if ( where->len != 0 )
+    {
+        g_string_append( where, " AND " );
+    }
+    g_string_append_printf( where, "(%s)", condition );
+}
 
-                if ( strcmp( paramPath->data, SPLIT_ACCOUNT ) == 0
-                        && strcmp( paramPath->next->data, QOF_PARAM_GUID ) == 0 )
-                {
-                    convert_query_term_to_sql( be, "s.account_guid", term, sql );
-#if SIMPLE_QUERY_COMPILATION
-                    goto done_compiling_query;
-#endif
+/**
+ * Compiles a split or transaction query into a SELECT of the transactions
+ * to load for it.
+ *
+ * @param be SQL backend
+ * @param query Query
+ * @param is_split_query TRUE for a split query, FALSE for a transaction query
+ * @return Compiled query, or NULL if all transactions are already loaded
+ */
+static /*@ null @*/ gpointer
+compile_tx_query( GncSqlBackend* be, QofQuery* query, gboolean is_split_query )
+{
+    tx_query_info_t* query_info;
+    gchar* terms_sql;
+    gchar* from_sql;
+    GString* where;
+    gboolean is_exact;
+    gboolean increasing;
+    gint max_results;
 
-                }
-                else if ( strcmp( paramPath->data, SPLIT_RECONCILE ) == 0 )
-                {
-                    convert_query_term_to_sql( be, "s.reconcile_state", term, sql );
+    g_return_val_if_fail( be != NULL, NULL );
+    g_return_val_if_fail( query != NULL, NULL );
 
-                }
-                else if ( strcmp( paramPath->data, SPLIT_TRANS ) == 0 )
-                {
-#if 0
-                    if ( !has_tx_guid_check )
-                    {
-                        g_string_append( sql, "(splits.tx_guid = transactions.guid) AND " );
-                        has_tx_guid_check = TRUE;
-                    }
-#endif
-                    if ( strcmp( paramPath->next->data, TRANS_DATE_POSTED ) == 0 )
-                    {
-                        convert_query_term_to_sql( be, "t.post_date", term, sql );
-                    }
-                    else if ( strcmp( paramPath->next->data, TRANS_DESCRIPTION ) == 0 )
-                    {
-                        convert_query_term_to_sql( be, "t.description", term, sql );
-                    }
-                    else
-                    {
-                        unknownPath = TRUE;
-                    }
+    // Unless they are loaded as needed, all transactions are already in memory
+    if ( !be->load_tx_as_needed ) return NULL;
 
-                }
-                else if ( strcmp( paramPath->data, SPLIT_VALUE ) == 0 )
-                {
-                    convert_query_term_to_sql( be, "s.value_num/s.value_denom", term, sql );
+    query_info = g_malloc( (gsize)sizeof(tx_query_info_t) );
+    g_assert( query_info != NULL );
+    query_info->sql = NULL;
+    query_info->has_been_run = FALSE;
 
-                }
-                else
-                {
-                    unknownPath = TRUE;
-                }
+    // The engine keeps none of the results
+    max_results = qof_query_get_max_results( query );
+    if ( max_results == 0 ) return query_info;
 
-                if ( unknownPath )
-                {
-                    GString* name = g_string_new( (gchar*)paramPath->data );
-                    while ( paramPath->next != NULL )
-                    {
-                        g_string_append( name, "." );
-                        g_string_append( name, paramPath->next->data );
-                        paramPath = paramPath->next;
-                    }
-                    PERR( "Unknown SPLIT query field: %s\n", name->str );
-                    g_string_free( name, TRUE );
-                }
-                need_AND = TRUE;
-            }
+    terms_sql = convert_query_terms_to_sql( be, query,
+                                            is_split_query ? convert_split_term_to_sql : convert_trans_term_to_sql,
+                                            &is_exact );
+    if ( is_split_query )
+    {
+        from_sql = g_strdup_printf( "%s AS t, %s AS s", TRANSACTION_TABLE, SPLIT_TABLE );
+    }
+    else
+    {
+        from_sql = g_strdup_printf( "%s AS t", TRANSACTION_TABLE );
+    }
+    where = g_string_new( "" );
+    if ( terms_sql != NULL )
+    {
+        append_condition( where, terms_sql );
+    }
 
-            /* If the last char in the string is a '(', then for some reason, there were
-               no terms added to the SQL.  If so, remove it and ignore the OR term. */
-            if ( sql->str[sql->len-1] == '(' )
-            {
-                g_string_truncate( sql, sql->len - 1 );
-                need_OR = FALSE;
-            }
-            else
-            {
-                g_string_append( sql, ")" );
-                need_OR = TRUE;
-            }
-        }
+    if ( is_exact && max_results > 0 && is_sorted_by_date_posted( query, is_split_query, &increasing ) )
+    {
+        GString* join_where = g_string_new( is_split_query ? "s.tx_guid=t.guid" : "" );
+        Timespec threshold;
 
-#if SIMPLE_QUERY_COMPILATION
-done_compiling_query:
-#endif
-        if ( sql->len != 0 )
+        if ( terms_sql != NULL )
         {
-#if SIMPLE_QUERY_COMPILATION
-            g_string_append( sql, ")" );
-#endif
-            query_sql = g_strdup_printf(
-                            "SELECT DISTINCT t.* FROM %s AS t, %s AS s WHERE s.tx_guid=t.guid AND %s",
-                            TRANSACTION_TABLE, SPLIT_TABLE, sql->str );
+            append_condition( join_where, terms_sql );
         }
-        else
+        if ( get_max_results_threshold( be, from_sql, join_where->str, max_results, increasing, &threshold ) )
         {
-            query_sql = g_strdup_printf( "SELECT * FROM %s", TRANSACTION_TABLE );
-        }
-        query_info->stmt = gnc_sql_create_statement_from_sql( be, query_sql );
+            gchar* datebuf = gnc_sql_convert_timespec_to_string( be, threshold );
+            gchar* condition = g_strdup_printf( "t.post_date IS NULL OR t.post_date %s '%s'",
+                                                increasing ? ">=" : "<=", datebuf );
 
-        g_string_free( sql, TRUE );
-        g_free( query_sql );
+            append_condition( where, condition );
+            g_free( condition );
+            g_free( datebuf );
+        }
+        (void)g_string_free( join_where, TRUE );
+    }
 
+    if ( where->len == 0 )
+    {
+        query_info->sql = g_strdup_printf( "SELECT guid FROM %s", TRANSACTION_TABLE );
+    }
+    else if ( is_split_query )
+    {
+        query_info->sql = g_strdup_printf( "SELECT DISTINCT t.guid FROM %s WHERE s.tx_guid=t.guid AND %s",
+                                           from_sql, where->str );
     }
     else
     {
-        query_sql = g_strdup_printf( "SELECT * FROM %s", TRANSACTION_TABLE );
-        query_info->stmt = gnc_sql_create_statement_from_sql( be, query_sql );
-        g_free( query_sql );
+        query_info->sql = g_strdup_printf( "SELECT t.guid FROM %s WHERE %s", from_sql, where->str );
     }
+    DEBUG( "%s\n", query_info->sql );
+
+    (void)g_string_free( where, TRUE );
+    g_free( from_sql );
+    g_free( terms_sql );
 
     return query_info;
 }
 
+static /*@ null @*/ gpointer
+compile_split_query( GncSqlBackend* be, QofQuery* query )
+{
+    return compile_tx_query( be, query, TRUE );
+}
+
+static /*@ null @*/ gpointer
+compile_trans_query( GncSqlBackend* be, QofQuery* query )
+{
+    return compile_tx_query( be, query, FALSE );
+}
+
 static void
-run_split_query( GncSqlBackend* be, gpointer pQuery )
+run_tx_query( GncSqlBackend* be, /*@ null @*/ gpointer pQuery )
 {
-    split_query_info_t* query_info = (split_query_info_t*)pQuery;
+    tx_query_info_t* query_info = (tx_query_info_t*)pQuery;
 
     g_return_if_fail( be != NULL );
-    g_return_if_fail( pQuery != NULL );
 
-    if ( !query_info->has_been_run )
+    // Nothing to load unless transactions are loaded as needed
+    if ( query_info == NULL ) return;
+
+    if ( !query_info->has_been_run && query_info->sql != NULL )
     {
-        query_transactions( be, query_info->stmt );
+        query_transactions( be, query_info->sql );
         query_info->has_been_run = TRUE;
-        gnc_sql_statement_dispose( query_info->stmt );
-        query_info->stmt = NULL;
+        g_free( query_info->sql );
+        query_info->sql = NULL;
     }
 }
 
 static void
-free_split_query( GncSqlBackend* be, gpointer pQuery )
+free_tx_query( GncSqlBackend* be, /*@ null @*/ gpointer pQuery )
+{
+    tx_query_info_t* query_info = (tx_query_info_t*)pQuery;
+
+    g_return_if_fail( be != NULL );
+
+    if ( query_info == NULL ) return;
+
+    g_free( query_info->sql );
+    g_free( query_info );
+}
+
+/**
+ * Loads the transactions at startup unless they are to be loaded as needed.
+ *
+ * @param be SQL backend
+ */
+static void
+initial_load_transactions( GncSqlBackend* be )
 {
     g_return_if_fail( be != NULL );
-    g_return_if_fail( pQuery != NULL );
 
-    g_free( pQuery );
+    if ( !be->load_tx_as_needed )
+    {
+        gnc_sql_transaction_load_all_tx( be );
+    }
 }
 
 /* ----------------------------------------------------------------- */
@@ -1341,7 +2900,6 @@ load_single_acct_balances( const GncSqlBackend* be, GncSqlRow* row )
 /*@ null @*/ GSList*
 gnc_sql_get_account_balances_slist( GncSqlBackend* be )
 {
-#if LOAD_TRANSACTIONS_AS_NEEDED
     GncSqlResult* result;
     GncSqlStatement* stmt;
     gchar* buf;
@@ -1349,8 +2907,10 @@ gnc_sql_get_account_balances_slist( GncSqlBackend* be )
 
     g_return_val_if_fail( be != NULL, NULL );
 
+    if ( !refresh_balance_checkpoints( be ) ) return NULL;
+
     buf = g_strdup_printf( "SELECT account_guid, reconcile_state, sum(quantity_num) as quantity_num, quantity_denom FROM %s GROUP BY account_guid, reconcile_state, quantity_denom ORDER BY account_guid, reconcile_state",
-                           SPLIT_TABLE );
+                           BALANCE_TABLE );
     stmt = gnc_sql_create_statement_from_sql( be, buf );
     g_assert( stmt != NULL );
     g_free( buf );
@@ -1366,17 +2926,14 @@ gnc_sql_get_account_balances_slist( GncSqlBackend* be )
         {
             single_acct_balance_t* single_bal;
 
-            // Get the next reconcile state balance and merge with other balances
+            // Get the next reconcile state balance and merge with other balances.
+            // Splits in accounts which aren't loaded (e.g. SX templates) are skipped.
             single_bal = load_single_acct_balances( be, row );
-            if ( single_bal != NULL )
+            if ( single_bal != NULL && single_bal->acct != NULL )
             {
                 if ( bal != NULL && bal->acct != single_bal->acct )
                 {
-                    bal->cleared_balance = gnc_numeric_add( bal->cleared_balance, bal->reconciled_balance,
-                                                            GNC_DENOM_AUTO, GNC_HOW_DENOM_LCD );
-                    bal->balance = gnc_numeric_add( bal->balance, bal->cleared_balance,
-                                                    GNC_DENOM_AUTO, GNC_HOW_DENOM_LCD );
-                    bal_slist = g_slist_append( bal_slist, bal );
+                    bal_slist = g_slist_prepend( bal_slist, bal );
                     bal = NULL;
                 }
                 if ( bal == NULL )
@@ -1389,42 +2946,22 @@ gnc_sql_get_account_balances_slist( GncSqlBackend* be )
                     bal->cleared_balance = gnc_numeric_zero();
                     bal->reconciled_balance = gnc_numeric_zero();
                 }
-                if ( single_bal->reconcile_state == 'n' )
-                {
-                    bal->balance = gnc_numeric_add( bal->balance, single_bal->balance,
-                                                    GNC_DENOM_AUTO, GNC_HOW_DENOM_LCD );
-                }
-                else if ( single_bal->reconcile_state == 'c' )
-                {
-                    bal->cleared_balance = gnc_numeric_add( bal->cleared_balance, single_bal->balance,
-                                                            GNC_DENOM_AUTO, GNC_HOW_DENOM_LCD );
-                }
-                else if ( single_bal->reconcile_state == 'y' )
-                {
-                    bal->reconciled_balance = gnc_numeric_add( bal->reconciled_balance, single_bal->balance,
-                                              GNC_DENOM_AUTO, GNC_HOW_DENOM_LCD );
-                }
-                g_free( single_bal );
+
+                add_to_account_balances( bal, single_bal->reconcile_state, single_bal->balance );
             }
+            g_free( single_bal );
             row = gnc_sql_result_get_next_row( result );
         }
 
         // Add the final balance
         if ( bal != NULL )
         {
-            bal->cleared_balance = gnc_numeric_add( bal->cleared_balance, bal->reconciled_balance,
-                                                    GNC_DENOM_AUTO, GNC_HOW_DENOM_LCD );
-            bal->balance = gnc_numeric_add( bal->balance, bal->cleared_balance,
-                                            GNC_DENOM_AUTO, GNC_HOW_DENOM_LCD );
-            bal_slist = g_slist_append( bal_slist, bal );
+            bal_slist = g_slist_prepend( bal_slist, bal );
         }
         gnc_sql_result_dispose( result );
     }
 
-    return bal_slist;
-#else
-    return NULL;
-#endif
+    return g_slist_reverse( bal_slist );
 }
 
 /* ----------------------------------------------------------------- */
@@ -1455,13 +2992,11 @@ load_tx_guid( const GncSqlBackend* be, GncSqlRow* row,
         if ( tx == NULL )
         {
             gchar* buf;
-            GncSqlStatement* stmt;
 
-            buf = g_strdup_printf( "SELECT * FROM %s WHERE guid='%s'",
+            buf = g_strdup_printf( "SELECT guid FROM %s WHERE guid='%s'",
                                    TRANSACTION_TABLE, guid_str );
-            stmt = gnc_sql_create_statement_from_sql( (GncSqlBackend*)be, buf );
+            query_transactions( (GncSqlBackend*)be, buf );
             g_free( buf );
-            query_transactions( (GncSqlBackend*)be, stmt );
             tx = xaccTransLookup( &guid, be->primary_book );
         }
 
@@ -1495,15 +3030,11 @@ gnc_sql_init_transaction_handler( void )
         GNC_SQL_BACKEND_VERSION,
         GNC_ID_TRANS,
         commit_transaction,          /* commit */
-#if LOAD_TRANSACTIONS_AS_NEEDED
-        NULL,                        /* initial load */
-#else
-        gnc_sql_transaction_load_all_tx,
-#endif
+        initial_load_transactions,   /* initial_load */
         create_transaction_tables,   /* create tables */
-        NULL,                        /* compile_query */
-        NULL,                        /* run_query */
-        NULL,                        /* free_query */
+        compile_trans_query,         /* compile_query */
+        run_tx_query,                /* run_query */
+        free_tx_query,               /* free_query */
         NULL                         /* write */
     };
     static GncSqlObjectBackend be_data_split =
@@ -1513,16 +3044,10 @@ gnc_sql_init_transaction_handler( void )
         commit_split,                /* commit */
         NULL,                        /* initial_load */
         NULL,                        /* create tables */
-#if LOAD_TRANSACTIONS_AS_NEEDED
-        compile_split_query,
-        run_split_query,
-        free_split_query,
-#else
-        NULL,                        /* compile_query */
-        NULL,                        /* run_query */
-        NULL,                        /* free_query */
-#endif
-        NULL                         /* write */
+        compile_split_query,         /* compile_query */
+        run_tx_query,                /* run_query */
+        free_tx_query,               /* free_query */
+        write_balance_checkpoints    /* write */
     };
 
     (void)qof_object_register_backend( GNC_ID_TRANS, GNC_SQL_BACKEND, &be_data_tx );
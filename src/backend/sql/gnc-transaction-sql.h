@@ -76,7 +76,7 @@ typedef struct
 
 /**
  * Returns a list of acct_balances_t structures, one for each account which
- * has splits.
+ * has splits.  The balances are summed from the balance checkpoints.
  *
  * @param be SQL backend
  * @return GSList of acct_balances_t structures
@@ -84,4 +84,17 @@ typedef struct
 /*@ null @*/
 GSList* gnc_sql_get_account_balances_slist( GncSqlBackend* be );
 
+/**
+ * Computes an account's balances from the splits posted before a date,
+ * using the balance checkpoints for the months before the date's month.
+ *
+ * @param be SQL backend
+ * @param acct Account
+ * @param date Date
+ * @param bal Balances to fill in
+ * @return TRUE if successful, FALSE if error
+ */
+gboolean gnc_sql_get_account_balances_as_of( GncSqlBackend* be, Account* acct,
+        Timespec date, acct_balances_t* bal );
+
 #endif /* GNC_TRANSACTION_SQL_H_ */
@@ -0,0 +1,250 @@
+/***************************************************************************
+ *            test-queued-commit.c
+ *
+ *  Checks that committing a transaction or a split doesn't read the db
+ *  when the connection queues commits to be written later.  The dbi
+ *  backend can only hand a db transaction to its background writer if
+ *  nothing in it is a SELECT.
+ ****************************************************************************/
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+#include "config.h"
+#include "qof.h"
+#include "qofbackend-p.h"
+#include "cashobjects.h"
+#include "test-stuff.h"
+
+#include "Account.h"
+#include "Transaction.h"
+#include "gnc-commodity.h"
+#include "gnc-backend-sql.h"
+#include "gnc-commodity-sql.h"
+
+/* A connection which only counts what it is asked to run */
+typedef struct
+{
+    GncSqlStatement base;
+    GString* sql;
+} FakeStatement;
+
+typedef struct
+{
+    GncSqlConnection base;
+    gboolean in_tx;
+    gint n_selects;         /* SELECTs inside a db transaction */
+    gint n_writes;          /* Other statements inside a db transaction */
+} FakeConnection;
+
+static void
+stmt_dispose( GncSqlStatement* stmt )
+{
+    (void)g_string_free( ((FakeStatement*)stmt)->sql, TRUE );
+    g_free( stmt );
+}
+
+static gchar*
+stmt_to_sql( GncSqlStatement* stmt )
+{
+    return ((FakeStatement*)stmt)->sql->str;
+}
+
+static void
+stmt_add_where_cond( GncSqlStatement* stmt, QofIdTypeConst type_name,
+                     gpointer obj, const GncSqlColumnTableEntry* table_row,
+                     GValue* value )
+{
+    g_string_append_printf( ((FakeStatement*)stmt)->sql, " WHERE %s=?",
+                            table_row->col_name );
+}
+
+static void
+conn_dispose( GncSqlConnection* conn )
+{
+    g_free( conn );
+}
+
+static GncSqlResult*
+conn_execute_select_statement( GncSqlConnection* conn, GncSqlStatement* stmt )
+{
+    FakeConnection* fake = (FakeConnection*)conn;
+
+    if ( fake->in_tx )
+    {
+        fake->n_selects++;
+    }
+    return NULL;
+}
+
+static gint
+conn_execute_nonselect_statement( GncSqlConnection* conn, GncSqlStatement* stmt )
+{
+    FakeConnection* fake = (FakeConnection*)conn;
+
+    if ( fake->in_tx )
+    {
+        fake->n_writes++;
+    }
+    return 1;
+}
+
+static GncSqlStatement*
+conn_create_statement_from_sql( GncSqlConnection* conn, const gchar* sql )
+{
+    FakeStatement* stmt = g_new0( FakeStatement, 1 );
+
+    stmt->base.dispose = stmt_dispose;
+    stmt->base.toSql = stmt_to_sql;
+    stmt->base.addWhereCond = stmt_add_where_cond;
+    stmt->sql = g_string_new( sql );
+
+    return (GncSqlStatement*)stmt;
+}
+
+static gboolean
+conn_does_table_exist( GncSqlConnection* conn, const gchar* table_name )
+{
+    return TRUE;
+}
+
+static gboolean
+conn_begin_transaction( GncSqlConnection* conn )
+{
+    ((FakeConnection*)conn)->in_tx = TRUE;
+    return TRUE;
+}
+
+static gboolean
+conn_end_transaction( GncSqlConnection* conn )
+{
+    ((FakeConnection*)conn)->in_tx = FALSE;
+    return TRUE;
+}
+
+static gchar*
+conn_quote_string( const GncSqlConnection* conn, gchar* unquoted_str )
+{
+    return g_strdup_printf( "'%s'", unquoted_str );
+}
+
+static GncSqlBackend*
+create_backend( QofBook* book, gboolean commits_are_queued )
+{
+    GncSqlBackend* be = g_new0( GncSqlBackend, 1 );
+    FakeConnection* conn = g_new0( FakeConnection, 1 );
+
+    conn->base.dispose = conn_dispose;
+    conn->base.executeSelectStatement = conn_execute_select_statement;
+    conn->base.executeNonSelectStatement = conn_execute_nonselect_statement;
+    conn->base.createStatementFromSql = conn_create_statement_from_sql;
+    conn->base.doesTableExist = conn_does_table_exist;
+    conn->base.beginTransaction = conn_begin_transaction;
+    conn->base.rollbackTransaction = conn_end_transaction;
+    conn->base.commitTransaction = conn_end_transaction;
+    conn->base.quoteString = conn_quote_string;
+
+    qof_backend_init( &be->be );
+    be->conn = (GncSqlConnection*)conn;
+    be->primary_book = book;
+    be->timespec_format = "%04d%02d%02d%02d%02d%02d";
+    // Checkpoint upkeep reads the db when commits aren't queued
+    be->load_tx_as_needed = TRUE;
+    be->commits_are_queued = commits_are_queued;
+
+    return be;
+}
+
+static void
+destroy_backend( GncSqlBackend* be )
+{
+    gnc_sql_forget_saved_commodities( be );
+    gnc_sql_clear_statement_cache( be );
+    gnc_sql_connection_dispose( be->conn );
+    qof_backend_destroy( &be->be );
+    g_free( be );
+}
+
+/* Commits an edited, already saved transaction and one of its splits, and
+   returns the number of SELECTs run inside their db transactions */
+static gint
+count_commit_selects( gboolean commits_are_queued, gint* n_writes )
+{
+    QofBook* book;
+    GncSqlBackend* be;
+    FakeConnection* conn;
+    gnc_commodity* currency;
+    Account* acct;
+    Transaction* trans;
+    Split* split;
+    gint n_selects;
+
+    book = qof_book_new();
+    currency = gnc_commodity_new( book, "US Dollar", "ISO4217", "USD", "840", 100 );
+    acct = xaccMallocAccount( book );
+    xaccAccountBeginEdit( acct );
+    xaccAccountSetCommodity( acct, currency );
+    xaccAccountCommitEdit( acct );
+
+    // With no backend on the book, the commit leaves both dirty but not new
+    trans = xaccMallocTransaction( book );
+    split = xaccMallocSplit( book );
+    xaccTransBeginEdit( trans );
+    xaccTransSetCurrency( trans, currency );
+    xaccTransSetDescription( trans, "Queued" );
+    xaccTransSetNotes( trans, "Written without reading the db" );
+    xaccSplitSetParent( split, trans );
+    xaccSplitSetAccount( split, acct );
+    xaccSplitSetAmount( split, gnc_numeric_create( 100, 100 ) );
+    xaccSplitSetValue( split, gnc_numeric_create( 100, 100 ) );
+    xaccTransCommitEdit( trans );
+
+    be = create_backend( book, commits_are_queued );
+    conn = (FakeConnection*)be->conn;
+    gnc_sql_commit_edit( be, QOF_INSTANCE(trans) );
+    gnc_sql_commit_edit( be, QOF_INSTANCE(split) );
+    n_selects = conn->n_selects;
+    *n_writes = conn->n_writes;
+    destroy_backend( be );
+
+    xaccTransBeginEdit( trans );
+    xaccTransDestroy( trans );
+    xaccTransCommitEdit( trans );
+    qof_book_destroy( book );
+
+    return n_selects;
+}
+
+int main( int argc, char ** argv )
+{
+    gint n_selects;
+    gint n_writes;
+
+    qof_init();
+    cashobjects_register();
+    gnc_sql_init( NULL );
+
+    n_selects = count_commit_selects( FALSE, &n_writes );
+    do_test( n_selects > 0, "Commits read the db when they aren't queued" );
+
+    n_selects = count_commit_selects( TRUE, &n_writes );
+    do_test( n_writes > 0, "Queued commits are written" );
+    do_test( n_selects == 0, "Queued commits don't read the db" );
+
+    print_test_results();
+    qof_close();
+    exit( get_rv() );
+}
@@ -68,6 +68,7 @@ typedef int ssize_t;
 #include "qof.h"
 #include "TransLog.h"
 #include "gnc-engine.h"
+#include "Transaction.h"
 
 #include "gnc-uri-utils.h"
 
@@ -95,6 +96,15 @@ typedef int ssize_t;
 #define KEY_FILE_COMPRESSION  "file_compression"
 #define KEY_RETAIN_TYPE "retain_type"
 #define KEY_RETAIN_DAYS "retain_days"
+#define KEY_FILE_JOURNAL "file_journal"
+#define KEY_FILE_CACHE "file_cache"
+
+#define JOURNAL_FILE_EXT ".journal"
+/* The data file is rewritten when the journal outgrows this, or a
+   quarter of the data file, whichever is larger */
+#define JOURNAL_COMPACT_MIN (1024 * 1024)
+
+#define CACHE_FILE_EXT ".cache"
 
 static QofLogModule log_module = GNC_MOD_BACKEND;
 
@@ -317,6 +327,9 @@ xml_session_begin(QofBackend *be_start, QofSession *session,
     xaccLogSetBaseName (be->fullpath);
     PINFO ("logpath=%s", be->fullpath ? be->fullpath : "(null)");
 
+    be->journalfile = g_strconcat(be->fullpath, JOURNAL_FILE_EXT, NULL);
+    be->cachefile = g_strconcat(be->fullpath, CACHE_FILE_EXT, NULL);
+
     /* And let's see if we can get a lock on it. */
     be->lockfile = g_strconcat(be->fullpath, ".LCK", NULL);
 
@@ -373,15 +386,25 @@ xml_session_end(QofBackend *be_start)
 
     g_free (be->linkfile);
     be->linkfile = NULL;
+
+    g_free (be->journalfile);
+    be->journalfile = NULL;
+
+    g_free (be->cachefile);
+    be->cachefile = NULL;
     LEAVE (" ");
 }
 
 static void
 xml_destroy_backend(QofBackend *be)
 {
+    FileBackend *fbe = (FileBackend*)be;
+
     /* Stop transactionlogging */
     xaccLogSetBaseName (NULL);
 
+    g_hash_table_destroy (fbe->journal_trans);
+
     qof_backend_destroy(be);
     g_free(be);
 }
@@ -836,8 +859,11 @@ gnc_xml_be_remove_old_files(FileBackend *be)
         name = g_build_filename(be->dirname, dent, (gchar*)NULL);
         len = strlen(name) - 4;
 
-        /* Never remove the current data file itself */
-        if (g_strcmp0(name, be->fullpath) == 0)
+        /* Never remove the current data file itself, its journal or its
+           cache */
+        if (g_strcmp0(name, be->fullpath) == 0 ||
+                g_strcmp0(name, be->journalfile) == 0 ||
+                g_strcmp0(name, be->cachefile) == 0)
             continue;
 
         /* Is this file associated with the current data file */
@@ -892,6 +918,194 @@ gnc_xml_be_remove_old_files(FileBackend *be)
     g_dir_close (dir);
 }
 
+/* ================================================================= */
+/* The change journal.  While it is enabled, a save normally appends the
+ * transactions changed since the last save to a journal beside the data
+ * file, and loading replays it.  Anything else that changes, and any
+ * transaction that lots, invoices or the like refer to, still needs the
+ * whole file written, as does a journal that has grown past
+ * JOURNAL_COMPACT_MIN or a quarter of the data file.  Rewriting the file
+ * starts a new, empty journal.
+ */
+
+/* Remember what the next save has to write */
+static void
+gnc_xml_be_journal_note(FileBackend *fbe, QofInstance *inst)
+{
+    Transaction *trans;
+    GncGUID *guid;
+
+    if (qof_instance_get_book(inst) != fbe->primary_book)
+        return;
+
+    if (GNC_IS_TRANS(inst))
+        trans = GNC_TRANS(inst);
+    else if (GNC_IS_SPLIT(inst))
+        trans = xaccSplitGetParent(GNC_SPLIT(inst));
+    else
+    {
+        fbe->journal_full_save = TRUE;
+        return;
+    }
+
+    if (!trans || g_hash_table_lookup(fbe->journal_trans,
+                                      qof_instance_get_guid(trans)))
+        return;
+
+    guid = g_new(GncGUID, 1);
+    *guid = *qof_instance_get_guid(trans);
+    g_hash_table_insert(fbe->journal_trans, guid, guid);
+}
+
+/* Whether a transaction can be replaced wholesale when the journal is
+   replayed without leaving something else pointing at the old copy */
+static gboolean
+gnc_xml_be_journal_can_hold(Transaction *trans)
+{
+    GList *node;
+
+    if (xaccTransGetReadOnly(trans) ||
+            xaccTransGetTxnType(trans) != TXN_TYPE_NONE)
+        return FALSE;
+
+    for (node = xaccTransGetSplitList(trans); node; node = node->next)
+    {
+        if (xaccSplitGetLot(node->data))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/* Save by appending to the journal.  Returns FALSE if the whole file
+   has to be written instead. */
+static gboolean
+gnc_xml_be_append_journal(FileBackend *fbe, QofBook *book)
+{
+    struct stat statbuf;
+    GList *guids, *node;
+    gboolean ok = TRUE;
+
+    if (!fbe->file_journal || fbe->journal_full_save)
+        return FALSE;
+
+    /* Make sure nothing else has written the data file since */
+    if (g_stat(fbe->fullpath, &statbuf) != 0 ||
+            statbuf.st_size != fbe->snapshot_size ||
+            statbuf.st_mtime != fbe->snapshot_mtime)
+        return FALSE;
+
+    if (g_stat(fbe->journalfile, &statbuf) == 0 &&
+            statbuf.st_size > MAX(JOURNAL_COMPACT_MIN, fbe->snapshot_size / 4))
+    {
+        PINFO("journal %s has grown to %" G_GINT64_FORMAT " bytes",
+              fbe->journalfile, (gint64) statbuf.st_size);
+        return FALSE;
+    }
+
+    guids = g_hash_table_get_keys(fbe->journal_trans);
+    for (node = guids; ok && node; node = node->next)
+    {
+        Transaction *trans = xaccTransLookup(node->data, book);
+        ok = (trans == NULL || gnc_xml_be_journal_can_hold(trans));
+    }
+
+    if (ok && guids)
+    {
+        ok = gnc_book_append_journal_v2(book, fbe->journalfile,
+                                        fbe->snapshot_size,
+                                        fbe->snapshot_mtime, guids);
+        if (!ok)
+        {
+            /* Rewriting the file starts the journal afresh */
+            PWARN("unable to append to %s", fbe->journalfile);
+            fbe->journal_full_save = TRUE;
+        }
+    }
+    g_list_free(guids);
+
+    if (!ok)
+        return FALSE;
+
+    g_hash_table_remove_all(fbe->journal_trans);
+    qof_book_mark_saved(book);
+    return TRUE;
+}
+
+/* Start an empty journal against the data file as it now is, or give
+   up on the journal until the file is next written if that fails. */
+static void
+gnc_xml_be_reset_journal(FileBackend *fbe)
+{
+    struct stat statbuf;
+
+    g_hash_table_remove_all(fbe->journal_trans);
+    fbe->journal_full_save = TRUE;
+
+    if (g_stat(fbe->fullpath, &statbuf) != 0)
+        return;
+
+    if (g_unlink(fbe->journalfile) != 0 && errno != ENOENT)
+    {
+        PWARN("unable to unlink journal %s: %s", fbe->journalfile,
+              g_strerror(errno) ? g_strerror(errno) : "");
+        return;
+    }
+
+    fbe->snapshot_size = statbuf.st_size;
+    fbe->snapshot_mtime = statbuf.st_mtime;
+    fbe->journal_full_save = FALSE;
+}
+
+/* Replay the journal over the data file just loaded.  Returns FALSE if
+   the next save should rewrite the file. */
+static gboolean
+gnc_xml_be_load_journal(FileBackend *fbe, QofBook *book)
+{
+    struct stat statbuf;
+
+    if (g_stat(fbe->fullpath, &statbuf) != 0)
+        return FALSE;
+    fbe->snapshot_size = statbuf.st_size;
+    fbe->snapshot_mtime = statbuf.st_mtime;
+
+    if (g_stat(fbe->journalfile, &statbuf) != 0)
+        return (errno == ENOENT);
+
+    if (!qof_session_load_journal_v2(book, fbe->journalfile,
+                                     fbe->snapshot_size, fbe->snapshot_mtime))
+    {
+        PWARN("journal %s was not fully replayed", fbe->journalfile);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* ================================================================= */
+/* The cache.  While it is enabled, a binary copy of the book is kept
+ * beside the data file, written whenever the data file is, and loaded
+ * in its place as long as the data file is the one it was taken from.
+ * See io-book-cache.h.
+ */
+
+/* Bring the cache up to date with a book just loaded from, or saved
+   to, the data file */
+static void
+gnc_xml_be_update_cache(FileBackend *fbe, QofBook *book)
+{
+    if (!fbe->file_cache)
+    {
+        /* Don't leave one behind once it is turned off */
+        g_unlink(fbe->cachefile);
+        return;
+    }
+
+    if (!gnc_book_write_cache_v2(book, fbe->fullpath, fbe->cachefile))
+    {
+        PWARN("unable to write cache %s", fbe->cachefile);
+        g_unlink(fbe->cachefile);
+    }
+}
+
 static void
 xml_sync_all(QofBackend* be, QofBook *book)
 {
@@ -909,7 +1123,19 @@ xml_sync_all(QofBackend* be, QofBook *book)
     if (NULL == fbe->primary_book) fbe->primary_book = book;
     if (book != fbe->primary_book) return;
 
-    gnc_xml_be_write_to_file (fbe, book, fbe->fullpath, TRUE);
+    if (gnc_xml_be_append_journal (fbe, book))
+    {
+        LEAVE ("book=%p, journaled", book);
+        return;
+    }
+
+    if (gnc_xml_be_write_to_file (fbe, book, fbe->fullpath, TRUE))
+    {
+        gnc_xml_be_reset_journal (fbe);
+        gnc_xml_be_update_cache (fbe, book);
+    }
+    else
+        fbe->journal_full_save = TRUE;
     gnc_xml_be_remove_old_files (fbe);
     LEAVE ("book=%p", book);
 }
@@ -995,6 +1221,9 @@ xml_commit_edit (QofBackend *be, QofInstance *inst)
         qof_collection_mark_dirty(qof_instance_get_collection(inst));
         qof_book_mark_dirty(qof_instance_get_book(inst));
     }
+    if (qof_instance_get_dirty_flag(inst) &&
+            !(qof_instance_get_infant(inst) && qof_instance_get_destroying(inst)))
+        gnc_xml_be_journal_note((FileBackend *) be, inst);
 #if BORKEN_FOR_NOW
     FileBackend *fbe = (FileBackend *) be;
     QofBook *book = gp;
@@ -1027,6 +1256,8 @@ gnc_xml_be_load_from_file (QofBackend *bend, QofBook *book, QofBackendLoadType l
 {
     QofBackendError error;
     gboolean rc;
+    gboolean journal_ok = FALSE;
+    gboolean journaled, from_cache = FALSE;
     FileBackend *be = (FileBackend *) bend;
 
     if (loadType != LOAD_TYPE_INITIAL_LOAD) return;
@@ -1037,8 +1268,25 @@ gnc_xml_be_load_from_file (QofBackend *bend, QofBook *book, QofBackendLoadType l
     switch (gnc_xml_be_determine_file_type(be->fullpath))
     {
     case GNC_BOOK_XML2_FILE:
-        rc = qof_session_load_from_xml_file_v2 (be, book);
-        if (FALSE == rc) error = ERR_FILEIO_PARSE_ERROR;
+        rc = TRUE;
+        if (be->file_cache)
+            rc = qof_session_load_from_cache_v2 (be, book, be->cachefile,
+                                                 &from_cache);
+        if (rc && !from_cache)
+            rc = qof_session_load_from_xml_file_v2 (be, book);
+        if (FALSE == rc)
+        {
+            error = ERR_FILEIO_PARSE_ERROR;
+            break;
+        }
+
+        journaled = g_file_test (be->journalfile, G_FILE_TEST_EXISTS);
+        journal_ok = gnc_xml_be_load_journal (be, book);
+
+        /* Once a journal is replayed the book is no longer just what
+           is in the data file, so the cache waits for the next save */
+        if (be->file_cache && !from_cache && !journaled)
+            gnc_xml_be_update_cache (be, book);
         break;
 
     case GNC_BOOK_XML2_FILE_NO_ENCODING:
@@ -1077,6 +1325,8 @@ gnc_xml_be_load_from_file (QofBackend *bend, QofBook *book, QofBackendLoadType l
 
     /* We just got done loading, it can't possibly be dirty !! */
     qof_book_mark_saved (book);
+    g_hash_table_remove_all (be->journal_trans);
+    be->journal_full_save = !journal_ok;
 }
 
 /* ---------------------------------------------------------------------- */
@@ -1161,6 +1411,22 @@ compression_changed_cb(GConfEntry *entry, gpointer user_data)
     be->file_compression = gnc_gconf_get_bool(GCONF_GENERAL, KEY_FILE_COMPRESSION, NULL);
 }
 
+static void
+journal_changed_cb(GConfEntry *entry, gpointer user_data)
+{
+    FileBackend *be = (FileBackend*)user_data;
+    g_return_if_fail(be != NULL);
+    be->file_journal = gnc_gconf_get_bool(GCONF_GENERAL, KEY_FILE_JOURNAL, NULL);
+}
+
+static void
+cache_changed_cb(GConfEntry *entry, gpointer user_data)
+{
+    FileBackend *be = (FileBackend*)user_data;
+    g_return_if_fail(be != NULL);
+    be->file_cache = gnc_gconf_get_bool(GCONF_GENERAL, KEY_FILE_CACHE, NULL);
+}
+
 static QofBackend*
 gnc_backend_new(void)
 {
@@ -1208,8 +1474,17 @@ gnc_backend_new(void)
 
     gnc_be->primary_book = NULL;
 
+    gnc_be->journalfile = NULL;
+    gnc_be->journal_trans = g_hash_table_new_full(guid_hash_to_guint,
+                            guid_g_hash_table_equal,
+                            g_free, NULL);
+    gnc_be->journal_full_save = TRUE;
+    gnc_be->cachefile = NULL;
+
     gnc_be->file_retention_days = (int)gnc_gconf_get_float(GCONF_GENERAL, KEY_RETAIN_DAYS, NULL);
     gnc_be->file_compression = gnc_gconf_get_bool(GCONF_GENERAL, KEY_FILE_COMPRESSION, NULL);
+    gnc_be->file_journal = gnc_gconf_get_bool(GCONF_GENERAL, KEY_FILE_JOURNAL, NULL);
+    gnc_be->file_cache = gnc_gconf_get_bool(GCONF_GENERAL, KEY_FILE_CACHE, NULL);
     retain_type_changed_cb(NULL, (gpointer)be); /* Get retain_type from gconf */
 
     if ( (gnc_be->file_retention_type == XML_RETAIN_DAYS) &&
@@ -1228,6 +1503,8 @@ gnc_backend_new(void)
     gnc_gconf_general_register_cb(KEY_RETAIN_DAYS, retain_changed_cb, be);
     gnc_gconf_general_register_cb(KEY_RETAIN_TYPE, retain_type_changed_cb, be);
     gnc_gconf_general_register_cb(KEY_FILE_COMPRESSION, compression_changed_cb, be);
+    gnc_gconf_general_register_cb(KEY_FILE_JOURNAL, journal_changed_cb, be);
+    gnc_gconf_general_register_cb(KEY_FILE_CACHE, cache_changed_cb, be);
 
     return be;
 }
@@ -58,6 +58,21 @@ struct FileBackend_struct
     XMLFileRetentionType file_retention_type;
     int file_retention_days;
     gboolean file_compression;
+
+    /* Saves that only append the changed transactions to a journal
+       beside the data file, until it is worth rewriting the file */
+    gboolean file_journal;
+    char *journalfile;
+    GHashTable *journal_trans;  /* GncGUID* of transactions changed since
+                                   the last save */
+    gboolean journal_full_save; /* the next save has to write the file */
+    gint64 snapshot_size;       /* the data file the journal applies to */
+    time_t snapshot_mtime;
+
+    /* A binary copy of the book beside the data file, loaded in its
+       place while the data file is unchanged */
+    gboolean file_cache;
+    char *cachefile;
 };
 
 typedef struct FileBackend_struct FileBackend;
@@ -193,6 +193,127 @@ gnc_transaction_dom_tree_create(Transaction *trn)
     return ret;
 }
 
+/* Streaming versions of the above, which write the same XML without
+   building the tree.  See the streaming generators in
+   sixtp-dom-generators.c. */
+
+static gboolean
+add_timespec_to_stream(GString *out, gint level, const gchar *tag,
+                       Timespec tms, gboolean always)
+{
+    if (always || !((tms.tv_sec == 0) && (tms.tv_nsec == 0)))
+    {
+        return timespec_to_xml_stream(out, level, tag, &tms);
+    }
+    return TRUE;
+}
+
+static gboolean
+split_to_xml_stream(GString *out, gint level, const gchar *tag, Split *spl)
+{
+    const char *memo = xaccSplitGetMemo(spl);
+    const char *action = xaccSplitGetAction(spl);
+    GNCLot *lot = xaccSplitGetLot(spl);
+    gnc_numeric value = xaccSplitGetValue(spl);
+    gnc_numeric amount = xaccSplitGetAmount(spl);
+    gboolean ok = TRUE;
+    char tmp[2];
+
+    g_string_append_printf(out, "%*s<%s>\n", 2 * level, "", tag);
+
+    ok = guid_to_xml_stream(out, level + 1, "split:id", xaccSplitGetGUID(spl)) && ok;
+
+    if (memo && safe_strcmp(memo, "") != 0)
+    {
+        ok = text_child_to_xml_stream(out, level + 1, "split:memo", memo) && ok;
+    }
+
+    if (action && safe_strcmp(action, "") != 0)
+    {
+        ok = text_child_to_xml_stream(out, level + 1, "split:action", action) && ok;
+    }
+
+    tmp[0] = xaccSplitGetReconcile(spl);
+    tmp[1] = '\0';
+    ok = text_child_to_xml_stream(out, level + 1, "split:reconciled-state", tmp) && ok;
+
+    ok = add_timespec_to_stream(out, level + 1, "split:reconcile-date",
+                                xaccSplitRetDateReconciledTS(spl), FALSE) && ok;
+
+    ok = gnc_numeric_to_xml_stream(out, level + 1, "split:value", &value) && ok;
+
+    ok = gnc_numeric_to_xml_stream(out, level + 1, "split:quantity", &amount) && ok;
+
+    ok = guid_to_xml_stream(out, level + 1, "split:account",
+                            xaccAccountGetGUID(xaccSplitGetAccount(spl))) && ok;
+
+    if (lot)
+    {
+        ok = guid_to_xml_stream(out, level + 1, "split:lot",
+                                gnc_lot_get_guid(lot)) && ok;
+    }
+
+    ok = kvp_frame_to_xml_stream(out, level + 1, "split:slots",
+                                 xaccSplitGetSlots(spl)) && ok;
+
+    g_string_append_printf(out, "%*s</%s>\n", 2 * level, "", tag);
+
+    return ok;
+}
+
+gboolean
+gnc_transaction_xml_stream_write(GString *out, Transaction *trn)
+{
+    GList *n;
+    gboolean ok = TRUE;
+
+    g_string_append_printf(out, "<gnc:transaction version=\"%s\">\n",
+                           transaction_version_string);
+
+    ok = guid_to_xml_stream(out, 1, "trn:id", xaccTransGetGUID(trn)) && ok;
+
+    ok = commodity_ref_to_xml_stream(out, 1, "trn:currency",
+                                     xaccTransGetCurrency(trn)) && ok;
+
+    if (xaccTransGetNum(trn) && (safe_strcmp(xaccTransGetNum(trn), "") != 0))
+    {
+        ok = text_child_to_xml_stream(out, 1, "trn:num", xaccTransGetNum(trn)) && ok;
+    }
+
+    ok = add_timespec_to_stream(out, 1, "trn:date-posted",
+                                xaccTransRetDatePostedTS(trn), TRUE) && ok;
+
+    ok = add_timespec_to_stream(out, 1, "trn:date-entered",
+                                xaccTransRetDateEnteredTS(trn), TRUE) && ok;
+
+    if (xaccTransGetDescription(trn))
+    {
+        ok = text_child_to_xml_stream(out, 1, "trn:description",
+                                      xaccTransGetDescription(trn)) && ok;
+    }
+
+    ok = kvp_frame_to_xml_stream(out, 1, "trn:slots", xaccTransGetSlots(trn)) && ok;
+
+    n = xaccTransGetSplitList(trn);
+    if (n == NULL)
+    {
+        g_string_append(out, "  <trn:splits/>\n");
+    }
+    else
+    {
+        g_string_append(out, "  <trn:splits>\n");
+        for (; n; n = n->next)
+        {
+            ok = split_to_xml_stream(out, 2, "trn:split", n->data) && ok;
+        }
+        g_string_append(out, "  </trn:splits>\n");
+    }
+
+    g_string_append(out, "</gnc:transaction>\n");
+
+    return ok;
+}
+
 /***********************************************************************/
 
 struct split_pdata
@@ -300,50 +421,64 @@ spl_quantity_handler(xmlNodePtr node, gpointer data)
 
 gboolean gnc_transaction_xml_v2_testing = FALSE;
 
-static gboolean
-spl_account_handler(xmlNodePtr node, gpointer data)
+static void
+spl_set_account(Split *spl, const GncGUID *id, QofBook *book)
 {
-    struct split_pdata *pdata = data;
-    GncGUID *id = dom_tree_to_guid(node);
     Account *account;
 
-    g_return_val_if_fail(id, FALSE);
-
-    account = xaccAccountLookup (id, pdata->book);
+    account = xaccAccountLookup (id, book);
     if (!account && gnc_transaction_xml_v2_testing &&
             !guid_equal (id, guid_null ()))
     {
-        account = xaccMallocAccount (pdata->book);
+        account = xaccMallocAccount (book);
         xaccAccountSetGUID (account, id);
         xaccAccountSetCommoditySCU (account,
-                                    xaccSplitGetAmount (pdata->split).denom);
+                                    xaccSplitGetAmount (spl).denom);
     }
 
-    xaccAccountInsertSplit (account, pdata->split);
-
-    g_free(id);
-
-    return TRUE;
+    xaccAccountInsertSplit (account, spl);
 }
 
 static gboolean
-spl_lot_handler(xmlNodePtr node, gpointer data)
+spl_account_handler(xmlNodePtr node, gpointer data)
 {
     struct split_pdata *pdata = data;
     GncGUID *id = dom_tree_to_guid(node);
-    GNCLot *lot;
 
     g_return_val_if_fail(id, FALSE);
 
-    lot = gnc_lot_lookup (id, pdata->book);
+    spl_set_account(pdata->split, id, pdata->book);
+
+    g_free(id);
+
+    return TRUE;
+}
+
+static void
+spl_set_lot(Split *spl, const GncGUID *id, QofBook *book)
+{
+    GNCLot *lot;
+
+    lot = gnc_lot_lookup (id, book);
     if (!lot && gnc_transaction_xml_v2_testing &&
             !guid_equal (id, guid_null ()))
     {
-        lot = gnc_lot_new (pdata->book);
+        lot = gnc_lot_new (book);
         gnc_lot_set_guid (lot, *id);
     }
 
-    gnc_lot_add_split (lot, pdata->split);
+    gnc_lot_add_split (lot, spl);
+}
+
+static gboolean
+spl_lot_handler(xmlNodePtr node, gpointer data)
+{
+    struct split_pdata *pdata = data;
+    GncGUID *id = dom_tree_to_guid(node);
+
+    g_return_val_if_fail(id, FALSE);
+
+    spl_set_lot(pdata->split, id, pdata->book);
 
     g_free(id);
 
@@ -572,6 +707,600 @@ struct dom_tree_handler trn_dom_handlers[] =
     { NULL, NULL, 0, 0 },
 };
 
+/***********************************************************************/
+/* Pipelined loading.
+
+   Engine objects may only be touched by the thread running the parse,
+   but turning the text of a <gnc:transaction> into guids, numbers and
+   dates needs nothing from the engine.  While a GncXmlTrnLoader is
+   active the end handler gives each transaction's DOM tree to a pool
+   of workers, which parse it into a list of trn_rec_op in document
+   order.  The parsing thread then builds the Transactions from those
+   lists in file order.  Slots and the currency stay DOM nodes: kvp
+   frames share a string cache and commodities come from the book. */
+
+typedef enum
+{
+    TRN_REC_ID,
+    TRN_REC_CURRENCY,
+    TRN_REC_NUM,
+    TRN_REC_DATE_POSTED,
+    TRN_REC_DATE_ENTERED,
+    TRN_REC_DESCRIPTION,
+    TRN_REC_SLOTS,
+    TRN_REC_SPLITS,
+    SPL_REC_ID,
+    SPL_REC_MEMO,
+    SPL_REC_ACTION,
+    SPL_REC_RECONCILED_STATE,
+    SPL_REC_RECONCILE_DATE,
+    SPL_REC_VALUE,
+    SPL_REC_QUANTITY,
+    SPL_REC_ACCOUNT,
+    SPL_REC_LOT,
+    SPL_REC_SLOTS
+} trn_rec_field;
+
+typedef struct
+{
+    trn_rec_field field;
+    gpointer value;
+} trn_rec_op;
+
+/* How many parsed transactions may wait ahead of the engine */
+#define TRN_REC_MAX_PENDING 1024
+
+static void trn_rec_ops_free(GSList *ops);
+
+static void
+trn_rec_op_free(trn_rec_op *op)
+{
+    GSList *n;
+
+    switch (op->field)
+    {
+    case TRN_REC_CURRENCY:
+    case TRN_REC_SLOTS:
+    case SPL_REC_SLOTS:
+        /* Still part of the DOM tree */
+        break;
+    case TRN_REC_SPLITS:
+        for (n = op->value; n; n = n->next)
+            trn_rec_ops_free(n->data);
+        g_slist_free(op->value);
+        break;
+    default:
+        g_free(op->value);
+        break;
+    }
+    g_free(op);
+}
+
+static void
+trn_rec_ops_free(GSList *ops)
+{
+    GSList *n;
+
+    for (n = ops; n; n = n->next)
+        trn_rec_op_free(n->data);
+    g_slist_free(ops);
+}
+
+static void
+trn_rec_add(GSList **ops, trn_rec_field field, gpointer value)
+{
+    trn_rec_op *op = g_new(trn_rec_op, 1);
+
+    op->field = field;
+    op->value = value;
+    *ops = g_slist_prepend(*ops, op);
+}
+
+/* The trn_rec_add_* functions fail where the matching handlers above
+   do, so the engine ends up with the same values either way. */
+
+static gboolean
+trn_rec_add_guid(gpointer ops, trn_rec_field field, xmlNodePtr node)
+{
+    GncGUID *id = dom_tree_to_guid(node);
+    g_return_val_if_fail(id, FALSE);
+
+    trn_rec_add(ops, field, id);
+    return TRUE;
+}
+
+static gboolean
+trn_rec_add_text(gpointer ops, trn_rec_field field, xmlNodePtr node)
+{
+    gchar *tmp = dom_tree_to_text(node);
+    g_return_val_if_fail(tmp, FALSE);
+
+    trn_rec_add(ops, field, tmp);
+    return TRUE;
+}
+
+static gboolean
+trn_rec_add_timespec(gpointer ops, trn_rec_field field, xmlNodePtr node)
+{
+    Timespec ts;
+
+    ts = dom_tree_to_timespec(node);
+    if (!dom_tree_valid_timespec(&ts, node->name)) return FALSE;
+
+    trn_rec_add(ops, field, g_memdup(&ts, sizeof(ts)));
+    return TRUE;
+}
+
+static gboolean
+trn_rec_add_gnc_num(gpointer ops, trn_rec_field field, xmlNodePtr node)
+{
+    gnc_numeric *num = dom_tree_to_gnc_numeric(node);
+    g_return_val_if_fail(num, FALSE);
+
+    trn_rec_add(ops, field, num);
+    return TRUE;
+}
+
+static gboolean
+trn_rec_add_node(gpointer ops, trn_rec_field field, xmlNodePtr node)
+{
+    trn_rec_add(ops, field, node);
+    return TRUE;
+}
+
+static gboolean
+spl_rec_id_handler(xmlNodePtr node, gpointer ops)
+{
+    return trn_rec_add_guid(ops, SPL_REC_ID, node);
+}
+
+static gboolean
+spl_rec_memo_handler(xmlNodePtr node, gpointer ops)
+{
+    return trn_rec_add_text(ops, SPL_REC_MEMO, node);
+}
+
+static gboolean
+spl_rec_action_handler(xmlNodePtr node, gpointer ops)
+{
+    return trn_rec_add_text(ops, SPL_REC_ACTION, node);
+}
+
+static gboolean
+spl_rec_reconciled_state_handler(xmlNodePtr node, gpointer ops)
+{
+    return trn_rec_add_text(ops, SPL_REC_RECONCILED_STATE, node);
+}
+
+static gboolean
+spl_rec_reconcile_date_handler(xmlNodePtr node, gpointer ops)
+{
+    return trn_rec_add_timespec(ops, SPL_REC_RECONCILE_DATE, node);
+}
+
+static gboolean
+spl_rec_value_handler(xmlNodePtr node, gpointer ops)
+{
+    return trn_rec_add_gnc_num(ops, SPL_REC_VALUE, node);
+}
+
+static gboolean
+spl_rec_quantity_handler(xmlNodePtr node, gpointer ops)
+{
+    return trn_rec_add_gnc_num(ops, SPL_REC_QUANTITY, node);
+}
+
+static gboolean
+spl_rec_account_handler(xmlNodePtr node, gpointer ops)
+{
+    return trn_rec_add_guid(ops, SPL_REC_ACCOUNT, node);
+}
+
+static gboolean
+spl_rec_lot_handler(xmlNodePtr node, gpointer ops)
+{
+    return trn_rec_add_guid(ops, SPL_REC_LOT, node);
+}
+
+static gboolean
+spl_rec_slots_handler(xmlNodePtr node, gpointer ops)
+{
+    return trn_rec_add_node(ops, SPL_REC_SLOTS, node);
+}
+
+static struct dom_tree_handler spl_rec_dom_handlers[] =
+{
+    { "split:id", spl_rec_id_handler, 1, 0 },
+    { "split:memo", spl_rec_memo_handler, 0, 0 },
+    { "split:action", spl_rec_action_handler, 0, 0 },
+    { "split:reconciled-state", spl_rec_reconciled_state_handler, 1, 0 },
+    { "split:reconcile-date", spl_rec_reconcile_date_handler, 0, 0 },
+    { "split:value", spl_rec_value_handler, 1, 0 },
+    { "split:quantity", spl_rec_quantity_handler, 1, 0 },
+    { "split:account", spl_rec_account_handler, 1, 0 },
+    { "split:lot", spl_rec_lot_handler, 0, 0 },
+    { "split:slots", spl_rec_slots_handler, 0, 0 },
+    { NULL, NULL, 0, 0 },
+};
+
+/* dom_tree_generic_parse() marks off tags in the table it is given,
+   so each worker parses with its own copy. */
+static gboolean
+trn_rec_parse(xmlNodePtr node, const struct dom_tree_handler *table,
+              gsize table_size, GSList **ops)
+{
+    struct dom_tree_handler *handlers;
+    gboolean successful;
+
+    handlers = g_memdup(table, table_size);
+    successful = dom_tree_generic_parse(node, handlers, ops);
+    g_free(handlers);
+
+    *ops = g_slist_reverse(*ops);
+    return successful;
+}
+
+static gboolean
+trn_rec_id_handler(xmlNodePtr node, gpointer ops)
+{
+    return trn_rec_add_guid(ops, TRN_REC_ID, node);
+}
+
+static gboolean
+trn_rec_currency_handler(xmlNodePtr node, gpointer ops)
+{
+    return trn_rec_add_node(ops, TRN_REC_CURRENCY, node);
+}
+
+static gboolean
+trn_rec_num_handler(xmlNodePtr node, gpointer ops)
+{
+    return trn_rec_add_text(ops, TRN_REC_NUM, node);
+}
+
+static gboolean
+trn_rec_date_posted_handler(xmlNodePtr node, gpointer ops)
+{
+    return trn_rec_add_timespec(ops, TRN_REC_DATE_POSTED, node);
+}
+
+static gboolean
+trn_rec_date_entered_handler(xmlNodePtr node, gpointer ops)
+{
+    return trn_rec_add_timespec(ops, TRN_REC_DATE_ENTERED, node);
+}
+
+static gboolean
+trn_rec_description_handler(xmlNodePtr node, gpointer ops)
+{
+    return trn_rec_add_text(ops, TRN_REC_DESCRIPTION, node);
+}
+
+static gboolean
+trn_rec_slots_handler(xmlNodePtr node, gpointer ops)
+{
+    return trn_rec_add_node(ops, TRN_REC_SLOTS, node);
+}
+
+static gboolean
+trn_rec_splits_handler(xmlNodePtr node, gpointer ops)
+{
+    GSList *splits = NULL;
+    xmlNodePtr mark;
+    gboolean ok = TRUE;
+
+    g_return_val_if_fail(node, FALSE);
+    g_return_val_if_fail(node->xmlChildrenNode, FALSE);
+
+    /* Like trn_splits_handler, keep the splits before a bad one */
+    for (mark = node->xmlChildrenNode; mark && ok; mark = mark->next)
+    {
+        GSList *spl_ops = NULL;
+
+        if (safe_strcmp("text", (char*)mark->name) == 0)
+            continue;
+
+        if (safe_strcmp("trn:split", (char*)mark->name) == 0 &&
+                trn_rec_parse(mark, spl_rec_dom_handlers,
+                              sizeof(spl_rec_dom_handlers), &spl_ops))
+        {
+            splits = g_slist_prepend(splits, spl_ops);
+        }
+        else
+        {
+            trn_rec_ops_free(spl_ops);
+            ok = FALSE;
+        }
+    }
+
+    trn_rec_add(ops, TRN_REC_SPLITS, g_slist_reverse(splits));
+    return ok;
+}
+
+static struct dom_tree_handler trn_rec_dom_handlers[] =
+{
+    { "trn:id", trn_rec_id_handler, 1, 0 },
+    { "trn:currency", trn_rec_currency_handler, 0, 0},
+    { "trn:num", trn_rec_num_handler, 0, 0 },
+    { "trn:date-posted", trn_rec_date_posted_handler, 1, 0 },
+    { "trn:date-entered", trn_rec_date_entered_handler, 1, 0 },
+    { "trn:description", trn_rec_description_handler, 0, 0 },
+    { "trn:slots", trn_rec_slots_handler, 0, 0 },
+    { "trn:splits", trn_rec_splits_handler, 1, 0 },
+    { NULL, NULL, 0, 0 },
+};
+
+static void
+spl_rec_apply(Split *spl, trn_rec_op *op, QofBook *book)
+{
+    gboolean successful;
+
+    switch (op->field)
+    {
+    case SPL_REC_ID:
+        xaccSplitSetGUID(spl, op->value);
+        break;
+    case SPL_REC_MEMO:
+        xaccSplitSetMemo(spl, op->value);
+        break;
+    case SPL_REC_ACTION:
+        xaccSplitSetAction(spl, op->value);
+        break;
+    case SPL_REC_RECONCILED_STATE:
+        xaccSplitSetReconcile(spl, ((gchar*)op->value)[0]);
+        break;
+    case SPL_REC_RECONCILE_DATE:
+        xaccSplitSetDateReconciledTS(spl, op->value);
+        break;
+    case SPL_REC_VALUE:
+        xaccSplitSetValue(spl, *(gnc_numeric*)op->value);
+        break;
+    case SPL_REC_QUANTITY:
+        xaccSplitSetAmount(spl, *(gnc_numeric*)op->value);
+        break;
+    case SPL_REC_ACCOUNT:
+        spl_set_account(spl, op->value, book);
+        break;
+    case SPL_REC_LOT:
+        spl_set_lot(spl, op->value, book);
+        break;
+    case SPL_REC_SLOTS:
+        successful = dom_tree_to_kvp_frame_given(op->value,
+                     xaccSplitGetSlots(spl));
+        g_return_if_fail(successful);
+        break;
+    default:
+        break;
+    }
+}
+
+static void
+trn_rec_apply(Transaction *trn, trn_rec_op *op, QofBook *book)
+{
+    gboolean successful;
+    GSList *n, *m;
+
+    switch (op->field)
+    {
+    case TRN_REC_ID:
+        xaccTransSetGUID(trn, op->value);
+        break;
+    case TRN_REC_CURRENCY:
+        xaccTransSetCurrency(trn, dom_tree_to_commodity_ref(op->value, book));
+        break;
+    case TRN_REC_NUM:
+        xaccTransSetNum(trn, op->value);
+        break;
+    case TRN_REC_DATE_POSTED:
+        xaccTransSetDatePostedTS(trn, op->value);
+        break;
+    case TRN_REC_DATE_ENTERED:
+        xaccTransSetDateEnteredTS(trn, op->value);
+        break;
+    case TRN_REC_DESCRIPTION:
+        xaccTransSetDescription(trn, op->value);
+        break;
+    case TRN_REC_SLOTS:
+        successful = dom_tree_to_kvp_frame_given(op->value,
+                     xaccTransGetSlots(trn));
+        g_return_if_fail(successful);
+        break;
+    case TRN_REC_SPLITS:
+        for (n = op->value; n; n = n->next)
+        {
+            Split *spl = xaccMallocSplit(book);
+
+            for (m = n->data; m; m = m->next)
+                spl_rec_apply(spl, m->data, book);
+            xaccTransAppendSplit(trn, spl);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+struct GncXmlTrnLoader
+{
+    GThreadPool *pool;
+    GMutex *lock;
+    GCond *cond;
+    GQueue *jobs;               /* trn_rec_job, in file order */
+    gboolean failed;
+};
+
+typedef struct
+{
+    xmlNodePtr tree;
+    gchar *tag;
+    gxpf_callback cb;
+    gpointer parsedata;
+    QofBook *book;
+
+    /* Set by the worker, under the loader's lock */
+    GSList *ops;
+    gboolean ok;
+    gboolean done;
+} trn_rec_job;
+
+static void
+trn_rec_job_run(gpointer data, gpointer user_data)
+{
+    trn_rec_job *job = data;
+    GncXmlTrnLoader *loader = user_data;
+    GSList *ops = NULL;
+    gboolean ok;
+
+    ok = trn_rec_parse(job->tree, trn_rec_dom_handlers,
+                       sizeof(trn_rec_dom_handlers), &ops);
+
+    g_mutex_lock(loader->lock);
+    job->ops = ops;
+    job->ok = ok;
+    job->done = TRUE;
+    g_cond_broadcast(loader->cond);
+    g_mutex_unlock(loader->lock);
+}
+
+/* Does what dom_tree_to_transaction() and the end handler do, from
+   the parsed ops. */
+static gboolean
+trn_rec_job_finish(trn_rec_job *job)
+{
+    Transaction *trn;
+    GSList *n;
+    gboolean ok = job->ok;
+
+    if (ok)
+    {
+        trn = xaccMallocTransaction(job->book);
+        xaccTransBeginEdit(trn);
+        for (n = job->ops; n; n = n->next)
+            trn_rec_apply(trn, n->data, job->book);
+        xaccTransCommitEdit(trn);
+
+        job->cb(job->tag, job->parsedata, trn);
+    }
+    else
+    {
+        xmlElemDump(stdout, NULL, job->tree);
+    }
+
+    trn_rec_ops_free(job->ops);
+    xmlFreeNode(job->tree);
+    g_free(job->tag);
+    g_free(job);
+
+    return ok;
+}
+
+/* Builds the transactions at the head of the queue, waiting for the
+   workers until no more than max_pending are left.  Returns FALSE if
+   any of the transactions built could not be parsed. */
+static gboolean
+trn_loader_finish_jobs(GncXmlTrnLoader *loader, guint max_pending)
+{
+    trn_rec_job *job;
+    gboolean ok = TRUE;
+
+    g_mutex_lock(loader->lock);
+    while ((job = g_queue_peek_head(loader->jobs)) != NULL)
+    {
+        if (!job->done)
+        {
+            if (g_queue_get_length(loader->jobs) <= max_pending)
+                break;
+            g_cond_wait(loader->cond, loader->lock);
+            continue;
+        }
+
+        g_queue_pop_head(loader->jobs);
+        g_mutex_unlock(loader->lock);
+        ok = trn_rec_job_finish(job) && ok;
+        g_mutex_lock(loader->lock);
+    }
+    g_mutex_unlock(loader->lock);
+
+    if (!ok)
+        loader->failed = TRUE;
+    return ok;
+}
+
+static gboolean
+trn_loader_submit(GncXmlTrnLoader *loader, xmlNodePtr tree,
+                  const gchar *tag, gxpf_data *gdata)
+{
+    trn_rec_job *job = g_new0(trn_rec_job, 1);
+
+    job->tree = tree;
+    job->tag = g_strdup(tag);
+    job->cb = gdata->cb;
+    job->parsedata = gdata->parsedata;
+    job->book = gdata->bookdata;
+
+    g_queue_push_tail(loader->jobs, job);
+    g_thread_pool_push(loader->pool, job, NULL);
+
+    return trn_loader_finish_jobs(loader, TRN_REC_MAX_PENDING);
+}
+
+GncXmlTrnLoader *
+gnc_transaction_xml_loader_new(gint n_threads)
+{
+    GncXmlTrnLoader *loader;
+    GError *error = NULL;
+
+    if (n_threads < 1 || !g_thread_supported())
+        return NULL;
+
+    loader = g_new0(GncXmlTrnLoader, 1);
+    loader->pool = g_thread_pool_new(trn_rec_job_run, loader, n_threads,
+                                     FALSE, &error);
+    if (!loader->pool)
+    {
+        g_warning("Could not create threads for loading transactions: %s",
+                  error ? error->message : "(null)");
+        if (error)
+            g_error_free(error);
+        g_free(loader);
+        return NULL;
+    }
+
+    loader->lock = g_mutex_new();
+    loader->cond = g_cond_new();
+    loader->jobs = g_queue_new();
+
+    return loader;
+}
+
+gboolean
+gnc_transaction_xml_loader_flush(GncXmlTrnLoader *loader)
+{
+    g_return_val_if_fail(loader, FALSE);
+
+    return trn_loader_finish_jobs(loader, 0);
+}
+
+gboolean
+gnc_transaction_xml_loader_destroy(GncXmlTrnLoader *loader)
+{
+    gboolean ok;
+
+    if (!loader)
+        return TRUE;
+
+    gnc_transaction_xml_loader_flush(loader);
+    g_thread_pool_free(loader->pool, FALSE, TRUE);
+    ok = !loader->failed;
+
+    g_queue_free(loader->jobs);
+    g_cond_free(loader->cond);
+    g_mutex_free(loader->lock);
+    g_free(loader);
+
+    return ok;
+}
+
 static gboolean
 gnc_transaction_end_handler(gpointer data_for_children,
                             GSList* data_from_children, GSList* sibling_data,
@@ -597,6 +1326,9 @@ gnc_transaction_end_handler(gpointer data_for_children,
 
     g_return_val_if_fail(tree, FALSE);
 
+    if (gdata->trn_loader)
+        return trn_loader_submit(gdata->trn_loader, tree, tag, gdata);
+
     trn = dom_tree_to_transaction(tree, gdata->bookdata);
     if (trn != NULL)
     {
@@ -31,6 +31,7 @@
 #include "gnc-budget.h"
 #include "gnc-xml-helper.h"
 #include "sixtp.h"
+#include "io-gncxml-gen.h"
 
 xmlNodePtr gnc_account_dom_tree_create(Account *act, gboolean exporting,
                                        gboolean allow_incompat);
@@ -59,8 +60,23 @@ xmlNodePtr gnc_budget_dom_tree_create( GncBudget *bgt );
 sixtp* gnc_budget_sixtp_parser_create(void);
 
 xmlNodePtr gnc_transaction_dom_tree_create(Transaction *txn);
+/* Appends the XML that xmlElemDump() writes for the transaction's DOM
+   tree, and a newline.  Returns FALSE if the output would differ, in
+   which case the caller should discard it and use the DOM. */
+gboolean gnc_transaction_xml_stream_write(GString *out, Transaction *txn);
 sixtp* gnc_transaction_sixtp_parser_create(void);
 
+/* With a loader in the parser's gxpf_data, transactions are parsed by
+   n_threads worker threads and built on the parsing thread in file
+   order.  Returns NULL if threads are not available. */
+GncXmlTrnLoader* gnc_transaction_xml_loader_new(gint n_threads);
+/* Builds every transaction submitted so far.  Returns FALSE if any of
+   them could not be parsed. */
+gboolean gnc_transaction_xml_loader_flush(GncXmlTrnLoader *loader);
+/* Flushes and frees the loader.  Returns FALSE if any transaction it
+   was given could not be parsed. */
+gboolean gnc_transaction_xml_loader_destroy(GncXmlTrnLoader *loader);
+
 sixtp* gnc_template_transaction_sixtp_parser_create(void);
 
 #endif /* GNC_XML_H */
@@ -0,0 +1,1161 @@
+/********************************************************************\
+ * io-book-cache.c -- binary cache of a book beside its data file   *
+ *                                                                  *
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 51 Franklin Street, Fifth Floor    Fax:    +1-617-542-2652       *
+ * Boston, MA  02110-1301,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+#include "config.h"
+
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "gnc-engine.h"
+#include "Account.h"
+#include "Transaction.h"
+#include "gnc-commodity.h"
+#include "gnc-lot.h"
+#include "io-book-cache.h"
+
+static QofLogModule log_module = GNC_MOD_IO;
+
+#define CACHE_MAGIC "GNCBKC\r\n"        /* \r\n catches text mode copies */
+#define CACHE_VERSION 1
+#define NONE G_MAXUINT32                /* no string, guid or slots */
+#define MAX_KVP_DEPTH 64
+#define CRC_CHUNK (1024 * 1024)
+
+/* The sections of the file, in order, each starting on an 8 byte
+   boundary.  The columns hold one fixed width field for each
+   transaction or split; strings, guids and slots are referred to by
+   their offset or index in the sections that hold them.  Everything is
+   little-endian. */
+enum
+{
+    SECTION_XML,
+    SECTION_STRINGS,            /* NUL terminated */
+    SECTION_GUIDS,              /* the accounts and lots of the splits */
+    SECTION_SLOTS,              /* encoded frames */
+
+    COL_TRN_GUID,
+    COL_TRN_CURRENCY_NS,
+    COL_TRN_CURRENCY_ID,
+    COL_TRN_NUM,
+    COL_TRN_DESCRIPTION,
+    COL_TRN_POSTED_SEC,         /* each _SEC is followed by its _NSEC */
+    COL_TRN_POSTED_NSEC,
+    COL_TRN_ENTERED_SEC,
+    COL_TRN_ENTERED_NSEC,
+    COL_TRN_SLOTS,
+    COL_TRN_N_SPLITS,
+
+    COL_SPL_GUID,
+    COL_SPL_MEMO,
+    COL_SPL_ACTION,
+    COL_SPL_RECONCILED,
+    COL_SPL_RECONCILE_SEC,
+    COL_SPL_RECONCILE_NSEC,
+    COL_SPL_VALUE_NUM,          /* each _NUM is followed by its _DENOM */
+    COL_SPL_VALUE_DENOM,
+    COL_SPL_AMOUNT_NUM,
+    COL_SPL_AMOUNT_DENOM,
+    COL_SPL_ACCOUNT,
+    COL_SPL_LOT,
+    COL_SPL_SLOTS,
+
+    N_SECTIONS
+};
+
+#define FIRST_SPL_COL COL_SPL_GUID
+
+/* The width of each column, 0 for the other sections */
+static const guint column_width[N_SECTIONS] =
+{
+    0, 0, 0, 0,
+    16, 4, 4, 4, 4, 8, 8, 8, 8, 4, 4,
+    16, 4, 4, 1, 8, 8, 8, 8, 8, 8, 4, 4, 4
+};
+
+/* The header holds the magic, the version, the number of sections, the
+   data file's size, mtime and CRC, the CRC of the rest of the cache,
+   the number of transactions and of splits, and then the offset and
+   length of each section. */
+#define HEADER_SECTIONS 48
+#define HEADER_SIZE (HEADER_SECTIONS + 16 * N_SECTIONS)
+
+static void
+set_u32(guint8 *p, guint32 v)
+{
+    gint i;
+
+    for (i = 0; i < 4; i++)
+        p[i] = (v >> (8 * i)) & 0xff;
+}
+
+static void
+set_u64(guint8 *p, guint64 v)
+{
+    set_u32(p, v & 0xffffffff);
+    set_u32(p + 4, v >> 32);
+}
+
+static guint32
+get_u32(const guint8 *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((guint32) p[3] << 24);
+}
+
+static guint64
+get_u64(const guint8 *p)
+{
+    return get_u32(p) | ((guint64) get_u32(p + 4) << 32);
+}
+
+static guint32
+buffer_crc(const guint8 *data, gsize len)
+{
+    guint32 crc = crc32(0L, Z_NULL, 0);
+
+    while (len > 0)
+    {
+        gsize n = MIN(len, CRC_CHUNK);
+
+        crc = crc32(crc, data, n);
+        data += n;
+        len -= n;
+    }
+    return crc;
+}
+
+/* The CRC of file from start to the end */
+static gboolean
+file_crc(FILE *file, long start, guint32 *crc)
+{
+    guint8 *buf;
+    size_t n;
+    gboolean ok;
+
+    if (fseek(file, start, SEEK_SET) != 0)
+        return FALSE;
+
+    buf = g_malloc(CRC_CHUNK);
+    *crc = crc32(0L, Z_NULL, 0);
+    while ((n = fread(buf, 1, CRC_CHUNK, file)) > 0)
+        *crc = crc32(*crc, buf, n);
+    ok = !ferror(file);
+    g_free(buf);
+
+    return ok;
+}
+
+gboolean
+gnc_book_cache_identify(const gchar *datafile, GncBookCacheId *id)
+{
+    struct stat statbuf;
+    FILE *file;
+    gboolean ok;
+
+    g_return_val_if_fail(datafile && id, FALSE);
+
+    if (g_stat(datafile, &statbuf) != 0)
+        return FALSE;
+    file = g_fopen(datafile, "rb");
+    if (!file)
+        return FALSE;
+
+    id->size = statbuf.st_size;
+    id->mtime = statbuf.st_mtime;
+    ok = file_crc(file, 0, &id->crc);
+    fclose(file);
+
+    return ok;
+}
+
+/***********************************************************************/
+/* Writing */
+
+struct GncBookCacheWriter
+{
+    FILE *out;
+    GByteArray *section[N_SECTIONS];    /* all but SECTION_XML */
+    GHashTable *strings;                /* gchar* -> offset + 1 */
+    GHashTable *guids;                  /* GncGUID* -> index + 1 */
+    guint32 n_trans;
+    guint32 n_splits;
+    gboolean ok;
+};
+
+static void
+put_u8(GByteArray *a, guint8 v)
+{
+    g_byte_array_append(a, &v, 1);
+}
+
+static void
+put_u32(GByteArray *a, guint32 v)
+{
+    guint8 b[4];
+
+    set_u32(b, v);
+    g_byte_array_append(a, b, sizeof(b));
+}
+
+static void
+put_u64(GByteArray *a, guint64 v)
+{
+    guint8 b[8];
+
+    set_u64(b, v);
+    g_byte_array_append(a, b, sizeof(b));
+}
+
+static void
+put_guid(GByteArray *a, const GncGUID *guid)
+{
+    g_byte_array_append(a, (guid ? guid : guid_null())->data, GUID_DATA_SIZE);
+}
+
+static guint32
+writer_string(GncBookCacheWriter *writer, const gchar *str)
+{
+    GByteArray *strings = writer->section[SECTION_STRINGS];
+    gpointer found;
+    guint32 offset;
+    gsize len;
+
+    if (!str)
+        return NONE;
+
+    found = g_hash_table_lookup(writer->strings, str);
+    if (found)
+        return GPOINTER_TO_UINT(found) - 1;
+
+    len = strlen(str) + 1;
+    if (strings->len >= NONE - len)
+    {
+        writer->ok = FALSE;
+        return NONE;
+    }
+
+    offset = strings->len;
+    g_byte_array_append(strings, (const guint8 *) str, len);
+    g_hash_table_insert(writer->strings, g_strdup(str),
+                        GUINT_TO_POINTER(offset + 1));
+    return offset;
+}
+
+static guint32
+writer_guid(GncBookCacheWriter *writer, const GncGUID *guid)
+{
+    GByteArray *guids = writer->section[SECTION_GUIDS];
+    gpointer found;
+    guint32 index;
+
+    if (!guid)
+        return NONE;
+
+    found = g_hash_table_lookup(writer->guids, guid);
+    if (found)
+        return GPOINTER_TO_UINT(found) - 1;
+
+    index = guids->len / GUID_DATA_SIZE;
+    put_guid(guids, guid);
+    g_hash_table_insert(writer->guids, g_memdup(guid, sizeof(GncGUID)),
+                        GUINT_TO_POINTER(index + 1));
+    return index;
+}
+
+/* A frame is its number of slots, then each slot's key and value.  A
+   value is its KvpValueType in a byte, then the value itself. */
+
+typedef struct
+{
+    GncBookCacheWriter *writer;
+    guint32 n_slots;
+} frame_data;
+
+static void writer_kvp_frame(GncBookCacheWriter *writer, KvpFrame *frame);
+
+static void
+writer_kvp_value(GncBookCacheWriter *writer, const KvpValue *val)
+{
+    GByteArray *slots = writer->section[SECTION_SLOTS];
+    KvpValueType type = kvp_value_get_type(val);
+
+    put_u8(slots, type);
+    switch (type)
+    {
+    case KVP_TYPE_GINT64:
+        put_u64(slots, kvp_value_get_gint64(val));
+        break;
+    case KVP_TYPE_DOUBLE:
+    {
+        gdouble d = kvp_value_get_double(val);
+        guint64 bits;
+
+        memcpy(&bits, &d, sizeof(bits));
+        put_u64(slots, bits);
+        break;
+    }
+    case KVP_TYPE_NUMERIC:
+    {
+        gnc_numeric n = kvp_value_get_numeric(val);
+
+        put_u64(slots, n.num);
+        put_u64(slots, n.denom);
+        break;
+    }
+    case KVP_TYPE_STRING:
+        put_u32(slots, writer_string(writer, kvp_value_get_string(val)));
+        break;
+    case KVP_TYPE_GUID:
+        put_guid(slots, kvp_value_get_guid(val));
+        break;
+    case KVP_TYPE_TIMESPEC:
+    {
+        Timespec ts = kvp_value_get_timespec(val);
+
+        put_u64(slots, ts.tv_sec);
+        put_u64(slots, ts.tv_nsec);
+        break;
+    }
+    case KVP_TYPE_BINARY:
+    {
+        guint64 size;
+        void *data = kvp_value_get_binary(val, &size);
+
+        if (!data)
+            size = 0;
+        put_u64(slots, size);
+        if (size > 0)
+            g_byte_array_append(slots, data, size);
+        break;
+    }
+    case KVP_TYPE_GLIST:
+    {
+        GList *node = kvp_value_get_glist(val);
+
+        put_u32(slots, g_list_length(node));
+        for (; node; node = node->next)
+            writer_kvp_value(writer, node->data);
+        break;
+    }
+    case KVP_TYPE_FRAME:
+        writer_kvp_frame(writer, kvp_value_get_frame(val));
+        break;
+    case KVP_TYPE_GDATE:
+    {
+        GDate date = kvp_value_get_gdate(val);
+
+        put_u32(slots, g_date_valid(&date) ? g_date_get_julian(&date) : 0);
+        break;
+    }
+    default:
+        PWARN("unknown kvp value type %d", type);
+        writer->ok = FALSE;
+        break;
+    }
+}
+
+static void
+writer_kvp_slot(const gchar *key, KvpValue *val, gpointer data)
+{
+    frame_data *fdata = data;
+    GncBookCacheWriter *writer = fdata->writer;
+
+    put_u32(writer->section[SECTION_SLOTS], writer_string(writer, key));
+    writer_kvp_value(writer, val);
+    fdata->n_slots++;
+}
+
+static void
+writer_kvp_frame(GncBookCacheWriter *writer, KvpFrame *frame)
+{
+    GByteArray *slots = writer->section[SECTION_SLOTS];
+    guint pos = slots->len;
+    frame_data fdata;
+
+    fdata.writer = writer;
+    fdata.n_slots = 0;
+
+    /* Filled in once the slots are counted */
+    put_u32(slots, 0);
+    if (frame)
+        kvp_frame_for_each_slot(frame, writer_kvp_slot, &fdata);
+    set_u32(slots->data + pos, fdata.n_slots);
+}
+
+static guint32
+writer_slots(GncBookCacheWriter *writer, KvpFrame *frame)
+{
+    guint offset = writer->section[SECTION_SLOTS]->len;
+
+    if (!frame || kvp_frame_is_empty(frame))
+        return NONE;
+
+    if (offset >= NONE)
+    {
+        writer->ok = FALSE;
+        return NONE;
+    }
+    writer_kvp_frame(writer, frame);
+    return offset;
+}
+
+/* As in the XML, empty nums, memos and actions are not kept */
+static guint32
+writer_nonempty_string(GncBookCacheWriter *writer, const gchar *str)
+{
+    return writer_string(writer, str && *str ? str : NULL);
+}
+
+static void
+writer_add_split(GncBookCacheWriter *writer, Split *spl)
+{
+    GByteArray **col = writer->section;
+    Account *account = xaccSplitGetAccount(spl);
+    GNCLot *lot = xaccSplitGetLot(spl);
+    Timespec ts = xaccSplitRetDateReconciledTS(spl);
+    gnc_numeric value = xaccSplitGetValue(spl);
+    gnc_numeric amount = xaccSplitGetAmount(spl);
+
+    put_guid(col[COL_SPL_GUID], xaccSplitGetGUID(spl));
+    put_u32(col[COL_SPL_MEMO],
+            writer_nonempty_string(writer, xaccSplitGetMemo(spl)));
+    put_u32(col[COL_SPL_ACTION],
+            writer_nonempty_string(writer, xaccSplitGetAction(spl)));
+    put_u8(col[COL_SPL_RECONCILED], xaccSplitGetReconcile(spl));
+    put_u64(col[COL_SPL_RECONCILE_SEC], ts.tv_sec);
+    put_u64(col[COL_SPL_RECONCILE_NSEC], ts.tv_nsec);
+    put_u64(col[COL_SPL_VALUE_NUM], value.num);
+    put_u64(col[COL_SPL_VALUE_DENOM], value.denom);
+    put_u64(col[COL_SPL_AMOUNT_NUM], amount.num);
+    put_u64(col[COL_SPL_AMOUNT_DENOM], amount.denom);
+    put_u32(col[COL_SPL_ACCOUNT],
+            writer_guid(writer, account ? xaccAccountGetGUID(account) : NULL));
+    put_u32(col[COL_SPL_LOT],
+            writer_guid(writer, lot ? gnc_lot_get_guid(lot) : NULL));
+    put_u32(col[COL_SPL_SLOTS], writer_slots(writer, xaccSplitGetSlots(spl)));
+
+    writer->n_splits++;
+}
+
+void
+gnc_book_cache_writer_add_transaction(GncBookCacheWriter *writer,
+                                      Transaction *trn)
+{
+    GByteArray **col;
+    gnc_commodity *currency;
+    Timespec ts;
+    GList *node;
+    guint32 n_splits = 0;
+
+    g_return_if_fail(writer && trn);
+
+    col = writer->section;
+    currency = xaccTransGetCurrency(trn);
+
+    put_guid(col[COL_TRN_GUID], xaccTransGetGUID(trn));
+    put_u32(col[COL_TRN_CURRENCY_NS], writer_string(writer,
+            currency ? gnc_commodity_get_namespace(currency) : NULL));
+    put_u32(col[COL_TRN_CURRENCY_ID], writer_string(writer,
+            currency ? gnc_commodity_get_mnemonic(currency) : NULL));
+    put_u32(col[COL_TRN_NUM],
+            writer_nonempty_string(writer, xaccTransGetNum(trn)));
+    put_u32(col[COL_TRN_DESCRIPTION],
+            writer_string(writer, xaccTransGetDescription(trn)));
+    ts = xaccTransRetDatePostedTS(trn);
+    put_u64(col[COL_TRN_POSTED_SEC], ts.tv_sec);
+    put_u64(col[COL_TRN_POSTED_NSEC], ts.tv_nsec);
+    ts = xaccTransRetDateEnteredTS(trn);
+    put_u64(col[COL_TRN_ENTERED_SEC], ts.tv_sec);
+    put_u64(col[COL_TRN_ENTERED_NSEC], ts.tv_nsec);
+    put_u32(col[COL_TRN_SLOTS], writer_slots(writer, xaccTransGetSlots(trn)));
+
+    for (node = xaccTransGetSplitList(trn); node; node = node->next)
+    {
+        writer_add_split(writer, node->data);
+        n_splits++;
+    }
+    put_u32(col[COL_TRN_N_SPLITS], n_splits);
+
+    writer->n_trans++;
+}
+
+GncBookCacheWriter *
+gnc_book_cache_writer_new(FILE *out)
+{
+    static const guint8 header[HEADER_SIZE];
+    GncBookCacheWriter *writer;
+    gint i;
+
+    g_return_val_if_fail(out, NULL);
+
+    writer = g_new0(GncBookCacheWriter, 1);
+    writer->out = out;
+    for (i = SECTION_STRINGS; i < N_SECTIONS; i++)
+        writer->section[i] = g_byte_array_new();
+    writer->strings = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                            g_free, NULL);
+    writer->guids = g_hash_table_new_full(guid_hash_to_guint,
+                                          guid_g_hash_table_equal,
+                                          g_free, NULL);
+
+    /* Written properly once everything else is */
+    writer->ok = fwrite(header, 1, sizeof(header), out) == sizeof(header);
+
+    return writer;
+}
+
+gboolean
+gnc_book_cache_writer_close(GncBookCacheWriter *writer,
+                            const GncBookCacheId *id)
+{
+    static const guint8 padding[8];
+    guint8 header[HEADER_SIZE];
+    guint64 offset[N_SECTIONS];
+    guint64 length[N_SECTIONS];
+    FILE *out;
+    guint32 crc = 0;
+    long pos;
+    gboolean ok;
+    gint i;
+
+    g_return_val_if_fail(writer && id, FALSE);
+
+    out = writer->out;
+    pos = ftell(out);
+    ok = writer->ok && pos >= HEADER_SIZE;
+
+    offset[SECTION_XML] = HEADER_SIZE;
+    length[SECTION_XML] = pos - HEADER_SIZE;
+    for (i = SECTION_STRINGS; ok && i < N_SECTIONS; i++)
+    {
+        GByteArray *section = writer->section[i];
+        size_t pad = (8 - pos % 8) % 8;
+
+        ok = fwrite(padding, 1, pad, out) == pad &&
+             (section->len == 0 ||
+              fwrite(section->data, 1, section->len, out) == section->len);
+        offset[i] = pos + pad;
+        length[i] = section->len;
+        pos += pad + section->len;
+    }
+
+    ok = ok && fflush(out) == 0 && file_crc(out, HEADER_SIZE, &crc);
+
+    if (ok)
+    {
+        memcpy(header, CACHE_MAGIC, 8);
+        set_u32(header + 8, CACHE_VERSION);
+        set_u32(header + 12, N_SECTIONS);
+        set_u64(header + 16, id->size);
+        set_u64(header + 24, id->mtime);
+        set_u32(header + 32, id->crc);
+        set_u32(header + 36, crc);
+        set_u32(header + 40, writer->n_trans);
+        set_u32(header + 44, writer->n_splits);
+        for (i = 0; i < N_SECTIONS; i++)
+        {
+            set_u64(header + HEADER_SECTIONS + 16 * i, offset[i]);
+            set_u64(header + HEADER_SECTIONS + 16 * i + 8, length[i]);
+        }
+
+        ok = fseek(out, 0, SEEK_SET) == 0 &&
+             fwrite(header, 1, sizeof(header), out) == sizeof(header) &&
+             fflush(out) == 0;
+    }
+
+    for (i = SECTION_STRINGS; i < N_SECTIONS; i++)
+        g_byte_array_free(writer->section[i], TRUE);
+    g_hash_table_destroy(writer->strings);
+    g_hash_table_destroy(writer->guids);
+    g_free(writer);
+
+    return ok;
+}
+
+/***********************************************************************/
+/* Reading */
+
+struct GncBookCache
+{
+    GMappedFile *file;
+    const guint8 *section[N_SECTIONS];
+    guint64 length[N_SECTIONS];
+    guint32 n_trans;
+    guint32 n_splits;
+};
+
+static guint32
+col_u32(const GncBookCache *cache, gint col, guint32 row)
+{
+    return get_u32(cache->section[col] + 4 * (gsize) row);
+}
+
+static gint64
+col_i64(const GncBookCache *cache, gint col, guint32 row)
+{
+    return (gint64) get_u64(cache->section[col] + 8 * (gsize) row);
+}
+
+static void
+col_guid(const GncBookCache *cache, gint col, guint32 row, GncGUID *guid)
+{
+    memcpy(guid->data, cache->section[col] + GUID_DATA_SIZE * (gsize) row,
+           GUID_DATA_SIZE);
+}
+
+static const gchar *
+col_string(const GncBookCache *cache, gint col, guint32 row)
+{
+    guint32 offset = col_u32(cache, col, row);
+
+    if (offset == NONE)
+        return NULL;
+    return (const gchar *) cache->section[SECTION_STRINGS] + offset;
+}
+
+static Timespec
+col_timespec(const GncBookCache *cache, gint sec_col, guint32 row)
+{
+    Timespec ts;
+
+    ts.tv_sec = col_i64(cache, sec_col, row);
+    ts.tv_nsec = col_i64(cache, sec_col + 1, row);
+    return ts;
+}
+
+static gnc_numeric
+col_numeric(const GncBookCache *cache, gint num_col, guint32 row)
+{
+    return gnc_numeric_create(col_i64(cache, num_col, row),
+                              col_i64(cache, num_col + 1, row));
+}
+
+#define SLOTS_LEFT(cache, pos) \
+    ((gsize) ((cache)->section[SECTION_SLOTS] + \
+              (cache)->length[SECTION_SLOTS] - (pos)))
+
+static gboolean
+read_string(const GncBookCache *cache, const guint8 **pos, const gchar **str)
+{
+    guint32 offset;
+
+    if (SLOTS_LEFT(cache, *pos) < 4)
+        return FALSE;
+    offset = get_u32(*pos);
+    *pos += 4;
+
+    if (offset == NONE)
+        *str = NULL;
+    else if (offset < cache->length[SECTION_STRINGS])
+        *str = (const gchar *) cache->section[SECTION_STRINGS] + offset;
+    else
+        return FALSE;
+    return TRUE;
+}
+
+/* These read the frame or value at *pos into frame or *value, or just
+   check it if frame or value is NULL. */
+static gboolean read_kvp_value(const GncBookCache *cache, const guint8 **pos,
+                               gint depth, KvpValue **value);
+
+static gboolean
+read_kvp_frame(const GncBookCache *cache, const guint8 **pos, gint depth,
+               KvpFrame *frame)
+{
+    guint32 n_slots;
+
+    if (depth > MAX_KVP_DEPTH || SLOTS_LEFT(cache, *pos) < 4)
+        return FALSE;
+    n_slots = get_u32(*pos);
+    *pos += 4;
+
+    while (n_slots-- > 0)
+    {
+        const gchar *key;
+        KvpValue *value = NULL;
+
+        if (!read_string(cache, pos, &key) || !key ||
+                !read_kvp_value(cache, pos, depth + 1, frame ? &value : NULL))
+            return FALSE;
+        if (frame)
+            kvp_frame_set_slot_nc(frame, key, value);
+    }
+    return TRUE;
+}
+
+static gboolean
+read_kvp_value(const GncBookCache *cache, const guint8 **pos, gint depth,
+               KvpValue **value)
+{
+    const guint8 *p;
+    gsize left;
+    guint8 type;
+
+    if (depth > MAX_KVP_DEPTH || SLOTS_LEFT(cache, *pos) < 1)
+        return FALSE;
+    type = **pos;
+    p = ++(*pos);
+    left = SLOTS_LEFT(cache, p);
+
+    switch (type)
+    {
+    case KVP_TYPE_GINT64:
+        if (left < 8)
+            return FALSE;
+        if (value)
+            *value = kvp_value_new_gint64((gint64) get_u64(p));
+        *pos += 8;
+        return TRUE;
+
+    case KVP_TYPE_DOUBLE:
+    {
+        guint64 bits;
+        gdouble d;
+
+        if (left < 8)
+            return FALSE;
+        bits = get_u64(p);
+        memcpy(&d, &bits, sizeof(d));
+        if (value)
+            *value = kvp_value_new_double(d);
+        *pos += 8;
+        return TRUE;
+    }
+
+    case KVP_TYPE_NUMERIC:
+        if (left < 16)
+            return FALSE;
+        if (value)
+            *value = kvp_value_new_numeric(
+                         gnc_numeric_create((gint64) get_u64(p),
+                                            (gint64) get_u64(p + 8)));
+        *pos += 16;
+        return TRUE;
+
+    case KVP_TYPE_STRING:
+    {
+        const gchar *str;
+
+        if (!read_string(cache, pos, &str))
+            return FALSE;
+        if (value)
+            *value = kvp_value_new_string(str);
+        return TRUE;
+    }
+
+    case KVP_TYPE_GUID:
+    {
+        GncGUID guid;
+
+        if (left < GUID_DATA_SIZE)
+            return FALSE;
+        memcpy(guid.data, p, GUID_DATA_SIZE);
+        if (value)
+            *value = kvp_value_new_guid(&guid);
+        *pos += GUID_DATA_SIZE;
+        return TRUE;
+    }
+
+    case KVP_TYPE_TIMESPEC:
+    {
+        Timespec ts;
+
+        if (left < 16)
+            return FALSE;
+        ts.tv_sec = (gint64) get_u64(p);
+        ts.tv_nsec = (gint64) get_u64(p + 8);
+        if (value)
+            *value = kvp_value_new_timespec(ts);
+        *pos += 16;
+        return TRUE;
+    }
+
+    case KVP_TYPE_BINARY:
+    {
+        guint64 size;
+
+        if (left < 8)
+            return FALSE;
+        size = get_u64(p);
+        if (size > left - 8)
+            return FALSE;
+        if (value)
+            *value = kvp_value_new_binary(p + 8, size);
+        *pos += 8 + size;
+        return TRUE;
+    }
+
+    case KVP_TYPE_GLIST:
+    {
+        GList *list = NULL;
+        guint32 n;
+
+        if (left < 4)
+            return FALSE;
+        n = get_u32(p);
+        *pos += 4;
+
+        while (n-- > 0)
+        {
+            KvpValue *item = NULL;
+
+            if (!read_kvp_value(cache, pos, depth + 1, value ? &item : NULL))
+            {
+                kvp_glist_delete(list);
+                return FALSE;
+            }
+            if (value)
+                list = g_list_prepend(list, item);
+        }
+        if (value)
+            *value = kvp_value_new_glist_nc(g_list_reverse(list));
+        return TRUE;
+    }
+
+    case KVP_TYPE_FRAME:
+    {
+        KvpFrame *frame = value ? kvp_frame_new() : NULL;
+
+        if (!read_kvp_frame(cache, pos, depth + 1, frame))
+        {
+            if (frame)
+                kvp_frame_delete(frame);
+            return FALSE;
+        }
+        if (value)
+            *value = kvp_value_new_frame_nc(frame);
+        return TRUE;
+    }
+
+    case KVP_TYPE_GDATE:
+    {
+        GDate date;
+        guint32 julian;
+
+        if (left < 4)
+            return FALSE;
+        julian = get_u32(p);
+        *pos += 4;
+
+        g_date_clear(&date, 1);
+        if (julian != 0)
+        {
+            if (!g_date_valid_julian(julian))
+                return FALSE;
+            g_date_set_julian(&date, julian);
+        }
+        if (value)
+            *value = kvp_value_new_gdate(date);
+        return TRUE;
+    }
+
+    default:
+        return FALSE;
+    }
+}
+
+/* Reads the slots a row refers to into frame, or checks them if frame
+   is NULL */
+static gboolean
+cache_slots(const GncBookCache *cache, gint col, guint32 row, KvpFrame *frame)
+{
+    guint32 offset = col_u32(cache, col, row);
+    const guint8 *pos;
+
+    if (offset == NONE)
+        return TRUE;
+    if (offset >= cache->length[SECTION_SLOTS])
+        return FALSE;
+
+    pos = cache->section[SECTION_SLOTS] + offset;
+    return read_kvp_frame(cache, &pos, 0, frame);
+}
+
+static gboolean
+cache_check_header(GncBookCache *cache, const guint8 *data, gsize len,
+                   const GncBookCacheId *id)
+{
+    gint i;
+
+    if (len < HEADER_SIZE ||
+            memcmp(data, CACHE_MAGIC, 8) != 0 ||
+            get_u32(data + 8) != CACHE_VERSION ||
+            get_u32(data + 12) != N_SECTIONS)
+        return FALSE;
+
+    if ((gint64) get_u64(data + 16) != id->size ||
+            (gint64) get_u64(data + 24) != id->mtime ||
+            get_u32(data + 32) != id->crc)
+        return FALSE;
+
+    if (get_u32(data + 36) != buffer_crc(data + HEADER_SIZE, len - HEADER_SIZE))
+        return FALSE;
+
+    cache->n_trans = get_u32(data + 40);
+    cache->n_splits = get_u32(data + 44);
+
+    for (i = 0; i < N_SECTIONS; i++)
+    {
+        guint64 offset = get_u64(data + HEADER_SECTIONS + 16 * i);
+        guint64 length = get_u64(data + HEADER_SECTIONS + 16 * i + 8);
+
+        if (offset < HEADER_SIZE || offset > len || length > len - offset)
+            return FALSE;
+
+        if (column_width[i] > 0)
+        {
+            guint64 rows = i < FIRST_SPL_COL ? cache->n_trans : cache->n_splits;
+
+            if (length != rows * column_width[i])
+                return FALSE;
+        }
+
+        cache->section[i] = data + offset;
+        cache->length[i] = length;
+    }
+    return TRUE;
+}
+
+static gboolean
+cache_check_string(const GncBookCache *cache, gint col, guint32 row)
+{
+    guint32 offset = col_u32(cache, col, row);
+
+    return offset == NONE || offset < cache->length[SECTION_STRINGS];
+}
+
+static gboolean
+cache_check_guid(const GncBookCache *cache, gint col, guint32 row)
+{
+    guint32 index = col_u32(cache, col, row);
+
+    return index == NONE ||
+           index < cache->length[SECTION_GUIDS] / GUID_DATA_SIZE;
+}
+
+/* Check every reference, so that building the transactions can't fail
+   part way through */
+static gboolean
+cache_check_columns(const GncBookCache *cache)
+{
+    guint64 n_splits = 0;
+    guint32 row;
+
+    if (cache->length[SECTION_STRINGS] > 0 &&
+            cache->section[SECTION_STRINGS][cache->length[SECTION_STRINGS] - 1] != '\0')
+        return FALSE;
+
+    if (cache->length[SECTION_GUIDS] % GUID_DATA_SIZE != 0)
+        return FALSE;
+
+    for (row = 0; row < cache->n_trans; row++)
+    {
+        if (!cache_check_string(cache, COL_TRN_CURRENCY_NS, row) ||
+                !cache_check_string(cache, COL_TRN_CURRENCY_ID, row) ||
+                !cache_check_string(cache, COL_TRN_NUM, row) ||
+                !cache_check_string(cache, COL_TRN_DESCRIPTION, row) ||
+                !cache_slots(cache, COL_TRN_SLOTS, row, NULL))
+            return FALSE;
+        n_splits += col_u32(cache, COL_TRN_N_SPLITS, row);
+    }
+    if (n_splits != cache->n_splits)
+        return FALSE;
+
+    for (row = 0; row < cache->n_splits; row++)
+    {
+        if (!cache_check_string(cache, COL_SPL_MEMO, row) ||
+                !cache_check_string(cache, COL_SPL_ACTION, row) ||
+                !cache_check_guid(cache, COL_SPL_ACCOUNT, row) ||
+                !cache_check_guid(cache, COL_SPL_LOT, row) ||
+                !cache_slots(cache, COL_SPL_SLOTS, row, NULL))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+GncBookCache *
+gnc_book_cache_open(const gchar *filename, const GncBookCacheId *id)
+{
+    GncBookCache *cache;
+    GMappedFile *file;
+    GError *error = NULL;
+
+    g_return_val_if_fail(filename && id, NULL);
+
+    file = g_mapped_file_new(filename, FALSE, &error);
+    if (!file)
+    {
+        PINFO("no cache %s: %s", filename, error->message);
+        g_error_free(error);
+        return NULL;
+    }
+
+    cache = g_new0(GncBookCache, 1);
+    cache->file = file;
+
+    if (!cache_check_header(cache,
+                            (const guint8 *) g_mapped_file_get_contents(file),
+                            g_mapped_file_get_length(file), id) ||
+            !cache_check_columns(cache))
+    {
+        PINFO("cache %s is out of date or damaged", filename);
+        gnc_book_cache_close(cache);
+        return NULL;
+    }
+
+    return cache;
+}
+
+void
+gnc_book_cache_close(GncBookCache *cache)
+{
+    if (!cache)
+        return;
+
+    g_mapped_file_free(cache->file);
+    g_free(cache);
+}
+
+const gchar *
+gnc_book_cache_get_xml(GncBookCache *cache, gsize *len)
+{
+    g_return_val_if_fail(cache && len, NULL);
+
+    *len = cache->length[SECTION_XML];
+    return (const gchar *) cache->section[SECTION_XML];
+}
+
+/* Builds a split in the same order the XML loader would, and adds it
+   to trn whether or not its slots could be read */
+static gboolean
+cache_build_split(const GncBookCache *cache, guint32 row, Transaction *trn,
+                  QofBook *book)
+{
+    Split *spl = xaccMallocSplit(book);
+    const gchar *str;
+    GncGUID guid;
+    Timespec ts;
+    guint32 index;
+    gboolean ok;
+
+    col_guid(cache, COL_SPL_GUID, row, &guid);
+    xaccSplitSetGUID(spl, &guid);
+    if ((str = col_string(cache, COL_SPL_MEMO, row)) != NULL)
+        xaccSplitSetMemo(spl, str);
+    if ((str = col_string(cache, COL_SPL_ACTION, row)) != NULL)
+        xaccSplitSetAction(spl, str);
+    xaccSplitSetReconcile(spl, cache->section[COL_SPL_RECONCILED][row]);
+    ts = col_timespec(cache, COL_SPL_RECONCILE_SEC, row);
+    if (ts.tv_sec != 0 || ts.tv_nsec != 0)
+        xaccSplitSetDateReconciledTS(spl, &ts);
+    xaccSplitSetValue(spl, col_numeric(cache, COL_SPL_VALUE_NUM, row));
+    xaccSplitSetAmount(spl, col_numeric(cache, COL_SPL_AMOUNT_NUM, row));
+
+    index = col_u32(cache, COL_SPL_ACCOUNT, row);
+    if (index != NONE)
+    {
+        Account *account;
+
+        col_guid(cache, SECTION_GUIDS, index, &guid);
+        account = xaccAccountLookup(&guid, book);
+        if (account)
+            xaccAccountInsertSplit(account, spl);
+    }
+
+    index = col_u32(cache, COL_SPL_LOT, row);
+    if (index != NONE)
+    {
+        GNCLot *lot;
+
+        col_guid(cache, SECTION_GUIDS, index, &guid);
+        lot = gnc_lot_lookup(&guid, book);
+        if (lot)
+            gnc_lot_add_split(lot, spl);
+    }
+
+    ok = cache_slots(cache, COL_SPL_SLOTS, row, xaccSplitGetSlots(spl));
+    xaccTransAppendSplit(trn, spl);
+
+    return ok;
+}
+
+gboolean
+gnc_book_cache_load_transactions(GncBookCache *cache, QofBook *book,
+                                 GncBookCacheTransCb cb, gpointer data)
+{
+    gnc_commodity_table *table;
+    guint32 row, split = 0;
+
+    g_return_val_if_fail(cache && book && cb, FALSE);
+
+    table = gnc_commodity_table_get_table(book);
+
+    for (row = 0; row < cache->n_trans; row++)
+    {
+        Transaction *trn = xaccMallocTransaction(book);
+        guint32 n_splits = col_u32(cache, COL_TRN_N_SPLITS, row);
+        const gchar *ns, *id, *str;
+        GncGUID guid;
+        Timespec ts;
+        gboolean ok;
+
+        xaccTransBeginEdit(trn);
+
+        col_guid(cache, COL_TRN_GUID, row, &guid);
+        xaccTransSetGUID(trn, &guid);
+        ns = col_string(cache, COL_TRN_CURRENCY_NS, row);
+        id = col_string(cache, COL_TRN_CURRENCY_ID, row);
+        if (ns && id)
+            xaccTransSetCurrency(trn, gnc_commodity_table_lookup(table, ns, id));
+        if ((str = col_string(cache, COL_TRN_NUM, row)) != NULL)
+            xaccTransSetNum(trn, str);
+        ts = col_timespec(cache, COL_TRN_POSTED_SEC, row);
+        xaccTransSetDatePostedTS(trn, &ts);
+        ts = col_timespec(cache, COL_TRN_ENTERED_SEC, row);
+        xaccTransSetDateEnteredTS(trn, &ts);
+        if ((str = col_string(cache, COL_TRN_DESCRIPTION, row)) != NULL)
+            xaccTransSetDescription(trn, str);
+        ok = cache_slots(cache, COL_TRN_SLOTS, row, xaccTransGetSlots(trn));
+
+        while (n_splits-- > 0)
+            ok = cache_build_split(cache, split++, trn, book) && ok;
+
+        xaccTransCommitEdit(trn);
+
+        if (!ok)
+        {
+            PWARN("could not build cached transaction %u", row);
+            xaccTransBeginEdit(trn);
+            xaccTransDestroy(trn);
+            xaccTransCommitEdit(trn);
+            return FALSE;
+        }
+
+        if (!cb(trn, data))
+            return FALSE;
+    }
+    return TRUE;
+}
@@ -0,0 +1,88 @@
+/********************************************************************\
+ * io-book-cache.h -- binary cache of a book beside its data file   *
+ *                                                                  *
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 51 Franklin Street, Fifth Floor    Fax:    +1-617-542-2652       *
+ * Boston, MA  02110-1301,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+#ifndef IO_BOOK_CACHE_H
+#define IO_BOOK_CACHE_H
+
+#include <stdio.h>
+#include <glib.h>
+
+#include "qof.h"
+#include "Transaction.h"
+
+/* A book cache is a copy of a book that opens without parsing its
+   transactions.  It holds the book's XML with the transactions left
+   out, followed by the transactions and splits in columns: one array
+   per field, with the strings in a shared table and the slots in a
+   compact binary form.  The header records the size, mtime and CRC-32
+   of the data file the cache was taken from, so that it is never used
+   in place of any other version of that file.  The file is read by
+   mapping it. */
+
+typedef struct
+{
+    gint64 size;
+    gint64 mtime;
+    guint32 crc;
+} GncBookCacheId;
+
+/* Fills in id from the data file as it is on disk.  Returns FALSE if
+   it could not be read. */
+gboolean gnc_book_cache_identify(const gchar *datafile, GncBookCacheId *id);
+
+typedef struct GncBookCacheWriter GncBookCacheWriter;
+
+/* Starts a cache in out, which must be open for both reading and
+   writing.  The caller then writes the book's XML to out, handing each
+   transaction it leaves out to gnc_book_cache_writer_add_transaction(). */
+GncBookCacheWriter *gnc_book_cache_writer_new(FILE *out);
+
+void gnc_book_cache_writer_add_transaction(GncBookCacheWriter *writer,
+        Transaction *trn);
+
+/* Writes the columns and the header and frees the writer, leaving out
+   open.  Returns FALSE if any part of the cache could not be written. */
+gboolean gnc_book_cache_writer_close(GncBookCacheWriter *writer,
+                                     const GncBookCacheId *id);
+
+typedef struct GncBookCache GncBookCache;
+
+/* Maps a cache and checks all of it.  Returns NULL if the cache is
+   missing or damaged, or was not taken from the data file id
+   describes. */
+GncBookCache *gnc_book_cache_open(const gchar *filename,
+                                  const GncBookCacheId *id);
+
+void gnc_book_cache_close(GncBookCache *cache);
+
+/* The XML the transactions were left out of */
+const gchar *gnc_book_cache_get_xml(GncBookCache *cache, gsize *len);
+
+typedef gboolean (*GncBookCacheTransCb)(Transaction *trn, gpointer data);
+
+/* Builds the cached transactions in book, in order, handing each to cb
+   once it is committed.  Returns FALSE if a transaction could not be
+   built or cb returned FALSE. */
+gboolean gnc_book_cache_load_transactions(GncBookCache *cache, QofBook *book,
+        GncBookCacheTransCb cb, gpointer data);
+
+#endif /* IO_BOOK_CACHE_H */
@@ -37,6 +37,7 @@ gnc_xml_parse_file(sixtp *top_parser, const char *filename,
     gpdata.cb = callback;
     gpdata.parsedata = parsedata;
     gpdata.bookdata = bookdata;
+    gpdata.trn_loader = NULL;
 
     return sixtp_parse_file(top_parser, filename,
                             NULL, &gpdata, &parse_result);
@@ -31,11 +31,16 @@
 typedef gboolean (*gxpf_callback)(const char *tag, gpointer parsedata,
                                   gpointer data);
 
+/* Set up by gnc_transaction_xml_loader_new() in gnc-xml.h */
+typedef struct GncXmlTrnLoader GncXmlTrnLoader;
+
 struct gxpf_data_struct
 {
     gxpf_callback cb;
     gpointer parsedata;
     gpointer bookdata;
+    GncXmlTrnLoader *trn_loader;        /* NULL to build transactions
+                                           as they are parsed */
 };
 
 typedef struct gxpf_data_struct gxpf_data;
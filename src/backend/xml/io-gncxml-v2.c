@@ -48,10 +48,12 @@
 #include "sixtp-utils.h"
 #include "gnc-xml.h"
 #include "io-utils.h"
+#include "io-gzip.h"
 #ifdef G_OS_WIN32
 # include <io.h>
 # define close _close
 # define fdopen _fdopen
+# define fsync _commit
 # define read _read
 #endif
 #include "platform.h"
@@ -82,6 +84,11 @@ typedef struct
     gboolean compress;
 } gz_thread_params_t;
 
+static FILE *try_gz_open (const char *filename, const char *perms,
+                           gboolean use_gzip, gboolean compress);
+static gboolean is_gzipped_file(const gchar *name);
+static gboolean wait_for_gzip(FILE *file);
+
 /* Callback structure */
 struct file_backend
 {
@@ -92,9 +99,11 @@ struct file_backend
     sixtp         * parser;
     FILE          * out;
     QofBook       * book;
+    GString       * buf;            /* Reused to write each transaction */
 };
 
 #define GNC_V2_STRING "gnc-v2"
+#define GNC_JOURNAL_STRING "gnc-journal"
 extern const gchar *gnc_v2_book_version_string;        /* see gnc-book-xml-v2 */
 
 void
@@ -519,6 +528,8 @@ static const char *TRANSACTION_TAG = "gnc:transaction";
 static const char *SCHEDXACTION_TAG = "gnc:schedxaction";
 static const char *TEMPLATE_TRANSACTION_TAG = "gnc:template-transactions";
 static const char *BUDGET_TAG = "gnc:budget";
+/* Stands in for the transactions in the XML of a cache */
+static const char *CACHED_TRANSACTIONS_TAG = "gnc:cached-transactions";
 
 static void
 add_item_cb (const char *type, gpointer data_p, gpointer be_data_p)
@@ -671,15 +682,131 @@ gnc_sixtp_gdv2_new (
     gd->counter.budgets_loaded = 0;
     gd->counter.budgets_total = 0;
     gd->exporting = exporting;
+    gd->cache = NULL;
+    gd->cache_writer = NULL;
     gd->countCallback = countcallback;
     gd->gui_display_fn = gui_display_fn;
     return gd;
 }
 
+/* Transactions are built in file order, but other objects may look
+   them up by guid, so the loader is flushed before anything else is
+   parsed. */
+static gboolean
+flush_transactions_before_child(gpointer data_for_children,
+                                GSList* data_from_children,
+                                GSList* sibling_data,
+                                gpointer parent_data,
+                                gpointer global_data,
+                                gpointer *result,
+                                const gchar *tag,
+                                const gchar *child_tag)
+{
+    gxpf_data *gdata = global_data;
+
+    if (!gdata->trn_loader || safe_strcmp(child_tag, TRANSACTION_TAG) == 0)
+        return TRUE;
+
+    return gnc_transaction_xml_loader_flush(gdata->trn_loader);
+}
+
+/* How many worker threads to load or save with, leaving one core for
+   the thread reading or writing the XML.  0 means use none. */
+static gint
+worker_thread_count(void)
+{
+#if defined(HAVE_UNISTD_H) && defined(_SC_NPROCESSORS_ONLN)
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (ncpus > 1)
+        return (gint) MIN(ncpus - 1, 8);
+#endif
+    return 0;
+}
+
+typedef struct
+{
+    const gchar *filename;
+    gboolean ok;
+} gz_push_data_type;
+
+/* Feeds the parser from a pipe, so inflating the file runs on the
+   gzip thread rather than inside libxml2. */
+static void
+parse_gz_push_handler (xmlParserCtxtPtr xml_context,
+                       gz_push_data_type *push_data)
+{
+    FILE *file;
+    gchar buffer[4096];
+    size_t bytes;
+    gboolean parsing = TRUE;
+
+    file = try_gz_open(push_data->filename, "r", TRUE, FALSE);
+    if (file == NULL)
+    {
+        PWARN("Unable to open file %s", push_data->filename);
+        push_data->ok = FALSE;
+        return;
+    }
+
+    /* Keep draining the pipe after a parse error, or the gzip thread
+       would block writing to it. */
+    while ((bytes = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        if (parsing && xmlParseChunk(xml_context, buffer, bytes, 0) != 0)
+            parsing = FALSE;
+    }
+    if (ferror(file))
+        push_data->ok = FALSE;
+
+    /* last chunk */
+    if (parsing)
+        xmlParseChunk(xml_context, "", 0, 1);
+
+    fclose(file);
+    if (!wait_for_gzip(file))
+        push_data->ok = FALSE;
+}
+
+static gboolean
+cached_transaction_cb(Transaction *trn, gpointer data)
+{
+    return add_transaction_local(data, trn);
+}
+
+static gboolean
+cached_transactions_end_handler(gpointer data_for_children,
+                                GSList* data_from_children, GSList* sibling_data,
+                                gpointer parent_data, gpointer global_data,
+                                gpointer *result, const gchar *tag)
+{
+    xmlNodePtr tree = (xmlNodePtr)data_for_children;
+    gxpf_data *gdata = (gxpf_data*)global_data;
+    sixtp_gdv2 *gd = gdata->parsedata;
+
+    if (parent_data)
+        return TRUE;
+
+    /* OK.  For some messed up reason this is getting called again with a
+       NULL tag.  So we ignore those cases */
+    if (!tag)
+        return TRUE;
+
+    if (tree)
+        xmlFreeNode(tree);
+
+    g_return_val_if_fail(gd->cache, FALSE);
+
+    return gnc_book_cache_load_transactions(gd->cache, gd->book,
+                                            cached_transaction_cb, gd);
+}
+
+/* cache is the cache being loaded, if the XML is a cache's */
 static gboolean
 qof_session_load_from_xml_file_v2_full(
     FileBackend *fbe, QofBook *book,
-    sixtp_push_handler push_handler, gpointer push_user_data)
+    sixtp_push_handler push_handler, gpointer push_user_data,
+    GncBookCache *cache)
 {
     Account *root;
     QofBackend *be = &fbe->be;
@@ -688,6 +815,8 @@ qof_session_load_from_xml_file_v2_full(
     sixtp *main_parser;
     sixtp *book_parser;
     struct file_backend be_data;
+    gxpf_data gpdata;
+    gpointer parse_result = NULL;
     gboolean retval;
 
     gd = gnc_sixtp_gdv2_new(book, FALSE, file_rw_feedback, be->percentage);
@@ -740,34 +869,65 @@ qof_session_load_from_xml_file_v2_full(
         goto bail;
     }
 
+    if (cache)
+    {
+        gd->cache = cache;
+        if (!sixtp_add_some_sub_parsers(
+                    book_parser, TRUE,
+                    CACHED_TRANSACTIONS_TAG,
+                    sixtp_dom_parser_new(cached_transactions_end_handler,
+                                         NULL, NULL),
+                    NULL, NULL))
+        {
+            goto bail;
+        }
+    }
+
     be_data.ok = TRUE;
     be_data.parser = book_parser;
     qof_object_foreach_backend (GNC_FILE_BACKEND, add_parser_cb, &be_data);
     if (be_data.ok == FALSE)
         goto bail;
 
+    sixtp_set_before_child(main_parser, flush_transactions_before_child);
+    sixtp_set_before_child(book_parser, flush_transactions_before_child);
+
     /* stop logging while we load */
     xaccLogDisable ();
     xaccDisableDataScrubbing();
 
+    gpdata.cb = generic_callback;
+    gpdata.parsedata = gd;
+    gpdata.bookdata = book;
+    gpdata.trn_loader = gnc_transaction_xml_loader_new(worker_thread_count());
+
     if (push_handler)
     {
-        gpointer parse_result = NULL;
-        gxpf_data gpdata;
-
-        gpdata.cb = generic_callback;
-        gpdata.parsedata = gd;
-        gpdata.bookdata = book;
-
         retval = sixtp_parse_push(top_parser, push_handler, push_user_data,
                                   NULL, &gpdata, &parse_result);
     }
+    else if (gpdata.trn_loader && is_gzipped_file(fbe->fullpath))
+    {
+        gz_push_data_type gz_data;
+
+        gz_data.filename = fbe->fullpath;
+        gz_data.ok = TRUE;
+
+        retval = sixtp_parse_push(top_parser,
+                                  (sixtp_push_handler) parse_gz_push_handler,
+                                  &gz_data, NULL, &gpdata, &parse_result);
+        retval = retval && gz_data.ok;
+    }
     else
     {
-        retval = gnc_xml_parse_file(top_parser, fbe->fullpath,
-                                    generic_callback, gd, book);
+        retval = sixtp_parse_file(top_parser, fbe->fullpath,
+                                  NULL, &gpdata, &parse_result);
     }
 
+    /* Build whatever the workers still hold */
+    if (!gnc_transaction_xml_loader_destroy(gpdata.trn_loader))
+        retval = FALSE;
+
     if (!retval)
     {
         sixtp_destroy(top_parser);
@@ -821,7 +981,50 @@ bail:
 gboolean
 qof_session_load_from_xml_file_v2(FileBackend *fbe, QofBook *book)
 {
-    return qof_session_load_from_xml_file_v2_full(fbe, book, NULL, NULL);
+    return qof_session_load_from_xml_file_v2_full(fbe, book, NULL, NULL, NULL);
+}
+
+/* Feeds the parser the XML in a mapped cache */
+static void
+cache_push_handler(xmlParserCtxtPtr xml_context, GncBookCache *cache)
+{
+    const gchar *xml;
+    gsize len, pos;
+
+    xml = gnc_book_cache_get_xml(cache, &len);
+    for (pos = 0; pos < len; pos += 65536)
+    {
+        if (xmlParseChunk(xml_context, xml + pos, MIN(len - pos, 65536), 0) != 0)
+            return;
+    }
+
+    /* last chunk */
+    xmlParseChunk(xml_context, "", 0, 1);
+}
+
+gboolean
+qof_session_load_from_cache_v2(FileBackend *fbe, QofBook *book,
+                               const char *filename, gboolean *loaded)
+{
+    GncBookCacheId id;
+    GncBookCache *cache;
+    gboolean success;
+
+    *loaded = FALSE;
+
+    if (!gnc_book_cache_identify(fbe->fullpath, &id))
+        return TRUE;
+    cache = gnc_book_cache_open(filename, &id);
+    if (!cache)
+        return TRUE;
+
+    *loaded = TRUE;
+    success = qof_session_load_from_xml_file_v2_full(
+                  fbe, book, (sixtp_push_handler) cache_push_handler, cache,
+                  cache);
+    gnc_book_cache_close(cache);
+
+    return success;
 }
 
 /***********************************************************************/
@@ -1089,18 +1292,32 @@ write_pricedb(FILE *out, QofBook *book, sixtp_gdv2 *gd)
     return TRUE;
 }
 
-static int
-xml_add_trn_data(Transaction *t, gpointer data)
+/* buf is scratch space, kept between calls to save reallocating it */
+static gboolean
+write_transaction(FILE *out, GString *buf, Transaction *t)
 {
-    struct file_backend *be_data = data;
     xmlNodePtr node;
 
+    /* Write straight from the transaction if possible; the DOM is only
+       needed for text libxml2 would write differently. */
+    g_string_truncate(buf, 0);
+    if (gnc_transaction_xml_stream_write(buf, t))
+        return fwrite(buf->str, 1, buf->len, out) == buf->len;
+
     node = gnc_transaction_dom_tree_create(t);
 
-    xmlElemDump(be_data->out, NULL, node);
+    xmlElemDump(out, NULL, node);
     xmlFreeNode(node);
 
-    if (ferror(be_data->out) || fprintf(be_data->out, "\n") < 0)
+    return !ferror(out) && fprintf(out, "\n") >= 0;
+}
+
+static int
+xml_add_trn_data(Transaction *t, gpointer data)
+{
+    struct file_backend *be_data = data;
+
+    if (!write_transaction(be_data->out, be_data->buf, t))
         return -1;
 
     be_data->gd->counter.transactions_loaded++;
@@ -1108,17 +1325,42 @@ xml_add_trn_data(Transaction *t, gpointer data)
     return 0;
 }
 
+static int
+cache_add_trn_data(Transaction *t, gpointer data)
+{
+    sixtp_gdv2 *gd = data;
+
+    gnc_book_cache_writer_add_transaction(gd->cache_writer, t);
+
+    gd->counter.transactions_loaded++;
+    run_callback(gd, "transaction");
+    return 0;
+}
+
 static gboolean
 write_transactions(FILE *out, QofBook *book, sixtp_gdv2 *gd)
 {
     struct file_backend be_data;
+    gboolean success;
+
+    /* A cache keeps its transactions out of the XML */
+    if (gd->cache_writer)
+    {
+        if (fprintf(out, "<%s/>\n", CACHED_TRANSACTIONS_TAG) < 0)
+            return FALSE;
+        return 0 == xaccAccountTreeForEachTransaction(
+                   gnc_book_get_root_account(book), cache_add_trn_data, gd);
+    }
 
     be_data.out = out;
     be_data.gd = gd;
-    return 0 ==
-           xaccAccountTreeForEachTransaction(gnc_book_get_root_account(book),
-                   xml_add_trn_data,
-                   (gpointer) &be_data);
+    be_data.buf = g_string_sized_new(4096);
+    success = 0 ==
+              xaccAccountTreeForEachTransaction(gnc_book_get_root_account(book),
+                      xml_add_trn_data,
+                      (gpointer) &be_data);
+    g_string_free(be_data.buf, TRUE);
+    return success;
 }
 
 static gboolean
@@ -1126,6 +1368,7 @@ write_template_transaction_data( FILE *out, QofBook *book, sixtp_gdv2 *gd )
 {
     Account *ra;
     struct file_backend be_data;
+    gboolean success = TRUE;
 
     be_data.out = out;
     be_data.gd = gd;
@@ -1133,15 +1376,17 @@ write_template_transaction_data( FILE *out, QofBook *book, sixtp_gdv2 *gd )
     ra = gnc_book_get_template_root(book);
     if ( gnc_account_n_descendants(ra) > 0 )
     {
+        be_data.buf = g_string_sized_new(4096);
         if (fprintf(out, "<%s>\n", TEMPLATE_TRANSACTION_TAG) < 0
                 || !write_account_tree(out, ra, gd)
                 || xaccAccountTreeForEachTransaction(ra, xml_add_trn_data, (gpointer)&be_data)
                 || fprintf(out, "</%s>\n", TEMPLATE_TRANSACTION_TAG) < 0)
 
-            return FALSE;
+            success = FALSE;
+        g_string_free(be_data.buf, TRUE);
     }
 
-    return TRUE;
+    return success;
 }
 
 static gboolean
@@ -1214,11 +1459,13 @@ do_write_namespace_cb (const char *type, gpointer data_p, gpointer file_p)
         (data->ns)(out);
 }
 
+/* Writes the XML declaration and the start of the root element with
+   all the namespaces, up to but not including its closing '>' */
 static gboolean
-write_v2_header (FILE *out)
+write_root_start (FILE *out, const char *root_tag)
 {
     if (fprintf(out, "<?xml version=\"1.0\" encoding=\"utf-8\" ?>\n") < 0
-            || fprintf(out, "<" GNC_V2_STRING) < 0
+            || fprintf(out, "<%s", root_tag) < 0
 
             || !gnc_xml2_write_namespace_decl (out, "gnc")
             || !gnc_xml2_write_namespace_decl (out, "act")
@@ -1241,14 +1488,18 @@ write_v2_header (FILE *out)
     /* now cope with the plugins */
     qof_object_foreach_backend (GNC_FILE_BACKEND, do_write_namespace_cb, out);
 
-    if (ferror(out) || fprintf(out, ">\n") < 0)
-        return FALSE;
+    return !ferror(out);
+}
 
-    return TRUE;
+static gboolean
+write_v2_header (FILE *out)
+{
+    return write_root_start(out, GNC_V2_STRING) && fprintf(out, ">\n") >= 0;
 }
 
-gboolean
-gnc_book_write_to_xml_filehandle_v2(QofBook *book, FILE *out)
+/* cache_writer is the cache being written, if any */
+static gboolean
+write_v2_book_file(QofBook *book, FILE *out, GncBookCacheWriter *cache_writer)
 {
     QofBackend *be;
     sixtp_gdv2 *gd;
@@ -1261,7 +1512,9 @@ gnc_book_write_to_xml_filehandle_v2(QofBook *book, FILE *out)
         return FALSE;
 
     be = qof_book_get_backend(book);
-    gd = gnc_sixtp_gdv2_new(book, FALSE, file_rw_feedback, be->percentage);
+    gd = gnc_sixtp_gdv2_new(book, FALSE, file_rw_feedback,
+                            cache_writer ? NULL : be->percentage);
+    gd->cache_writer = cache_writer;
     gd->counter.commodities_total =
         gnc_commodity_table_get_size(gnc_book_get_commodity_table(book));
     gd->counter.accounts_total = 1 +
@@ -1280,6 +1533,12 @@ gnc_book_write_to_xml_filehandle_v2(QofBook *book, FILE *out)
     return success;
 }
 
+gboolean
+gnc_book_write_to_xml_filehandle_v2(QofBook *book, FILE *out)
+{
+    return write_v2_book_file(book, out, NULL);
+}
+
 /*
  * This function is called by the "export" code.
  */
@@ -1318,6 +1577,71 @@ gnc_book_write_accounts_to_xml_filehandle_v2(QofBackend *be, QofBook *book, FILE
 }
 
 #define BUFLEN 4096
+#define PARALLEL_BUFLEN (64 * 1024)
+
+/* Compresses what arrives on the pipe with n_threads threads deflating
+ * blocks of it at once.  Returns 1 on success or 0 otherwise. */
+static gint
+gz_parallel_compress(gz_thread_params_t *params, gint n_threads)
+{
+    gchar *buffer;
+    gssize bytes;
+    FILE *file;
+    GncGzipWriter *writer;
+    gint success = 1;
+
+    file = g_fopen(params->filename, "wb");
+    if (file == NULL)
+    {
+        g_warning("Could not open the compressed file '%s': %s",
+                  params->filename, g_strerror(errno));
+        return 0;
+    }
+
+    writer = gnc_gzip_writer_new(file, Z_DEFAULT_COMPRESSION, n_threads);
+    if (writer == NULL)
+    {
+        fclose(file);
+        return 0;
+    }
+
+    buffer = g_malloc(PARALLEL_BUFLEN);
+    while (success)
+    {
+        bytes = read(params->fd, buffer, PARALLEL_BUFLEN);
+        if (bytes > 0)
+        {
+            if (!gnc_gzip_writer_write(writer, buffer, bytes))
+            {
+                g_warning("Could not write the compressed file '%s'",
+                          params->filename);
+                success = 0;
+            }
+        }
+        else if (bytes == 0)
+        {
+            break;
+        }
+        else
+        {
+            g_warning("Could not read from pipe. The error is '%s' (errno %d)",
+                      g_strerror(errno) ? g_strerror(errno) : "", errno);
+            success = 0;
+        }
+    }
+    g_free(buffer);
+
+    if (!gnc_gzip_writer_close(writer))
+        success = 0;
+    if (fclose(file) != 0)
+    {
+        g_warning("Could not close the compressed file '%s'",
+                  params->filename);
+        success = 0;
+    }
+
+    return success;
+}
 
 /* Compress or decompress function that is to be run in a separate thread.
  * Returns 1 on success or 0 otherwise, stuffed into a pointer type. */
@@ -1329,6 +1653,14 @@ gz_thread_func(gz_thread_params_t *params)
     gint gzval;
     gzFile *file;
     gint success = 1;
+    gint n_threads;
+
+    n_threads = worker_thread_count();
+    if (params->compress && n_threads > 1)
+    {
+        success = gz_parallel_compress(params, n_threads);
+        goto cleanup_gz_thread_func;
+    }
 
 #ifdef G_OS_WIN32
     {
@@ -1593,6 +1925,365 @@ gnc_book_write_accounts_to_xml_file_v2(
     return success;
 }
 
+gboolean
+gnc_book_write_cache_v2(QofBook *book, const char *datafile,
+                        const char *filename)
+{
+    GncBookCacheId id;
+    GncBookCacheWriter *writer;
+    gchar *tmp_name;
+    FILE *out;
+    gboolean success;
+
+    if (!gnc_book_cache_identify(datafile, &id))
+        return FALSE;
+
+    tmp_name = g_strconcat(filename, ".tmp", NULL);
+    out = g_fopen(tmp_name, "w+b");
+    if (!out)
+    {
+        g_free(tmp_name);
+        return FALSE;
+    }
+    /* It holds the whole book */
+    g_chmod(tmp_name, 0600);
+
+    writer = gnc_book_cache_writer_new(out);
+    success = write_v2_book_file(book, out, writer);
+    success = gnc_book_cache_writer_close(writer, &id) && success;
+    if (fclose(out) != 0)
+        success = FALSE;
+
+    /* Never leave a partly written cache in place */
+    if (success)
+    {
+        g_unlink(filename);
+        success = g_rename(tmp_name, filename) == 0;
+    }
+    if (!success)
+        g_unlink(tmp_name);
+
+    g_free(tmp_name);
+    return success;
+}
+
+/***********************************************************************/
+/* The change journal.  Each save that does not rewrite the whole file
+ * appends one batch to it, holding every transaction changed since the
+ * last save as a whole gnc:transaction, or as a jnl:destroy naming it
+ * if it is gone.  The root element is never closed, so that batches
+ * can simply be appended; the reader closes it itself and applies only
+ * the batches it read to the end, so a save cut short leaves the
+ * journal as it was before.
+ *
+ * The journal starts with the size and modification time of the data
+ * file it was written against, and is ignored if the data file has
+ * since changed.
+ */
+
+static const char *JOURNAL_SNAPSHOT_TAG = "jnl:snapshot";
+static const char *JOURNAL_SIZE_TAG = "jnl:size";
+static const char *JOURNAL_MTIME_TAG = "jnl:mtime";
+static const char *JOURNAL_BATCH_TAG = "jnl:batch";
+static const char *JOURNAL_DESTROY_TAG = "jnl:destroy";
+
+static gboolean
+write_journal_header(FILE *out, gint64 snapshot_size, time_t snapshot_mtime)
+{
+    return write_root_start(out, GNC_JOURNAL_STRING)
+           && gnc_xml2_write_namespace_decl(out, "jnl")
+           && fprintf(out, ">\n<%s>\n"
+                      "  <%s>%" G_GINT64_FORMAT "</%s>\n"
+                      "  <%s>%" G_GINT64_FORMAT "</%s>\n"
+                      "</%s>\n",
+                      JOURNAL_SNAPSHOT_TAG,
+                      JOURNAL_SIZE_TAG, snapshot_size, JOURNAL_SIZE_TAG,
+                      JOURNAL_MTIME_TAG, (gint64) snapshot_mtime,
+                      JOURNAL_MTIME_TAG,
+                      JOURNAL_SNAPSHOT_TAG) >= 0;
+}
+
+static gboolean
+write_journal_destroy(FILE *out, const GncGUID *guid)
+{
+    gchar guidstr[GUID_ENCODING_LENGTH + 1];
+
+    guid_to_string_buff(guid, guidstr);
+    return fprintf(out, "<%s type=\"guid\">%s</%s>\n",
+                   JOURNAL_DESTROY_TAG, guidstr, JOURNAL_DESTROY_TAG) >= 0;
+}
+
+gboolean
+gnc_book_append_journal_v2(QofBook *book, const char *filename,
+                           gint64 snapshot_size, time_t snapshot_mtime,
+                           GList *guids)
+{
+    FILE *out;
+    GString *buf;
+    GList *node;
+    gboolean success = TRUE;
+
+    out = g_fopen(filename, "ab");
+    if (!out)
+        return FALSE;
+
+    if (fseek(out, 0, SEEK_END) != 0)
+        success = FALSE;
+    else if (ftell(out) == 0)
+        success = write_journal_header(out, snapshot_size, snapshot_mtime);
+
+    if (success && fprintf(out, "<%s>\n", JOURNAL_BATCH_TAG) < 0)
+        success = FALSE;
+
+    buf = g_string_sized_new(4096);
+    for (node = guids; success && node; node = node->next)
+    {
+        Transaction *trn = xaccTransLookup(node->data, book);
+
+        if (trn)
+            success = write_transaction(out, buf, trn);
+        else
+            success = write_journal_destroy(out, node->data);
+    }
+    g_string_free(buf, TRUE);
+
+    if (success && fprintf(out, "</%s>\n", JOURNAL_BATCH_TAG) < 0)
+        success = FALSE;
+
+    /* The caller marks the book saved, so make sure it is */
+    if (fflush(out) != 0 || fsync(fileno(out)) != 0)
+        success = FALSE;
+    if (fclose(out) != 0)
+        success = FALSE;
+
+    return success;
+}
+
+typedef struct
+{
+    const gchar *filename;
+    sixtp_gdv2 *gd;
+    gint64 snapshot_size;
+    time_t snapshot_mtime;
+    gboolean matches;           /* written against this data file */
+    gboolean ok;
+} journal_data;
+
+static gboolean
+journal_snapshot_end_handler(gpointer data_for_children,
+                             GSList* data_from_children, GSList* sibling_data,
+                             gpointer parent_data, gpointer global_data,
+                             gpointer *result, const gchar *tag)
+{
+    xmlNodePtr tree = (xmlNodePtr)data_for_children;
+    journal_data *data = global_data;
+    xmlNodePtr node;
+    gint64 size = -1;
+    gint64 mtime = -1;
+
+    if (parent_data || !tag)
+        return TRUE;
+
+    g_return_val_if_fail(tree, FALSE);
+
+    for (node = tree->xmlChildrenNode; node; node = node->next)
+    {
+        if (safe_strcmp((char*) node->name, JOURNAL_SIZE_TAG) == 0)
+            dom_tree_to_integer(node, &size);
+        else if (safe_strcmp((char*) node->name, JOURNAL_MTIME_TAG) == 0)
+            dom_tree_to_integer(node, &mtime);
+    }
+    xmlFreeNode(tree);
+
+    data->matches = (size == data->snapshot_size &&
+                     mtime == (gint64) data->snapshot_mtime);
+    if (!data->matches)
+    {
+        PWARN("%s was not written against the current data file",
+              data->filename);
+        data->ok = FALSE;
+    }
+    return data->matches;
+}
+
+/* Replaces or removes one transaction.  A record always holds the whole
+   transaction, so any copy already in the book goes first. */
+static gboolean
+journal_apply_record(sixtp_gdv2 *gd, xmlNodePtr node)
+{
+    Transaction *trn;
+    GncGUID *guid = NULL;
+    xmlNodePtr child;
+    gboolean is_trn;
+
+    is_trn = (safe_strcmp((char*) node->name, TRANSACTION_TAG) == 0);
+    if (is_trn)
+    {
+        for (child = node->xmlChildrenNode; child && !guid; child = child->next)
+        {
+            if (safe_strcmp((char*) child->name, "trn:id") == 0)
+                guid = dom_tree_to_guid(child);
+        }
+    }
+    else if (safe_strcmp((char*) node->name, JOURNAL_DESTROY_TAG) == 0)
+    {
+        guid = dom_tree_to_guid(node);
+    }
+    else
+    {
+        PWARN("unexpected tag %s", node->name);
+        return FALSE;
+    }
+
+    if (!guid)
+        return FALSE;
+
+    trn = xaccTransLookup(guid, gd->book);
+    g_free(guid);
+    if (trn)
+    {
+        /* A transaction that is read-only in the data file can only
+           change along with objects the journal does not hold, so the
+           journal and the file disagree. */
+        if (xaccTransGetReadOnly(trn))
+        {
+            PWARN("journal record for a read-only transaction");
+            return FALSE;
+        }
+        xaccTransBeginEdit(trn);
+        xaccTransDestroy(trn);
+        xaccTransCommitEdit(trn);
+    }
+
+    if (!is_trn)
+        return TRUE;
+
+    trn = dom_tree_to_transaction(node, gd->book);
+    if (!trn)
+        return FALSE;
+
+    add_transaction_local(gd, trn);
+    return TRUE;
+}
+
+static gboolean
+journal_batch_end_handler(gpointer data_for_children,
+                          GSList* data_from_children, GSList* sibling_data,
+                          gpointer parent_data, gpointer global_data,
+                          gpointer *result, const gchar *tag)
+{
+    xmlNodePtr tree = (xmlNodePtr)data_for_children;
+    journal_data *data = global_data;
+    xmlNodePtr node;
+
+    if (parent_data || !tag)
+        return TRUE;
+
+    g_return_val_if_fail(tree, FALSE);
+
+    if (data->matches)
+    {
+        for (node = tree->xmlChildrenNode; node; node = node->next)
+        {
+            if (node->type != XML_ELEMENT_NODE)
+                continue;
+            if (!journal_apply_record(data->gd, node))
+                data->ok = FALSE;
+        }
+    }
+    xmlFreeNode(tree);
+
+    return data->matches;
+}
+
+static void
+journal_push_handler(xmlParserCtxtPtr xml_context, journal_data *data)
+{
+    static const gchar end[] = "</" GNC_JOURNAL_STRING ">\n";
+    FILE *file;
+    gchar buffer[4096];
+    size_t bytes;
+    gboolean parsing = TRUE;
+
+    file = g_fopen(data->filename, "rb");
+    if (file == NULL)
+    {
+        PWARN("Unable to open file %s", data->filename);
+        data->ok = FALSE;
+        return;
+    }
+
+    while (parsing && (bytes = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        if (xmlParseChunk(xml_context, buffer, bytes, 0) != 0)
+            parsing = FALSE;
+    }
+    if (ferror(file))
+        data->ok = FALSE;
+    fclose(file);
+
+    /* Close the root element ourselves.  If the last batch was cut
+       short, this fails to match it and the batch is dropped. */
+    if (parsing)
+        xmlParseChunk(xml_context, end, sizeof(end) - 1, 1);
+}
+
+gboolean
+qof_session_load_journal_v2(QofBook *book, const char *filename,
+                            gint64 snapshot_size, time_t snapshot_mtime)
+{
+    sixtp *top_parser;
+    sixtp *journal_parser;
+    journal_data data;
+    gboolean retval = FALSE;
+
+    top_parser = sixtp_new();
+    journal_parser = sixtp_new();
+
+    if (!sixtp_add_some_sub_parsers(
+                top_parser, TRUE,
+                GNC_JOURNAL_STRING, journal_parser,
+                NULL, NULL))
+    {
+        return FALSE;
+    }
+
+    if (!sixtp_add_some_sub_parsers(
+                journal_parser, TRUE,
+                JOURNAL_SNAPSHOT_TAG,
+                sixtp_dom_parser_new(journal_snapshot_end_handler, NULL, NULL),
+                JOURNAL_BATCH_TAG,
+                sixtp_dom_parser_new(journal_batch_end_handler, NULL, NULL),
+                NULL, NULL))
+    {
+        return FALSE;
+    }
+
+    data.filename = filename;
+    data.gd = gnc_sixtp_gdv2_new(book, FALSE, NULL, NULL);
+    data.snapshot_size = snapshot_size;
+    data.snapshot_mtime = snapshot_mtime;
+    data.matches = FALSE;
+    data.ok = TRUE;
+
+    xaccLogDisable();
+    xaccDisableDataScrubbing();
+
+    if (sixtp_parse_push(top_parser, (sixtp_push_handler) journal_push_handler,
+                         &data, NULL, &data, NULL))
+        retval = data.ok && data.matches;
+
+    xaccEnableDataScrubbing();
+    xaccLogEnable();
+
+    PINFO("replayed %d transactions from %s",
+          data.gd->counter.transactions_loaded, filename);
+
+    sixtp_destroy(top_parser);
+    g_free(data.gd);
+    return retval;
+}
+
 /***********************************************************************/
 static gboolean
 is_gzipped_file(const gchar *name)
@@ -2095,7 +2786,7 @@ gnc_xml2_parse_with_subst (FileBackend *fbe, QofBook *book, GHashTable *subst)
 
     success = qof_session_load_from_xml_file_v2_full(
                   fbe, book, (sixtp_push_handler) parse_with_subst_push_handler,
-                  push_data);
+                  push_data, NULL);
 
     if (success)
         qof_book_kvp_changed(book);
@@ -35,6 +35,7 @@
 
 #include "gnc-engine.h"
 #include "gnc-backend-xml.h"
+#include "io-book-cache.h"
 
 #include "sixtp.h"
 
@@ -71,6 +72,9 @@ struct sixtp_gdv2
     countCallbackFn countCallback;
     QofBePercentageFunc gui_display_fn;
     gboolean exporting;
+    GncBookCache *cache;            /* holds the book's transactions when
+                                       loading from a cache */
+    GncBookCacheWriter *cache_writer; /* takes them when writing one */
 };
 
 /**
@@ -134,6 +138,35 @@ gboolean qof_session_load_from_xml_file_v2(FileBackend *, QofBook *);
 gboolean gnc_book_write_to_xml_filehandle_v2(QofBook *book, FILE *fh);
 gboolean gnc_book_write_to_xml_file_v2(QofBook *book, const char *filename, gboolean compress);
 
+/** Append the transactions with the given GUIDs to the change journal
+ * kept beside a data file, creating it if need be.  Transactions no
+ * longer in the book are recorded as deleted.  snapshot_size and
+ * snapshot_mtime identify the data file the journal applies to. */
+gboolean gnc_book_append_journal_v2(QofBook *book, const char *filename,
+                                    gint64 snapshot_size, time_t snapshot_mtime,
+                                    GList *guids);
+
+/** Replay a change journal over a book just loaded from its data file.
+ * Returns FALSE if the journal was written against some other version
+ * of the data file, or could not all be applied; whatever could be is
+ * applied anyway. */
+gboolean qof_session_load_journal_v2(QofBook *book, const char *filename,
+                                     gint64 snapshot_size, time_t snapshot_mtime);
+
+/** Write a binary cache of the book, which must be just as it was
+ * loaded from or saved to datafile, for qof_session_load_from_cache_v2()
+ * to load in its place.  See io-book-cache.h. */
+gboolean gnc_book_write_cache_v2(QofBook *book, const char *datafile,
+                                 const char *filename);
+
+/** Load a book from a cache of its data file rather than from the file
+ * itself.  *loaded is set FALSE, and nothing is done, if the cache is
+ * missing or was not taken from the data file as it now is.  Returns
+ * FALSE if the cache was used but could not all be loaded. */
+gboolean qof_session_load_from_cache_v2(FileBackend *fbe, QofBook *book,
+                                        const char *filename,
+                                        gboolean *loaded);
+
 /** write just the commodities and accounts to a file */
 gboolean gnc_book_write_accounts_to_xml_filehandle_v2(QofBackend *be, QofBook *book, FILE *fh);
 gboolean gnc_book_write_accounts_to_xml_file_v2(QofBackend * be, QofBook *book,
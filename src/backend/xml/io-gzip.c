@@ -0,0 +1,295 @@
+/********************************************************************\
+ * io-gzip.c -- block-parallel gzip compression for file saves      *
+ *                                                                  *
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 51 Franklin Street, Fifth Floor    Fax:    +1-617-542-2652       *
+ * Boston, MA  02110-1301,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+#include "config.h"
+
+#include <string.h>
+#include <zlib.h>
+
+#include <glib.h>
+
+#include "io-gzip.h"
+
+#define BLOCK_SIZE (128 * 1024)
+#define DICT_SIZE  (32 * 1024)  /* the deflate window */
+
+typedef struct
+{
+    guchar *in;
+    gsize in_len;
+    guchar *dict;
+    gsize dict_len;
+    gboolean last;
+
+    /* Set by the worker, under the writer's lock */
+    guchar *out;
+    gsize out_len;
+    guint32 crc;
+    gboolean ok;
+    gboolean done;
+} gzip_job;
+
+struct GncGzipWriter
+{
+    FILE *out;
+    gint level;
+    GThreadPool *pool;
+    GMutex *lock;
+    GCond *cond;
+    GQueue *jobs;               /* gzip_job, in file order */
+    guint max_pending;
+
+    guchar *block;              /* input not yet given to a job */
+    gsize block_len;
+    guchar *dict;               /* the end of the last full block */
+    gsize dict_len;
+
+    guint32 crc;
+    guint32 size;               /* input length, mod 2^32 */
+    gboolean ok;
+};
+
+static void
+gzip_job_free(gzip_job *job)
+{
+    g_free(job->in);
+    g_free(job->dict);
+    g_free(job->out);
+    g_free(job);
+}
+
+static void
+gzip_job_run(gpointer data, gpointer user_data)
+{
+    gzip_job *job = data;
+    GncGzipWriter *writer = user_data;
+    z_stream strm;
+    guchar *out = NULL;
+    gsize out_len = 0;
+    gboolean ok = FALSE;
+    guint32 crc;
+
+    memset(&strm, 0, sizeof(strm));
+    if (deflateInit2(&strm, writer->level, Z_DEFLATED, -MAX_WBITS, 8,
+                     Z_DEFAULT_STRATEGY) == Z_OK)
+    {
+        /* Leave room for the sync or final marker */
+        gsize bound = deflateBound(&strm, job->in_len) + 16;
+        int ret;
+
+        out = g_malloc(bound);
+        if (job->dict_len == 0 ||
+                deflateSetDictionary(&strm, job->dict, job->dict_len) == Z_OK)
+        {
+            strm.next_in = job->in;
+            strm.avail_in = job->in_len;
+            strm.next_out = out;
+            strm.avail_out = bound;
+
+            /* A sync flush ends the block on a byte boundary without
+               ending the stream, so the next block's output can follow
+               it directly. */
+            ret = deflate(&strm, job->last ? Z_FINISH : Z_SYNC_FLUSH);
+            if (job->last)
+                ok = (ret == Z_STREAM_END);
+            else
+                ok = (ret == Z_OK && strm.avail_in == 0 && strm.avail_out > 0);
+            out_len = bound - strm.avail_out;
+        }
+        deflateEnd(&strm);
+    }
+    crc = crc32(0L, job->in, job->in_len);
+
+    g_mutex_lock(writer->lock);
+    job->out = out;
+    job->out_len = out_len;
+    job->crc = crc;
+    job->ok = ok;
+    job->done = TRUE;
+    g_cond_broadcast(writer->cond);
+    g_mutex_unlock(writer->lock);
+}
+
+/* Writes out the jobs at the head of the queue, waiting for the
+   workers until no more than max_pending are left. */
+static void
+gzip_writer_finish_jobs(GncGzipWriter *writer, guint max_pending)
+{
+    gzip_job *job;
+
+    g_mutex_lock(writer->lock);
+    while ((job = g_queue_peek_head(writer->jobs)) != NULL)
+    {
+        if (!job->done)
+        {
+            if (g_queue_get_length(writer->jobs) <= max_pending)
+                break;
+            g_cond_wait(writer->cond, writer->lock);
+            continue;
+        }
+
+        g_queue_pop_head(writer->jobs);
+        g_mutex_unlock(writer->lock);
+
+        if (!job->ok)
+        {
+            g_warning("Could not compress a block of the file");
+            writer->ok = FALSE;
+        }
+        else if (writer->ok &&
+                 fwrite(job->out, 1, job->out_len, writer->out) != job->out_len)
+        {
+            writer->ok = FALSE;
+        }
+        writer->crc = crc32_combine(writer->crc, job->crc, job->in_len);
+        gzip_job_free(job);
+
+        g_mutex_lock(writer->lock);
+    }
+    g_mutex_unlock(writer->lock);
+}
+
+static void
+gzip_writer_submit(GncGzipWriter *writer, gboolean last)
+{
+    gzip_job *job = g_new0(gzip_job, 1);
+
+    job->in = writer->block;
+    job->in_len = writer->block_len;
+    job->dict = writer->dict;
+    job->dict_len = writer->dict_len;
+    job->last = last;
+
+    if (last)
+    {
+        writer->block = NULL;
+        writer->dict = NULL;
+        writer->dict_len = 0;
+    }
+    else
+    {
+        writer->dict_len = MIN(job->in_len, DICT_SIZE);
+        writer->dict = g_memdup(job->in + job->in_len - writer->dict_len,
+                                writer->dict_len);
+        writer->block = g_malloc(BLOCK_SIZE);
+    }
+    writer->block_len = 0;
+
+    g_queue_push_tail(writer->jobs, job);
+    g_thread_pool_push(writer->pool, job, NULL);
+
+    gzip_writer_finish_jobs(writer, writer->max_pending);
+}
+
+GncGzipWriter *
+gnc_gzip_writer_new(FILE *out, gint level, gint n_threads)
+{
+    /* Deflate, no name or time, Unix */
+    static const guchar header[10] =
+    { 0x1f, 0x8b, Z_DEFLATED, 0, 0, 0, 0, 0, 0, 3 };
+    GncGzipWriter *writer;
+    GError *error = NULL;
+
+    g_return_val_if_fail(out, NULL);
+
+    if (n_threads < 1 || !g_thread_supported())
+        return NULL;
+
+    writer = g_new0(GncGzipWriter, 1);
+    writer->pool = g_thread_pool_new(gzip_job_run, writer, n_threads,
+                                     FALSE, &error);
+    if (!writer->pool)
+    {
+        g_warning("Could not create threads for compression: %s",
+                  error ? error->message : "(null)");
+        if (error)
+            g_error_free(error);
+        g_free(writer);
+        return NULL;
+    }
+
+    writer->out = out;
+    writer->level = level;
+    writer->lock = g_mutex_new();
+    writer->cond = g_cond_new();
+    writer->jobs = g_queue_new();
+    /* Enough to keep every thread busy while the oldest is written */
+    writer->max_pending = 2 * n_threads;
+    writer->block = g_malloc(BLOCK_SIZE);
+    writer->ok = fwrite(header, 1, sizeof(header), out) == sizeof(header);
+
+    return writer;
+}
+
+gboolean
+gnc_gzip_writer_write(GncGzipWriter *writer, const gchar *data, gsize len)
+{
+    g_return_val_if_fail(writer, FALSE);
+
+    writer->size += len;
+    while (writer->ok && len > 0)
+    {
+        gsize n = MIN(len, BLOCK_SIZE - writer->block_len);
+
+        memcpy(writer->block + writer->block_len, data, n);
+        writer->block_len += n;
+        data += n;
+        len -= n;
+
+        if (writer->block_len == BLOCK_SIZE)
+            gzip_writer_submit(writer, FALSE);
+    }
+
+    return writer->ok;
+}
+
+gboolean
+gnc_gzip_writer_close(GncGzipWriter *writer)
+{
+    guchar trailer[8];
+    gboolean ok;
+    gint i;
+
+    g_return_val_if_fail(writer, FALSE);
+
+    gzip_writer_submit(writer, TRUE);
+    gzip_writer_finish_jobs(writer, 0);
+    g_thread_pool_free(writer->pool, FALSE, TRUE);
+
+    /* CRC-32 and length, little-endian */
+    for (i = 0; i < 4; i++)
+    {
+        trailer[i] = (writer->crc >> (8 * i)) & 0xff;
+        trailer[i + 4] = (writer->size >> (8 * i)) & 0xff;
+    }
+    ok = writer->ok &&
+         fwrite(trailer, 1, sizeof(trailer), writer->out) == sizeof(trailer);
+
+    g_queue_free(writer->jobs);
+    g_cond_free(writer->cond);
+    g_mutex_free(writer->lock);
+    g_free(writer->block);
+    g_free(writer->dict);
+    g_free(writer);
+
+    return ok;
+}
@@ -0,0 +1,48 @@
+/********************************************************************\
+ * io-gzip.h -- block-parallel gzip compression for file saves      *
+ *                                                                  *
+ * This program is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as   *
+ * published by the Free Software Foundation; either version 2 of   *
+ * the License, or (at your option) any later version.              *
+ *                                                                  *
+ * This program is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of   *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the    *
+ * GNU General Public License for more details.                     *
+ *                                                                  *
+ * You should have received a copy of the GNU General Public License*
+ * along with this program; if not, contact:                        *
+ *                                                                  *
+ * Free Software Foundation           Voice:  +1-617-542-5942       *
+ * 51 Franklin Street, Fifth Floor    Fax:    +1-617-542-2652       *
+ * Boston, MA  02110-1301,  USA       gnu@gnu.org                   *
+ *                                                                  *
+\********************************************************************/
+
+#ifndef IO_GZIP_H
+#define IO_GZIP_H
+
+#include <stdio.h>
+#include <glib.h>
+
+/* Writes a single gzip member to a FILE, deflating 128k blocks of the
+   input on a pool of threads.  Each block is primed with the 32k that
+   precede it, and all but the last end on a sync flush, so the blocks
+   join up into one ordinary deflate stream that gunzip and zlib read
+   as usual. */
+typedef struct GncGzipWriter GncGzipWriter;
+
+/* Returns NULL if the threads could not be created.  level is a zlib
+   compression level. */
+GncGzipWriter *gnc_gzip_writer_new(FILE *out, gint level, gint n_threads);
+
+/* Returns FALSE once anything has failed. */
+gboolean gnc_gzip_writer_write(GncGzipWriter *writer,
+                               const gchar *data, gsize len);
+
+/* Writes the rest of the file and frees the writer, leaving out open.
+   Returns FALSE if any part of the file could not be written. */
+gboolean gnc_gzip_writer_close(GncGzipWriter *writer);
+
+#endif /* IO_GZIP_H */
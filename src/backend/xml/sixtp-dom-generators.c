@@ -402,3 +402,444 @@ kvp_frame_to_dom_tree(const char *tag, const kvp_frame *frame)
     return ret;
 }
 
+
+/***********************************************************************/
+/* Streaming generators.
+
+   These append to a GString exactly what xmlElemDump() writes for the
+   tree built by the matching *_to_dom_tree() function, without building
+   it.  Each writes one child element at the given nesting level: the
+   indentation, the element and a newline.
+
+   libxml2 versions differ in how they write some text: older ones write
+   non-ASCII characters as character references, newer ones as UTF-8, and
+   carriage returns and invalid text are handled differently again.  The
+   first is checked once against the libxml2 in use.  For the others,
+   which are rare, the generators return FALSE and the caller should
+   discard the output and write that object through the DOM instead.
+*/
+
+/* libxml2 indents two spaces per level, up to 60 spaces */
+#define XML_STREAM_MAX_INDENT_LEVEL 30
+
+typedef enum
+{
+    XML_STREAM_UTF8_UNKNOWN,
+    XML_STREAM_UTF8_RAW,
+    XML_STREAM_UTF8_CHARREF,
+    XML_STREAM_UTF8_UNSUPPORTED
+} xml_stream_utf8_mode;
+
+static xml_stream_utf8_mode
+get_utf8_mode(void)
+{
+    static xml_stream_utf8_mode mode = XML_STREAM_UTF8_UNKNOWN;
+    xmlNodePtr node;
+    xmlBufferPtr buf;
+    const char *dumped;
+
+    if (mode != XML_STREAM_UTF8_UNKNOWN)
+        return mode;
+
+    /* xmlNodeDump() escapes text the same way as xmlElemDump() */
+    node = xmlNewNode(NULL, BAD_CAST "t");
+    xmlNodeAddContent(node, BAD_CAST "\xc3\xa9");
+    buf = xmlBufferCreate();
+    xmlNodeDump(buf, NULL, node, 0, 1);
+    dumped = (const char*)xmlBufferContent(buf);
+
+    if (safe_strcmp(dumped, "<t>\xc3\xa9</t>") == 0)
+        mode = XML_STREAM_UTF8_RAW;
+    else if (safe_strcmp(dumped, "<t>&#xE9;</t>") == 0)
+        mode = XML_STREAM_UTF8_CHARREF;
+    else
+    {
+        PWARN("Unexpected libxml2 output %s, not streaming non-ASCII text", dumped);
+        mode = XML_STREAM_UTF8_UNSUPPORTED;
+    }
+
+    xmlBufferFree(buf);
+    xmlFreeNode(node);
+    return mode;
+}
+
+static void
+xml_stream_indent(GString *out, gint level)
+{
+    gint i;
+
+    if (level > XML_STREAM_MAX_INDENT_LEVEL)
+        level = XML_STREAM_MAX_INDENT_LEVEL;
+    for (i = 0; i < level; i++)
+        g_string_append(out, "  ");
+}
+
+static gboolean
+xml_stream_escape(GString *out, const char *str)
+{
+    const guchar *in = (const guchar*)str;
+
+    while (*in)
+    {
+        guint32 val;
+        gint len, i;
+
+        if (*in == '<')
+            g_string_append(out, "&lt;");
+        else if (*in == '>')
+            g_string_append(out, "&gt;");
+        else if (*in == '&')
+            g_string_append(out, "&amp;");
+        else if ((*in >= 0x20 && *in < 0x80) || *in == '\n' || *in == '\t')
+            g_string_append_c(out, *in);
+        else if (*in < 0x80)
+            return FALSE;
+        else
+        {
+            if (*in < 0xC0)
+                return FALSE;
+            else if (*in < 0xE0)
+            {
+                val = *in & 0x1F;
+                len = 2;
+            }
+            else if (*in < 0xF0)
+            {
+                val = *in & 0x0F;
+                len = 3;
+            }
+            else if (*in < 0xF8)
+            {
+                val = *in & 0x07;
+                len = 4;
+            }
+            else
+                return FALSE;
+
+            for (i = 1; i < len; i++)
+            {
+                if ((in[i] & 0xC0) != 0x80)
+                    return FALSE;
+                val = (val << 6) | (in[i] & 0x3F);
+            }
+            if (!((val >= 0x80 && val <= 0xD7FF) ||
+                    (val >= 0xE000 && val <= 0xFFFD) ||
+                    (val >= 0x10000 && val <= 0x10FFFF)))
+                return FALSE;
+
+            switch (get_utf8_mode())
+            {
+            case XML_STREAM_UTF8_RAW:
+                g_string_append_len(out, (const gchar*)in, len);
+                break;
+            case XML_STREAM_UTF8_CHARREF:
+                g_string_append_printf(out, "&#x%X;", val);
+                break;
+            default:
+                return FALSE;
+            }
+            in += len;
+            continue;
+        }
+        in++;
+    }
+
+    return TRUE;
+}
+
+/* Writes <tag type="type">str</tag>.  As with xmlNewTextChild(), a NULL
+   str gives an empty element and "" gives a start and end tag. */
+static gboolean
+typed_text_to_xml_stream(GString *out, gint level, const char *tag,
+                         const char *type, const char *str)
+{
+    gboolean ok = TRUE;
+
+    xml_stream_indent(out, level);
+    g_string_append_c(out, '<');
+    g_string_append(out, tag);
+    if (type)
+        g_string_append_printf(out, " type=\"%s\"", type);
+    if (str)
+    {
+        g_string_append_c(out, '>');
+        ok = xml_stream_escape(out, str);
+        g_string_append_printf(out, "</%s>\n", tag);
+    }
+    else
+        g_string_append(out, "/>\n");
+
+    return ok;
+}
+
+gboolean
+text_child_to_xml_stream(GString *out, gint level, const char *tag,
+                         const char *str)
+{
+    return typed_text_to_xml_stream(out, level, tag, NULL, str);
+}
+
+gboolean
+guid_to_xml_stream(GString *out, gint level, const char *tag,
+                   const GncGUID *gid)
+{
+    char guid_str[GUID_ENCODING_LENGTH + 1];
+
+    if (!guid_to_string_buff(gid, guid_str))
+        return FALSE;
+
+    return typed_text_to_xml_stream(out, level, tag, "guid", guid_str);
+}
+
+gboolean
+commodity_ref_to_xml_stream(GString *out, gint level, const char *tag,
+                            const gnc_commodity *c)
+{
+    gboolean ok;
+
+    if (!c)
+        return FALSE;
+    /* commodity_ref_to_dom_tree() adds nothing for these */
+    if (!gnc_commodity_get_namespace(c) || !gnc_commodity_get_mnemonic(c))
+        return TRUE;
+
+    xml_stream_indent(out, level);
+    g_string_append_printf(out, "<%s>\n", tag);
+    ok = text_child_to_xml_stream(out, level + 1, "cmdty:space",
+                                  gnc_commodity_get_namespace_compat(c))
+         && text_child_to_xml_stream(out, level + 1, "cmdty:id",
+                                     gnc_commodity_get_mnemonic(c));
+    xml_stream_indent(out, level);
+    g_string_append_printf(out, "</%s>\n", tag);
+
+    return ok;
+}
+
+static gboolean
+typed_timespec_to_xml_stream(GString *out, gint level, const char *tag,
+                             const char *type, const Timespec *spec)
+{
+    gchar *date_str;
+    gchar *ns_str;
+    gboolean ok;
+
+    date_str = timespec_sec_to_string(spec);
+    if (!date_str)
+        return TRUE;
+
+    xml_stream_indent(out, level);
+    g_string_append_c(out, '<');
+    g_string_append(out, tag);
+    if (type)
+        g_string_append_printf(out, " type=\"%s\"", type);
+    g_string_append(out, ">\n");
+    ok = text_child_to_xml_stream(out, level + 1, "ts:date", date_str);
+    if (spec->tv_nsec > 0)
+    {
+        ns_str = timespec_nsec_to_string(spec);
+        ok = text_child_to_xml_stream(out, level + 1, "ts:ns", ns_str) && ok;
+        g_free(ns_str);
+    }
+    xml_stream_indent(out, level);
+    g_string_append_printf(out, "</%s>\n", tag);
+
+    g_free(date_str);
+    return ok;
+}
+
+gboolean
+timespec_to_xml_stream(GString *out, gint level, const char *tag,
+                       const Timespec *spec)
+{
+    g_return_val_if_fail(spec, FALSE);
+
+    return typed_timespec_to_xml_stream(out, level, tag, NULL, spec);
+}
+
+gboolean
+gnc_numeric_to_xml_stream(GString *out, gint level, const char *tag,
+                          const gnc_numeric *num)
+{
+    gchar *numstr;
+    gboolean ok;
+
+    g_return_val_if_fail(num, FALSE);
+
+    numstr = gnc_numeric_to_string(*num);
+    /* gnc_numeric_to_dom_tree() uses xmlNodeAddContent(), which adds
+       nothing for "" */
+    ok = typed_text_to_xml_stream(out, level, tag, NULL,
+                                  *numstr ? numstr : NULL);
+    g_free(numstr);
+
+    return ok;
+}
+
+struct kvp_stream_data
+{
+    GString *out;
+    gint level;
+    gboolean ok;
+};
+
+static void
+add_kvp_slot_to_stream(gpointer key, gpointer value, gpointer data);
+
+static gboolean
+kvp_value_to_xml_stream(GString *out, gint level, const char *tag,
+                        kvp_value *val)
+{
+    const char *type;
+    gchar *str;
+    gboolean ok;
+
+    switch (kvp_value_get_type(val))
+    {
+    case KVP_TYPE_GINT64:
+        type = "integer";
+        str = g_strdup_printf("%" G_GINT64_FORMAT, kvp_value_get_gint64(val));
+        break;
+    case KVP_TYPE_DOUBLE:
+        type = "double";
+        str = double_to_string(kvp_value_get_double(val));
+        break;
+    case KVP_TYPE_NUMERIC:
+        type = "numeric";
+        str = gnc_numeric_to_string(kvp_value_get_numeric(val));
+        break;
+    case KVP_TYPE_STRING:
+        return typed_text_to_xml_stream(out, level, tag, "string",
+                                        kvp_value_get_string(val));
+    case KVP_TYPE_GUID:
+    {
+        char guid_str[GUID_ENCODING_LENGTH + 1];
+
+        if (!guid_to_string_buff(kvp_value_get_guid(val), guid_str))
+            return FALSE;
+        return typed_text_to_xml_stream(out, level, tag, "guid", guid_str);
+    }
+    case KVP_TYPE_TIMESPEC:
+    {
+        Timespec ts = kvp_value_get_timespec(val);
+
+        return typed_timespec_to_xml_stream(out, level, tag, "timespec", &ts);
+    }
+    case KVP_TYPE_GDATE:
+    {
+        GDate d = kvp_value_get_gdate(val);
+        gchar date_str[512];
+
+        /* The DOM writer would format an uninitialized buffer */
+        if (!g_date_valid(&d))
+            return FALSE;
+        g_date_strftime(date_str, sizeof(date_str), "%Y-%m-%d", &d);
+
+        xml_stream_indent(out, level);
+        g_string_append_printf(out, "<%s type=\"gdate\">\n", tag);
+        ok = text_child_to_xml_stream(out, level + 1, "gdate", date_str);
+        xml_stream_indent(out, level);
+        g_string_append_printf(out, "</%s>\n", tag);
+        return ok;
+    }
+    case KVP_TYPE_BINARY:
+    {
+        guint64 size;
+        void *binary_data = kvp_value_get_binary(val, &size);
+
+        if (!binary_data)
+            return typed_text_to_xml_stream(out, level, tag, "binary", NULL);
+        str = binary_to_string(binary_data, size);
+        /* libxml2 versions differ in what xmlNodeSetContent() does with "" */
+        ok = *str && typed_text_to_xml_stream(out, level, tag, "binary", str);
+        g_free(str);
+        return ok;
+    }
+    case KVP_TYPE_GLIST:
+    {
+        GList *cursor = kvp_value_get_glist(val);
+
+        if (!cursor)
+            return typed_text_to_xml_stream(out, level, tag, "list", NULL);
+
+        ok = TRUE;
+        xml_stream_indent(out, level);
+        g_string_append_printf(out, "<%s type=\"list\">\n", tag);
+        for (; cursor; cursor = cursor->next)
+        {
+            ok = kvp_value_to_xml_stream(out, level + 1, "slot:value",
+                                         (kvp_value*)cursor->data) && ok;
+        }
+        xml_stream_indent(out, level);
+        g_string_append_printf(out, "</%s>\n", tag);
+        return ok;
+    }
+    case KVP_TYPE_FRAME:
+    {
+        kvp_frame *frame = kvp_value_get_frame(val);
+        struct kvp_stream_data data;
+
+        if (!frame || !kvp_frame_get_hash(frame)
+                || g_hash_table_size(kvp_frame_get_hash(frame)) == 0)
+            return typed_text_to_xml_stream(out, level, tag, "frame", NULL);
+
+        data.out = out;
+        data.level = level + 1;
+        data.ok = TRUE;
+        xml_stream_indent(out, level);
+        g_string_append_printf(out, "<%s type=\"frame\">\n", tag);
+        g_hash_table_foreach(kvp_frame_get_hash(frame),
+                             add_kvp_slot_to_stream, &data);
+        xml_stream_indent(out, level);
+        g_string_append_printf(out, "</%s>\n", tag);
+        return data.ok;
+    }
+    default:
+        return typed_text_to_xml_stream(out, level, tag, NULL, NULL);
+    }
+
+    ok = typed_text_to_xml_stream(out, level, tag, type, str);
+    g_free(str);
+    return ok;
+}
+
+static void
+add_kvp_slot_to_stream(gpointer key, gpointer value, gpointer data)
+{
+    struct kvp_stream_data *sdata = data;
+    gboolean ok;
+
+    xml_stream_indent(sdata->out, sdata->level);
+    g_string_append(sdata->out, "<slot>\n");
+    ok = text_child_to_xml_stream(sdata->out, sdata->level + 1, "slot:key",
+                                  (const char*)key);
+    ok = kvp_value_to_xml_stream(sdata->out, sdata->level + 1, "slot:value",
+                                 (kvp_value*)value) && ok;
+    xml_stream_indent(sdata->out, sdata->level);
+    g_string_append(sdata->out, "</slot>\n");
+
+    sdata->ok = sdata->ok && ok;
+}
+
+gboolean
+kvp_frame_to_xml_stream(GString *out, gint level, const char *tag,
+                        const kvp_frame *frame)
+{
+    struct kvp_stream_data data;
+
+    if (!frame || !kvp_frame_get_hash(frame)
+            || g_hash_table_size(kvp_frame_get_hash(frame)) == 0)
+        return TRUE;
+
+    data.out = out;
+    data.level = level + 1;
+    data.ok = TRUE;
+
+    xml_stream_indent(out, level);
+    g_string_append_printf(out, "<%s>\n", tag);
+    g_hash_table_foreach(kvp_frame_get_hash(frame), add_kvp_slot_to_stream,
+                         &data);
+    xml_stream_indent(out, level);
+    g_string_append_printf(out, "</%s>\n", tag);
+
+    return data.ok;
+}
@@ -49,4 +49,17 @@ xmlNodePtr recurrence_to_dom_tree(const gchar *tag, const Recurrence *r);
 
 gchar* double_to_string(double value);
 
+gboolean text_child_to_xml_stream(GString *out, gint level, const char *tag,
+                                  const char *str);
+gboolean guid_to_xml_stream(GString *out, gint level, const char *tag,
+                            const GncGUID *gid);
+gboolean commodity_ref_to_xml_stream(GString *out, gint level, const char *tag,
+                                     const gnc_commodity *c);
+gboolean timespec_to_xml_stream(GString *out, gint level, const char *tag,
+                                const Timespec *spec);
+gboolean gnc_numeric_to_xml_stream(GString *out, gint level, const char *tag,
+                                   const gnc_numeric *num);
+gboolean kvp_frame_to_xml_stream(GString *out, gint level, const char *tag,
+                                 const kvp_frame *frame);
+
 #endif /* _SIXTP_DOM_GENERATORS_H_ */
@@ -0,0 +1,186 @@
+/***************************************************************************
+ *            test-gzip-perf.c
+ *
+ *  Times the block-parallel gzip writer used for compressed saves with
+ *  1, 2, 4 and 8 threads, and checks that zlib reads back what was
+ *  written.  This is not part of "make check"; build it with
+ *  "make test-gzip-perf".  The amount of XML compressed defaults to
+ *  64MB and may be given in MB on the command line.
+ ****************************************************************************/
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include "io-gzip.h"
+
+#define DEFAULT_MB 64
+#define NUM_RUNS 3
+#define WRITE_SIZE 4096         /* what the save pipe hands over */
+
+/* Something shaped like the transactions of a real book */
+static GString *
+build_xml (gsize size)
+{
+    GString *xml = g_string_sized_new(size + 1024);
+    guint i = 0;
+
+    while (xml->len < size)
+    {
+        g_string_append_printf(xml,
+                               "<gnc:transaction version=\"2.0.0\">\n"
+                               "  <trn:id type=\"guid\">%08x%08x%08x%08x</trn:id>\n"
+                               "  <trn:date-posted>\n"
+                               "    <ts:date>2009-%02d-%02d 00:00:00 +0000</ts:date>\n"
+                               "  </trn:date-posted>\n"
+                               "  <trn:description>Payee %d</trn:description>\n"
+                               "  <trn:splits>\n"
+                               "    <trn:split>\n"
+                               "      <split:value>%d/100</split:value>\n"
+                               "      <split:quantity>%d/100</split:quantity>\n"
+                               "    </trn:split>\n"
+                               "  </trn:splits>\n"
+                               "</gnc:transaction>\n",
+                               rand(), rand(), rand(), i++,
+                               rand() % 12 + 1, rand() % 28 + 1,
+                               rand() % 100, rand() % 100000,
+                               rand() % 100000);
+    }
+    return xml;
+}
+
+static gboolean
+compress_to (const gchar *filename, GString *xml, gint n_threads)
+{
+    GncGzipWriter *writer;
+    FILE *out;
+    gsize pos;
+    gboolean ok;
+
+    out = g_fopen(filename, "wb");
+    if (!out)
+        return FALSE;
+
+    writer = gnc_gzip_writer_new(out, Z_DEFAULT_COMPRESSION, n_threads);
+    if (!writer)
+    {
+        fclose(out);
+        return FALSE;
+    }
+
+    for (pos = 0; pos < xml->len; pos += WRITE_SIZE)
+        gnc_gzip_writer_write(writer, xml->str + pos,
+                              MIN(WRITE_SIZE, xml->len - pos));
+
+    ok = gnc_gzip_writer_close(writer);
+    return fclose(out) == 0 && ok;
+}
+
+static gboolean
+reads_back (const gchar *filename, GString *xml)
+{
+    gzFile file;
+    gchar *buf;
+    gint len;
+    gboolean ok;
+
+    file = gzopen(filename, "rb");
+    if (!file)
+        return FALSE;
+
+    buf = g_malloc(xml->len + 1);
+    len = gzread(file, buf, xml->len + 1);
+    ok = (len == (gint) xml->len && memcmp(buf, xml->str, xml->len) == 0);
+    g_free(buf);
+    gzclose(file);
+    return ok;
+}
+
+int
+main (int argc, char **argv)
+{
+    static const gint threads[] = { 1, 2, 4, 8 };
+    GString *xml;
+    GTimer *timer;
+    gchar *filename;
+    gsize mb = DEFAULT_MB;
+    guint i;
+    gint fd;
+    gint rv = 0;
+
+    if (argc > 1)
+        mb = strtoul(argv[1], NULL, 10);
+
+    g_thread_init(NULL);
+    srand(0);
+    xml = build_xml(mb * 1024 * 1024);
+
+    filename = g_strdup("test-gzip-perf-XXXXXX");
+    fd = g_mkstemp(filename);
+    if (fd < 0)
+    {
+        perror("g_mkstemp");
+        return 1;
+    }
+    close(fd);
+
+    timer = g_timer_new();
+    for (i = 0; i < G_N_ELEMENTS(threads); i++)
+    {
+        gdouble best = -1;
+        gint run;
+
+        for (run = 0; run < NUM_RUNS; run++)
+        {
+            gdouble elapsed;
+
+            g_timer_start(timer);
+            if (!compress_to(filename, xml, threads[i]))
+            {
+                printf("%d threads: write failed\n", threads[i]);
+                rv = 1;
+                break;
+            }
+            elapsed = g_timer_elapsed(timer, NULL);
+            if (best < 0 || elapsed < best)
+                best = elapsed;
+        }
+
+        if (!reads_back(filename, xml))
+        {
+            printf("%d threads: file does not read back\n", threads[i]);
+            rv = 1;
+        }
+        else if (best > 0)
+        {
+            printf("%d threads %8.1f MB/s\n", threads[i],
+                   xml->len / best / (1024 * 1024));
+        }
+    }
+
+    g_timer_destroy(timer);
+    g_unlink(filename);
+    g_free(filename);
+    g_string_free(xml, TRUE);
+    return rv;
+}
@@ -0,0 +1,208 @@
+/***************************************************************************
+ *            test-gzip-writer.c
+ *
+ *  Checks that the block-parallel gzip writer used for compressed saves
+ *  writes files that zlib reads back unchanged, at the edges of its
+ *  blocks, and that it reports a failed write.
+ ****************************************************************************/
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include "io-gzip.h"
+#include "test-stuff.h"
+
+#define GZIP_BLOCK_SIZE (128 * 1024)    /* BLOCK_SIZE in io-gzip.c */
+#define N_THREADS 4
+
+/* Half text that compresses well, half noise that doesn't */
+static gchar *
+build_data (gsize len)
+{
+    gchar *data = g_malloc(len + 1);
+    gsize i;
+
+    for (i = 0; i < len; i++)
+    {
+        if ((i / 1000) % 2)
+            data[i] = rand() & 0xff;
+        else
+            data[i] = "<split:value>1234/100</split:value>\n"[i % 36];
+    }
+    return data;
+}
+
+static gboolean
+compress_to (const gchar *filename, const gchar *data, gsize len,
+             gsize chunk)
+{
+    GncGzipWriter *writer;
+    FILE *out;
+    gsize pos;
+    gboolean ok;
+
+    out = g_fopen(filename, "wb");
+    if (!out)
+        return FALSE;
+
+    writer = gnc_gzip_writer_new(out, Z_DEFAULT_COMPRESSION, N_THREADS);
+    if (!writer)
+    {
+        fclose(out);
+        return FALSE;
+    }
+
+    for (pos = 0; pos < len; pos += chunk)
+        gnc_gzip_writer_write(writer, data + pos, MIN(chunk, len - pos));
+
+    ok = gnc_gzip_writer_close(writer);
+    return fclose(out) == 0 && ok;
+}
+
+/* Inflates the whole file, so that a bad CRC, length or trailing
+   garbage is an error too. */
+static gboolean
+reads_back (const gchar *filename, const gchar *data, gsize len)
+{
+    gchar *contents;
+    gsize contents_len;
+    gchar *buf;
+    z_stream strm;
+    gboolean ok;
+    int ret;
+
+    if (!g_file_get_contents(filename, &contents, &contents_len, NULL))
+        return FALSE;
+
+    memset(&strm, 0, sizeof(strm));
+    if (inflateInit2(&strm, 16 + MAX_WBITS) != Z_OK)
+    {
+        g_free(contents);
+        return FALSE;
+    }
+
+    buf = g_malloc(len + 1);
+    strm.next_in = (guchar *) contents;
+    strm.avail_in = contents_len;
+    strm.next_out = (guchar *) buf;
+    strm.avail_out = len + 1;
+    ret = inflate(&strm, Z_FINISH);
+    ok = (ret == Z_STREAM_END && strm.avail_in == 0 &&
+          strm.total_out == len && memcmp(buf, data, len) == 0);
+    inflateEnd(&strm);
+
+    g_free(buf);
+    g_free(contents);
+    return ok;
+}
+
+static void
+test_round_trip (const gchar *filename, gsize len, gsize chunk,
+                 const char *title)
+{
+    gchar *data = build_data(len);
+
+    if (!compress_to(filename, data, len, chunk))
+    {
+        failure_args(title, __FILE__, __LINE__, "write failed");
+    }
+    else if (!reads_back(filename, data, len))
+    {
+        failure_args(title, __FILE__, __LINE__, "file does not read back");
+    }
+    else
+    {
+        success(title);
+    }
+    g_free(data);
+}
+
+/* Every fwrite to a stream opened for reading fails */
+static void
+test_write_error (const gchar *filename)
+{
+    GncGzipWriter *writer;
+    gchar *data;
+    FILE *out;
+    gboolean write_ok, close_ok;
+
+    out = g_fopen(filename, "rb");
+    if (!out)
+    {
+        failure("can't open the file to test a write error");
+        return;
+    }
+
+    writer = gnc_gzip_writer_new(out, Z_DEFAULT_COMPRESSION, N_THREADS);
+    if (!writer)
+    {
+        failure("can't create a gzip writer");
+        fclose(out);
+        return;
+    }
+
+    data = build_data(2 * GZIP_BLOCK_SIZE);
+    write_ok = gnc_gzip_writer_write(writer, data, 2 * GZIP_BLOCK_SIZE);
+    close_ok = gnc_gzip_writer_close(writer);
+    fclose(out);
+    g_free(data);
+
+    do_test(!write_ok, "write reports a failed fwrite");
+    do_test(!close_ok, "close reports a failed fwrite");
+}
+
+int
+main (int argc, char **argv)
+{
+    gchar *filename;
+    gint fd;
+
+    g_thread_init(NULL);
+    srand(0);
+
+    filename = g_strdup("test-gzip-writer-XXXXXX");
+    fd = g_mkstemp(filename);
+    if (fd < 0)
+    {
+        failure("can't create a temporary file");
+        return get_rv();
+    }
+    close(fd);
+
+    test_round_trip(filename, 0, 1, "empty input");
+    test_round_trip(filename, 1000, 1000, "input shorter than a block");
+    test_round_trip(filename, GZIP_BLOCK_SIZE, GZIP_BLOCK_SIZE,
+                    "input of exactly one block");
+    test_round_trip(filename, 3 * GZIP_BLOCK_SIZE, 4096,
+                    "input of exactly three blocks");
+    test_round_trip(filename, 3 * GZIP_BLOCK_SIZE + 1, 4099,
+                    "input one byte past a block");
+    test_round_trip(filename, 20 * GZIP_BLOCK_SIZE, 20 * GZIP_BLOCK_SIZE,
+                    "more blocks than the writer keeps pending");
+    test_write_error(filename);
+
+    g_unlink(filename);
+    g_free(filename);
+    return get_rv();
+}
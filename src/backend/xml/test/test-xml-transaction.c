@@ -27,6 +27,7 @@
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <sys/types.h>
@@ -42,6 +43,7 @@
 #include "sixtp-dom-parsers.h"
 #include "TransLog.h"
 #include "io-gncxml-gen.h"
+#include "io-gncxml-v2.h"
 
 #include "test-stuff.h"
 #include "test-engine-stuff.h"
@@ -358,6 +360,45 @@ test_add_transaction(const char *tag, gpointer globaldata, gpointer data)
     return TRUE;
 }
 
+/* Returns what the file writer used to write for the node */
+static gchar *
+dom_node_to_string(xmlNodePtr node)
+{
+    FILE *f = tmpfile();
+    gchar *str;
+    long len;
+
+    xmlElemDump(f, NULL, node);
+    fprintf(f, "\n");
+    len = ftell(f);
+    rewind(f);
+    str = g_new0(gchar, len + 1);
+    if (fread(str, 1, len, f) != (size_t)len)
+        str[0] = '\0';
+    fclose(f);
+
+    return str;
+}
+
+static void
+test_transaction_stream(xmlNodePtr node, Transaction *trn)
+{
+    GString *stream = g_string_new(NULL);
+    gchar *dumped = dom_node_to_string(node);
+
+    /* FALSE means the writer falls back to the DOM for this transaction */
+    if (gnc_transaction_xml_stream_write(stream, trn))
+    {
+        do_test_args(safe_strcmp(stream->str, dumped) == 0,
+                     "transaction_xml_stream", __FILE__, __LINE__,
+                     "streamed XML differs from DOM:\n%s\n%s",
+                     stream->str, dumped);
+    }
+
+    g_free(dumped);
+    g_string_free(stream, TRUE);
+}
+
 static void
 test_transaction(void)
 {
@@ -430,6 +471,8 @@ test_transaction(void)
             success_args("transaction_xml", __FILE__, __LINE__, "%d", i );
         }
 
+        test_transaction_stream(test_node, ran_trn);
+
         filename1 = g_strdup_printf("test_file_XXXXXX");
 
         fd = g_mkstemp(filename1);
@@ -476,6 +519,37 @@ test_transaction(void)
             /* sixtp_destroy(parser); */
         }
 
+        {
+            sixtp *parser;
+            tran_data data;
+            gxpf_data gpdata;
+            gpointer parse_result = NULL;
+            gboolean ok;
+
+            data.trn = ran_trn;
+            data.new_trn = NULL;
+            data.com = com;
+            data.value = i;
+
+            gpdata.cb = test_add_transaction;
+            gpdata.parsedata = &data;
+            gpdata.bookdata = book;
+            gpdata.trn_loader = gnc_transaction_xml_loader_new(2);
+
+            parser = gnc_transaction_sixtp_parser_create();
+
+            ok = sixtp_parse_file(parser, filename1, NULL, &gpdata,
+                                  &parse_result);
+            ok = gnc_transaction_xml_loader_destroy(gpdata.trn_loader) && ok;
+            if (!ok || !data.new_trn)
+            {
+                failure_args("transaction loader", __FILE__, __LINE__,
+                             "%d", i);
+            }
+            else
+                really_get_rid_of_transaction (data.new_trn);
+        }
+
         g_unlink(filename1);
         g_free(filename1);
         really_get_rid_of_transaction(ran_trn);
@@ -483,6 +557,196 @@ test_transaction(void)
     }
 }
 
+static Transaction *
+get_random_transaction_in_accounts(void)
+{
+    Transaction *trn;
+    GList *list, *node;
+
+    get_random_account_tree(book);
+    trn = get_random_transaction(book);
+    if (!trn)
+        return NULL;
+
+    list = g_list_copy(xaccTransGetSplitList(trn));
+    for (node = list; node; node = node->next)
+    {
+        Split *s = node->data;
+        Account *a = xaccMallocAccount(book);
+
+        xaccAccountBeginEdit(a);
+        xaccAccountSetCommoditySCU(a, xaccSplitGetAmount(s).denom);
+        xaccAccountInsertSplit(a, s);
+        xaccAccountCommitEdit(a);
+    }
+    g_list_free(list);
+    return trn;
+}
+
+static gchar *
+get_temp_filename(const gchar *template)
+{
+    gchar *filename = g_strdup(template);
+    int fd = g_mkstemp(filename);
+
+    close(fd);
+    g_unlink(filename);
+    return filename;
+}
+
+static void
+test_journal(void)
+{
+    Transaction *trn;
+    GncGUID guid;
+    GList *guids;
+    gchar *description;
+    gchar *filename;
+    int n_splits;
+    FILE *f;
+
+    trn = get_random_transaction_in_accounts();
+    if (!trn)
+    {
+        failure_args("journal", __FILE__, __LINE__,
+                     "get_random_transaction returned NULL");
+        return;
+    }
+    guid = *xaccTransGetGUID(trn);
+    guids = g_list_prepend(NULL, &guid);
+    description = g_strdup(xaccTransGetDescription(trn));
+    n_splits = xaccTransCountSplits(trn);
+
+    /* A record replaces the transaction in the book */
+    filename = get_temp_filename("test_journal_XXXXXX");
+    do_test(gnc_book_append_journal_v2(book, filename, 1, 2, guids),
+            "journal append");
+
+    xaccTransBeginEdit(trn);
+    xaccTransSetDescription(trn, "changed since the journal");
+    xaccTransCommitEdit(trn);
+
+    do_test(!qof_session_load_journal_v2(book, filename, 1, 3),
+            "journal for another data file");
+    trn = xaccTransLookup(&guid, book);
+    do_test(trn && safe_strcmp(xaccTransGetDescription(trn),
+                               "changed since the journal") == 0,
+            "journal for another data file left alone");
+
+    /* A batch cut short is dropped, the ones before it are not */
+    f = g_fopen(filename, "ab");
+    fprintf(f, "<jnl:batch>\n<gnc:transaction version=\"2.0.0\">\n");
+    fclose(f);
+
+    do_test(!qof_session_load_journal_v2(book, filename, 1, 2),
+            "journal with a partial batch");
+    trn = xaccTransLookup(&guid, book);
+    do_test(trn && safe_strcmp(xaccTransGetDescription(trn), description) == 0
+            && xaccTransCountSplits(trn) == n_splits,
+            "journal record replayed");
+
+    g_unlink(filename);
+    g_free(filename);
+
+    /* A transaction no longer in the book is recorded as deleted */
+    filename = get_temp_filename("test_journal_XXXXXX");
+    do_test(gnc_book_append_journal_v2(book, filename, 1, 2, guids),
+            "journal append before destroy");
+    if (trn)
+        really_get_rid_of_transaction(trn);
+    do_test(gnc_book_append_journal_v2(book, filename, 1, 2, guids),
+            "journal append after destroy");
+
+    do_test(qof_session_load_journal_v2(book, filename, 1, 2),
+            "journal replay");
+    do_test(xaccTransLookup(&guid, book) == NULL,
+            "journal destroy record replayed");
+
+    g_unlink(filename);
+    g_free(filename);
+    g_free(description);
+    g_list_free(guids);
+}
+
+static gboolean
+cache_trn_cb(Transaction *trn, gpointer data)
+{
+    *(Transaction **)data = trn;
+    return TRUE;
+}
+
+static void
+test_cache(void)
+{
+    static const gchar xml[] = "<gnc-v2/>\n";
+    GncBookCacheId id = { 1, 2, 3 };
+    GncBookCacheId other_id = { 1, 2, 4 };
+    GncBookCacheWriter *writer;
+    GncBookCache *cache;
+    Transaction *trn, *loaded = NULL;
+    xmlNodePtr node;
+    const gchar *cached_xml;
+    const char *msg;
+    gchar *filename;
+    gsize len;
+    FILE *f;
+    int c;
+
+    trn = get_random_transaction_in_accounts();
+    if (!trn)
+    {
+        failure_args("cache", __FILE__, __LINE__,
+                     "get_random_transaction returned NULL");
+        return;
+    }
+    node = gnc_transaction_dom_tree_create(trn);
+
+    filename = get_temp_filename("test_cache_XXXXXX");
+    f = g_fopen(filename, "w+b");
+    writer = gnc_book_cache_writer_new(f);
+    fputs(xml, f);
+    gnc_book_cache_writer_add_transaction(writer, trn);
+    do_test(gnc_book_cache_writer_close(writer, &id), "cache write");
+    fclose(f);
+
+    do_test(gnc_book_cache_open(filename, &other_id) == NULL,
+            "cache of another data file");
+
+    /* The cached transaction takes the place of the original */
+    really_get_rid_of_transaction(trn);
+
+    cache = gnc_book_cache_open(filename, &id);
+    do_test(cache != NULL, "cache open");
+    if (cache)
+    {
+        cached_xml = gnc_book_cache_get_xml(cache, &len);
+        do_test(len == strlen(xml) && strncmp(cached_xml, xml, len) == 0,
+                "cache xml");
+        do_test(gnc_book_cache_load_transactions(cache, book, cache_trn_cb,
+                &loaded), "cache load");
+        msg = loaded ? node_and_transaction_equal(node, loaded) :
+              "no transaction";
+        do_test_args(msg == NULL, "cached transaction", __FILE__, __LINE__,
+                     msg);
+        gnc_book_cache_close(cache);
+    }
+
+    /* Any damage to it is noticed */
+    f = g_fopen(filename, "r+b");
+    fseek(f, -1, SEEK_END);
+    c = fgetc(f);
+    fseek(f, -1, SEEK_END);
+    fputc(c ^ 1, f);
+    fclose(f);
+    do_test(gnc_book_cache_open(filename, &id) == NULL, "damaged cache");
+
+    if (loaded)
+        really_get_rid_of_transaction(loaded);
+    xmlFreeNode(node);
+    g_unlink(filename);
+    g_free(filename);
+}
+
 static gboolean
 test_real_transaction(const char *tag, gpointer global_data, gpointer data)
 {
@@ -499,6 +763,8 @@ test_real_transaction(const char *tag, gpointer global_data, gpointer data)
 int
 main (int argc, char ** argv)
 {
+    if (!g_thread_supported())
+        g_thread_init(NULL);
     qof_init();
     cashobjects_register();
     xaccLogDisable();
@@ -516,6 +782,8 @@ main (int argc, char ** argv)
     else
     {
         test_transaction();
+        test_journal();
+        test_cache();
     }
 
     print_test_results();
@@ -114,6 +114,46 @@ test_employee (void)
         gncEmployeeSetGUID (employee, &guid);
         do_test (guid_equal (&guid, qof_instance_get_guid(QOF_INSTANCE(employee))), "guid compare");
     }
+
+    /* Test that referring objects follow changes to the employee */
+    {
+        Account *acc1 = xaccMallocAccount (book);
+        Account *acc2 = xaccMallocAccount (book);
+        GList *list;
+
+        gncEmployeeBeginEdit (employee);
+        gncEmployeeSetCCard (employee, acc1);
+        gncEmployeeCommitEdit (employee);
+        list = qof_instance_get_referring_object_list (QOF_INSTANCE(acc1));
+        do_test (g_list_find (list, employee) != NULL, "referred to by employee");
+        g_list_free (list);
+
+        gncEmployeeBeginEdit (employee);
+        gncEmployeeSetCCard (employee, acc2);
+        gncEmployeeCommitEdit (employee);
+        list = qof_instance_get_referring_object_list (QOF_INSTANCE(acc1));
+        do_test (g_list_find (list, employee) == NULL, "no longer referred to");
+        g_list_free (list);
+        list = qof_instance_get_referring_object_list (QOF_INSTANCE(acc2));
+        do_test (g_list_find (list, employee) != NULL, "referred to after change");
+        g_list_free (list);
+
+        /* Before the commit, lookups see the employee as it is now */
+        gncEmployeeBeginEdit (employee);
+        gncEmployeeSetCCard (employee, acc1);
+        list = qof_instance_get_referring_object_list (QOF_INSTANCE(acc1));
+        do_test (g_list_find (list, employee) != NULL, "referred to while open for edit");
+        g_list_free (list);
+        list = qof_instance_get_referring_object_list (QOF_INSTANCE(acc2));
+        do_test (g_list_find (list, employee) == NULL, "old reference gone while open for edit");
+        g_list_free (list);
+        gncEmployeeCommitEdit (employee);
+        list = qof_instance_get_referring_object_list (QOF_INSTANCE(acc1));
+        do_test (g_list_find (list, employee) != NULL &&
+                 g_list_find (g_list_find (list, employee)->next, employee) == NULL,
+                 "referred to once after the commit");
+        g_list_free (list);
+    }
 #if 0
     {
         GList *list;
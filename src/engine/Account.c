@@ -38,6 +38,7 @@
 #include "gnc-glib-utils.h"
 #include "gnc-lot.h"
 #include "gnc-pricedb.h"
+#include "Query.h"
 
 #define GNC_ID_ROOT_ACCOUNT        "RootAccount"
 
@@ -137,6 +138,11 @@ typedef struct AccountPrivate
     gnc_numeric starting_cleared_balance;
     gnc_numeric starting_reconciled_balance;
 
+    /* Set by backends which load transactions as needed, while some of
+     * the account's splits are still only in the backend and the
+     * starting balances stand in for them. */
+    gboolean splits_incomplete;
+
     /* cached parameters */
     gnc_numeric balance;
     gnc_numeric cleared_balance;
@@ -144,9 +150,29 @@ typedef struct AccountPrivate
 
     gboolean balance_dirty;     /* balances in splits incorrect */
 
+    /* When only some splits changed, balance_partial is set instead of
+     * balance_dirty, and balance_valid_to names the last split whose
+     * running balances are still correct (NULL means none are), so
+     * that only the splits after it need to be re-summed. */
+    gboolean balance_partial;
+    Split *balance_valid_to;
+
     GList *splits;              /* list of split pointers */
     gboolean sort_dirty;        /* sort order of splits is bad */
 
+    /* The splits list above is only the ordered view handed out to
+     * callers.  The split_seq balanced tree holds the GList nodes of
+     * that view in xaccSplitOrder() order, and split_index maps each
+     * Split to its position in the tree, so that inserting, removing
+     * or finding a split costs O(log n) instead of a list walk. */
+    GSequence  *split_seq;
+    GHashTable *split_index;
+
+    /* Splits whose sort key may have changed and that need to be
+     * moved to their proper place on the next sort.  Only when the
+     * whole order is suspect is sort_dirty set instead. */
+    GHashTable *split_moved;
+
     LotList   *lots;		/* list of lot pointers */
     GNCPolicy *policy;		/* Cached pointer to policy method */
 
@@ -316,10 +342,16 @@ gnc_account_init(Account* acc)
     priv->starting_balance = gnc_numeric_zero();
     priv->starting_cleared_balance = gnc_numeric_zero();
     priv->starting_reconciled_balance = gnc_numeric_zero();
+    priv->splits_incomplete = FALSE;
     priv->balance_dirty = FALSE;
+    priv->balance_partial = FALSE;
+    priv->balance_valid_to = NULL;
 
     priv->splits = NULL;
     priv->sort_dirty = FALSE;
+    priv->split_seq = g_sequence_new(NULL);
+    priv->split_index = g_hash_table_new(g_direct_hash, g_direct_equal);
+    priv->split_moved = g_hash_table_new(g_direct_hash, g_direct_equal);
 }
 
 static void
@@ -331,6 +363,16 @@ gnc_account_dispose (GObject *acctp)
 static void
 gnc_account_finalize(GObject* acctp)
 {
+    AccountPrivate *priv;
+
+    priv = GET_PRIVATE(acctp);
+    g_sequence_free(priv->split_seq);
+    priv->split_seq = NULL;
+    g_hash_table_destroy(priv->split_index);
+    priv->split_index = NULL;
+    g_hash_table_destroy(priv->split_moved);
+    priv->split_moved = NULL;
+
     G_OBJECT_CLASS(gnc_account_parent_class)->finalize(acctp);
 }
 
@@ -381,10 +423,10 @@ gnc_account_get_property (GObject         *object,
         g_value_set_boolean(value, priv->non_standard_scu);
         break;
     case PROP_SORT_DIRTY:
-        g_value_set_boolean(value, priv->sort_dirty);
+        g_value_set_boolean(value, gnc_account_get_sort_dirty(account));
         break;
     case PROP_BALANCE_DIRTY:
-        g_value_set_boolean(value, priv->balance_dirty);
+        g_value_set_boolean(value, gnc_account_get_balance_dirty(account));
         break;
     case PROP_START_BALANCE:
         g_value_set_boxed(value, &priv->starting_balance);
@@ -1154,6 +1196,8 @@ xaccFreeAccount (Account *acc)
     priv->commodity = NULL;
 
     priv->balance_dirty = FALSE;
+    priv->balance_partial = FALSE;
+    priv->balance_valid_to = NULL;
     priv->sort_dirty = FALSE;
 
     /* qof_instance_release (&acc->inst); */
@@ -1545,8 +1589,11 @@ xaccAccountEqual(const Account *aa, const Account *ab, gboolean check_guids)
 gboolean
 gnc_account_get_sort_dirty (Account *acc)
 {
+    AccountPrivate *priv;
+
     g_return_val_if_fail(GNC_IS_ACCOUNT(acc), FALSE);
-    return GET_PRIVATE(acc)->sort_dirty;
+    priv = GET_PRIVATE(acc);
+    return priv->sort_dirty || g_hash_table_size(priv->split_moved) > 0;
 }
 
 void
@@ -1566,8 +1613,11 @@ gnc_account_set_sort_dirty (Account *acc)
 gboolean
 gnc_account_get_balance_dirty (Account *acc)
 {
+    AccountPrivate *priv;
+
     g_return_val_if_fail(GNC_IS_ACCOUNT(acc), FALSE);
-    return GET_PRIVATE(acc)->balance_dirty;
+    priv = GET_PRIVATE(acc);
+    return priv->balance_dirty || priv->balance_partial;
 }
 
 void
@@ -1587,43 +1637,233 @@ gnc_account_set_balance_dirty (Account *acc)
 /********************************************************************\
 \********************************************************************/
 
+/* The split index stores GList nodes, so compare the splits they hold. */
+static gint
+split_node_order (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    return xaccSplitOrder(((const GList *)a)->data, ((const GList *)b)->data);
+}
+
+/* Add a split to the index and link its node into the GList view at
+ * the same position, using the neighbouring tree entries to find the
+ * list neighbours instead of walking the list.  When 'sorted' is
+ * FALSE the split is simply appended, and the caller is responsible
+ * for marking the sort order dirty. */
+static void
+account_splits_link (AccountPrivate *priv, Split *s, gboolean sorted)
+{
+    GSequenceIter *iter, *next;
+    GList *node, *neighbour;
+
+    node = g_list_alloc();
+    node->data = s;
+
+    if (sorted)
+        iter = g_sequence_insert_sorted(priv->split_seq, node,
+                                        split_node_order, NULL);
+    else
+        iter = g_sequence_append(priv->split_seq, node);
+    g_hash_table_insert(priv->split_index, s, iter);
+
+    next = g_sequence_iter_next(iter);
+    if (!g_sequence_iter_is_end(next))
+    {
+        neighbour = g_sequence_get(next);
+        node->next = neighbour;
+        node->prev = neighbour->prev;
+        if (neighbour->prev)
+            neighbour->prev->next = node;
+        else
+            priv->splits = node;
+        neighbour->prev = node;
+    }
+    else if (!g_sequence_iter_is_begin(iter))
+    {
+        neighbour = g_sequence_get(g_sequence_iter_prev(iter));
+        neighbour->next = node;
+        node->prev = neighbour;
+    }
+    else
+    {
+        priv->splits = node;
+    }
+}
+
+/* Remove a split from the index and unlink its node from the GList
+ * view.  Returns FALSE if the split isn't in this account. */
+static gboolean
+account_splits_unlink (AccountPrivate *priv, Split *s)
+{
+    GSequenceIter *iter;
+    GList *node;
+
+    iter = g_hash_table_lookup(priv->split_index, s);
+    if (NULL == iter)
+        return FALSE;
+
+    node = g_sequence_get(iter);
+    g_sequence_remove(iter);
+    g_hash_table_remove(priv->split_index, s);
+    priv->splits = g_list_delete_link(priv->splits, node);
+    return TRUE;
+}
+
+/* Rebuild the GList view links to match the order of the index.  The
+ * nodes themselves are reused, so the index entries stay valid. */
+static void
+account_splits_relink (AccountPrivate *priv)
+{
+    GSequenceIter *iter;
+    GList *node, *prev = NULL;
+
+    priv->splits = NULL;
+    for (iter = g_sequence_get_begin_iter(priv->split_seq);
+            !g_sequence_iter_is_end(iter);
+            iter = g_sequence_iter_next(iter))
+    {
+        node = g_sequence_get(iter);
+        node->prev = prev;
+        node->next = NULL;
+        if (prev)
+            prev->next = node;
+        else
+            priv->splits = node;
+        prev = node;
+    }
+}
+
+/* Note that the running balances of 's' and every split after it are
+ * stale.  The split must still be in the index, at the position whose
+ * successors are affected. */
+static void
+account_balance_dirty_from (AccountPrivate *priv, Split *s)
+{
+    GSequenceIter *iter, *valid_iter;
+    Split *prev = NULL;
+
+    if (priv->balance_dirty)
+        return;
+
+    iter = g_hash_table_lookup(priv->split_index, s);
+    if (!iter)
+    {
+        priv->balance_dirty = TRUE;
+        return;
+    }
+    if (!g_sequence_iter_is_begin(iter))
+        prev = ((GList *)g_sequence_get(g_sequence_iter_prev(iter)))->data;
+
+    if (!priv->balance_partial)
+    {
+        priv->balance_partial = TRUE;
+        priv->balance_valid_to = prev;
+        return;
+    }
+
+    /* Keep whichever of the two is earlier. */
+    if (!priv->balance_valid_to || !prev)
+    {
+        priv->balance_valid_to = NULL;
+        return;
+    }
+    valid_iter = g_hash_table_lookup(priv->split_index, priv->balance_valid_to);
+    if (!valid_iter ||
+            g_sequence_iter_compare(g_sequence_iter_prev(iter), valid_iter) < 0)
+        priv->balance_valid_to = prev;
+}
+
+/* Move the splits in split_moved to their proper place.  All of them
+ * are taken out of the tree first, so that the remaining entries are
+ * correctly ordered and each can be re-inserted with a binary search.
+ * The running balances are invalidated from both the old and the new
+ * position of every moved split. */
+static void
+account_splits_reposition (AccountPrivate *priv)
+{
+    GList *moved, *lp;
+
+    moved = g_hash_table_get_keys(priv->split_moved);
+    for (lp = moved; lp; lp = lp->next)
+        account_balance_dirty_from(priv, lp->data);
+    for (lp = moved; lp; lp = lp->next)
+        account_splits_unlink(priv, lp->data);
+    for (lp = moved; lp; lp = lp->next)
+    {
+        account_splits_link(priv, lp->data, TRUE);
+        account_balance_dirty_from(priv, lp->data);
+    }
+    g_list_free(moved);
+    g_hash_table_remove_all(priv->split_moved);
+}
+
+void
+gnc_account_set_split_dirty (Account *acc, Split *s)
+{
+    AccountPrivate *priv;
+
+    g_return_if_fail(GNC_IS_ACCOUNT(acc));
+    g_return_if_fail(GNC_IS_SPLIT(s));
+
+    if (qof_instance_get_destroying(acc))
+        return;
+
+    /* A split that isn't in the account yet will be placed and
+     * accounted for when it is inserted. */
+    priv = GET_PRIVATE(acc);
+    if (!g_hash_table_lookup(priv->split_index, s))
+        return;
+
+    if (priv->sort_dirty)
+    {
+        priv->balance_dirty = TRUE;
+        return;
+    }
+    g_hash_table_insert(priv->split_moved, s, s);
+    account_balance_dirty_from(priv, s);
+}
+
 gboolean
 gnc_account_find_split (Account *acc, Split *s)
 {
     AccountPrivate *priv;
-    GList *node;
 
     g_return_val_if_fail(GNC_IS_ACCOUNT(acc), FALSE);
     g_return_val_if_fail(GNC_IS_SPLIT(s), FALSE);
 
     priv = GET_PRIVATE(acc);
-    node = g_list_find(priv->splits, s);
-    return node ? TRUE : FALSE;
+    return g_hash_table_lookup(priv->split_index, s) ? TRUE : FALSE;
 }
 
 gboolean
 gnc_account_insert_split (Account *acc, Split *s)
 {
     AccountPrivate *priv;
-    GList *node;
 
     g_return_val_if_fail(GNC_IS_ACCOUNT(acc), FALSE);
     g_return_val_if_fail(GNC_IS_SPLIT(s), FALSE);
 
     priv = GET_PRIVATE(acc);
-    node = g_list_find(priv->splits, s);
-    if (node)
+    if (g_hash_table_lookup(priv->split_index, s))
         return FALSE;
 
-    if (qof_instance_get_editlevel(acc) == 0)
+    /* If the existing order is already suspect there is no point in
+     * searching for the right place; the next sort will fix it. */
+    if (qof_instance_get_editlevel(acc) == 0 && !priv->sort_dirty &&
+            g_hash_table_size(priv->split_moved) == 0)
     {
-        priv->splits = g_list_insert_sorted(priv->splits, s,
-                                            (GCompareFunc)xaccSplitOrder);
+        account_splits_link(priv, s, TRUE);
+        account_balance_dirty_from(priv, s);
     }
     else
     {
-        priv->splits = g_list_prepend(priv->splits, s);
-        priv->sort_dirty = TRUE;
+        account_splits_link(priv, s, FALSE);
+        if (priv->sort_dirty)
+            priv->balance_dirty = TRUE;
+        else
+        {
+            g_hash_table_insert(priv->split_moved, s, s);
+            account_balance_dirty_from(priv, s);
+        }
     }
 
     //FIXME: find better event
@@ -1631,7 +1871,6 @@ gnc_account_insert_split (Account *acc, Split *s)
     /* Also send an event based on the account */
     qof_event_gen(&acc->inst, GNC_EVENT_ITEM_ADDED, s);
 
-    priv->balance_dirty = TRUE;
 //  DRH: Should the below be added? It is present in the delete path.
 //  xaccAccountRecomputeBalance(acc);
     return TRUE;
@@ -1641,23 +1880,23 @@ gboolean
 gnc_account_remove_split (Account *acc, Split *s)
 {
     AccountPrivate *priv;
-    GList *node;
 
     g_return_val_if_fail(GNC_IS_ACCOUNT(acc), FALSE);
     g_return_val_if_fail(GNC_IS_SPLIT(s), FALSE);
 
     priv = GET_PRIVATE(acc);
-    node = g_list_find(priv->splits, s);
-    if (NULL == node)
+    if (!g_hash_table_lookup(priv->split_index, s))
         return FALSE;
 
-    priv->splits = g_list_delete_link(priv->splits, node);
+    g_hash_table_remove(priv->split_moved, s);
+    account_balance_dirty_from(priv, s);
+    account_splits_unlink(priv, s);
+
     //FIXME: find better event type
     qof_event_gen(&acc->inst, QOF_EVENT_MODIFY, NULL);
     // And send the account-based event, too
     qof_event_gen(&acc->inst, GNC_EVENT_ITEM_REMOVED, s);
 
-    priv->balance_dirty = TRUE;
     xaccAccountRecomputeBalance(acc);
     return TRUE;
 }
@@ -1670,11 +1909,20 @@ xaccAccountSortSplits (Account *acc, gboolean force)
     g_return_if_fail(GNC_IS_ACCOUNT(acc));
 
     priv = GET_PRIVATE(acc);
-    if (!priv->sort_dirty || (!force && qof_instance_get_editlevel(acc) > 0))
+    if (!force && qof_instance_get_editlevel(acc) > 0)
         return;
-    priv->splits = g_list_sort(priv->splits, (GCompareFunc)xaccSplitOrder);
-    priv->sort_dirty = FALSE;
-    priv->balance_dirty = TRUE;
+    if (priv->sort_dirty)
+    {
+        g_sequence_sort(priv->split_seq, split_node_order, NULL);
+        account_splits_relink(priv);
+        g_hash_table_remove_all(priv->split_moved);
+        priv->sort_dirty = FALSE;
+        priv->balance_dirty = TRUE;
+    }
+    else if (g_hash_table_size(priv->split_moved) > 0)
+    {
+        account_splits_reposition(priv);
+    }
 }
 
 static void
@@ -1956,23 +2204,40 @@ xaccAccountRecomputeBalance (Account * acc)
     gnc_numeric  cleared_balance;
     gnc_numeric  reconciled_balance;
     Split *last_split = NULL;
+    GSequenceIter *iter = NULL;
     GList *lp;
 
     if (NULL == acc) return;
 
     priv = GET_PRIVATE(acc);
     if (qof_instance_get_editlevel(acc) > 0) return;
-    if (!priv->balance_dirty) return;
+    if (!priv->balance_dirty && !priv->balance_partial) return;
     if (qof_instance_get_destroying(acc)) return;
     if (qof_book_shutting_down(qof_instance_get_book(acc))) return;
 
-    balance            = priv->starting_balance;
-    cleared_balance    = priv->starting_cleared_balance;
-    reconciled_balance = priv->starting_reconciled_balance;
+    if (!priv->balance_dirty && priv->balance_valid_to)
+        iter = g_hash_table_lookup(priv->split_index, priv->balance_valid_to);
+
+    if (iter)
+    {
+        /* Only the splits after the last good one need re-summing. */
+        last_split         = priv->balance_valid_to;
+        balance            = last_split->balance;
+        cleared_balance    = last_split->cleared_balance;
+        reconciled_balance = last_split->reconciled_balance;
+        lp = ((GList *)g_sequence_get(iter))->next;
+    }
+    else
+    {
+        balance            = priv->starting_balance;
+        cleared_balance    = priv->starting_cleared_balance;
+        reconciled_balance = priv->starting_reconciled_balance;
+        lp = priv->splits;
+    }
 
     PINFO ("acct=%s starting baln=%" G_GINT64_FORMAT "/%" G_GINT64_FORMAT,
            priv->accountName, balance.num, balance.denom);
-    for (lp = priv->splits; lp; lp = lp->next)
+    for (; lp; lp = lp->next)
     {
         Split *split = (Split *) lp->data;
         gnc_numeric amt = xaccSplitGetAmount (split);
@@ -2002,6 +2267,8 @@ xaccAccountRecomputeBalance (Account * acc)
     priv->cleared_balance = cleared_balance;
     priv->reconciled_balance = reconciled_balance;
     priv->balance_dirty = FALSE;
+    priv->balance_partial = FALSE;
+    priv->balance_valid_to = NULL;
 }
 
 /********************************************************************\
@@ -3080,6 +3347,90 @@ gnc_account_set_start_reconciled_balance (Account *acc,
     priv->balance_dirty = TRUE;
 }
 
+gboolean
+gnc_account_get_splits_incomplete (const Account *acc)
+{
+    g_return_val_if_fail(GNC_IS_ACCOUNT(acc), FALSE);
+
+    return GET_PRIVATE(acc)->splits_incomplete;
+}
+
+void
+gnc_account_set_splits_incomplete (Account *acc, gboolean incomplete)
+{
+    g_return_if_fail(GNC_IS_ACCOUNT(acc));
+
+    GET_PRIVATE(acc)->splits_incomplete = incomplete;
+}
+
+/* Runs a query for the account's splits, which makes the backend load
+ * them, and marks the account complete if the backend reported no
+ * error.  Errors are left on the backend for the caller to see. */
+static void
+account_query_splits (Account *acc)
+{
+    QofBook *book = qof_instance_get_book(acc);
+    QofBackend *be = qof_book_get_backend(book);
+    QofBackendError old_err = ERR_BACKEND_NO_ERR;
+    QofBackendError err = ERR_BACKEND_NO_ERR;
+    QofQuery *q;
+
+    if (be)
+        old_err = qof_backend_get_error(be);
+
+    q = qof_query_create_for(GNC_ID_SPLIT);
+    qof_query_set_book(q, book);
+    xaccQueryAddSingleAccountMatch(q, acc, QOF_QUERY_AND);
+    (void)qof_query_run(q);
+    qof_query_destroy(q);
+
+    if (be)
+    {
+        err = qof_backend_get_error(be);
+        qof_backend_set_error(be, old_err != ERR_BACKEND_NO_ERR ? old_err : err);
+    }
+    if (err == ERR_BACKEND_NO_ERR)
+        GET_PRIVATE(acc)->splits_incomplete = FALSE;
+    else
+        PWARN("splits of account %s not loaded, error %d",
+              xaccAccountGetName(acc), err);
+}
+
+/* Anything that needs all of an account's splits, rather than just its
+ * end balances, must have them loaded from a backend which only loads
+ * transactions as needed.  Running a query for the account's splits
+ * makes the backend load them.  Queries can't be nested, so an account
+ * asked for while another is loading is queued and loaded as soon as
+ * that finishes; until then the nested caller sees only the splits
+ * already in memory. */
+static void
+account_load_splits (const Account *acc)
+{
+    static gboolean loading = FALSE;
+    static GList *queued = NULL;
+
+    if (!GET_PRIVATE(acc)->splits_incomplete)
+        return;
+
+    if (!g_list_find(queued, acc))
+        queued = g_list_append(queued, g_object_ref((Account*)acc));
+    if (loading)
+        return;
+
+    loading = TRUE;
+    while (queued)
+    {
+        Account *next = queued->data;
+
+        queued = g_list_delete_link(queued, queued);
+        if (GET_PRIVATE(next)->splits_incomplete &&
+                !qof_instance_get_destroying(next))
+            account_query_splits(next);
+        g_object_unref(next);
+    }
+    loading = FALSE;
+}
+
 gnc_numeric
 xaccAccountGetBalance (const Account *acc)
 {
@@ -3139,106 +3490,169 @@ xaccAccountGetProjectedMinimumBalance (const Account *acc)
 /********************************************************************\
 \********************************************************************/
 
+/* The split index is ordered first by the parent transaction's
+ * posted date, so the splits on either side of a given date can be
+ * found with a binary search.  The search needle is always NULL, and
+ * sorts just after every split posted before 'date' (or on it, if
+ * 'inclusive'). */
+typedef struct
+{
+    time_t date;
+    gboolean inclusive;
+} SplitDateSearch;
+
+static gint
+split_node_date_search (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    const SplitDateSearch *search = user_data;
+    const GList *node = a ? a : b;
+    time_t split_date;
+    gboolean before;
+
+    split_date = xaccTransGetDate(xaccSplitGetParent(node->data));
+    before = search->inclusive ? (split_date <= search->date)
+             : (split_date < search->date);
+
+    /* 'a' is the needle if it is NULL; flip the result if so. */
+    if (a)
+        return before ? -1 : 1;
+    return before ? 1 : -1;
+}
+
+/* Return the last split posted before 'date' (or on it, if
+ * 'inclusive'), or NULL if there is none. */
+static Split *
+account_last_split_before (AccountPrivate *priv, time_t date,
+                           gboolean inclusive)
+{
+    SplitDateSearch search;
+    GSequenceIter *iter;
+
+    search.date = date;
+    search.inclusive = inclusive;
+    iter = g_sequence_search(priv->split_seq, NULL,
+                             split_node_date_search, &search);
+    if (g_sequence_iter_is_begin(iter))
+        return NULL;
+    return ((GList *)g_sequence_get(g_sequence_iter_prev(iter)))->data;
+}
+
+typedef enum
+{
+    ACCOUNT_BALANCE,
+    ACCOUNT_CLEARED_BALANCE,
+    ACCOUNT_RECONCILED_BALANCE
+} AccountBalanceKind;
+
+static gnc_numeric
+account_balance_as_of_date (Account *acc, time_t date,
+                            AccountBalanceKind kind)
+{
+    AccountPrivate *priv;
+    Split *split;
+
+    priv = GET_PRIVATE(acc);
+    split = account_last_split_before(priv, date, FALSE);
+    if (!split)
+    {
+        /* With no splits at all the starting balance is all there is,
+         * otherwise the AsOf date is before any entries. */
+        if (priv->splits)
+            return gnc_numeric_zero();
+        switch (kind)
+        {
+        case ACCOUNT_CLEARED_BALANCE:
+            return priv->cleared_balance;
+        case ACCOUNT_RECONCILED_BALANCE:
+            return priv->reconciled_balance;
+        default:
+            return priv->balance;
+        }
+    }
+
+    switch (kind)
+    {
+    case ACCOUNT_CLEARED_BALANCE:
+        return xaccSplitGetClearedBalance(split);
+    case ACCOUNT_RECONCILED_BALANCE:
+        return xaccSplitGetReconciledBalance(split);
+    default:
+        return xaccSplitGetBalance(split);
+    }
+}
+
 gnc_numeric
 xaccAccountGetBalanceAsOfDate (Account *acc, time_t date)
 {
-    /* Ideally this could use xaccAccountForEachSplit, but
-     * it doesn't exist yet and I'm uncertain of exactly how
-     * it would work at this time, since it differs from
-     * xaccAccountForEachTransaction by using gpointer return
-     * values rather than gints.
-     */
-    AccountPrivate *priv;
-    GList   *lp;
-    Timespec ts, trans_ts;
-    gboolean found = FALSE;
-    gnc_numeric balance;
+    g_return_val_if_fail(GNC_IS_ACCOUNT(acc), gnc_numeric_zero());
 
+    account_load_splits (acc);
+    xaccAccountSortSplits (acc, TRUE); /* just in case, normally a noop */
+    xaccAccountRecomputeBalance (acc); /* just in case, normally a noop */
+    return account_balance_as_of_date(acc, date, ACCOUNT_BALANCE);
+}
+
+gnc_numeric
+xaccAccountGetClearedBalanceAsOfDate (Account *acc, time_t date)
+{
     g_return_val_if_fail(GNC_IS_ACCOUNT(acc), gnc_numeric_zero());
 
+    account_load_splits (acc);
     xaccAccountSortSplits (acc, TRUE); /* just in case, normally a noop */
     xaccAccountRecomputeBalance (acc); /* just in case, normally a noop */
+    return account_balance_as_of_date(acc, date, ACCOUNT_CLEARED_BALANCE);
+}
 
-    priv = GET_PRIVATE(acc);
-    balance = priv->balance;
-
-    /* Since transaction post times are stored as a Timespec,
-     * convert date into a Timespec as well rather than converting
-     * each transaction's Timespec into a time_t.
-     *
-     * FIXME: CAS: I think this comment is a bogus justification for
-     * using xaccTransGetDatePostedTS.  There's no benefit to using
-     * Timespec when the input argument is time_t, and it's hard to
-     * imagine that casting long long to long and comparing two longs is
-     * worse than comparing two long longs every time.  IMO,
-     * xaccAccountGetPresentBalance gets this right, and its algorithm
-     * should be used here.
-     */
-    ts.tv_sec = date;
-    ts.tv_nsec = 0;
+gnc_numeric
+xaccAccountGetReconciledBalanceAsOfDate (Account *acc, time_t date)
+{
+    g_return_val_if_fail(GNC_IS_ACCOUNT(acc), gnc_numeric_zero());
 
-    lp = priv->splits;
-    while ( lp && !found )
-    {
-        xaccTransGetDatePostedTS( xaccSplitGetParent( (Split *)lp->data ),
-                                  &trans_ts );
-        if ( timespec_cmp( &trans_ts, &ts ) >= 0 )
-            found = TRUE;
-        else
-            lp = lp->next;
-    }
+    account_load_splits (acc);
+    xaccAccountSortSplits (acc, TRUE); /* just in case, normally a noop */
+    xaccAccountRecomputeBalance (acc); /* just in case, normally a noop */
+    return account_balance_as_of_date(acc, date, ACCOUNT_RECONCILED_BALANCE);
+}
 
-    if ( lp )
-    {
-        if ( lp->prev )
-        {
-            /* Since lp is now pointing to a split which was past the reconcile
-             * date, get the running balance of the previous split.
-             */
-            balance = xaccSplitGetBalance( (Split *)lp->prev->data );
-        }
-        else
-        {
-            /* AsOf date must be before any entries, return zero. */
-            balance = gnc_numeric_zero();
-        }
-    }
+void
+xaccAccountGetBalancesAsOfDates (Account *acc, const time_t *dates,
+                                 guint n_dates, gnc_numeric *balances)
+{
+    guint i;
 
-    /* Otherwise there were no splits posted after the given date,
-     * so the latest account balance should be good enough.
-     */
+    g_return_if_fail(GNC_IS_ACCOUNT(acc));
+    g_return_if_fail(dates || n_dates == 0);
+    g_return_if_fail(balances || n_dates == 0);
 
-    return( balance );
+    account_load_splits (acc);
+    xaccAccountSortSplits (acc, TRUE);
+    xaccAccountRecomputeBalance (acc);
+    for (i = 0; i < n_dates; i++)
+        balances[i] = account_balance_as_of_date(acc, dates[i], ACCOUNT_BALANCE);
 }
 
 /*
  * Originally gsr_account_present_balance in gnc-split-reg.c
  *
- * How does this routine compare to xaccAccountGetBalanceAsOfDate just
- * above?  These two routines should eventually be collapsed into one.
- * Perhaps the startup logic from that one, and the logic from this
- * one that walks from the tail of the split list.
+ * Unlike xaccAccountGetBalanceAsOfDate just above, this includes the
+ * splits posted on the given day, and returns zero rather than the
+ * starting balance for an empty account.
  */
 gnc_numeric
 xaccAccountGetPresentBalance (const Account *acc)
 {
-    AccountPrivate *priv;
-    GList *node;
-    time_t today;
+    Split *split;
 
     g_return_val_if_fail(GNC_IS_ACCOUNT(acc), gnc_numeric_zero());
 
-    priv = GET_PRIVATE(acc);
-    today = gnc_timet_get_today_end();
-    for (node = g_list_last(priv->splits); node; node = node->prev)
-    {
-        Split *split = node->data;
-
-        if (xaccTransGetDate (xaccSplitGetParent (split)) <= today)
-            return xaccSplitGetBalance (split);
-    }
-
-    return gnc_numeric_zero ();
+    /* XXX: violates the const'ness, the search needs all the splits,
+     * in order and with their running balances current */
+    account_load_splits (acc);
+    xaccAccountSortSplits ((Account*)acc, TRUE); /* normally a noop */
+    xaccAccountRecomputeBalance ((Account*)acc); /* normally a noop */
+    split = account_last_split_before(GET_PRIVATE(acc),
+                                      gnc_timet_get_today_end(), TRUE);
+    return split ? xaccSplitGetBalance (split) : gnc_numeric_zero ();
 }
 
 
@@ -3572,10 +3986,18 @@ SplitList *
 xaccAccountGetSplitList (const Account *acc)
 {
     g_return_val_if_fail(GNC_IS_ACCOUNT(acc), NULL);
+    account_load_splits(acc);
     xaccAccountSortSplits((Account*)acc, FALSE);  // normally a noop
     return GET_PRIVATE(acc)->splits;
 }
 
+SplitList *
+gnc_account_get_loaded_splits (const Account *acc)
+{
+    g_return_val_if_fail(GNC_IS_ACCOUNT(acc), NULL);
+    return GET_PRIVATE(acc)->splits;
+}
+
 LotList *
 xaccAccountGetLotList (const Account *acc)
 {
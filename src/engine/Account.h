@@ -334,6 +334,19 @@ void gnc_account_set_start_cleared_balance (Account *acc,
 void gnc_account_set_start_reconciled_balance (Account *acc,
         const gnc_numeric start_baln);
 
+/** Backends which load transactions as needed set this flag on an
+ *  account while some of its splits have not been loaded, and the
+ *  starting balances stand in for them.  The end balances are then
+ *  right, but a balance as of a date or a walk of the split list would
+ *  not be, so xaccAccountGetSplitList() and the balance as of date
+ *  functions first run a query for the account's splits, which loads
+ *  the rest of them and clears the flag. */
+void gnc_account_set_splits_incomplete (Account *acc, gboolean incomplete);
+
+/** Returns TRUE while some of the account's splits have not been
+ *  loaded by the backend.  See gnc_account_set_splits_incomplete(). */
+gboolean gnc_account_get_splits_incomplete (const Account *acc);
+
 /** Tell the account that the running balances may be incorrect and
  *  need to be recomputed.
  *
@@ -346,6 +359,17 @@ void gnc_account_set_balance_dirty (Account *acc);
  *  @param acc Set the flag on this account. */
 void gnc_account_set_sort_dirty (Account *acc);
 
+/** Tell the account that the given split has changed in a way that
+ *  may affect its position in the account or the running balances
+ *  from that split onward, e.g. its amount, reconcile state or the
+ *  parent transaction's date.  Only that split is re-positioned on
+ *  the next sort, and only the balances after it are recomputed.
+ *
+ *  @param acc The account holding the split.
+ *
+ *  @param s The split that changed. */
+void gnc_account_set_split_dirty (Account *acc, Split *s);
+
 /** Find the given split in an account.
  *
  *  @param acc The account whose splits are to be searched.
@@ -563,6 +587,25 @@ gnc_numeric xaccAccountGetProjectedMinimumBalance (const Account *account);
 /** Get the balance of the account as of the date specified */
 gnc_numeric xaccAccountGetBalanceAsOfDate (Account *account,
         time_t date);
+/** Get the balance of the account as of the date specified, only
+    including cleared transactions */
+gnc_numeric xaccAccountGetClearedBalanceAsOfDate (Account *account,
+        time_t date);
+/** Get the balance of the account as of the date specified, only
+    including reconciled transactions */
+gnc_numeric xaccAccountGetReconciledBalanceAsOfDate (Account *account,
+        time_t date);
+/** Get the balances of the account as of each of the dates specified.
+    This is the same as calling xaccAccountGetBalanceAsOfDate() for
+    each date, but only brings the account up to date once.  Each
+    lookup is a binary search over the account's splits.
+
+    @param account The account to look at.
+    @param dates An array of n_dates dates.
+    @param n_dates The number of dates.
+    @param balances An array of n_dates that receives the balances. */
+void xaccAccountGetBalancesAsOfDates (Account *account, const time_t *dates,
+                                      guint n_dates, gnc_numeric *balances);
 
 /* These two functions convert a given balance from one commodity to
    another.  The account argument is only used to get the Book, and
@@ -1018,6 +1061,13 @@ guint32 xaccAccountTypesValid(void);
  */
 SplitList* xaccAccountGetSplitList (const Account *account);
 
+/** Returns the splits of the account which are in memory, like
+ *  xaccAccountGetSplitList() but without loading the rest of them when
+ *  gnc_account_get_splits_incomplete() is TRUE.  The query engine uses
+ *  it once the backend has loaded the splits a query can match.  The
+ *  list is not necessarily sorted. */
+SplitList* gnc_account_get_loaded_splits (const Account *account);
+
 /** The xaccAccountMoveAllSplits() routine reassigns each of the splits
  *  in accfrom to accto. */
 void xaccAccountMoveAllSplits (Account *accfrom, Account *accto);
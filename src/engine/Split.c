@@ -502,7 +502,7 @@ void mark_split (Split *s)
 {
     if (s->acc)
     {
-        g_object_set(s->acc, "sort-dirty", TRUE, "balance-dirty", TRUE, NULL);
+        gnc_account_set_split_dirty(s->acc, s);
     }
 
     /* set dirty flag on lot too. */
@@ -783,7 +783,7 @@ xaccSplitCommitEdit(Split *s)
 
     if (acc)
     {
-        g_object_set(acc, "sort-dirty", TRUE, "balance-dirty", TRUE, NULL);
+        gnc_account_set_split_dirty(acc, s);
         xaccAccountRecomputeBalance(acc);
     }
 }
@@ -2088,6 +2088,30 @@ qofSplitSetAccount(Split *s, QofInstance *ent)
     xaccSplitSetAccount(s, acc);
 }
 
+/* Query indexes: the splits referring to an account or transaction
+ * are already listed by it.  The backend has loaded the account's
+ * splits which the query can match before the index is used, so the
+ * rest of them aren't loaded. */
+static void
+split_account_index (QofInstance *acc, QofInstanceForeachCB cb,
+                     gpointer user_data)
+{
+    GList *node;
+
+    for (node = gnc_account_get_loaded_splits(GNC_ACCOUNT(acc)); node; node = node->next)
+        cb(node->data, user_data);
+}
+
+static void
+split_trans_index (QofInstance *trans, QofInstanceForeachCB cb,
+                   gpointer user_data)
+{
+    GList *node;
+
+    for (node = xaccTransGetSplitList(GNC_TRANS(trans)); node; node = node->next)
+        cb(node->data, user_data);
+}
+
 gboolean xaccSplitRegister (void)
 {
     static const QofParam params[] =
@@ -2189,6 +2213,9 @@ gboolean xaccSplitRegister (void)
     qof_class_register (SPLIT_CORR_ACCT_CODE,
                         (QofSortFunc)xaccSplitCompareOtherAccountCodes, NULL);
 
+    qof_query_register_index (GNC_ID_SPLIT, SPLIT_ACCOUNT, split_account_index);
+    qof_query_register_index (GNC_ID_SPLIT, SPLIT_TRANS, split_trans_index);
+
     return qof_object_register (&split_object_def);
 }
 
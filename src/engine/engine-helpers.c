@@ -2412,3 +2412,54 @@ qof_session_to_scm (const QofSession *session)
 {
     return gnc_generic_to_scm(session, "_p_QofSession");
 }
+
+/* The dates are inclusive, the way the report system's date matches
+ * are, so look up the balance as of the start of the next second.  A
+ * date before the account's first split gets #f rather than a zero
+ * balance, since the reports have never added anything for those. */
+SCM
+gnc_accounts_get_balances_at_dates (AccountList *accounts, SCM dates)
+{
+    SCM result = SCM_EOL;
+    time_t *c_dates;
+    gnc_numeric *balances;
+    guint n_dates, i;
+    long len;
+    GList *node;
+
+    len = scm_ilength(dates);
+    if (len <= 0)
+        return SCM_EOL;
+    n_dates = len;
+
+    c_dates = g_new(time_t, n_dates);
+    balances = g_new(gnc_numeric, n_dates);
+    for (i = 0; i < n_dates; i++, dates = SCM_CDR(dates))
+        c_dates[i] = gnc_timepair2timespec(SCM_CAR(dates)).tv_sec + 1;
+
+    for (node = accounts; node; node = node->next)
+    {
+        SCM acct_balances = SCM_EOL;
+
+        if (node->data)
+        {
+            SplitList *splits = xaccAccountGetSplitList(node->data);
+            time_t first = 0;
+
+            if (splits)
+                first = xaccTransGetDate(xaccSplitGetParent(splits->data));
+            xaccAccountGetBalancesAsOfDates(node->data, c_dates, n_dates,
+                                            balances);
+            for (i = n_dates; i > 0; i--)
+                acct_balances =
+                    scm_cons(splits && first < c_dates[i - 1] ?
+                             gnc_numeric_to_scm(balances[i - 1]) : SCM_BOOL_F,
+                             acct_balances);
+        }
+        result = scm_cons(acct_balances, result);
+    }
+
+    g_free(balances);
+    g_free(c_dates);
+    return scm_reverse(result);
+}
@@ -75,4 +75,15 @@ SCM gnc_commodity_to_scm (const gnc_commodity *commodity);
 SCM gnc_book_to_scm (const QofBook *book);
 SCM qof_session_to_scm (const QofSession *session);
 
+/** Look up the balances of several accounts as of several dates,
+ *  using the accounts' in-memory split lists.
+ *
+ *  @param accounts The accounts to look at.
+ *  @param dates A scheme list of timepairs.  Each date is inclusive.
+ *  @return A scheme list with one entry per account, each entry being
+ *  a list of balances (one per date, in the same order) in that
+ *  account's commodity, or #f for a date before the account's first
+ *  split.  Children are not included. */
+SCM gnc_accounts_get_balances_at_dates (AccountList *accounts, SCM dates);
+
 #endif
@@ -57,6 +57,13 @@ struct gnc_price_db_s
     QofInstance inst;              /* globally unique object identifier */
     GHashTable *commodity_hash;
     gboolean bulk_update;		 /* TRUE while reading XML file, etc. */
+
+    /* Conversion paths found by gnc_pricedb_convert_balance_*, and the
+     * graph of priced commodity pairs they were found in.  Both are
+     * built on demand and dropped whenever a price is added, removed
+     * or revalued. */
+    GHashTable *rate_cache;
+    GHashTable *price_graph;
 };
 
 struct _GncPriceDBClass
@@ -32,8 +32,17 @@
 /* This static indicates the debugging module that this .o belongs to.  */
 static QofLogModule log_module = GNC_MOD_PRICE;
 
-static gboolean add_price(GNCPriceDB *db, GNCPrice *p);
+/* What add_price() did with a price */
+typedef enum
+{
+    PRICE_ADD_FAILED,
+    PRICE_ADDED,
+    PRICE_DUPLICATE     /* An equal price is already in the db */
+} PriceAddResult;
+
+static PriceAddResult add_price(GNCPriceDB *db, GNCPrice *p);
 static gboolean remove_price(GNCPriceDB *db, GNCPrice *p, gboolean cleanup);
+static void pricedb_invalidate_rates(GNCPriceDB *db);
 
 enum
 {
@@ -473,6 +482,8 @@ gnc_price_set_value(GNCPrice *p, gnc_numeric value)
         p->value = value;
         gnc_price_set_dirty(p);
         gnc_price_commit_edit (p);
+        if (p->db)
+            pricedb_invalidate_rates (p->db);
     }
 }
 
@@ -724,12 +735,189 @@ gnc_price_list_equal(PriceList *prices1, PriceList *prices2)
 
    Structurally a GNCPriceDB contains a hash mapping price commodities
    (of type gnc_commodity*) to hashes mapping price currencies (of
-   type gnc_commodity*) to GNCPrice lists (see gnc-pricedb.h for a
-   description of GNCPrice lists).  The top-level key is the commodity
-   you want the prices for, and the second level key is the commodity
-   that the value is expressed in terms of.
+   type gnc_commodity*) to GPtrArrays of GNCPrices.  The top-level key
+   is the commodity you want the prices for, and the second level key
+   is the commodity that the value is expressed in terms of.
+
+   Each array holds a reference to each of its prices and is kept in
+   the same order as a GNCPrice list (see gnc-pricedb.h): most recent
+   first, as defined by compare_prices_by_date().  That lets the
+   lookups below find a date by binary search instead of walking every
+   price of the pair.
  */
 
+/* Returns the index of the first (i.e. most recent) price in the
+ * array whose time is no later than t, or the array length if every
+ * price is later than t. */
+static guint
+price_array_search(const GPtrArray *prices, Timespec t)
+{
+    guint lo = 0, hi = prices->len;
+
+    while (lo < hi)
+    {
+        guint mid = lo + (hi - lo) / 2;
+        Timespec price_time = gnc_price_get_time(g_ptr_array_index(prices, mid));
+
+        if (timespec_cmp(&price_time, &t) > 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* As price_array_search(), but compares the canonical day of each
+ * price to the canonical day t. */
+static guint
+price_array_search_day(const GPtrArray *prices, Timespec t)
+{
+    guint lo = 0, hi = prices->len;
+
+    while (lo < hi)
+    {
+        guint mid = lo + (hi - lo) / 2;
+        Timespec price_day =
+            timespecCanonicalDayTime(gnc_price_get_time(g_ptr_array_index(prices, mid)));
+
+        if (timespec_cmp(&price_day, &t) > 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Returns the index at which p is, or would be, in the array. */
+static guint
+price_array_position(const GPtrArray *prices, const GNCPrice *p)
+{
+    guint lo = 0, hi = prices->len;
+
+    while (lo < hi)
+    {
+        guint mid = lo + (hi - lo) / 2;
+
+        if (compare_prices_by_date(g_ptr_array_index(prices, mid), p) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Inserts p, taking a reference to it.  A duplicate isn't inserted and
+ * no reference is taken, so the caller's unref of it is the last one. */
+static PriceAddResult
+price_array_insert(GPtrArray *prices, GNCPrice *p, gboolean check_dupl)
+{
+    guint i;
+
+    if (check_dupl)
+    {
+        Timespec day = timespecCanonicalDayTime(gnc_price_get_time(p));
+
+        /* Every price of the pair has the same commodity and currency,
+           so a duplicate is one on the same day with the same value. */
+        for (i = price_array_search_day(prices, day); i < prices->len; i++)
+        {
+            GNCPrice *other = g_ptr_array_index(prices, i);
+            Timespec other_day =
+                timespecCanonicalDayTime(gnc_price_get_time(other));
+
+            if (!timespec_equal(&other_day, &day)) break;
+            if (gnc_numeric_equal(gnc_price_get_value(other),
+                                  gnc_price_get_value(p)))
+                return PRICE_DUPLICATE;
+        }
+    }
+
+    gnc_price_ref(p);
+    i = price_array_position(prices, p);
+    g_ptr_array_add(prices, NULL);
+    memmove(&prices->pdata[i + 1], &prices->pdata[i],
+            (prices->len - 1 - i) * sizeof(gpointer));
+    prices->pdata[i] = p;
+    return PRICE_ADDED;
+}
+
+static void
+price_array_remove(GPtrArray *prices, GNCPrice *p)
+{
+    guint i = price_array_position(prices, p);
+
+    if (i < prices->len && g_ptr_array_index(prices, i) == p)
+        g_ptr_array_remove_index(prices, i);
+    else if (!g_ptr_array_remove(prices, p))
+        return;
+    gnc_price_unref(p);
+}
+
+/* Returns the prices of the array as a GNCPrice list, without taking
+ * references to them. */
+static PriceList *
+price_array_to_list(const GPtrArray *prices)
+{
+    GList *result = NULL;
+    guint i;
+
+    for (i = prices->len; i > 0; i--)
+        result = g_list_prepend(result, g_ptr_array_index(prices, i - 1));
+    return result;
+}
+
+static void
+price_array_destroy(GPtrArray *prices)
+{
+    guint i;
+
+    for (i = 0; i < prices->len; i++)
+        gnc_price_unref(g_ptr_array_index(prices, i));
+    g_ptr_array_free(prices, TRUE);
+}
+
+/* Choose the price that is closest to the given time from the prices
+ * on either side of it.  In case of a tie, prefer the older price
+ * since it actually existed at the time (bug #541970), unless
+ * prefer_newer is set. */
+static GNCPrice *
+price_array_nearest(const GPtrArray *prices, Timespec t, gboolean prefer_newer)
+{
+    GNCPrice *current_price, *next_price;
+    Timespec current_t, next_t, diff_current, diff_next, abs_current, abs_next;
+    guint i;
+
+    if (prices->len == 0) return NULL;
+
+    i = price_array_search(prices, t);
+    if (i == 0) return g_ptr_array_index(prices, 0);
+    if (i == prices->len) return g_ptr_array_index(prices, i - 1);
+
+    current_price = g_ptr_array_index(prices, i - 1);
+    next_price = g_ptr_array_index(prices, i);
+    current_t = gnc_price_get_time(current_price);
+    next_t = gnc_price_get_time(next_price);
+    diff_current = timespec_diff(&current_t, &t);
+    diff_next = timespec_diff(&next_t, &t);
+    abs_current = timespec_abs(&diff_current);
+    abs_next = timespec_abs(&diff_next);
+
+    if (timespec_cmp(&abs_current, &abs_next) < 0 ||
+            (prefer_newer && timespec_cmp(&abs_current, &abs_next) == 0))
+        return current_price;
+    return next_price;
+}
+
+/* Returns the most recent price no later than t, or NULL. */
+static GNCPrice *
+price_array_latest_before(const GPtrArray *prices, Timespec t)
+{
+    guint i = price_array_search(prices, t);
+
+    return i < prices->len ? g_ptr_array_index(prices, i) : NULL;
+}
+
+
 /* GObject Initialization */
 QOF_GOBJECT_IMPL(gnc_pricedb, GNCPriceDB, QOF_TYPE_INSTANCE);
 
@@ -786,18 +974,18 @@ destroy_pricedb_currency_hash_data(gpointer key,
                                    gpointer data,
                                    gpointer user_data)
 {
-    GList *price_list = (GList *) data;
-    GList *node;
+    GPtrArray *prices = (GPtrArray *) data;
     GNCPrice *p;
+    guint i;
 
-    for (node = price_list; node; node = node->next)
+    for (i = 0; i < prices->len; i++)
     {
-        p = node->data;
+        p = g_ptr_array_index(prices, i);
 
         p->db = NULL;
     }
 
-    gnc_price_list_destroy(price_list);
+    price_array_destroy(prices);
 }
 
 static void
@@ -825,6 +1013,7 @@ gnc_pricedb_destroy(GNCPriceDB *db)
     }
     g_hash_table_destroy (db->commodity_hash);
     db->commodity_hash = NULL;
+    pricedb_invalidate_rates (db);
     /* qof_instance_release (&db->inst); */
     g_object_unref(db);
 }
@@ -907,7 +1096,7 @@ pricedb_equal_foreach_pricelist(gpointer key, gpointer val, gpointer user_data)
 {
     GNCPriceDBEqualData *equal_data = user_data;
     gnc_commodity *currency = key;
-    GList *price_list1 = val;
+    GList *price_list1 = price_array_to_list (val);
     GList *price_list2;
 
     price_list2 = gnc_pricedb_get_prices (equal_data->db2,
@@ -917,6 +1106,7 @@ pricedb_equal_foreach_pricelist(gpointer key, gpointer val, gpointer user_data)
     if (!gnc_price_list_equal (price_list1, price_list2))
         equal_data->equal = FALSE;
 
+    g_list_free (price_list1);
     gnc_price_list_destroy (price_list2);
 }
 
@@ -961,17 +1151,18 @@ gnc_pricedb_equal (GNCPriceDB *db1, GNCPriceDB *db2)
 /* The add_price() function is a utility that only manages the
  * dual hash table instertion */
 
-static gboolean
+static PriceAddResult
 add_price(GNCPriceDB *db, GNCPrice *p)
 {
     /* This function will use p, adding a ref, so treat p as read-only
-       if this function succeeds. */
-    GList *price_list;
+       if this function adds it.  A duplicate is left alone. */
+    GPtrArray *prices;
     gnc_commodity *commodity;
     gnc_commodity *currency;
     GHashTable *currency_hash;
+    PriceAddResult result;
 
-    if (!db || !p) return FALSE;
+    if (!db || !p) return PRICE_ADD_FAILED;
     ENTER ("db=%p, pr=%p dirty=%d destroying=%d",
            db, p, qof_instance_get_dirty_flag(p),
            qof_instance_get_destroying(p));
@@ -980,7 +1171,7 @@ add_price(GNCPriceDB *db, GNCPrice *p)
     {
         PERR ("attempted to mix up prices across different books");
         LEAVE (" ");
-        return FALSE;
+        return PRICE_ADD_FAILED;
     }
 
     commodity = gnc_price_get_commodity(p);
@@ -988,19 +1179,19 @@ add_price(GNCPriceDB *db, GNCPrice *p)
     {
         PWARN("no commodity");
         LEAVE (" ");
-        return FALSE;
+        return PRICE_ADD_FAILED;
     }
     currency = gnc_price_get_currency(p);
     if (!currency)
     {
         PWARN("no currency");
         LEAVE (" ");
-        return FALSE;
+        return PRICE_ADD_FAILED;
     }
     if (!db->commodity_hash)
     {
         LEAVE ("no commodity hash found ");
-        return FALSE;
+        return PRICE_ADD_FAILED;
     }
 
     currency_hash = g_hash_table_lookup(db->commodity_hash, commodity);
@@ -1010,19 +1201,20 @@ add_price(GNCPriceDB *db, GNCPrice *p)
         g_hash_table_insert(db->commodity_hash, commodity, currency_hash);
     }
 
-    price_list = g_hash_table_lookup(currency_hash, currency);
-    if (!gnc_price_list_insert(&price_list, p, !db->bulk_update))
+    prices = g_hash_table_lookup(currency_hash, currency);
+    if (!prices)
     {
-        LEAVE ("gnc_price_list_insert failed");
-        return FALSE;
+        prices = g_ptr_array_new();
+        g_hash_table_insert(currency_hash, currency, prices);
     }
-    if (!price_list)
+    result = price_array_insert(prices, p, !db->bulk_update);
+    if (result == PRICE_DUPLICATE)
     {
-        LEAVE (" no price list");
-        return FALSE;
+        LEAVE ("db=%p, pr=%p is a duplicate", db, p);
+        return result;
     }
-    g_hash_table_insert(currency_hash, currency, price_list);
     p->db = db;
+    pricedb_invalidate_rates(db);
     qof_event_gen (&p->inst, QOF_EVENT_ADD, NULL);
 
     LEAVE ("db=%p, pr=%p dirty=%d dextroying=%d commodity=%s/%s currency_hash=%p",
@@ -1031,7 +1223,7 @@ add_price(GNCPriceDB *db, GNCPrice *p)
            gnc_commodity_get_namespace(p->commodity),
            gnc_commodity_get_mnemonic(p->commodity),
            currency_hash);
-    return TRUE;
+    return result;
 }
 
 /* the gnc_pricedb_add_price() function will use p, adding a ref, so
@@ -1045,10 +1237,16 @@ gnc_pricedb_add_price(GNCPriceDB *db, GNCPrice *p)
            db, p, qof_instance_get_dirty_flag(p),
            qof_instance_get_destroying(p));
 
-    if (FALSE == add_price(db, p))
+    switch (add_price(db, p))
     {
+    case PRICE_ADD_FAILED:
         LEAVE (" failed to add price");
         return FALSE;
+    case PRICE_DUPLICATE:
+        LEAVE (" duplicate price not added");
+        return TRUE;
+    default:
+        break;
     }
 
     gnc_pricedb_begin_edit(db);
@@ -1069,7 +1267,7 @@ gnc_pricedb_add_price(GNCPriceDB *db, GNCPrice *p)
 static gboolean
 remove_price(GNCPriceDB *db, GNCPrice *p, gboolean cleanup)
 {
-    GList *price_list;
+    GPtrArray *prices;
     gnc_commodity *commodity;
     gnc_commodity *currency;
     GHashTable *currency_hash;
@@ -1105,24 +1303,22 @@ remove_price(GNCPriceDB *db, GNCPrice *p, gboolean cleanup)
     }
 
     qof_event_gen (&p->inst, QOF_EVENT_REMOVE, NULL);
-    price_list = g_hash_table_lookup(currency_hash, currency);
-    gnc_price_ref(p);
-    if (!gnc_price_list_remove(&price_list, p))
+    prices = g_hash_table_lookup(currency_hash, currency);
+    if (!prices)
     {
-        gnc_price_unref(p);
-        LEAVE (" cannot remove price list");
-        return FALSE;
+        LEAVE (" no price array");
+        return TRUE;
     }
+    gnc_price_ref(p);
+    price_array_remove(prices, p);
+    pricedb_invalidate_rates(db);
 
-    /* if the price list is empty, then remove this currency from the
+    /* if the price array is empty, then remove this currency from the
        commodity hash */
-    if (price_list)
-    {
-        g_hash_table_insert(currency_hash, currency, price_list);
-    }
-    else
+    if (prices->len == 0)
     {
         g_hash_table_remove(currency_hash, currency);
+        g_ptr_array_free(prices, TRUE);
 
         if (cleanup)
         {
@@ -1217,18 +1413,18 @@ pricedb_remove_foreach_pricelist (gpointer key,
                                   gpointer val,
                                   gpointer user_data)
 {
-    GList *price_list = (GList *) val;
-    GList *node = price_list;
+    GPtrArray *prices = (GPtrArray *) val;
     remove_info *data = (remove_info *) user_data;
+    guint i;
 
     ENTER("key %p, value %p, data %p", key, val, user_data);
 
-    /* The most recent price is the first in the list */
-    if (!data->delete_last)
-        node = g_list_next(node);
+    /* The most recent price is the first in the array */
+    i = data->delete_last ? 0 : 1;
 
-    /* now check each item in the list */
-    g_list_foreach(node, (GFunc)check_one_price_date, data);
+    /* now check each item in the array */
+    for (; i < prices->len; i++)
+        check_one_price_date (g_ptr_array_index(prices, i), data);
 
     LEAVE(" ");
 }
@@ -1297,7 +1493,7 @@ gnc_pricedb_lookup_latest(GNCPriceDB *db,
                           const gnc_commodity *commodity,
                           const gnc_commodity *currency)
 {
-    GList *price_list;
+    GPtrArray *prices;
     GNCPrice *result;
     GHashTable *currency_hash;
     QofBook *book;
@@ -1326,8 +1522,8 @@ gnc_pricedb_lookup_latest(GNCPriceDB *db,
         return NULL;
     }
 
-    price_list = g_hash_table_lookup(currency_hash, currency);
-    if (!price_list)
+    prices = g_hash_table_lookup(currency_hash, currency);
+    if (!prices)
     {
         LEAVE (" no price list");
         return NULL;
@@ -1335,8 +1531,8 @@ gnc_pricedb_lookup_latest(GNCPriceDB *db,
 
     /* This works magically because prices are inserted in date-sorted
      * order, and the latest date always comes first. So return the
-     * first in the list.  */
-    result = price_list->data;
+     * first in the array.  */
+    result = g_ptr_array_index(prices, 0);
     gnc_price_ref(result);
     LEAVE(" ");
     return result;
@@ -1347,13 +1543,13 @@ static void
 lookup_latest(gpointer key, gpointer val, gpointer user_data)
 {
     //gnc_commodity *currency = (gnc_commodity *)key;
-    GList *price_list = (GList *)val;
+    GPtrArray *prices = (GPtrArray *)val;
     GList **return_list = (GList **)user_data;
 
-    if (!price_list) return;
+    if (!prices) return;
 
-    /* the latest price is the first in list */
-    gnc_price_list_insert(return_list, price_list->data, FALSE);
+    /* the latest price is the first in the array */
+    gnc_price_list_insert(return_list, g_ptr_array_index(prices, 0), FALSE);
 }
 
 PriceList *
@@ -1408,7 +1604,7 @@ static void
 hash_values_helper(gpointer key, gpointer value, gpointer data)
 {
     GList ** l = data;
-    *l = g_list_concat(*l, g_list_copy (value));
+    *l = g_list_concat(*l, price_array_to_list (value));
 }
 
 gboolean
@@ -1416,7 +1612,7 @@ gnc_pricedb_has_prices(GNCPriceDB *db,
                        const gnc_commodity *commodity,
                        const gnc_commodity *currency)
 {
-    GList *price_list;
+    GPtrArray *prices;
     GHashTable *currency_hash;
     gint size;
     QofBook *book;
@@ -1446,8 +1642,8 @@ gnc_pricedb_has_prices(GNCPriceDB *db,
 
     if (currency)
     {
-        price_list = g_hash_table_lookup(currency_hash, currency);
-        if (price_list)
+        prices = g_hash_table_lookup(currency_hash, currency);
+        if (prices)
         {
             LEAVE("yes");
             return TRUE;
@@ -1467,7 +1663,7 @@ gnc_pricedb_get_prices(GNCPriceDB *db,
                        const gnc_commodity *commodity,
                        const gnc_commodity *currency)
 {
-    GList *price_list;
+    GPtrArray *prices;
     GList *result;
     GList *node;
     GHashTable *currency_hash;
@@ -1498,13 +1694,13 @@ gnc_pricedb_get_prices(GNCPriceDB *db,
 
     if (currency)
     {
-        price_list = g_hash_table_lookup(currency_hash, currency);
-        if (!price_list)
+        prices = g_hash_table_lookup(currency_hash, currency);
+        if (!prices)
         {
             LEAVE (" no price list");
             return NULL;
         }
-        result = g_list_copy (price_list);
+        result = price_array_to_list (prices);
     }
     else
     {
@@ -1525,9 +1721,9 @@ gnc_pricedb_lookup_day(GNCPriceDB *db,
                        const gnc_commodity *currency,
                        Timespec t)
 {
-    GList *price_list;
+    GPtrArray *prices;
     GList *result = NULL;
-    GList *item = NULL;
+    guint i;
     GHashTable *currency_hash;
     QofBook *book;
     QofBackend *be;
@@ -1557,24 +1753,21 @@ gnc_pricedb_lookup_day(GNCPriceDB *db,
         return NULL;
     }
 
-    price_list = g_hash_table_lookup(currency_hash, currency);
-    if (!price_list)
+    prices = g_hash_table_lookup(currency_hash, currency);
+    if (!prices)
     {
         LEAVE (" no price list");
         return NULL;
     }
 
-    item = price_list;
-    while (item)
+    for (i = price_array_search_day(prices, t); i < prices->len; i++)
     {
-        GNCPrice *p = item->data;
+        GNCPrice *p = g_ptr_array_index(prices, i);
         Timespec price_time = timespecCanonicalDayTime(gnc_price_get_time(p));
-        if (timespec_equal(&price_time, &t))
-        {
-            result = g_list_prepend(result, p);
-            gnc_price_ref(p);
-        }
-        item = item->next;
+        if (!timespec_equal(&price_time, &t))
+            break;
+        result = g_list_prepend(result, p);
+        gnc_price_ref(p);
     }
     LEAVE (" ");
     return result;
@@ -1585,22 +1778,19 @@ static void
 lookup_day(gpointer key, gpointer val, gpointer user_data)
 {
     //gnc_commodity *currency = (gnc_commodity *)key;
-    GList *price_list = (GList *)val;
-    GList *item = NULL;
+    GPtrArray *prices = (GPtrArray *)val;
     GNCPriceLookupHelper *lookup_helper = (GNCPriceLookupHelper *)user_data;
     GList **return_list = lookup_helper->return_list;
     Timespec t = lookup_helper->time;
+    guint i;
 
-    item = price_list;
-    while (item)
+    for (i = price_array_search_day(prices, t); i < prices->len; i++)
     {
-        GNCPrice *p = item->data;
+        GNCPrice *p = g_ptr_array_index(prices, i);
         Timespec price_time = timespecCanonicalDayTime(gnc_price_get_time(p));
-        if (timespec_equal(&price_time, &t))
-        {
-            gnc_price_list_insert(return_list, item->data, FALSE);
-        }
-        item = item->next;
+        if (!timespec_equal(&price_time, &t))
+            break;
+        gnc_price_list_insert(return_list, p, FALSE);
     }
 }
 
@@ -1663,9 +1853,9 @@ gnc_pricedb_lookup_at_time(GNCPriceDB *db,
                            const gnc_commodity *currency,
                            Timespec t)
 {
-    GList *price_list;
+    GPtrArray *prices;
     GList *result = NULL;
-    GList *item = NULL;
+    guint i;
     GHashTable *currency_hash;
     QofBook *book;
     QofBackend *be;
@@ -1693,24 +1883,21 @@ gnc_pricedb_lookup_at_time(GNCPriceDB *db,
         return NULL;
     }
 
-    price_list = g_hash_table_lookup(currency_hash, currency);
-    if (!price_list)
+    prices = g_hash_table_lookup(currency_hash, currency);
+    if (!prices)
     {
         LEAVE (" no price list");
         return NULL;
     }
 
-    item = price_list;
-    while (item)
+    for (i = price_array_search(prices, t); i < prices->len; i++)
     {
-        GNCPrice *p = item->data;
+        GNCPrice *p = g_ptr_array_index(prices, i);
         Timespec price_time = gnc_price_get_time(p);
-        if (timespec_equal(&price_time, &t))
-        {
-            result = g_list_prepend(result, p);
-            gnc_price_ref(p);
-        }
-        item = item->next;
+        if (!timespec_equal(&price_time, &t))
+            break;
+        result = g_list_prepend(result, p);
+        gnc_price_ref(p);
     }
     LEAVE (" ");
     return result;
@@ -1720,22 +1907,19 @@ static void
 lookup_time(gpointer key, gpointer val, gpointer user_data)
 {
     //gnc_commodity *currency = (gnc_commodity *)key;
-    GList *price_list = (GList *)val;
-    GList *item = NULL;
+    GPtrArray *prices = (GPtrArray *)val;
     GNCPriceLookupHelper *lookup_helper = (GNCPriceLookupHelper *)user_data;
     GList **return_list = lookup_helper->return_list;
     Timespec t = lookup_helper->time;
+    guint i;
 
-    item = price_list;
-    while (item)
+    for (i = price_array_search(prices, t); i < prices->len; i++)
     {
-        GNCPrice *p = item->data;
+        GNCPrice *p = g_ptr_array_index(prices, i);
         Timespec price_time = gnc_price_get_time(p);
-        if (timespec_equal(&price_time, &t))
-        {
-            gnc_price_list_insert(return_list, item->data, FALSE);
-        }
-        item = item->next;
+        if (!timespec_equal(&price_time, &t))
+            break;
+        gnc_price_list_insert(return_list, p, FALSE);
     }
 }
 
@@ -1796,11 +1980,8 @@ gnc_pricedb_lookup_nearest_in_time(GNCPriceDB *db,
                                    const gnc_commodity *currency,
                                    Timespec t)
 {
-    GList *price_list;
-    GNCPrice *current_price = NULL;
-    GNCPrice *next_price = NULL;
-    GNCPrice *result = NULL;
-    GList *item = NULL;
+    GPtrArray *prices;
+    GNCPrice *result;
     GHashTable *currency_hash;
     QofBook *book;
     QofBackend *be;
@@ -1828,62 +2009,14 @@ gnc_pricedb_lookup_nearest_in_time(GNCPriceDB *db,
         return NULL;
     }
 
-    price_list = g_hash_table_lookup(currency_hash, currency);
-    if (!price_list)
+    prices = g_hash_table_lookup(currency_hash, currency);
+    if (!prices)
     {
         LEAVE ("no price list");
         return NULL;
     }
 
-    item = price_list;
-
-    /* default answer */
-    current_price = item->data;
-
-    /* find the first candidate past the one we want.  Remember that
-       prices are in most-recent-first order. */
-    while (!next_price && item)
-    {
-        GNCPrice *p = item->data;
-        Timespec price_time = gnc_price_get_time(p);
-        if (timespec_cmp(&price_time, &t) <= 0)
-        {
-            next_price = item->data;
-            break;
-        }
-        current_price = item->data;
-        item = item->next;
-    }
-
-    if (current_price)
-    {
-        if (!next_price)
-        {
-            result = current_price;
-        }
-        else
-        {
-            Timespec current_t = gnc_price_get_time(current_price);
-            Timespec next_t = gnc_price_get_time(next_price);
-            Timespec diff_current = timespec_diff(&current_t, &t);
-            Timespec diff_next = timespec_diff(&next_t, &t);
-            Timespec abs_current = timespec_abs(&diff_current);
-            Timespec abs_next = timespec_abs(&diff_next);
-
-            /* Choose the price that is closest to the given time. In case of
-             * a tie, prefer the older price since it actually existed at the
-             * time. (This also fixes bug #541970.) */
-            if (timespec_cmp(&abs_current, &abs_next) < 0)
-            {
-                result = current_price;
-            }
-            else
-            {
-                result = next_price;
-            }
-        }
-    }
-
+    result = price_array_nearest(prices, t, FALSE);
     gnc_price_ref(result);
     LEAVE (" ");
     return result;
@@ -1895,15 +2028,11 @@ gnc_pricedb_lookup_latest_before (GNCPriceDB *db,
                                   gnc_commodity *currency,
                                   Timespec t)
 {
-    GList *price_list;
-    GNCPrice *current_price = NULL;
-    /*  GNCPrice *next_price = NULL;
-        GNCPrice *result = NULL;*/
-    GList *item = NULL;
+    GPtrArray *prices;
+    GNCPrice *current_price;
     GHashTable *currency_hash;
     QofBook *book;
     QofBackend *be;
-    Timespec price_time;
 
     if (!db || !c || !currency) return NULL;
     ENTER ("db=%p commodity=%p currency=%p", db, c, currency);
@@ -1928,22 +2057,14 @@ gnc_pricedb_lookup_latest_before (GNCPriceDB *db,
         return NULL;
     }
 
-    price_list = g_hash_table_lookup(currency_hash, currency);
-    if (!price_list)
+    prices = g_hash_table_lookup(currency_hash, currency);
+    if (!prices)
     {
         LEAVE ("no price list");
         return NULL;
     }
 
-    item = price_list;
-    do
-    {
-        price_time = gnc_price_get_time (item->data);
-        if (timespec_cmp(&price_time, &t) <= 0)
-            current_price = item->data;
-        item = item->next;
-    }
-    while (timespec_cmp(&price_time, &t) > 0 && item);
+    current_price = price_array_latest_before(prices, t);
     gnc_price_ref(current_price);
     LEAVE (" ");
     return current_price;
@@ -1954,62 +2075,13 @@ static void
 lookup_nearest(gpointer key, gpointer val, gpointer user_data)
 {
     //gnc_commodity *currency = (gnc_commodity *)key;
-    GList *price_list = (GList *)val;
-    GNCPrice *current_price = NULL;
-    GNCPrice *next_price = NULL;
-    GNCPrice *result = NULL;
-    GList *item = NULL;
+    GPtrArray *prices = (GPtrArray *)val;
     GNCPriceLookupHelper *lookup_helper = (GNCPriceLookupHelper *)user_data;
     GList **return_list = lookup_helper->return_list;
     Timespec t = lookup_helper->time;
 
-    item = price_list;
-
-    /* default answer */
-    current_price = item->data;
-
-    /* find the first candidate past the one we want.  Remember that
-       prices are in most-recent-first order. */
-    while (!next_price && item)
-    {
-        GNCPrice *p = item->data;
-        Timespec price_time = gnc_price_get_time(p);
-        if (timespec_cmp(&price_time, &t) <= 0)
-        {
-            next_price = item->data;
-            break;
-        }
-        current_price = item->data;
-        item = item->next;
-    }
-
-    if (current_price)
-    {
-        if (!next_price)
-        {
-            result = current_price;
-        }
-        else
-        {
-            Timespec current_t = gnc_price_get_time(current_price);
-            Timespec next_t = gnc_price_get_time(next_price);
-            Timespec diff_current = timespec_diff(&current_t, &t);
-            Timespec diff_next = timespec_diff(&next_t, &t);
-            Timespec abs_current = timespec_abs(&diff_current);
-            Timespec abs_next = timespec_abs(&diff_next);
-
-            if (timespec_cmp(&abs_current, &abs_next) <= 0)
-            {
-                result = current_price;
-            }
-            else
-            {
-                result = next_price;
-            }
-        }
-    }
-
-    gnc_price_list_insert(return_list, result, FALSE);
+    gnc_price_list_insert(return_list, price_array_nearest(prices, t, TRUE),
+                          FALSE);
 }
 
 
@@ -2017,30 +2089,13 @@ static void
 lookup_latest_before(gpointer key, gpointer val, gpointer user_data)
 {
     //gnc_commodity *currency = (gnc_commodity *)key;
-    GList *price_list = (GList *)val;
-    GNCPrice *current_price = NULL;
-    /*  GNCPrice *next_price = NULL;
-        GNCPrice *result = NULL;*/
-    GList *item = NULL;
+    GPtrArray *prices = (GPtrArray *)val;
     GNCPriceLookupHelper *lookup_helper = (GNCPriceLookupHelper *)user_data;
     GList **return_list = lookup_helper->return_list;
     Timespec t = lookup_helper->time;
-    Timespec price_time;
-
-    if (price_list)
-    {
-        item = price_list;
-        do
-        {
-            price_time = gnc_price_get_time (item->data);
-            if (timespec_cmp(&price_time, &t) <= 0)
-                current_price = item->data;
-            item = item->next;
-        }
-        while (timespec_cmp(&price_time, &t) > 0 && item);
-    }
 
-    gnc_price_list_insert(return_list, current_price, FALSE);
+    gnc_price_list_insert(return_list, price_array_latest_before(prices, t),
+                          FALSE);
 }
 
 
@@ -2146,300 +2201,431 @@ gnc_pricedb_lookup_latest_before_any_currency(GNCPriceDB *db,
 }
 
 
-/*
- * Convert a balance from one currency to another.
+/* ==================================================================== */
+/* Balance conversion
+
+   A balance is converted along the shortest chain of priced commodity
+   pairs between its commodity and the new one.  Each hop uses the
+   price of the pair if there is one, or else the reciprocal of the
+   price of the reversed pair.  The chain is found by a breadth-first
+   search over the graph of priced pairs, visiting neighbours in
+   namespace/mnemonic order so that the same chain is found every time.
+
+   Because reports convert the same balances over and over, the chain
+   found for each (from, to, kind of lookup, day) is cached.  For the
+   latest price the cached chain keeps its prices; otherwise the chain
+   is found as of the end of the day, and its prices are looked up
+   again at the time asked for.  If a pair in the chain has no price
+   by then, the chain is searched for afresh at that time.  The cache
+   holds at most PRICE_RATE_CACHE_MAX chains, and is dropped whenever
+   a price is added, removed or revalued.
+
+   The balance is converted exactly through the intermediate
+   commodities, unless that would overflow, and is rounded to the new
+   currency at the end.
  */
-gnc_numeric
-gnc_pricedb_convert_balance_latest_price(GNCPriceDB *pdb,
-        gnc_numeric balance,
-        const gnc_commodity *balance_currency,
-        const gnc_commodity *new_currency)
+
+#define PRICE_RATE_CACHE_MAX 4096
+#define PRICE_RATE_BUCKET_SECS (24 * 60 * 60)
+#define PRICE_RATE_SIGFIGS 15
+
+typedef enum
 {
-    GNCPrice *price, *currency_price;
-    GList *price_list, *list_helper;
-    gnc_numeric currency_price_value;
-    gnc_commodity *intermediate_currency;
+    PRICE_RATE_LATEST,
+    PRICE_RATE_NEAREST,
+    PRICE_RATE_LATEST_BEFORE
+} PriceRateKind;
 
-    if (gnc_numeric_zero_p (balance) ||
-            gnc_commodity_equiv (balance_currency, new_currency))
-        return balance;
+typedef struct
+{
+    const gnc_commodity *from;
+    const gnc_commodity *to;
+    PriceRateKind kind;
+    gint64 secs;
+} PriceRateKey;
 
-    /* Look for a direct price. */
-    price = gnc_pricedb_lookup_latest (pdb, balance_currency, new_currency);
-    if (price)
-    {
-        balance = gnc_numeric_mul (balance, gnc_price_get_value (price),
-                                   gnc_commodity_get_fraction (new_currency),
-                                   GNC_HOW_RND_ROUND);
-        gnc_price_unref (price);
-        return balance;
-    }
+typedef struct
+{
+    const gnc_commodity *to;
+    gnc_numeric value;
+    gboolean invert;
+} PriceRateHop;
 
-    /* Look for a price of the new currency in the balance currency and use
-     * the reciprocal if we find it
-     */
-    price = gnc_pricedb_lookup_latest (pdb, new_currency, balance_currency);
-    if (price)
-    {
-        balance = gnc_numeric_div (balance, gnc_price_get_value (price),
-                                   gnc_commodity_get_fraction (new_currency),
-                                   GNC_HOW_RND_ROUND);
-        gnc_price_unref (price);
-        return balance;
-    }
+/* A chain of n_hops conversions; no hops means no chain was found. */
+typedef struct
+{
+    guint n_hops;
+    PriceRateHop *hops;
+} PriceRatePath;
 
-    /*
-     * no direct price found, try if we find a price in another currency
-     * and convert in two stages
-     */
-    price_list = gnc_pricedb_lookup_latest_any_currency(pdb, balance_currency);
-    if (!price_list)
-    {
-        balance =  gnc_numeric_zero ();
-        return balance;
-    }
+typedef struct
+{
+    const gnc_commodity *prev;
+    PriceRateHop hop;
+} PriceRateVisit;
 
-    list_helper = price_list;
-    currency_price_value = gnc_numeric_zero();
+static guint
+price_rate_key_hash(gconstpointer key)
+{
+    const PriceRateKey *k = key;
 
-    do
-    {
-        price = (GNCPrice *)(list_helper->data);
+    return g_direct_hash(k->from) ^ (g_direct_hash(k->to) << 1) ^
+           (guint) k->kind ^ (guint) k->secs;
+}
 
-        intermediate_currency = gnc_price_get_currency(price);
-        currency_price = gnc_pricedb_lookup_latest(pdb, intermediate_currency,
-                         new_currency);
-        if (currency_price)
-        {
-            currency_price_value = gnc_price_get_value(currency_price);
-            gnc_price_unref(currency_price);
-        }
-        else
-        {
-            currency_price = gnc_pricedb_lookup_latest(pdb, new_currency,
-                             intermediate_currency);
-            if (currency_price)
-            {
-                /* here we need the reciprocal */
-                currency_price_value = gnc_numeric_div(gnc_numeric_create(1, 1),
-                                                       gnc_price_get_value(currency_price),
-                                                       GNC_DENOM_AUTO,
-                                                       GNC_HOW_DENOM_EXACT | GNC_HOW_RND_NEVER);
-                gnc_price_unref(currency_price);
-            }
-        }
+static gboolean
+price_rate_key_equal(gconstpointer a, gconstpointer b)
+{
+    const PriceRateKey *ka = a, *kb = b;
 
-        list_helper = list_helper->next;
+    return ka->from == kb->from && ka->to == kb->to &&
+           ka->kind == kb->kind && ka->secs == kb->secs;
+}
+
+static void
+price_rate_path_free(gpointer data)
+{
+    PriceRatePath *path = data;
+
+    g_free(path->hops);
+    g_free(path);
+}
+
+static void
+pricedb_invalidate_rates(GNCPriceDB *db)
+{
+    if (db->rate_cache)
+    {
+        g_hash_table_destroy(db->rate_cache);
+        db->rate_cache = NULL;
+    }
+    if (db->price_graph)
+    {
+        g_hash_table_destroy(db->price_graph);
+        db->price_graph = NULL;
     }
-    while ((list_helper != NULL) &&
-            (gnc_numeric_zero_p(currency_price_value)));
+}
+
+static gint
+compare_commodities_by_name(gconstpointer a, gconstpointer b)
+{
+    int cmp_result;
 
-    balance = gnc_numeric_mul (balance, currency_price_value,
-                               GNC_DENOM_AUTO,
-                               GNC_HOW_DENOM_EXACT | GNC_HOW_RND_NEVER);
-    balance = gnc_numeric_mul (balance, gnc_price_get_value (price),
-                               gnc_commodity_get_fraction (new_currency),
-                               GNC_HOW_RND_ROUND);
+    cmp_result = safe_strcmp(gnc_commodity_get_namespace(a),
+                             gnc_commodity_get_namespace(b));
+    if (cmp_result != 0) return cmp_result;
 
-    gnc_price_list_destroy(price_list);
-    return balance;
+    return safe_strcmp(gnc_commodity_get_mnemonic(a),
+                       gnc_commodity_get_mnemonic(b));
 }
 
-gnc_numeric
-gnc_pricedb_convert_balance_nearest_price(GNCPriceDB *pdb,
-        gnc_numeric balance,
-        const gnc_commodity *balance_currency,
-        const gnc_commodity *new_currency,
-        Timespec t)
+static void
+price_graph_add_edge(GHashTable *graph, gnc_commodity *a, gnc_commodity *b)
 {
-    GNCPrice *price, *currency_price;
-    GList *price_list, *list_helper;
-    gnc_numeric currency_price_value;
-    gnc_commodity *intermediate_currency;
+    GList *neighbours = g_hash_table_lookup(graph, a);
 
-    if (gnc_numeric_zero_p (balance) ||
-            gnc_commodity_equiv (balance_currency, new_currency))
-        return balance;
+    if (g_list_find(neighbours, b)) return;
+    g_hash_table_steal(graph, a);
+    neighbours = g_list_insert_sorted(neighbours, b, compare_commodities_by_name);
+    g_hash_table_insert(graph, a, neighbours);
+}
+
+static void
+price_graph_add_currencies(gpointer key, gpointer val, gpointer user_data)
+{
+    GHashTable *graph = user_data;
+    GHashTable *currency_hash = val;
+    GList *currencies, *node;
 
-    /* Look for a direct price. */
-    price = gnc_pricedb_lookup_nearest_in_time (pdb, balance_currency, new_currency, t);
-    if (price)
+    currencies = g_hash_table_get_keys(currency_hash);
+    for (node = currencies; node; node = node->next)
     {
-        balance = gnc_numeric_mul (balance, gnc_price_get_value (price),
-                                   gnc_commodity_get_fraction (new_currency),
-                                   GNC_HOW_RND_ROUND);
-        gnc_price_unref (price);
-        return balance;
+        price_graph_add_edge(graph, key, node->data);
+        price_graph_add_edge(graph, node->data, key);
     }
+    g_list_free(currencies);
+}
 
-    /* Look for a price of the new currency in the balance currency and use
-     * the reciprocal if we find it
-     */
-    price = gnc_pricedb_lookup_nearest_in_time (pdb, new_currency, balance_currency, t);
-    if (price)
+/* Returns a hash mapping each commodity to the sorted list of the
+ * commodities it has prices with, in either direction. */
+static GHashTable *
+pricedb_get_graph(GNCPriceDB *db)
+{
+    if (!db->price_graph)
     {
-        balance = gnc_numeric_div (balance, gnc_price_get_value (price),
-                                   gnc_commodity_get_fraction (new_currency),
-                                   GNC_HOW_RND_ROUND);
-        gnc_price_unref (price);
-        return balance;
+        db->price_graph = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                                NULL, (GDestroyNotify) g_list_free);
+        g_hash_table_foreach(db->commodity_hash, price_graph_add_currencies,
+                             db->price_graph);
     }
+    return db->price_graph;
+}
 
-    /*
-     * no direct price found, try if we find a price in another currency
-     * and convert in two stages
-     */
-    price_list = gnc_pricedb_lookup_nearest_in_time_any_currency(pdb, balance_currency, t);
-    if (!price_list)
+static GNCPrice *
+pricedb_lookup_rate_price(GNCPriceDB *db, const gnc_commodity *c,
+                          const gnc_commodity *currency,
+                          PriceRateKind kind, Timespec t)
+{
+    switch (kind)
     {
-        balance =  gnc_numeric_zero ();
-        return balance;
+    case PRICE_RATE_NEAREST:
+        return gnc_pricedb_lookup_nearest_in_time(db, c, currency, t);
+    case PRICE_RATE_LATEST_BEFORE:
+        return gnc_pricedb_lookup_latest_before(db, (gnc_commodity *) c,
+                                                (gnc_commodity *) currency, t);
+    case PRICE_RATE_LATEST:
+    default:
+        return gnc_pricedb_lookup_latest(db, c, currency);
     }
+}
 
-    list_helper = price_list;
-    currency_price_value = gnc_numeric_zero();
+/* Find the price for converting from one commodity directly to another,
+ * preferring a price of from in to over the reciprocal of a price of
+ * to in from. */
+static gboolean
+pricedb_lookup_hop(GNCPriceDB *db, const gnc_commodity *from,
+                   const gnc_commodity *to, PriceRateKind kind, Timespec t,
+                   PriceRateHop *hop)
+{
+    GNCPrice *price;
+
+    price = pricedb_lookup_rate_price(db, from, to, kind, t);
+    hop->invert = (price == NULL);
+    if (!price)
+        price = pricedb_lookup_rate_price(db, to, from, kind, t);
+    if (!price)
+        return FALSE;
+
+    hop->to = to;
+    hop->value = gnc_price_get_value(price);
+    gnc_price_unref(price);
+    return !gnc_numeric_zero_p(hop->value);
+}
 
-    do
+static PriceRatePath *
+pricedb_find_rate_path(GNCPriceDB *db, const gnc_commodity *from,
+                       const gnc_commodity *to, PriceRateKind kind, Timespec t)
+{
+    PriceRatePath *path = g_new0(PriceRatePath, 1);
+    GHashTable *graph = pricedb_get_graph(db);
+    GHashTable *visited;
+    GQueue *queue;
+    PriceRateVisit *visit;
+    const gnc_commodity *c;
+    gboolean found = FALSE;
+
+    visited = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    queue = g_queue_new();
+
+    visit = g_new0(PriceRateVisit, 1);
+    g_hash_table_insert(visited, (gpointer) from, visit);
+    g_queue_push_tail(queue, (gpointer) from);
+
+    while (!found && !g_queue_is_empty(queue))
     {
-        price = (GNCPrice *)(list_helper->data);
+        GList *node;
 
-        intermediate_currency = gnc_price_get_currency(price);
-        currency_price = gnc_pricedb_lookup_nearest_in_time(pdb, intermediate_currency,
-                         new_currency, t);
-        if (currency_price)
+        c = g_queue_pop_head(queue);
+        for (node = g_hash_table_lookup(graph, c); node; node = node->next)
         {
-            currency_price_value = gnc_price_get_value(currency_price);
-            gnc_price_unref(currency_price);
-        }
-        else
-        {
-            currency_price = gnc_pricedb_lookup_nearest_in_time(pdb, new_currency,
-                             intermediate_currency, t);
-            if (currency_price)
+            const gnc_commodity *next = node->data;
+            PriceRateHop hop;
+
+            if (g_hash_table_lookup(visited, next)) continue;
+            if (!pricedb_lookup_hop(db, c, next, kind, t, &hop)) continue;
+
+            visit = g_new0(PriceRateVisit, 1);
+            visit->prev = c;
+            visit->hop = hop;
+            g_hash_table_insert(visited, (gpointer) next, visit);
+            if (next == to)
             {
-                /* here we need the reciprocal */
-                currency_price_value = gnc_numeric_div(gnc_numeric_create(1, 1),
-                                                       gnc_price_get_value(currency_price),
-                                                       gnc_commodity_get_fraction (new_currency),
-                                                       GNC_HOW_RND_ROUND);
-                gnc_price_unref(currency_price);
+                found = TRUE;
+                break;
             }
+            g_queue_push_tail(queue, (gpointer) next);
         }
+    }
 
-        list_helper = list_helper->next;
+    if (found)
+    {
+        guint i;
+
+        for (c = to; c != from; c = visit->prev)
+        {
+            visit = g_hash_table_lookup(visited, c);
+            path->n_hops++;
+        }
+        path->hops = g_new(PriceRateHop, path->n_hops);
+        for (c = to, i = path->n_hops; c != from; c = visit->prev)
+        {
+            visit = g_hash_table_lookup(visited, c);
+            path->hops[--i] = visit->hop;
+        }
     }
-    while ((list_helper != NULL) &&
-            (gnc_numeric_zero_p(currency_price_value)));
 
-    balance = gnc_numeric_mul (balance, currency_price_value,
-                               gnc_commodity_get_fraction (new_currency),
-                               GNC_HOW_RND_ROUND);
+    g_queue_free(queue);
+    g_hash_table_destroy(visited);
+    return path;
+}
 
-    balance = gnc_numeric_mul (balance, gnc_price_get_value (price),
-                               gnc_commodity_get_fraction (new_currency),
-                               GNC_HOW_RND_ROUND);
+/* Look the prices of a cached chain up again at time t.  Returns FALSE
+ * if one of its pairs has no price then. */
+static gboolean
+pricedb_reprice_rate_path(GNCPriceDB *db, const gnc_commodity *from,
+                          PriceRatePath *path, PriceRateKind kind, Timespec t)
+{
+    guint i;
 
-    gnc_price_list_destroy(price_list);
-    return balance;
+    for (i = 0; i < path->n_hops; i++)
+    {
+        if (!pricedb_lookup_hop(db, from, path->hops[i].to, kind, t,
+                                &path->hops[i]))
+            return FALSE;
+        from = path->hops[i].to;
+    }
+    return TRUE;
 }
 
+static PriceRatePath *
+pricedb_cached_rate_path(GNCPriceDB *pdb, const gnc_commodity *from,
+                         const gnc_commodity *to, PriceRateKind kind,
+                         Timespec t)
+{
+    PriceRateKey key;
+    PriceRatePath *path;
+    Timespec bucket_end = {0, 0};
 
-gnc_numeric
-gnc_pricedb_convert_balance_latest_before(GNCPriceDB *pdb,
-        gnc_numeric balance,
-        gnc_commodity *balance_currency,
-        gnc_commodity *new_currency,
-        Timespec t)
+    key.from = from;
+    key.to = to;
+    key.kind = kind;
+    key.secs = 0;
+    if (kind != PRICE_RATE_LATEST)
+    {
+        key.secs = t.tv_sec / PRICE_RATE_BUCKET_SECS;
+        if (t.tv_sec < 0 && t.tv_sec % PRICE_RATE_BUCKET_SECS)
+            key.secs--;
+        bucket_end.tv_sec = (key.secs + 1) * PRICE_RATE_BUCKET_SECS - 1;
+    }
+
+    if (!pdb->rate_cache)
+        pdb->rate_cache = g_hash_table_new_full(price_rate_key_hash,
+                                                price_rate_key_equal,
+                                                g_free, price_rate_path_free);
+    path = g_hash_table_lookup(pdb->rate_cache, &key);
+    if (!path)
+    {
+        if (g_hash_table_size(pdb->rate_cache) >= PRICE_RATE_CACHE_MAX)
+            g_hash_table_remove_all(pdb->rate_cache);
+        path = pricedb_find_rate_path(pdb, from, to, kind, bucket_end);
+        g_hash_table_insert(pdb->rate_cache, g_memdup(&key, sizeof(key)), path);
+    }
+    return path;
+}
+
+static gnc_numeric
+pricedb_convert_hop(gnc_numeric balance, const PriceRateHop *hop,
+                    gint64 denom, gint how)
 {
-    GNCPrice *price, *currency_price;
-    GList *price_list, *list_helper;
-    gnc_numeric currency_price_value;
-    gnc_commodity *intermediate_currency;
+    if (hop->invert)
+        return gnc_numeric_div (balance, hop->value, denom, how);
+    return gnc_numeric_mul (balance, hop->value, denom, how);
+}
+
+static gnc_numeric
+pricedb_convert_balance(GNCPriceDB *pdb, gnc_numeric balance,
+                        const gnc_commodity *balance_currency,
+                        const gnc_commodity *new_currency,
+                        PriceRateKind kind, Timespec t)
+{
+    PriceRatePath *path, *found = NULL;
+    guint i;
 
     if (gnc_numeric_zero_p (balance) ||
             gnc_commodity_equiv (balance_currency, new_currency))
         return balance;
+    if (!pdb || !balance_currency || !new_currency)
+        return gnc_numeric_zero ();
 
-    /* Look for a direct price. */
-    price = gnc_pricedb_lookup_latest_before (pdb, balance_currency, new_currency, t);
+    path = pricedb_cached_rate_path(pdb, balance_currency, new_currency,
+                                    kind, t);
+    if (kind != PRICE_RATE_LATEST && path->n_hops > 0 &&
+            !pricedb_reprice_rate_path(pdb, balance_currency, path, kind, t))
+        path = found = pricedb_find_rate_path(pdb, balance_currency,
+                                              new_currency, kind, t);
 
-    if (price)
+    if (path->n_hops == 0)
     {
-        balance = gnc_numeric_mul (balance, gnc_price_get_value (price),
-                                   gnc_commodity_get_fraction (new_currency),
-                                   GNC_HOW_RND_ROUND);
-        gnc_price_unref (price);
-        return balance;
+        if (found)
+            price_rate_path_free (found);
+        return gnc_numeric_zero ();
     }
 
-    /* Look for a price of the new currency in the balance currency and use
-     * the reciprocal if we find it.
-     */
-    price = gnc_pricedb_lookup_latest_before (pdb, new_currency, balance_currency, t);
-    if (price)
+    for (i = 0; i < path->n_hops - 1; i++)
     {
-        balance = gnc_numeric_div (balance, gnc_price_get_value (price),
+        gnc_numeric exact;
+
+        exact = pricedb_convert_hop (balance, &path->hops[i], GNC_DENOM_AUTO,
+                                     GNC_HOW_DENOM_EXACT | GNC_HOW_RND_NEVER);
+        if (gnc_numeric_check (exact) == GNC_ERROR_OK)
+            balance = exact;
+        else
+            balance = pricedb_convert_hop (balance, &path->hops[i],
+                                           GNC_DENOM_AUTO,
+                                           GNC_HOW_DENOM_SIGFIGS(PRICE_RATE_SIGFIGS) |
+                                           GNC_HOW_RND_ROUND);
+    }
+    balance = pricedb_convert_hop (balance, &path->hops[i],
                                    gnc_commodity_get_fraction (new_currency),
                                    GNC_HOW_RND_ROUND);
-        gnc_price_unref (price);
-        return balance;
-    }
+    if (found)
+        price_rate_path_free (found);
 
-    /*
-     * no direct price found, try if we find a price in another currency
-     * and convert in two stages
-     */
-    price_list = gnc_pricedb_lookup_latest_before_any_currency(pdb, balance_currency, t);
-    if (!price_list)
+    if (gnc_numeric_check (balance) != GNC_ERROR_OK)
     {
-        balance =  gnc_numeric_zero ();
-        return balance;
+        PWARN ("converting to %s overflowed",
+               gnc_commodity_get_mnemonic (new_currency));
+        return gnc_numeric_zero ();
     }
+    return balance;
+}
 
-    list_helper = price_list;
-    currency_price_value = gnc_numeric_zero();
-
-    do
-    {
-        price = (GNCPrice *)(list_helper->data);
+/*
+ * Convert a balance from one currency to another.
+ */
+gnc_numeric
+gnc_pricedb_convert_balance_latest_price(GNCPriceDB *pdb,
+        gnc_numeric balance,
+        const gnc_commodity *balance_currency,
+        const gnc_commodity *new_currency)
+{
+    Timespec t = {0, 0};
 
-        intermediate_currency = gnc_price_get_currency(price);
-        currency_price = gnc_pricedb_lookup_latest_before(pdb, intermediate_currency,
-                         new_currency, t);
-        if (currency_price)
-        {
-            currency_price_value = gnc_price_get_value(currency_price);
-            gnc_price_unref(currency_price);
-        }
-        else
-        {
-            currency_price = gnc_pricedb_lookup_nearest_in_time(pdb, new_currency,
-                             intermediate_currency, t);
-            if (currency_price)
-            {
-                /* here we need the reciprocal */
-                currency_price_value = gnc_numeric_div(gnc_numeric_create(1, 1),
-                                                       gnc_price_get_value(currency_price),
-                                                       gnc_commodity_get_fraction (new_currency),
-                                                       GNC_HOW_RND_ROUND);
-                gnc_price_unref(currency_price);
-            }
-        }
+    return pricedb_convert_balance (pdb, balance, balance_currency,
+                                    new_currency, PRICE_RATE_LATEST, t);
+}
 
-        list_helper = list_helper->next;
-    }
-    while ((list_helper != NULL) &&
-            (gnc_numeric_zero_p(currency_price_value)));
+gnc_numeric
+gnc_pricedb_convert_balance_nearest_price(GNCPriceDB *pdb,
+        gnc_numeric balance,
+        const gnc_commodity *balance_currency,
+        const gnc_commodity *new_currency,
+        Timespec t)
+{
+    return pricedb_convert_balance (pdb, balance, balance_currency,
+                                    new_currency, PRICE_RATE_NEAREST, t);
+}
 
-    balance = gnc_numeric_mul (balance, currency_price_value,
-                               gnc_commodity_get_fraction (new_currency),
-                               GNC_HOW_RND_ROUND);
-    balance = gnc_numeric_mul (balance, gnc_price_get_value (price),
-                               gnc_commodity_get_fraction (new_currency),
-                               GNC_HOW_RND_ROUND);
 
-    gnc_price_list_destroy(price_list);
-    return balance;
+gnc_numeric
+gnc_pricedb_convert_balance_latest_before(GNCPriceDB *pdb,
+        gnc_numeric balance,
+        gnc_commodity *balance_currency,
+        gnc_commodity *new_currency,
+        Timespec t)
+{
+    return pricedb_convert_balance (pdb, balance, balance_currency,
+                                    new_currency, PRICE_RATE_LATEST_BEFORE, t);
 }
 
 
@@ -2458,16 +2644,15 @@ typedef struct
 static void
 pricedb_foreach_pricelist(gpointer key, gpointer val, gpointer user_data)
 {
-    GList *price_list = (GList *) val;
-    GList *node = price_list;
+    GPtrArray *prices = (GPtrArray *) val;
     GNCPriceDBForeachData *foreach_data = (GNCPriceDBForeachData *) user_data;
+    guint i;
 
     /* stop traversal when func returns FALSE */
-    while (foreach_data->ok && node)
+    for (i = 0; foreach_data->ok && i < prices->len; i++)
     {
-        GNCPrice *p = (GNCPrice *) node->data;
+        GNCPrice *p = (GNCPrice *) g_ptr_array_index(prices, i);
         foreach_data->ok = foreach_data->func(p, foreach_data->user_data);
-        node = node->next;
     }
 }
 
@@ -2552,12 +2737,12 @@ stable_price_traversal(GNCPriceDB *db,
         for (j = price_lists; j; j = j->next)
         {
             GHashTableKVPair *pricelist_kvp = (GHashTableKVPair *) j->data;
-            GList *price_list = (GList *) pricelist_kvp->value;
-            GList *node;
+            GPtrArray *prices = (GPtrArray *) pricelist_kvp->value;
+            guint k;
 
-            for (node = (GList *) price_list; node; node = node->next)
+            for (k = 0; k < prices->len; k++)
             {
-                GNCPrice *price = (GNCPrice *) node->data;
+                GNCPrice *price = (GNCPrice *) g_ptr_array_index(prices, k);
 
                 /* stop traversal when f returns FALSE */
                 if (FALSE == ok) break;
@@ -2779,15 +2964,14 @@ VoidGNCPriceDBForeachData;
 static void
 void_pricedb_foreach_pricelist(gpointer key, gpointer val, gpointer user_data)
 {
-    GList *price_list = (GList *) val;
-    GList *node = price_list;
+    GPtrArray *prices = (GPtrArray *) val;
     VoidGNCPriceDBForeachData *foreach_data = (VoidGNCPriceDBForeachData *) user_data;
+    guint i;
 
-    while (node)
+    for (i = 0; i < prices->len; i++)
     {
-        GNCPrice *p = (GNCPrice *) node->data;
+        GNCPrice *p = (GNCPrice *) g_ptr_array_index(prices, i);
         foreach_data->func(p, foreach_data->user_data);
-        node = node->next;
     }
 }
 
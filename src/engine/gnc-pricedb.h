@@ -303,7 +303,9 @@ void gnc_pricedb_set_bulk_update(GNCPriceDB *db, gboolean bulk_update);
 
 /** gnc_pricedb_add_price - add a price to the pricedb, you may drop
      your reference to the price (i.e. call unref) after this
-     succeeds, whenever you're finished with the price. */
+     succeeds, whenever you're finished with the price.  A price equal
+     to one already in the db (same day and value) isn't added, and
+     that unref then destroys it. */
 gboolean     gnc_pricedb_add_price(GNCPriceDB *db, GNCPrice *p);
 
 /** gnc_pricedb_remove_price - removes the given price, p, from the
@@ -328,6 +328,24 @@ impl_get_typed_referring_object_list(const QofInstance* inst, const QofInstance*
     return qof_instance_get_referring_object_list_from_collection(qof_instance_get_collection(inst), ref);
 }
 
+/** Calls cb for each object this object refers to, for the book's reference index. */
+static void
+impl_foreach_referenced_object(const QofInstance* inst,
+                               void (*cb)(QofInstance*, gpointer),
+                               gpointer user_data)
+{
+    GncEntry* entry;
+
+    g_return_if_fail(inst != NULL);
+    g_return_if_fail(GNC_IS_ENTRY(inst));
+
+    entry = GNC_ENTRY(inst);
+    cb(QOF_INSTANCE(entry->i_account), user_data);
+    cb(QOF_INSTANCE(entry->b_account), user_data);
+    cb(QOF_INSTANCE(entry->i_tax_table), user_data);
+    cb(QOF_INSTANCE(entry->b_tax_table), user_data);
+}
+
 static void
 gnc_entry_class_init (GncEntryClass *klass)
 {
@@ -342,6 +360,7 @@ gnc_entry_class_init (GncEntryClass *klass)
     qof_class->get_display_name = impl_get_display_name;
     qof_class->refers_to_object = impl_refers_to_object;
     qof_class->get_typed_referring_object_list = impl_get_typed_referring_object_list;
+    qof_class->foreach_referenced_object = impl_foreach_referenced_object;
 
     g_object_class_install_property
     (gobject_class,
@@ -263,6 +263,26 @@ impl_get_typed_referring_object_list(const QofInstance* inst, const QofInstance*
     return qof_instance_get_referring_object_list_from_collection(qof_instance_get_collection(inst), ref);
 }
 
+/** Calls cb for each object this object refers to, for the book's reference index. */
+static void
+impl_foreach_referenced_object(const QofInstance* inst,
+                               void (*cb)(QofInstance*, gpointer),
+                               gpointer user_data)
+{
+    GncInvoice* inv;
+
+    g_return_if_fail(inst != NULL);
+    g_return_if_fail(GNC_IS_INVOICE(inst));
+
+    inv = GNC_INVOICE(inst);
+    cb(QOF_INSTANCE(inv->terms), user_data);
+    cb(QOF_INSTANCE(inv->job), user_data);
+    cb(QOF_INSTANCE(inv->currency), user_data);
+    cb(QOF_INSTANCE(inv->posted_acc), user_data);
+    cb(QOF_INSTANCE(inv->posted_txn), user_data);
+    cb(QOF_INSTANCE(inv->posted_lot), user_data);
+}
+
 static void
 gnc_invoice_class_init (GncInvoiceClass *klass)
 {
@@ -277,6 +297,7 @@ gnc_invoice_class_init (GncInvoiceClass *klass)
     qof_class->get_display_name = impl_get_display_name;
     qof_class->refers_to_object = impl_refers_to_object;
     qof_class->get_typed_referring_object_list = impl_get_typed_referring_object_list;
+    qof_class->foreach_referenced_object = impl_foreach_referenced_object;
 
     g_object_class_install_property
     (gobject_class,
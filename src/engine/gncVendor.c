@@ -205,6 +205,22 @@ impl_get_typed_referring_object_list(const QofInstance* inst, const QofInstance*
     return qof_instance_get_referring_object_list_from_collection(qof_instance_get_collection(inst), ref);
 }
 
+/** Calls cb for each object this object refers to, for the book's reference index. */
+static void
+impl_foreach_referenced_object(const QofInstance* inst,
+                               void (*cb)(QofInstance*, gpointer),
+                               gpointer user_data)
+{
+    GncVendor* v;
+
+    g_return_if_fail(inst != NULL);
+    g_return_if_fail(GNC_IS_VENDOR(inst));
+
+    v = GNC_VENDOR(inst);
+    cb(QOF_INSTANCE(v->terms), user_data);
+    cb(QOF_INSTANCE(v->taxtable), user_data);
+}
+
 static void
 gnc_vendor_class_init (GncVendorClass *klass)
 {
@@ -219,6 +235,7 @@ gnc_vendor_class_init (GncVendorClass *klass)
     qof_class->get_display_name = NULL;
     qof_class->refers_to_object = impl_refers_to_object;
     qof_class->get_typed_referring_object_list = impl_get_typed_referring_object_list;
+    qof_class->foreach_referenced_object = impl_foreach_referenced_object;
 
     g_object_class_install_property
     (gobject_class,
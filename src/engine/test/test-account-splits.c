@@ -0,0 +1,269 @@
+/***************************************************************************
+ *            test-account-splits.c
+ *
+ *  Checks that an account's split list stays ordered and consistent
+ *  as splits are inserted, moved and removed, and that its balances as
+ *  of a date, cleared and reconciled too, agree with a walk of the list.
+ ****************************************************************************/
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+#include "config.h"
+#include <stdlib.h>
+#include <glib.h>
+#include "qof.h"
+#include "cashobjects.h"
+#include "Account.h"
+#include "Split.h"
+#include "Transaction.h"
+#include "TransLog.h"
+#include "gnc-engine.h"
+#include "test-engine-stuff.h"
+#include "test-stuff.h"
+
+#define NUM_TRANS 200
+
+static const char reconcile_states[] = { NREC, CREC, YREC, FREC };
+
+static Split *
+add_trans (QofBook *book, gnc_commodity *currency,
+           Account *acc, Account *other, time_t date, gint64 amount)
+{
+    Transaction *trans;
+    Split *split, *balance;
+    gnc_numeric value = gnc_numeric_create(amount, 100);
+
+    trans = xaccMallocTransaction(book);
+    xaccTransBeginEdit(trans);
+    xaccTransSetCurrency(trans, currency);
+    xaccTransSetDatePostedSecs(trans, date);
+
+    split = xaccMallocSplit(book);
+    xaccSplitSetParent(split, trans);
+    xaccSplitSetAccount(split, acc);
+    xaccSplitSetAmount(split, value);
+    xaccSplitSetValue(split, value);
+    xaccSplitSetReconcile(split, reconcile_states[amount % 4]);
+
+    balance = xaccMallocSplit(book);
+    xaccSplitSetParent(balance, trans);
+    xaccSplitSetAccount(balance, other);
+    xaccSplitSetAmount(balance, gnc_numeric_neg(value));
+    xaccSplitSetValue(balance, gnc_numeric_neg(value));
+
+    xaccTransCommitEdit(trans);
+    return split;
+}
+
+static gboolean
+splits_are_ordered (Account *acc, guint expected)
+{
+    GList *node;
+    guint count = 0;
+
+    for (node = xaccAccountGetSplitList(acc); node; node = node->next)
+    {
+        count++;
+        if (node->prev && node->prev->next != node)
+            return FALSE;
+        if (node->next &&
+                xaccSplitOrder(node->data, node->next->data) > 0)
+            return FALSE;
+        if (!gnc_account_find_split(acc, node->data))
+            return FALSE;
+    }
+    return count == expected;
+}
+
+static gboolean
+balances_are_correct (Account *acc)
+{
+    GList *node;
+    gnc_numeric total = gnc_numeric_zero();
+
+    for (node = xaccAccountGetSplitList(acc); node; node = node->next)
+    {
+        total = gnc_numeric_add_fixed(total, xaccSplitGetAmount(node->data));
+        if (!gnc_numeric_equal(total, xaccSplitGetBalance(node->data)))
+            return FALSE;
+    }
+    return gnc_numeric_equal(total, xaccAccountGetBalance(acc));
+}
+
+/* Walk the split list the slow way to get the balances as of a date,
+ * adding up the amounts by reconcile state rather than trusting the
+ * running balances. */
+static void
+linear_balances_as_of (Account *acc, time_t date, gnc_numeric *balance,
+                       gnc_numeric *cleared, gnc_numeric *reconciled)
+{
+    GList *node;
+
+    *balance = *cleared = *reconciled = gnc_numeric_zero();
+    for (node = xaccAccountGetSplitList(acc); node; node = node->next)
+    {
+        gnc_numeric amount = xaccSplitGetAmount(node->data);
+        char state = xaccSplitGetReconcile(node->data);
+
+        if (xaccTransGetDate(xaccSplitGetParent(node->data)) >= date)
+            break;
+        *balance = gnc_numeric_add_fixed(*balance, amount);
+        if (state != NREC)
+            *cleared = gnc_numeric_add_fixed(*cleared, amount);
+        if (state == YREC || state == FREC)
+            *reconciled = gnc_numeric_add_fixed(*reconciled, amount);
+    }
+}
+
+static void
+test_as_of_balances (Account *acc, time_t base, const char *when)
+{
+    time_t dates[60];
+    gnc_numeric balances[60];
+    gnc_numeric balance, cleared, reconciled;
+    gboolean balance_ok = TRUE, cleared_ok = TRUE, reconciled_ok = TRUE;
+    gboolean differ = FALSE;
+    gint i;
+
+    for (i = 0; i < 60; i++)
+        dates[i] = base + (i - 5) * 86400 + (i % 2) * 3600;
+    xaccAccountGetBalancesAsOfDates(acc, dates, 60, balances);
+
+    for (i = 0; i < 60; i++)
+    {
+        linear_balances_as_of(acc, dates[i], &balance, &cleared, &reconciled);
+        if (!gnc_numeric_equal(balance, balances[i]) ||
+                !gnc_numeric_equal(balance,
+                                   xaccAccountGetBalanceAsOfDate(acc, dates[i])))
+            balance_ok = FALSE;
+        if (!gnc_numeric_equal(cleared,
+                               xaccAccountGetClearedBalanceAsOfDate(acc, dates[i])))
+            cleared_ok = FALSE;
+        if (!gnc_numeric_equal(reconciled,
+                               xaccAccountGetReconciledBalanceAsOfDate(acc, dates[i])))
+            reconciled_ok = FALSE;
+        if (!gnc_numeric_equal(balance, cleared) &&
+                !gnc_numeric_equal(cleared, reconciled))
+            differ = TRUE;
+    }
+
+    do_test(differ, "as of date balances differ by reconcile state");
+    do_test_args(balance_ok, "balances as of dates", __FILE__, __LINE__,
+                 "%s", when);
+    do_test_args(cleared_ok, "cleared balances as of dates", __FILE__,
+                 __LINE__, "%s", when);
+    do_test_args(reconciled_ok, "reconciled balances as of dates", __FILE__,
+                 __LINE__, "%s", when);
+}
+
+static void
+run_test (void)
+{
+    QofSession *session;
+    QofBook *book;
+    gnc_commodity *currency;
+    Account *acc, *other;
+    Split *splits[NUM_TRANS];
+    Transaction *trans;
+    time_t base = 1230768000; /* 2009-01-01 */
+    gint i, removed = 0;
+
+    session = qof_session_new ();
+    book = qof_session_get_book (session);
+
+    currency = gnc_commodity_new(book, "US Dollar", "ISO4217", "USD", "840", 100);
+    acc = xaccMallocAccount(book);
+    other = xaccMallocAccount(book);
+    xaccAccountBeginEdit(acc);
+    xaccAccountSetCommodity(acc, currency);
+    xaccAccountCommitEdit(acc);
+    xaccAccountBeginEdit(other);
+    xaccAccountSetCommodity(other, currency);
+    xaccAccountCommitEdit(other);
+
+    /* Insert in random date order, with plenty of equal dates. */
+    for (i = 0; i < NUM_TRANS; i++)
+        splits[i] = add_trans(book, currency, acc, other,
+                              base + (rand() % 50) * 86400, i + 1);
+    do_test(splits_are_ordered(acc, NUM_TRANS), "splits inserted in order");
+    do_test(balances_are_correct(acc), "running balances after insert");
+
+    /* Move some transactions to a new date; the account must re-sort. */
+    for (i = 0; i < NUM_TRANS; i += 7)
+    {
+        trans = xaccSplitGetParent(splits[i]);
+        xaccTransBeginEdit(trans);
+        xaccTransSetDatePostedSecs(trans, base + (rand() % 50) * 86400);
+        xaccTransCommitEdit(trans);
+    }
+    do_test(splits_are_ordered(acc, NUM_TRANS), "splits re-sorted after date change");
+    do_test(balances_are_correct(acc), "running balances after date change");
+
+    /* Change a few amounts in the middle of the account. */
+    for (i = 5; i < NUM_TRANS; i += 11)
+    {
+        Split *balance = xaccSplitGetOtherSplit(splits[i]);
+        gnc_numeric value = gnc_numeric_create(i * 3, 100);
+
+        trans = xaccSplitGetParent(splits[i]);
+        xaccTransBeginEdit(trans);
+        xaccSplitSetAmount(splits[i], value);
+        xaccSplitSetValue(splits[i], value);
+        xaccSplitSetAmount(balance, gnc_numeric_neg(value));
+        xaccSplitSetValue(balance, gnc_numeric_neg(value));
+        xaccTransCommitEdit(trans);
+    }
+    do_test(balances_are_correct(acc), "running balances after amount change");
+    test_as_of_balances(acc, base, "after amount change");
+
+    /* Clear, reconcile and unreconcile some splits. */
+    for (i = 2; i < NUM_TRANS; i += 5)
+        xaccSplitSetReconcile(splits[i], reconcile_states[(i / 5) % 4]);
+    test_as_of_balances(acc, base, "after reconcile state change");
+
+    /* Remove every third split. */
+    for (i = 0; i < NUM_TRANS; i += 3)
+    {
+        trans = xaccSplitGetParent(splits[i]);
+        xaccTransBeginEdit(trans);
+        xaccTransDestroy(trans);
+        xaccTransCommitEdit(trans);
+        removed++;
+    }
+    do_test(splits_are_ordered(acc, NUM_TRANS - removed),
+            "splits still ordered after removal");
+    do_test(balances_are_correct(acc), "running balances after removal");
+    test_as_of_balances(acc, base, "after removal");
+    do_test(gnc_account_find_split(acc, splits[1]), "surviving split found");
+
+    qof_session_end (session);
+}
+
+int
+main (int argc, char **argv)
+{
+    qof_init();
+    if (cashobjects_register())
+    {
+        xaccLogDisable ();
+        srand(0);
+        run_test ();
+        print_test_results();
+    }
+    qof_close();
+    return get_rv();
+}
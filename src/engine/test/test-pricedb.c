@@ -0,0 +1,372 @@
+/***************************************************************************
+ *            test-pricedb.c
+ *
+ *  Checks the price database's time lookups against a plain walk of
+ *  the price list, and balance conversion through intermediate
+ *  commodities.
+ ****************************************************************************/
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+#include "config.h"
+#include <stdlib.h>
+#include <glib.h>
+#include "qof.h"
+#include "cashobjects.h"
+#include "gnc-commodity.h"
+#include "gnc-pricedb.h"
+#include "TransLog.h"
+#include "gnc-engine.h"
+#include "test-stuff.h"
+
+#define NUM_PRICES 300
+
+static time_t base = 1230768000; /* 2009-01-01 */
+
+static GNCPrice *
+add_price_value (QofBook *book, GNCPriceDB *db, gnc_commodity *c,
+                 gnc_commodity *currency, time_t secs, gnc_numeric value)
+{
+    GNCPrice *p = gnc_price_create(book);
+    Timespec t = {secs, 0};
+
+    gnc_price_begin_edit(p);
+    gnc_price_set_commodity(p, c);
+    gnc_price_set_currency(p, currency);
+    gnc_price_set_time(p, t);
+    gnc_price_set_value(p, value);
+    gnc_price_commit_edit(p);
+    gnc_pricedb_add_price(db, p);
+    gnc_price_unref(p);
+    return p;
+}
+
+static GNCPrice *
+add_price (QofBook *book, GNCPriceDB *db, gnc_commodity *c,
+           gnc_commodity *currency, time_t secs, gint64 value)
+{
+    return add_price_value(book, db, c, currency, secs,
+                           gnc_numeric_create(value, 100));
+}
+
+/* The reference answers walk the full list, which is sorted most
+ * recent first. */
+static GNCPrice *
+linear_latest_before (GList *prices, Timespec t)
+{
+    for (; prices; prices = prices->next)
+    {
+        Timespec pt = gnc_price_get_time(prices->data);
+        if (timespec_cmp(&pt, &t) <= 0)
+            return prices->data;
+    }
+    return NULL;
+}
+
+static GNCPrice *
+linear_nearest (GList *prices, Timespec t)
+{
+    GNCPrice *newer = NULL;
+    GNCPrice *older = linear_latest_before(prices, t);
+    Timespec nt, ot, dn, dold;
+
+    for (; prices && prices->data != older; prices = prices->next)
+        newer = prices->data;
+    if (!newer) return older;
+    if (!older) return newer;
+
+    nt = gnc_price_get_time(newer);
+    ot = gnc_price_get_time(older);
+    dn = timespec_diff(&nt, &t);
+    dold = timespec_diff(&ot, &t);
+    dn = timespec_abs(&dn);
+    dold = timespec_abs(&dold);
+    return timespec_cmp(&dn, &dold) < 0 ? newer : older;
+}
+
+static gboolean
+list_is_sorted (GList *prices, guint expected)
+{
+    guint count = 0;
+
+    for (; prices; prices = prices->next)
+    {
+        Timespec a, b;
+
+        count++;
+        if (!prices->next) break;
+        a = gnc_price_get_time(prices->data);
+        b = gnc_price_get_time(prices->next->data);
+        if (timespec_cmp(&a, &b) < 0)
+            return FALSE;
+    }
+    return count == expected;
+}
+
+static gboolean
+lookups_are_correct (GNCPriceDB *db, gnc_commodity *c,
+                     gnc_commodity *currency)
+{
+    GList *prices = gnc_pricedb_get_prices(db, c, currency);
+    gboolean ok = TRUE;
+    gint i;
+
+    for (i = -2; i < 120 && ok; i++)
+    {
+        Timespec t = {base + i * 86400 + (i % 3) * 3600, 0};
+        GNCPrice *p;
+        GList *at;
+        Timespec p_time;
+
+        p = gnc_pricedb_lookup_latest_before(db, c, currency, t);
+        ok = ok && (p == linear_latest_before(prices, t));
+        gnc_price_unref(p);
+
+        p = gnc_pricedb_lookup_nearest_in_time(db, c, currency, t);
+        ok = ok && (p == linear_nearest(prices, t));
+        gnc_price_unref(p);
+
+        at = gnc_pricedb_lookup_at_time(db, c, currency, t);
+        p = linear_latest_before(prices, t);
+        if (p) p_time = gnc_price_get_time(p);
+        if (p && timespec_equal(&t, &p_time))
+            ok = ok && at && g_list_find(at, p);
+        else
+            ok = ok && !at;
+        gnc_price_list_destroy(at);
+    }
+    gnc_price_list_destroy(prices);
+    return ok;
+}
+
+static gboolean
+converts_to (gnc_numeric balance, gint64 num, gint64 denom)
+{
+    return gnc_numeric_equal(balance, gnc_numeric_create(num, denom));
+}
+
+/* Widgets are priced in euros, euros in dollars, and pounds in
+ * dollars, so converting widgets to pounds takes three hops, the last
+ * one through the reciprocal of the pound's price. */
+static void
+test_convert_balance (QofBook *book, GNCPriceDB *db, gnc_commodity *usd)
+{
+    gnc_commodity *eur, *gbp, *widget, *bond;
+    gnc_numeric ten = gnc_numeric_create(10, 1);
+    gnc_numeric big = gnc_numeric_create(1000000000001LL, 1);
+    gnc_numeric converted;
+    Timespec then = {base - 10 * 86400, 0};
+    Timespec later = {base - 5 * 86400, 0};
+    Timespec early = {base - 10 * 86400 - 1, 0};
+    Timespec morning = {base - 10 * 86400 + 1800, 0};
+    Timespec noon = {base - 10 * 86400 + 7200, 0};
+    GNCPrice *direct;
+
+    eur = gnc_commodity_new(book, "Euro", "ISO4217", "EUR", "978", 100);
+    gbp = gnc_commodity_new(book, "Pound", "ISO4217", "GBP", "826", 100);
+    widget = gnc_commodity_new(book, "Widget", "NYSE", "WDGT", "", 10000);
+
+    add_price(book, db, widget, eur, then.tv_sec, 200);
+    add_price(book, db, eur, usd, then.tv_sec, 150);
+    add_price(book, db, gbp, usd, then.tv_sec, 200);
+
+    do_test(converts_to(gnc_pricedb_convert_balance_latest_price(db, ten,
+                        widget, gbp), 1500, 100),
+            "convert latest through two commodities");
+    do_test(converts_to(gnc_pricedb_convert_balance_nearest_price(db, ten,
+                        widget, gbp, then), 1500, 100),
+            "convert nearest through two commodities");
+    do_test(converts_to(gnc_pricedb_convert_balance_latest_before(db, ten,
+                        widget, gbp, later), 1500, 100),
+            "convert latest before through two commodities");
+    do_test(gnc_numeric_zero_p(gnc_pricedb_convert_balance_latest_before(db,
+                               ten, widget, gbp, early)),
+            "no conversion before the first price");
+
+    /* A direct price is a shorter path, and must replace the cached one. */
+    direct = add_price(book, db, widget, gbp, then.tv_sec, 1600);
+    do_test(converts_to(gnc_pricedb_convert_balance_latest_price(db, ten,
+                        widget, gbp), 16000, 100),
+            "convert latest uses new direct price");
+    do_test(converts_to(gnc_pricedb_convert_balance_latest_price(db, ten,
+                        gbp, widget), 6250, 10000),
+            "convert latest uses reciprocal of direct price");
+    gnc_pricedb_remove_price(db, direct);
+    do_test(converts_to(gnc_pricedb_convert_balance_latest_price(db, ten,
+                        widget, gbp), 1500, 100),
+            "convert latest after removing direct price");
+
+    /* Lookups on the same day share a cached chain, but not its prices. */
+    add_price(book, db, widget, eur, then.tv_sec + 3600, 300);
+    do_test(converts_to(gnc_pricedb_convert_balance_latest_before(db, ten,
+                        widget, gbp, noon), 2250, 100),
+            "convert latest before with a later price that day");
+    do_test(converts_to(gnc_pricedb_convert_balance_latest_before(db, ten,
+                        widget, gbp, morning), 1500, 100),
+            "convert latest before with an earlier price that day");
+
+    /* An exact intermediate result would overflow here, so it is
+     * rounded instead. */
+    bond = gnc_commodity_new(book, "Bond", "NYSE", "BOND", "", 1);
+    add_price_value(book, db, bond, eur, then.tv_sec,
+                    gnc_numeric_create(123456789, 1000000000));
+    converted = gnc_pricedb_convert_balance_latest_price(db, big, bond, gbp);
+    do_test(gnc_numeric_check(converted) == GNC_ERROR_OK &&
+            gnc_numeric_convert(converted, 100, GNC_HOW_RND_ROUND).num >=
+            9259259175008LL &&
+            gnc_numeric_convert(converted, 100, GNC_HOW_RND_ROUND).num <=
+            9259259175010LL,
+            "convert a large balance through quote-sized denominators");
+}
+
+static gint
+count_prices (GNCPriceDB *db, gnc_commodity *c, gnc_commodity *currency)
+{
+    GList *list = gnc_pricedb_get_prices(db, c, currency);
+    gint n = g_list_length(list);
+
+    gnc_price_list_destroy(list);
+    return n;
+}
+
+static gboolean
+is_latest (GNCPriceDB *db, gnc_commodity *c, gnc_commodity *currency,
+           GNCPrice *p)
+{
+    GNCPrice *latest = gnc_pricedb_lookup_latest(db, c, currency);
+
+    gnc_price_unref(latest);
+    return latest == p;
+}
+
+static void
+count_adds (QofInstance *ent, QofEventId event_type, gpointer handler_data,
+            gpointer event_data)
+{
+    if (event_type == QOF_EVENT_ADD && GNC_IS_PRICE(ent))
+        (*(gint *) handler_data)++;
+}
+
+/* A duplicate isn't added, so dropping the caller's reference to it
+ * must not free a price the db still holds. */
+static void
+test_duplicate_price (QofBook *book, GNCPriceDB *db, gnc_commodity *currency)
+{
+    gnc_commodity *c;
+    GNCPrice *p, *equal;
+    Timespec later = {base - 20 * 86400 + 3600, 0};
+    gint n_adds = 0;
+    gint handler_id;
+
+    c = gnc_commodity_new(book, "Dupe", "NYSE", "DUPE", "", 10000);
+    p = add_price(book, db, c, currency, base - 20 * 86400, 500);
+
+    handler_id = qof_event_register_handler(count_adds, &n_adds);
+    gnc_price_ref(p);
+    do_test(gnc_pricedb_add_price(db, p), "add the same price twice");
+    gnc_price_unref(p);
+    do_test(count_prices(db, c, currency) == 1, "same price added once");
+    do_test(is_latest(db, c, currency, p), "db keeps the price after the unref");
+
+    /* Later the same day with the same value */
+    equal = gnc_price_create(book);
+    gnc_price_begin_edit(equal);
+    gnc_price_set_commodity(equal, c);
+    gnc_price_set_currency(equal, currency);
+    gnc_price_set_time(equal, later);
+    gnc_price_set_value(equal, gnc_numeric_create(500, 100));
+    gnc_price_commit_edit(equal);
+    do_test(gnc_pricedb_add_price(db, equal), "add an equal price");
+    do_test(count_prices(db, c, currency) == 1, "equal price not added");
+    do_test(is_latest(db, c, currency, p), "db keeps the first of equal prices");
+    gnc_price_unref(equal);
+    qof_event_unregister_handler(handler_id);
+    do_test(n_adds == 0, "no add event for a duplicate");
+
+    do_test(gnc_pricedb_remove_price(db, p), "remove the price");
+    do_test(count_prices(db, c, currency) == 0, "no prices after removal");
+}
+
+static void
+run_test (void)
+{
+    QofSession *session;
+    QofBook *book;
+    GNCPriceDB *db;
+    gnc_commodity *c, *currency;
+    GNCPrice *prices[NUM_PRICES];
+    GList *list;
+    gint i;
+
+    session = qof_session_new ();
+    book = qof_session_get_book (session);
+    db = gnc_pricedb_get_db(book);
+
+    currency = gnc_commodity_new(book, "US Dollar", "ISO4217", "USD", "840", 100);
+    c = gnc_commodity_new(book, "Acme", "NYSE", "ACME", "", 10000);
+
+    /* Random order, with several prices on some days. */
+    for (i = 0; i < NUM_PRICES; i++)
+        prices[i] = add_price(book, db, c, currency,
+                              base + (rand() % 100) * 86400 + (rand() % 4) * 7200,
+                              i + 1);
+    list = gnc_pricedb_get_prices(db, c, currency);
+    do_test(list_is_sorted(list, NUM_PRICES), "prices sorted");
+    do_test(gnc_pricedb_lookup_latest(db, c, currency) == list->data,
+            "latest is first");
+    gnc_price_unref(list->data);
+    gnc_price_list_destroy(list);
+    do_test(lookups_are_correct(db, c, currency), "lookups after insert");
+
+    /* Move some prices and remove others. */
+    for (i = 0; i < NUM_PRICES; i += 5)
+    {
+        Timespec t = {base + (rand() % 100) * 86400, 0};
+
+        if (i % 2)
+        {
+            gnc_price_begin_edit(prices[i]);
+            gnc_price_set_time(prices[i], t);
+            gnc_price_commit_edit(prices[i]);
+        }
+        else
+        {
+            gnc_pricedb_remove_price(db, prices[i]);
+        }
+    }
+    do_test(lookups_are_correct(db, c, currency), "lookups after change");
+
+    test_convert_balance(book, db, currency);
+    test_duplicate_price(book, db, currency);
+
+    qof_session_end (session);
+}
+
+int
+main (int argc, char **argv)
+{
+    qof_init();
+    if (cashobjects_register())
+    {
+        xaccLogDisable ();
+        srand(0);
+        run_test ();
+        print_test_results();
+    }
+    qof_close();
+    return get_rv();
+}
@@ -0,0 +1,164 @@
+/***************************************************************************
+ *            test-query-perf.c
+ *
+ *  Times split queries over a large synthetic book.  This is not part
+ *  of "make check"; build it with "make test-query-perf" and run it on
+ *  two revisions to compare query evaluation speed.  The number of
+ *  splits defaults to one million and may be given on the command line.
+ ****************************************************************************/
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <glib.h>
+#include "qof.h"
+#include "cashobjects.h"
+#include "Account.h"
+#include "Query.h"
+#include "Split.h"
+#include "Transaction.h"
+#include "TransLog.h"
+#include "gnc-engine.h"
+
+#define DEFAULT_SPLITS 1000000
+#define NUM_RUNS 5
+#define NUM_DAYS 3650
+
+static time_t base = 1230768000; /* 2009-01-01 */
+
+static void
+build_book (QofBook *book, guint n_splits)
+{
+    gnc_commodity *currency;
+    Account *acc, *other;
+    guint i;
+    gchar desc[32];
+
+    currency = gnc_commodity_new(book, "US Dollar", "ISO4217", "USD", "840", 100);
+    acc = xaccMallocAccount(book);
+    other = xaccMallocAccount(book);
+    xaccAccountBeginEdit(acc);
+    xaccAccountSetCommodity(acc, currency);
+    xaccAccountCommitEdit(acc);
+    xaccAccountBeginEdit(other);
+    xaccAccountSetCommodity(other, currency);
+    xaccAccountCommitEdit(other);
+
+    for (i = 0; i < n_splits / 2; i++)
+    {
+        Transaction *trans;
+        Split *split;
+        gnc_numeric value = gnc_numeric_create(rand() % 100000 - 50000, 100);
+
+        trans = xaccMallocTransaction(book);
+        xaccTransBeginEdit(trans);
+        xaccTransSetCurrency(trans, currency);
+        xaccTransSetDatePostedSecs(trans, base + (rand() % NUM_DAYS) * 86400);
+        g_snprintf(desc, sizeof(desc), "Payee %d", rand() % 100);
+        xaccTransSetDescription(trans, desc);
+
+        split = xaccMallocSplit(book);
+        xaccSplitSetParent(split, trans);
+        xaccSplitSetAccount(split, acc);
+        xaccSplitSetAmount(split, value);
+        xaccSplitSetValue(split, value);
+
+        split = xaccMallocSplit(book);
+        xaccSplitSetParent(split, trans);
+        xaccSplitSetAccount(split, other);
+        xaccSplitSetAmount(split, gnc_numeric_neg(value));
+        xaccSplitSetValue(split, gnc_numeric_neg(value));
+
+        xaccTransCommitEdit(trans);
+    }
+}
+
+/* The expensive term is added first, so that evaluating the terms in
+ * insertion order runs the regex on every split. */
+static Query *
+make_query (QofBook *book, time_t start, time_t end)
+{
+    Query *q = qof_query_create_for(GNC_ID_SPLIT);
+
+    qof_query_set_book(q, book);
+    qof_query_set_sort_order(q, NULL, NULL, NULL);
+    xaccQueryAddDescriptionMatch(q, "^Payee 7", TRUE, TRUE, QOF_QUERY_AND);
+    xaccQueryAddValueMatch(q, gnc_numeric_zero(), QOF_NUMERIC_MATCH_CREDIT,
+                           QOF_COMPARE_GTE, QOF_QUERY_AND);
+    xaccQueryAddDateMatchTT(q, TRUE, start, TRUE, end, QOF_QUERY_AND);
+    return q;
+}
+
+static void
+time_query (QofBook *book, const char *label, time_t start, time_t end)
+{
+    GTimer *timer = g_timer_new();
+    gdouble best = -1;
+    guint matches = 0;
+    gint run;
+
+    for (run = 0; run < NUM_RUNS; run++)
+    {
+        Query *q = make_query(book, start, end);
+        GList *result;
+        gdouble elapsed;
+
+        g_timer_start(timer);
+        result = qof_query_run(q);
+        elapsed = g_timer_elapsed(timer, NULL);
+        if (best < 0 || elapsed < best)
+            best = elapsed;
+        matches = g_list_length(result);
+        qof_query_destroy(q);
+    }
+    g_timer_destroy(timer);
+    printf("%-24s %8u matches  %8.3f s\n", label, matches, best);
+}
+
+int
+main (int argc, char **argv)
+{
+    QofSession *session;
+    QofBook *book;
+    guint n_splits = DEFAULT_SPLITS;
+
+    if (argc > 1)
+        n_splits = strtoul(argv[1], NULL, 10);
+
+    qof_init();
+    if (cashobjects_register())
+    {
+        xaccLogDisable ();
+        srand(0);
+        session = qof_session_new ();
+        book = qof_session_get_book (session);
+        build_book(book, n_splits);
+        printf("%u splits\n", n_splits);
+
+        time_query(book, "one week", base + 1000 * 86400,
+                   base + 1007 * 86400);
+        time_query(book, "one year", base + 1000 * 86400,
+                   base + 1365 * 86400);
+        time_query(book, "all dates", base, base + NUM_DAYS * 86400);
+
+        qof_session_end (session);
+    }
+    qof_close();
+    return 0;
+}
@@ -65,6 +65,260 @@ test_trans_query (Transaction *trans, gpointer data)
     return 0;
 }
 
+/* A query with max_results must return exactly the tail of the same
+ * query's full sorted result. */
+static void
+test_max_results (QofBook *book, gint max_results)
+{
+    Query *q;
+    GList *all, *top, *node;
+    gint n_all;
+
+    q = qof_query_create_for (GNC_ID_SPLIT);
+    qof_query_set_book (q, book);
+    qof_query_set_sort_order (q,
+                              qof_query_build_param_list (SPLIT_TRANS,
+                                      TRANS_DATE_POSTED, NULL),
+                              qof_query_build_param_list (QUERY_DEFAULT_SORT,
+                                      NULL),
+                              NULL);
+    all = g_list_copy (qof_query_run (q));
+    n_all = g_list_length (all);
+
+    qof_query_set_max_results (q, max_results);
+    top = qof_query_run (q);
+
+    if ((gint) g_list_length (top) != MIN (n_all, max_results))
+    {
+        failure_args ("max results", __FILE__, __LINE__,
+                      "got %d results, wanted %d", g_list_length (top),
+                      MIN (n_all, max_results));
+    }
+    else
+    {
+        for (node = g_list_nth (all, n_all - g_list_length (top));
+                node && top; node = node->next, top = top->next)
+        {
+            if (node->data != top->data)
+                break;
+        }
+        if (node)
+        {
+            failure ("max results returned the wrong splits");
+        }
+        else
+        {
+            success ("max results matches the sorted tail");
+        }
+    }
+
+    g_list_free (all);
+    qof_query_destroy (q);
+}
+
+/* Queries that can enumerate their candidates from an index must
+ * return the same splits as a scan of every split in the book. */
+typedef gboolean (*SplitPredicate) (Split *split, gpointer data);
+
+typedef struct
+{
+    SplitPredicate pred;
+    gpointer       data;
+    GHashTable *   expected;
+} ExpectedSplitsCB;
+
+static void
+expected_split_cb (QofInstance *inst, gpointer user_data)
+{
+    ExpectedSplitsCB *ecb = user_data;
+
+    if (ecb->pred (GNC_SPLIT (inst), ecb->data))
+        g_hash_table_insert (ecb->expected, inst, inst);
+}
+
+static void
+check_indexed_query (QofBook *book, Query *q, SplitPredicate pred,
+                     gpointer data, const char *what)
+{
+    ExpectedSplitsCB ecb;
+    GHashTable *seen;
+    GList *result, *node;
+    gboolean ok = TRUE;
+
+    ecb.pred = pred;
+    ecb.data = data;
+    ecb.expected = g_hash_table_new (g_direct_hash, g_direct_equal);
+    qof_collection_foreach (qof_book_get_collection (book, GNC_ID_SPLIT),
+                            expected_split_cb, &ecb);
+
+    qof_query_set_book (q, book);
+    result = qof_query_run (q);
+
+    seen = g_hash_table_new (g_direct_hash, g_direct_equal);
+    for (node = result; node; node = node->next)
+    {
+        if (!g_hash_table_lookup (ecb.expected, node->data) ||
+                g_hash_table_lookup (seen, node->data))
+            ok = FALSE;
+        g_hash_table_insert (seen, node->data, node->data);
+    }
+    if (g_hash_table_size (seen) != g_hash_table_size (ecb.expected))
+        ok = FALSE;
+
+    if (ok)
+    {
+        success (what);
+    }
+    else
+    {
+        failure_args (what, __FILE__, __LINE__,
+                      "query returned %d splits, full scan found %d",
+                      g_list_length (result),
+                      g_hash_table_size (ecb.expected));
+    }
+
+    g_hash_table_destroy (seen);
+    g_hash_table_destroy (ecb.expected);
+    qof_query_destroy (q);
+}
+
+static Query *
+account_query (QofBook *book, Account *acc)
+{
+    Query *q = qof_query_create_for (GNC_ID_SPLIT);
+
+    qof_query_set_book (q, book);
+    xaccQueryAddSingleAccountMatch (q, acc, QOF_QUERY_AND);
+    return q;
+}
+
+static gboolean
+split_in_account (Split *split, gpointer acc)
+{
+    return xaccSplitGetAccount (split) == acc;
+}
+
+static gboolean
+split_in_either_account (Split *split, gpointer accs)
+{
+    Account *acc = xaccSplitGetAccount (split);
+
+    return acc == ((Account **)accs)[0] || acc == ((Account **)accs)[1];
+}
+
+static gboolean
+split_in_account_or_trans (Split *split, gpointer other)
+{
+    return xaccSplitGetAccount (split) == xaccSplitGetAccount (other) ||
+           xaccSplitGetParent (split) == xaccSplitGetParent (other);
+}
+
+static gboolean
+split_not_in_account (Split *split, gpointer acc)
+{
+    return xaccSplitGetAccount (split) != acc;
+}
+
+static gboolean
+split_is (Split *split, gpointer other)
+{
+    return split == other;
+}
+
+static void
+test_indexed_queries (QofBook *book, Account *root)
+{
+    GList *accounts, *node;
+    Account *accs[2] = { NULL, NULL };
+    Split *split = NULL;
+    Query *q, *q1, *q2;
+    GncGUID guid;
+
+    /* Find two accounts with splits to query on */
+    accounts = gnc_account_get_descendants (root);
+    for (node = accounts; node && !accs[1]; node = node->next)
+    {
+        if (!xaccAccountGetSplitList (node->data))
+            continue;
+        if (!accs[0])
+            accs[0] = node->data;
+        else
+            accs[1] = node->data;
+    }
+    g_list_free (accounts);
+    if (!accs[1])
+        return;
+
+    check_indexed_query (book, account_query (book, accs[0]),
+                         split_in_account, accs[0], "account index");
+
+    /* OR-terms, each answered by its own index */
+    q1 = account_query (book, accs[0]);
+    q2 = account_query (book, accs[1]);
+    q = qof_query_merge (q1, q2, QOF_QUERY_OR);
+    qof_query_destroy (q1);
+    qof_query_destroy (q2);
+    check_indexed_query (book, q, split_in_either_account, accs,
+                         "account index with OR terms");
+
+    /* OR-terms naming the same split twice */
+    split = xaccAccountGetSplitList (accs[0])->data;
+    q1 = account_query (book, accs[0]);
+    q2 = qof_query_create_for (GNC_ID_SPLIT);
+    qof_query_add_guid_match (q2, qof_query_build_param_list (SPLIT_TRANS,
+                              QOF_PARAM_GUID, NULL),
+                              xaccTransGetGUID (xaccSplitGetParent (split)),
+                              QOF_QUERY_AND);
+    q = qof_query_merge (q1, q2, QOF_QUERY_OR);
+    qof_query_destroy (q1);
+    qof_query_destroy (q2);
+    check_indexed_query (book, q, split_in_account_or_trans, split,
+                         "account and transaction indexes overlapping");
+
+    /* An inverted term can't use the index, on its own or next to one
+     * that can */
+    q1 = account_query (book, accs[0]);
+    q = qof_query_invert (q1);
+    qof_query_destroy (q1);
+    check_indexed_query (book, q, split_not_in_account, accs[0],
+                         "inverted account term");
+
+    q1 = account_query (book, accs[1]);
+    q2 = qof_query_invert (q1);
+    qof_query_destroy (q1);
+    q1 = account_query (book, accs[0]);
+    q = qof_query_merge (q1, q2, QOF_QUERY_AND);
+    qof_query_destroy (q1);
+    qof_query_destroy (q2);
+    check_indexed_query (book, q, split_in_account, accs[0],
+                         "account index with an inverted term");
+
+    /* The split's own GUID, and one that names nothing */
+    q = qof_query_create_for (GNC_ID_SPLIT);
+    qof_query_add_guid_match (q, qof_query_build_param_list (QOF_PARAM_GUID,
+                              NULL), xaccSplitGetGUID (split),
+                              QOF_QUERY_AND);
+    check_indexed_query (book, q, split_is, split, "own GUID");
+
+    guid_new (&guid);
+    q = qof_query_create_for (GNC_ID_SPLIT);
+    qof_query_add_guid_match (q, qof_query_build_param_list (QOF_PARAM_GUID,
+                              NULL), &guid, QOF_QUERY_AND);
+    check_indexed_query (book, q, split_is, NULL, "unknown GUID");
+
+    /* Move a split to the other account and query both */
+    xaccTransBeginEdit (xaccSplitGetParent (split));
+    xaccAccountInsertSplit (accs[1], split);
+    xaccTransCommitEdit (xaccSplitGetParent (split));
+
+    check_indexed_query (book, account_query (book, accs[0]),
+                         split_in_account, accs[0],
+                         "account index after moving a split out");
+    check_indexed_query (book, account_query (book, accs[1]),
+                         split_in_account, accs[1],
+                         "account index after moving a split in");
+}
+
 static void
 run_test (void)
 {
@@ -80,6 +334,13 @@ run_test (void)
 
     xaccAccountTreeForEachTransaction (root, test_trans_query, book);
 
+    test_max_results (book, 1);
+    test_max_results (book, 7);
+    test_max_results (book, 1000);
+    test_max_results (book, G_MAXINT);
+
+    test_indexed_queries (book, root);
+
     qof_session_end (session);
 }
 
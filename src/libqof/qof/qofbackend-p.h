@@ -308,6 +308,11 @@ struct QofBackend_s
     void (*commit) (QofBackend *, QofInstance *);
     void (*rollback) (QofBackend *, QofInstance *);
 
+    /** Called by qof_book_begin_batch() and qof_book_end_batch().  The
+     * commits in between may be written together.  Optional. */
+    void (*begin_batch) (QofBackend *);
+    void (*end_batch) (QofBackend *);
+
     gpointer (*compile_query) (QofBackend *, QofQuery *);
     void (*free_query) (QofBackend *, gpointer);
     void (*run_query) (QofBackend *, gpointer);
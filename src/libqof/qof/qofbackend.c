@@ -124,6 +124,9 @@ qof_backend_init(QofBackend *be)
     be->commit = NULL;
     be->rollback = NULL;
 
+    be->begin_batch = NULL;
+    be->end_batch = NULL;
+
     be->compile_query = NULL;
     be->free_query = NULL;
     be->run_query = NULL;
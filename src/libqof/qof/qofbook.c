@@ -231,6 +231,30 @@ qof_book_set_dirty_cb(QofBook *book, QofBookDirtyCB cb, gpointer user_data)
     book->dirty_cb = cb;
 }
 
+void
+qof_book_begin_batch (QofBook *book)
+{
+    QofBackend *be;
+
+    if (!book) return;
+
+    be = qof_book_get_backend (book);
+    if (be && be->begin_batch)
+        (be->begin_batch) (be);
+}
+
+void
+qof_book_end_batch (QofBook *book)
+{
+    QofBackend *be;
+
+    if (!book) return;
+
+    be = qof_book_get_backend (book);
+    if (be && be->end_batch)
+        (be->end_batch) (be);
+}
+
 /* ====================================================================== */
 /* getters */
 
@@ -255,6 +255,18 @@ void qof_book_mark_saved(QofBook *book);
  */
 void qof_book_mark_dirty(QofBook *book);
 
+/** Start a group of edits which the backend may write to storage
+ *    together, e.g. in a single database transaction, instead of one
+ *    edit at a time.  Use this around bulk changes such as imports.
+ *    Every call must be matched by a call to qof_book_end_batch();
+ *    groups may be nested, and the edits are written when the
+ *    outermost group ends.
+ */
+void qof_book_begin_batch(QofBook *book);
+
+/** End a group of edits started by qof_book_begin_batch(). */
+void qof_book_end_batch(QofBook *book);
+
 /** This debugging function can be used to traverse the book structure
  *    and all subsidiary structures, printing out which structures
  *    have been marked dirty.
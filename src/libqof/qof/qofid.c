@@ -258,6 +258,19 @@ qof_collection_lookup_entity (const QofCollection *col, const GncGUID * guid)
     return ent;
 }
 
+static gboolean
+any_entity_cb (gpointer key, gpointer value, gpointer user_data)
+{
+    return TRUE;
+}
+
+QofInstance *
+qof_collection_get_any_entity (const QofCollection *col)
+{
+    g_return_val_if_fail (col, NULL);
+    return g_hash_table_find (col->hash_of_entities, any_entity_cb, NULL);
+}
+
 QofCollection *
 qof_collection_from_glist (QofIdType type, const GList *glist)
 {
@@ -177,6 +177,11 @@ QofIdType qof_collection_get_type (const QofCollection *);
 /*@ dependent @*/
 QofInstance * qof_collection_lookup_entity (const QofCollection *, const GncGUID *);
 
+/** Return some entity from the collection, or NULL if it is empty.
+ *  Useful for getting at the class of the entities it holds. */
+/*@ dependent @*/
+QofInstance * qof_collection_get_any_entity (const QofCollection *);
+
 /** Callback type for qof_collection_foreach */
 typedef void (*QofInstanceForeachCB) (QofInstance *, gpointer user_data);
 
@@ -138,6 +138,7 @@ static void qof_instance_class_init(QofInstanceClass *klass)
     klass->get_display_name = NULL;
     klass->refers_to_object = NULL;
     klass->get_typed_referring_object_list = NULL;
+    klass->foreach_referenced_object = NULL;
 
     g_object_class_install_property
     (object_class,
@@ -929,6 +930,168 @@ gchar* qof_instance_get_display_name(const QofInstance* inst)
     }
 }
 
+/* The reference index maps each object to the set of objects which
+ * refer to it, for the classes which implement
+ * foreach_referenced_object.  It is kept per book, built by scanning
+ * those classes' collections the first time someone asks for the
+ * referrers of an object, and from then on kept up to date from
+ * qof_commit_edit_part2().  The forward map remembers what each object
+ * referred to when it was last indexed, so that the old entries can be
+ * dropped when it changes.
+ *
+ * An object open for edit, or whose last commit failed, may already
+ * refer to things its index entries don't show.  Those objects are kept
+ * in a stale set from qof_begin_edit() until they are committed, and
+ * lookups check them directly, as the collection scan did.
+ */
+#define QOF_REFERENCE_INDEX "qof-reference-index"
+
+typedef struct
+{
+    GHashTable *referrers;      /* QofInstance* -> set of QofInstance* */
+    GHashTable *references;     /* QofInstance* -> GSList of QofInstance* */
+    GHashTable *stale;          /* set of QofInstance* not yet re-indexed */
+} QofReferenceIndex;
+
+static void
+reference_index_free_refs (gpointer refs)
+{
+    g_slist_free (refs);
+}
+
+static void
+reference_index_free (QofBook *book, gpointer key, gpointer user_data)
+{
+    QofReferenceIndex *index = user_data;
+
+    g_hash_table_destroy (index->referrers);
+    g_hash_table_destroy (index->references);
+    g_hash_table_destroy (index->stale);
+    g_free (index);
+}
+
+static void
+collect_reference_cb (QofInstance *ref, gpointer user_data)
+{
+    GSList **refs = user_data;
+
+    if (ref && !g_slist_find (*refs, ref))
+        *refs = g_slist_prepend (*refs, ref);
+}
+
+static void
+reference_index_remove (QofReferenceIndex *index, QofInstance *inst)
+{
+    GSList *node;
+
+    node = g_hash_table_lookup (index->references, inst);
+    for (; node; node = node->next)
+    {
+        GHashTable *set = g_hash_table_lookup (index->referrers, node->data);
+        if (!set) continue;
+        g_hash_table_remove (set, inst);
+        if (g_hash_table_size (set) == 0)
+            g_hash_table_remove (index->referrers, node->data);
+    }
+    g_hash_table_remove (index->references, inst);
+}
+
+static void
+reference_index_add (QofInstance *inst, gpointer user_data)
+{
+    QofReferenceIndex *index = user_data;
+    GSList *refs = NULL, *node;
+
+    if (GET_PRIVATE (inst)->editlevel > 0)
+        g_hash_table_insert (index->stale, inst, inst);
+
+    QOF_INSTANCE_GET_CLASS (inst)->foreach_referenced_object (inst,
+            collect_reference_cb, &refs);
+    if (!refs) return;
+
+    for (node = refs; node; node = node->next)
+    {
+        GHashTable *set = g_hash_table_lookup (index->referrers, node->data);
+        if (!set)
+        {
+            set = g_hash_table_new (g_direct_hash, g_direct_equal);
+            g_hash_table_insert (index->referrers, node->data, set);
+        }
+        g_hash_table_insert (set, inst, inst);
+    }
+    g_hash_table_insert (index->references, inst, refs);
+}
+
+static void
+reference_index_add_collection (QofCollection *coll, gpointer user_data)
+{
+    QofInstance *inst = qof_collection_get_any_entity (coll);
+
+    if (inst && QOF_INSTANCE_GET_CLASS (inst)->foreach_referenced_object)
+        qof_collection_foreach (coll, reference_index_add, user_data);
+}
+
+static QofReferenceIndex *
+reference_index_get (QofBook *book, gboolean create)
+{
+    QofReferenceIndex *index;
+
+    if (!book || qof_book_shutting_down (book)) return NULL;
+
+    index = qof_book_get_data (book, QOF_REFERENCE_INDEX);
+    if (!index && create)
+    {
+        index = g_new0 (QofReferenceIndex, 1);
+        index->referrers = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                           NULL, (GDestroyNotify) g_hash_table_destroy);
+        index->references = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                            NULL, reference_index_free_refs);
+        index->stale = g_hash_table_new (g_direct_hash, g_direct_equal);
+        qof_book_foreach_collection (book, reference_index_add_collection, index);
+        qof_book_set_data_fin (book, QOF_REFERENCE_INDEX, index,
+                               reference_index_free);
+    }
+    return index;
+}
+
+/* Until inst is committed, lookups can't trust its index entries. */
+static void
+qof_instance_mark_references_stale (QofInstance *inst)
+{
+    QofInstancePrivate *priv = GET_PRIVATE (inst);
+    QofReferenceIndex *index;
+
+    if (!QOF_INSTANCE_GET_CLASS (inst)->foreach_referenced_object) return;
+
+    index = reference_index_get (priv->book, FALSE);
+    if (index)
+        g_hash_table_insert (index->stale, inst, inst);
+}
+
+/* Bring the book's reference index up to date with what inst refers
+ * to now, or drop it from the index if it is being destroyed. */
+static void
+qof_instance_update_references (QofInstance *inst)
+{
+    QofInstancePrivate *priv = GET_PRIVATE (inst);
+    QofReferenceIndex *index;
+
+    index = reference_index_get (priv->book, FALSE);
+    if (!index) return;
+
+    g_hash_table_remove (index->stale, inst);
+    if (priv->do_free)
+    {
+        reference_index_remove (index, inst);
+        g_hash_table_remove (index->referrers, inst);
+    }
+    else if (QOF_INSTANCE_GET_CLASS (inst)->foreach_referenced_object)
+    {
+        reference_index_remove (index, inst);
+        reference_index_add (inst, index);
+    }
+}
+
 typedef struct
 {
     const QofInstance* inst;
@@ -936,28 +1099,59 @@ typedef struct
 } GetReferringObjectHelperData;
 
 static void
-get_referring_object_instance_helper(QofInstance* inst, gpointer user_data)
+get_referring_object_helper(QofCollection* coll, gpointer user_data)
 {
-    QofInstance** pInst = (QofInstance**)user_data;
+    QofInstance* first_instance;
+    QofInstanceClass* klass;
+    GetReferringObjectHelperData* data = (GetReferringObjectHelperData*)user_data;
+
+    first_instance = qof_collection_get_any_entity(coll);
+    if (first_instance == NULL) return;
 
-    if (*pInst == NULL)
+    /* Objects which refer to nothing needn't be looked at, and those
+       which report their references are found in the reference index. */
+    klass = QOF_INSTANCE_GET_CLASS(first_instance);
+    if (klass->foreach_referenced_object != NULL ||
+            (klass->refers_to_object == NULL &&
+             klass->get_typed_referring_object_list == NULL))
     {
-        *pInst = inst;
+        return;
     }
+
+    data->list = g_list_concat(data->list,
+                               qof_instance_get_typed_referring_object_list(first_instance, data->inst));
 }
 
+typedef struct
+{
+    const QofInstance* inst;
+    GList* list;
+    GHashTable* stale;
+} GetIndexedReferringObjectHelperData;
+
 static void
-get_referring_object_helper(QofCollection* coll, gpointer user_data)
+get_indexed_referring_object_helper(gpointer key, gpointer value, gpointer user_data)
 {
-    QofInstance* first_instance = NULL;
-    GetReferringObjectHelperData* data = (GetReferringObjectHelperData*)user_data;
+    QofInstance* referrer = key;
+    GetIndexedReferringObjectHelperData* data = user_data;
 
-    qof_collection_foreach(coll, get_referring_object_instance_helper, &first_instance);
+    /* The index is only as fresh as the last commit; double-check. */
+    if (!g_hash_table_lookup(data->stale, referrer) &&
+            qof_instance_refers_to_object(referrer, data->inst))
+    {
+        data->list = g_list_prepend(data->list, referrer);
+    }
+}
 
-    if (first_instance != NULL)
+static void
+get_stale_referring_object_helper(gpointer key, gpointer value, gpointer user_data)
+{
+    QofInstance* referrer = key;
+    GetIndexedReferringObjectHelperData* data = user_data;
+
+    if (qof_instance_refers_to_object(referrer, data->inst))
     {
-        GList* new_list = qof_instance_get_typed_referring_object_list(first_instance, data->inst);
-        data->list = g_list_concat(data->list, new_list);
+        data->list = g_list_prepend(data->list, referrer);
     }
 }
 
@@ -965,16 +1159,38 @@ get_referring_object_helper(QofCollection* coll, gpointer user_data)
 GList* qof_instance_get_referring_object_list(const QofInstance* inst)
 {
     GetReferringObjectHelperData data;
+    QofReferenceIndex* index;
+    QofBook* book;
 
     g_return_val_if_fail( inst != NULL, NULL );
 
-    /* scan all collections */
+    /* scan the collections the index doesn't cover */
     data.inst = inst;
     data.list = NULL;
+    book = qof_instance_get_book(inst);
 
-    qof_book_foreach_collection(qof_instance_get_book(inst),
+    qof_book_foreach_collection(book,
                                 get_referring_object_helper,
                                 &data);
+
+    index = reference_index_get(book, TRUE);
+    if (index != NULL)
+    {
+        GetIndexedReferringObjectHelperData indexed_data;
+        GHashTable* set = g_hash_table_lookup(index->referrers, inst);
+
+        indexed_data.inst = inst;
+        indexed_data.list = data.list;
+        indexed_data.stale = index->stale;
+        if (set != NULL)
+        {
+            g_hash_table_foreach(set, get_indexed_referring_object_helper,
+                                 &indexed_data);
+        }
+        g_hash_table_foreach(index->stale, get_stale_referring_object_helper,
+                             &indexed_data);
+        data.list = indexed_data.list;
+    }
     return data.list;
 }
 
@@ -1060,6 +1276,8 @@ qof_begin_edit (QofInstance *inst)
     if (0 >= priv->editlevel)
         priv->editlevel = 1;
 
+    qof_instance_mark_references_stale (inst);
+
     be = qof_book_get_backend(priv->book);
     if (be && qof_backend_begin_exists(be))
         qof_backend_run_begin(be, inst);
@@ -1146,6 +1364,8 @@ qof_commit_edit_part2(QofInstance *inst,
 //    }
     priv->infant = FALSE;
 
+    qof_instance_update_references (inst);
+
     if (priv->do_free)
     {
         if (on_free)
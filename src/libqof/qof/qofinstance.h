@@ -87,6 +87,13 @@ struct _QofInstanceClass
 
     /* Returns a list of my type of object which refers to an object */
     GList* (*get_typed_referring_object_list)(const QofInstance* inst, const QofInstance* ref);
+
+    /* Calls cb for each object this object refers to.  Objects which
+       implement this are tracked in the book's reference index when
+       they are committed, so they never need to be scanned. */
+    void (*foreach_referenced_object)(const QofInstance* inst,
+                                      void (*cb)(QofInstance* ref, gpointer user_data),
+                                      gpointer user_data);
 };
 
 /** Return the GType of a QofInstance */
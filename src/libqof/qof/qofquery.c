@@ -38,6 +38,10 @@
 
 static QofLogModule log_module = QOF_MOD_QUERY;
 
+/* Registered indexes: a hash of object type to a hash of parameter
+ * name to QofQueryIndexFunc. */
+static GHashTable *queryIndexTable = NULL;
+
 struct _QofQueryTerm
 {
     GSList *                param_list;
@@ -53,6 +57,38 @@ struct _QofQueryTerm
     QofQueryPredicateFunc   pred_fcn;
 };
 
+/* A query term flattened for evaluation.  The parameter chain is
+ * copied out of the GSList into an array of the intermediate getters
+ * plus the final parameter, and the term's predicate data is copied
+ * in so that check_object never has to touch the term list. */
+typedef struct _QofQueryOp
+{
+    QofQueryPredicateFunc   pred_fcn;
+    QofQueryPredData *      pdata;
+    gboolean                invert;
+    const QofParam **       getters;
+    guint                   n_getters;
+    const QofParam *        param;
+    guint                   cost;
+
+    /* Index of the first op of the next OR-term.  Evaluation jumps
+     * here when this op fails, and the object matches when it steps
+     * onto it after this op succeeds. */
+    guint                   group_end;
+} QofQueryOp;
+
+/* The compiled form of a query's terms: the AND-terms of every OR-term
+ * laid out one after the other, cheapest first within each OR-term. */
+typedef struct _QofQueryProgram
+{
+    QofQueryOp *            ops;
+    guint                   n_ops;
+
+    /* Set when some OR-term has no evaluable AND-terms, which makes
+     * it (and so the whole query) match everything. */
+    gboolean                match_all;
+} QofQueryProgram;
+
 struct _QofQuerySort
 {
     GSList *            param_list;
@@ -101,15 +137,50 @@ struct _QofQuery
     gint              changed;
 
     GList *           results;
+
+    /* The terms compiled for evaluation; rebuilt by compile_terms */
+    QofQueryProgram * program;
 };
 
+/* An entry in the bounded heap used when max_results is set.  The
+ * sequence number records the order in which the match was found, so
+ * that ties are broken exactly the way the stable list sort does. */
+typedef struct _QofQueryTopEntry
+{
+    gpointer          object;
+    guint             seq;
+} QofQueryTopEntry;
+
 typedef struct _QofQueryCB
 {
     QofQuery *        query;
     GList *           list;
     gint              count;
+
+    /* When max_results is positive only the best max_results matches
+     * are kept, in a min-heap ordered by the query's sort, instead of
+     * collecting every match in 'list'.  The heap grows as matches
+     * come in, so a large limit costs nothing on a small book. */
+    QofQueryTopEntry *top;
+    gint              top_len;
+    gint              top_alloc;
+    gboolean          top_sorted;
 } QofQueryCB;
 
+static void
+query_free_program (QofQuery *q)
+{
+    QofQueryProgram *prog = q->program;
+    guint i;
+
+    if (!prog) return;
+    for (i = 0; i < prog->n_ops; i++)
+        g_free (prog->ops[i].getters);
+    g_free (prog->ops);
+    g_free (prog);
+    q->program = NULL;
+}
+
 /* initial_term will be owned by the new Query */
 static void query_init (QofQuery *q, QofQueryTerm *initial_term)
 {
@@ -139,6 +210,8 @@ static void query_init (QofQuery *q, QofQueryTerm *initial_term)
     g_slist_free (q->secondary_sort.param_fcns);
     g_slist_free (q->tertiary_sort.param_fcns);
 
+    query_free_program (q);
+
     ht = q->be_compiled;
     memset (q, 0, sizeof (*q));
     q->be_compiled = ht;
@@ -269,6 +342,8 @@ static void free_members (QofQuery *q)
 
     g_list_free(q->results);
     q->results = NULL;
+
+    query_free_program (q);
 }
 
 static int cmp_func (const QofQuerySort *sort, QofSortFunc default_sort,
@@ -350,58 +425,122 @@ static int sort_func (const gconstpointer a, const gconstpointer b, const gpoint
 }
 
 /* ==================================================================== */
-/* This is the main workhorse for performing the query.  For each
- * object, it walks over all of the query terms to see if the
- * object passes the seive.
- */
+/* Bounded selection of the last max_results matches.  The result of a
+ * query with max_results is the tail of the sorted list of matches, so
+ * keep the max_results greatest matches seen so far in a min-heap;
+ * each new match either replaces the smallest one or is dropped. */
 
 static int
-check_object (const QofQuery *q, gpointer object)
+top_entry_cmp (const QofQueryCB *qcb, const QofQueryTopEntry *a,
+               const QofQueryTopEntry *b)
 {
-    const GList     * and_ptr;
-    const GList     * or_ptr;
-    const QofQueryTerm * qt;
-    int       and_terms_ok = 1;
+    int retval = 0;
 
-    for (or_ptr = q->terms; or_ptr; or_ptr = or_ptr->next)
+    if (qcb->top_sorted)
+        retval = sort_func (a->object, b->object, qcb->query);
+    if (retval == 0)
+        retval = (a->seq < b->seq) ? -1 : (a->seq > b->seq);
+    return retval;
+}
+
+static int
+top_entry_qsort_cmp (gconstpointer a, gconstpointer b, gpointer qcb)
+{
+    return top_entry_cmp (qcb, a, b);
+}
+
+static void
+top_sift_down (QofQueryCB *qcb, gint i)
+{
+    QofQueryTopEntry tmp;
+    gint child;
+
+    while ((child = 2 * i + 1) < qcb->top_len)
     {
-        and_terms_ok = 1;
-        for (and_ptr = or_ptr->data; and_ptr; and_ptr = and_ptr->next)
-        {
-            qt = (QofQueryTerm *)(and_ptr->data);
-            if (qt->param_fcns && qt->pred_fcn)
-            {
-                const GSList *node;
-                QofParam *param = NULL;
-                gpointer conv_obj = object;
+        if (child + 1 < qcb->top_len &&
+                top_entry_cmp (qcb, &qcb->top[child + 1], &qcb->top[child]) < 0)
+            child++;
+        if (top_entry_cmp (qcb, &qcb->top[child], &qcb->top[i]) >= 0)
+            break;
+        tmp = qcb->top[i];
+        qcb->top[i] = qcb->top[child];
+        qcb->top[child] = tmp;
+        i = child;
+    }
+}
 
-                /* iterate through the conversions */
-                for (node = qt->param_fcns; node; node = node->next)
-                {
-                    param = node->data;
+static void
+top_sift_up (QofQueryCB *qcb, gint i)
+{
+    QofQueryTopEntry tmp;
+    gint parent;
 
-                    /* The last term is the actual parameter getter */
-                    if (!node->next) break;
+    while (i > 0)
+    {
+        parent = (i - 1) / 2;
+        if (top_entry_cmp (qcb, &qcb->top[i], &qcb->top[parent]) >= 0)
+            break;
+        tmp = qcb->top[i];
+        qcb->top[i] = qcb->top[parent];
+        qcb->top[parent] = tmp;
+        i = parent;
+    }
+}
 
-                    conv_obj = param->param_getfcn (conv_obj, param);
-                }
+static void
+top_insert (QofQueryCB *qcb, gpointer object)
+{
+    QofQueryTopEntry entry;
 
-                if (((qt->pred_fcn)(conv_obj, param, qt->pdata)) == qt->invert)
-                {
-                    and_terms_ok = 0;
-                    break;
-                }
-            }
-            else
-            {
-                /* XXX: Don't know how to do this conversion -- do we care? */
-            }
-        }
-        if (and_terms_ok)
+    entry.object = object;
+    entry.seq = qcb->count;
+
+    if (qcb->top_len < qcb->query->max_results)
+    {
+        if (qcb->top_len == qcb->top_alloc)
         {
-            return 1;
+            qcb->top_alloc = MIN (qcb->top_alloc * 2,
+                                  qcb->query->max_results);
+            qcb->top = g_renew (QofQueryTopEntry, qcb->top, qcb->top_alloc);
         }
+        qcb->top[qcb->top_len] = entry;
+        top_sift_up (qcb, qcb->top_len++);
     }
+    else if (top_entry_cmp (qcb, &entry, &qcb->top[0]) > 0)
+    {
+        qcb->top[0] = entry;
+        top_sift_down (qcb, 0);
+    }
+}
+
+/* Sort the surviving entries and return them as an ordered list. */
+static GList *
+top_to_list (QofQueryCB *qcb)
+{
+    GList *list = NULL;
+    gint i;
+
+    g_qsort_with_data (qcb->top, qcb->top_len, sizeof (QofQueryTopEntry),
+                       top_entry_qsort_cmp, qcb);
+    for (i = qcb->top_len - 1; i >= 0; i--)
+        list = g_list_prepend (list, qcb->top[i].object);
+    return list;
+}
+
+/* ==================================================================== */
+/* This is the main workhorse for performing the query.  For each
+ * object, it runs the compiled program to see if the object passes
+ * the seive.  The ops of each OR-term are laid out back to back; a
+ * failing op skips to the next OR-term, and stepping past the last op
+ * of an OR-term means every AND-term matched.
+ */
+
+static int
+check_object (const QofQuery *q, gpointer object)
+{
+    const QofQueryProgram *prog = q->program;
+    const QofQueryOp *op;
+    guint i, j;
 
     /* If there are no terms, assume a "match any" applies.
      * A query with no terms is still meaningful, since the user
@@ -409,6 +548,30 @@ check_object (const QofQuery *q, gpointer object)
      * order.
      */
     if (NULL == q->terms) return 1;
+    g_return_val_if_fail (prog, 0);
+    if (prog->match_all) return 1;
+
+    i = 0;
+    while (i < prog->n_ops)
+    {
+        gpointer conv_obj = object;
+
+        op = &prog->ops[i];
+
+        /* iterate through the conversions */
+        for (j = 0; j < op->n_getters; j++)
+            conv_obj = op->getters[j]->param_getfcn (conv_obj, op->getters[j]);
+
+        if (((op->pred_fcn)(conv_obj, (QofParam *) op->param, op->pdata))
+                == op->invert)
+        {
+            i = op->group_end;
+            continue;
+        }
+
+        if (++i == op->group_end)
+            return 1;
+    }
     return 0;
 }
 
@@ -499,6 +662,94 @@ compile_sort (QofQuerySort *sort, QofIdType obj)
     LEAVE ("sort=%p id=%s", sort, obj);
 }
 
+/* Rough relative cost of evaluating a term, used to run the cheap
+ * comparisons of an AND-term before the expensive ones.  Fixed-size
+ * core types compare in a few instructions, strings have to be walked
+ * (or worse, run through a regex), and every hop through the
+ * parameter chain is another getter call.
+ */
+static guint
+query_op_cost (const QofQueryOp *op)
+{
+    const char *type = op->pdata->type_name;
+    guint cost;
+
+    if (!safe_strcmp (type, QOF_TYPE_GUID))
+        cost = 2 + g_list_length (((query_guid_t) op->pdata)->guids);
+    else if (!safe_strcmp (type, QOF_TYPE_DATE) ||
+             !safe_strcmp (type, QOF_TYPE_INT32) ||
+             !safe_strcmp (type, QOF_TYPE_INT64) ||
+             !safe_strcmp (type, QOF_TYPE_DOUBLE) ||
+             !safe_strcmp (type, QOF_TYPE_BOOLEAN) ||
+             !safe_strcmp (type, QOF_TYPE_CHAR))
+        cost = 2;
+    else if (!safe_strcmp (type, QOF_TYPE_NUMERIC))
+        cost = 4;
+    else if (!safe_strcmp (type, QOF_TYPE_STRING))
+        cost = ((query_string_t) op->pdata)->is_regex ? 32 : 8;
+    else
+        cost = 16;
+
+    return cost + 2 * op->n_getters;
+}
+
+/* Flatten the compiled terms into q->program.  Within each OR-term the
+ * ops are ordered by cost; the sort is an insertion sort so that terms
+ * of equal cost keep the order in which they were added.
+ */
+static void
+compile_program (QofQuery *q)
+{
+    QofQueryProgram *prog;
+    GList *or_ptr, *and_ptr;
+    guint n_ops = 0;
+
+    query_free_program (q);
+
+    for (or_ptr = q->terms; or_ptr; or_ptr = or_ptr->next)
+        n_ops += g_list_length (or_ptr->data);
+
+    prog = g_new0 (QofQueryProgram, 1);
+    prog->ops = g_new0 (QofQueryOp, MAX (n_ops, 1));
+    q->program = prog;
+
+    for (or_ptr = q->terms; or_ptr; or_ptr = or_ptr->next)
+    {
+        guint first = prog->n_ops;
+        guint i, j;
+
+        for (and_ptr = or_ptr->data; and_ptr; and_ptr = and_ptr->next)
+        {
+            QofQueryTerm *qt = and_ptr->data;
+            QofQueryOp op;
+            GSList *node;
+
+            /* XXX: Don't know how to do this conversion -- do we care? */
+            if (!qt->param_fcns || !qt->pred_fcn) continue;
+
+            op.pred_fcn = qt->pred_fcn;
+            op.pdata = qt->pdata;
+            op.invert = qt->invert;
+            op.n_getters = g_slist_length (qt->param_fcns) - 1;
+            op.getters = g_new (const QofParam *, MAX (op.n_getters, 1));
+            for (node = qt->param_fcns, j = 0; node->next; node = node->next)
+                op.getters[j++] = node->data;
+            op.param = node->data;
+            op.cost = query_op_cost (&op);
+
+            for (i = prog->n_ops; i > first && prog->ops[i - 1].cost > op.cost; i--)
+                prog->ops[i] = prog->ops[i - 1];
+            prog->ops[i] = op;
+            prog->n_ops++;
+        }
+
+        if (prog->n_ops == first)
+            prog->match_all = TRUE;
+        for (i = first; i < prog->n_ops; i++)
+            prog->ops[i].group_end = prog->n_ops;
+    }
+}
+
 static void compile_terms (QofQuery *q)
 {
     GList *or_ptr, *and_ptr, *node;
@@ -532,6 +783,9 @@ static void compile_terms (QofQuery *q)
         }
     }
 
+    /* Lay the terms out for check_object */
+    compile_program (q);
+
     /* Update the sort functions */
     compile_sort (&(q->primary_sort), q->search_for);
     compile_sort (&(q->secondary_sort), q->search_for);
@@ -563,7 +817,10 @@ static void check_item_cb (gpointer object, gpointer user_data)
 
     if (check_object (ql->query, object))
     {
-        ql->list = g_list_prepend (ql->list, object);
+        if (ql->top)
+            top_insert (ql, object);
+        else
+            ql->list = g_list_prepend (ql->list, object);
         ql->count++;
     }
     return;
@@ -719,8 +976,6 @@ static GList * qof_query_run_internal (QofQuery *q,
     g_return_val_if_fail (run_cb, NULL);
     ENTER (" q=%p", q);
 
-    /* XXX: Prioritize the query terms? */
-
     /* prepare the Query for processing */
     if (q->changed)
     {
@@ -735,67 +990,202 @@ static GList * qof_query_run_internal (QofQuery *q,
     /* Now run the query over all the objects and save the results */
     {
         QofQueryCB qcb;
+        gboolean sorted;
+
+        sorted = (q->primary_sort.comp_fcn || q->primary_sort.obj_cmp ||
+                  (q->primary_sort.use_default && q->defaultSort));
 
         memset (&qcb, 0, sizeof (qcb));
         qcb.query = q;
 
+        /* If only a few results are wanted, select them as the matches
+         * come in rather than sorting the whole set of matches. */
+        if (q->max_results > 0)
+        {
+            qcb.top_alloc = MIN (q->max_results, 64);
+            qcb.top = g_new (QofQueryTopEntry, qcb.top_alloc);
+            qcb.top_sorted = sorted;
+        }
+
         /* Run the query callback */
         run_cb(&qcb, cb_arg);
 
-        matching_objects = qcb.list;
-        object_count = qcb.count;
+        if (qcb.top)
+        {
+            matching_objects = top_to_list (&qcb);
+            object_count = qcb.top_len;
+            g_free (qcb.top);
+        }
+        else
+        {
+            PINFO ("matching objects=%p count=%d", qcb.list, qcb.count);
+
+            /* There is no absolute need to reverse this list, since it's
+             * being sorted below. However, in the common case, we will be
+             * searching in a confined location where the objects are
+             * already in order, thus reversing will put us in the correct
+             * order we want and make the sorting go much faster.
+             */
+            matching_objects = g_list_reverse(qcb.list);
+            object_count = qcb.count;
+
+            /* Now sort the matching objects based on the search criteria */
+            if (sorted)
+                matching_objects = g_list_sort_with_data(matching_objects,
+                                   sort_func, q);
+
+            /* Crop the list if no results were wanted at all. */
+            if (q->max_results == 0)
+            {
+                g_list_free(matching_objects);
+                matching_objects = NULL;
+                object_count = 0;
+            }
+        }
     }
-    PINFO ("matching objects=%p count=%d", matching_objects, object_count);
+    PINFO ("returning objects=%p count=%d", matching_objects, object_count);
 
-    /* There is no absolute need to reverse this list, since it's being
-     * sorted below. However, in the common case, we will be searching
-     * in a confined location where the objects are already in order,
-     * thus reversing will put us in the correct order we want and make
-     * the sorting go much faster.
-     */
-    matching_objects = g_list_reverse(matching_objects);
+    q->changed = 0;
+
+    g_list_free(q->results);
+    q->results = matching_objects;
+
+    LEAVE (" q=%p", q);
+    return matching_objects;
+}
+
+/* ==================================================================== */
+/* Index selection.  If every OR-term of the query has a GUID "match
+ * any" term that can be answered from an index, only the objects the
+ * indexes return need to be checked; the whole term tree is still
+ * evaluated on each of them. */
+
+typedef struct
+{
+    QofQueryCB *      qcb;
+    GHashTable *      seen;
+} QofQueryIndexCB;
+
+/* Find a term in the AND-list that an index can answer.  Sets
+ * 'index_fcn' to NULL when the term is a match on the object's own
+ * GUID. */
+static QofQueryTerm *
+find_index_term (const QofQuery *q, GList *and_terms,
+                 QofQueryIndexFunc *index_fcn)
+{
+    GList *node;
+    GHashTable *ht;
 
-    /* Now sort the matching objects based on the search criteria */
-    if (q->primary_sort.comp_fcn || q->primary_sort.obj_cmp ||
-            (q->primary_sort.use_default && q->defaultSort))
+    ht = g_hash_table_lookup (queryIndexTable, q->search_for);
+
+    for (node = and_terms; node; node = node->next)
     {
-        matching_objects = g_list_sort_with_data(matching_objects, sort_func, q);
+        QofQueryTerm *qt = node->data;
+        query_guid_t pdata = (query_guid_t) qt->pdata;
+        GSList *params = qt->param_list;
+
+        if (qt->invert || !pdata ||
+                safe_strcmp (pdata->pd.type_name, QOF_TYPE_GUID) ||
+                pdata->options != QOF_GUID_MATCH_ANY || !params)
+            continue;
+
+        if (!params->next && !safe_strcmp (params->data, QOF_PARAM_GUID))
+        {
+            *index_fcn = NULL;
+            return qt;
+        }
+        if (ht && params->next && !params->next->next &&
+                !safe_strcmp (params->next->data, QOF_PARAM_GUID))
+        {
+            *index_fcn = g_hash_table_lookup (ht, params->data);
+            if (*index_fcn)
+                return qt;
+        }
     }
+    return NULL;
+}
+
+static void
+check_indexed_item_cb (QofInstance *inst, gpointer user_data)
+{
+    QofQueryIndexCB *icb = user_data;
 
-    /* Crop the list to limit the number of splits. */
-    if ((object_count > q->max_results) && (q->max_results > -1))
+    /* OR-terms (or a GUID list) can name the same object twice. */
+    if (g_hash_table_lookup (icb->seen, inst))
+        return;
+    g_hash_table_insert (icb->seen, inst, inst);
+    check_item_cb (inst, icb->qcb);
+}
+
+static gboolean
+query_run_indexed (QofQueryCB *qcb, QofBook *book)
+{
+    QofQuery *q = qcb->query;
+    QofQueryTerm **terms;
+    QofQueryIndexFunc *fcns;
+    QofQueryIndexCB icb;
+    GList *or_ptr;
+    gint i, n_terms;
+
+    if (!q->terms)
+        return FALSE;
+
+    n_terms = g_list_length (q->terms);
+    terms = g_new (QofQueryTerm *, n_terms);
+    fcns = g_new (QofQueryIndexFunc, n_terms);
+    for (or_ptr = q->terms, i = 0; or_ptr; or_ptr = or_ptr->next, i++)
     {
-        if (q->max_results > 0)
+        terms[i] = find_index_term (q, or_ptr->data, &fcns[i]);
+        if (!terms[i])
         {
-            GList *mptr;
+            g_free (terms);
+            g_free (fcns);
+            return FALSE;
+        }
+    }
 
-            /* mptr is set to the first node of what will be the new list */
-            mptr = g_list_nth(matching_objects, object_count - q->max_results);
-            /* mptr should not be NULL, but let's be safe */
-            if (mptr != NULL)
-            {
-                if (mptr->prev != NULL) mptr->prev->next = NULL;
-                mptr->prev = NULL;
-            }
-            g_list_free(matching_objects);
-            matching_objects = mptr;
+    icb.qcb = qcb;
+    icb.seen = g_hash_table_new (g_direct_hash, g_direct_equal);
+    for (i = 0; i < n_terms; i++)
+    {
+        query_guid_t pdata = (query_guid_t) terms[i]->pdata;
+        QofCollection *col;
+        GList *node;
+
+        if (fcns[i])
+        {
+            const QofParam *param;
+
+            param = qof_class_get_parameter (q->search_for,
+                                             terms[i]->param_list->data);
+            col = param ? qof_book_get_collection (book, param->param_type) : NULL;
         }
         else
         {
-            /* q->max_results == 0 */
-            g_list_free(matching_objects);
-            matching_objects = NULL;
+            col = qof_book_get_collection (book, q->search_for);
         }
-        object_count = q->max_results;
-    }
+        if (!col)
+            continue;
 
-    q->changed = 0;
+        for (node = pdata->guids; node; node = node->next)
+        {
+            QofInstance *inst = qof_collection_lookup_entity (col, node->data);
 
-    g_list_free(q->results);
-    q->results = matching_objects;
+            if (!inst)
+                continue;
+            if (fcns[i])
+                (fcns[i]) (inst, check_indexed_item_cb, &icb);
+            else
+                check_indexed_item_cb (inst, &icb);
+        }
+    }
+    PINFO ("query %p used indexes, checked %d objects", q,
+           g_hash_table_size (icb.seen));
 
-    LEAVE (" q=%p", q);
-    return matching_objects;
+    g_hash_table_destroy (icb.seen);
+    g_free (terms);
+    g_free (fcns);
+    return TRUE;
 }
 
 static void qof_query_run_cb(QofQueryCB* qcb, gpointer cb_arg)
@@ -822,9 +1212,11 @@ static void qof_query_run_cb(QofQueryCB* qcb, gpointer cb_arg)
             }
         }
 
-        /* And then iterate over all the objects */
-        qof_object_foreach (qcb->query->search_for, book,
-                            (QofInstanceForeachCB) check_item_cb, qcb);
+        /* And then iterate over all the objects, unless an index can
+         * narrow them down */
+        if (!query_run_indexed (qcb, book))
+            qof_object_foreach (qcb->query->search_for, book,
+                                (QofInstanceForeachCB) check_item_cb, qcb);
     }
 }
 
@@ -992,6 +1384,7 @@ QofQuery * qof_query_copy (QofQuery *q)
     memcpy (copy, q, sizeof (QofQuery));
 
     copy->be_compiled = ht;
+    copy->program = NULL;
     copy->terms = copy_or_terms (q->terms);
     copy->books = g_list_copy (q->books);
     copy->results = g_list_copy (q->results);
@@ -1325,15 +1718,38 @@ void qof_query_init (void)
     ENTER (" ");
     qof_query_core_init ();
     qof_class_init ();
+    queryIndexTable = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                      (GDestroyNotify) g_hash_table_destroy);
     LEAVE ("Completed initialization of QofQuery");
 }
 
 void qof_query_shutdown (void)
 {
+    g_hash_table_destroy (queryIndexTable);
+    queryIndexTable = NULL;
     qof_class_shutdown ();
     qof_query_core_shutdown ();
 }
 
+void qof_query_register_index (QofIdTypeConst obj_type, const char *param,
+                               QofQueryIndexFunc index_fcn)
+{
+    GHashTable *ht;
+
+    g_return_if_fail (obj_type);
+    g_return_if_fail (param);
+    g_return_if_fail (index_fcn);
+    g_return_if_fail (queryIndexTable);
+
+    ht = g_hash_table_lookup (queryIndexTable, obj_type);
+    if (!ht)
+    {
+        ht = g_hash_table_new (g_str_hash, g_str_equal);
+        g_hash_table_insert (queryIndexTable, (gpointer)obj_type, ht);
+    }
+    g_hash_table_insert (ht, (gpointer)param, index_fcn);
+}
+
 int qof_query_get_max_results (const QofQuery *q)
 {
     if (!q) return 0;
@@ -371,6 +371,29 @@ gboolean qof_query_equal (const QofQuery *q1, const QofQuery *q2);
  */
 void qof_query_print (QofQuery *query);
 
+/** A QofQueryIndexFunc calls 'cb' for every object whose indexed
+ *  parameter refers to 'referent'.  It may call 'cb' for objects that
+ *  don't match, but must not miss any that do. */
+typedef void (*QofQueryIndexFunc) (QofInstance *referent,
+                                   QofInstanceForeachCB cb,
+                                   gpointer user_data);
+
+/** Register an index for queries on objects of type 'obj_type'.
+ *
+ *  When every OR-term of a query contains a GUID "match any" term
+ *  on the parameter path (param, QOF_PARAM_GUID), the query only
+ *  visits the objects that the index returns for each of the GUIDs,
+ *  instead of every object in the book.  The remaining terms are then
+ *  checked as usual.  'param' must be a parameter of 'obj_type' whose
+ *  type is an object type.
+ *
+ *  Queries on the object's own GUID (QOF_PARAM_GUID alone) are
+ *  always looked up directly in the book's collection, and need no
+ *  registration.
+ */
+void qof_query_register_index (QofIdTypeConst obj_type, const char *param,
+                               QofQueryIndexFunc index_fcn);
+
 /** Return the type of data we're querying for */
 /*@ dependent @*/
 QofIdType qof_query_get_search_for (const QofQuery *q);
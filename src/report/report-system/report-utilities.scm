@@ -474,37 +474,34 @@
 ;; values rather than double values.
 (define (gnc:account-get-comm-balance-at-date account 
 					      date include-children?)
-  (let ((balance-collector (gnc:make-commodity-collector))
-	(query (qof-query-create-for-splits))
-	(splits #f))
-
-      (if include-children?
-	  (for-each 
-	   (lambda (x) 
-	     (gnc-commodity-collector-merge balance-collector x))
-	   (gnc:account-map-descendants
-	    (lambda (child)
-	      (gnc:account-get-comm-balance-at-date child date #f))
-	    account)))
-
-      (qof-query-set-book query (gnc-get-current-book))
-      (xaccQueryAddSingleAccountMatch query account QOF-QUERY-AND)
-      (xaccQueryAddDateMatchTS query #f date #t date QOF-QUERY-AND)
-      (qof-query-set-sort-order query
-				(list SPLIT-TRANS TRANS-DATE-POSTED)
-				(list QUERY-DEFAULT-SORT)
-				'())
-      (qof-query-set-sort-increasing query #t #t #t)
-      (qof-query-set-max-results query 1)
-      
-      (set! splits (qof-query-run query))
-      (qof-query-destroy query)
-
-      (if (and splits (not (null? splits)))
-	  (gnc-commodity-collector-add balance-collector
-				       (xaccAccountGetCommodity account)
-				       (xaccSplitGetBalance (car splits))))
-      balance-collector))
+  (car (gnc:account-get-comm-balances-at-dates
+        account (list date) include-children?)))
+
+;; Returns a list of commodity-collectors, one for each date in
+;; dates, holding the balance of the account at that date.  If
+;; include-children? is true, the balances of all children (not just
+;; direct children) are included.  All the balances are looked up in
+;; a single call into the engine.  As before, nothing is added for an
+;; account at a date before its first split.
+(define (gnc:account-get-comm-balances-at-dates account
+                                                dates include-children?)
+  (let* ((accounts (if include-children?
+                       (cons account (gnc-account-get-descendants account))
+                       (list account)))
+         (collectors (map (lambda (date) (gnc:make-commodity-collector))
+                          dates)))
+    (if (not (null? dates))
+        (for-each
+         (lambda (acct acct-balances)
+           (let ((commodity (xaccAccountGetCommodity acct)))
+             (for-each
+              (lambda (collector balance)
+                (if balance
+                    (gnc-commodity-collector-add collector commodity balance)))
+              collectors acct-balances)))
+         accounts
+         (gnc-accounts-get-balances-at-dates accounts dates)))
+    collectors))
 
 ;; Calculate the increase in the balance of the account in terms of
 ;; "value" (as opposed to "amount") between the specified dates.
@@ -281,24 +281,27 @@ developing over time"))
           (define (get-balance account date-list-entry subacct?)
             ((if (reverse-balance? account)
                  - +)
-             (if do-intervals?
-                 (collector->double
-                  (gnc:account-get-comm-balance-interval 
-                   account 
-                   (first date-list-entry) 
-                   (second date-list-entry) subacct?)
-                  (second date-list-entry))
-                 (collector->double
-                  (gnc:account-get-comm-balance-at-date
-                   account date-list-entry subacct?)
-                  date-list-entry))))
+             (collector->double
+              (gnc:account-get-comm-balance-interval 
+               account 
+               (first date-list-entry) 
+               (second date-list-entry) subacct?)
+              (second date-list-entry))))
           
           ;; Creates the <balance-list> to be used in the function
           ;; below. 
           (define (account->balance-list account subacct?)
-            (map 
-             (lambda (d) (get-balance account d subacct?))
-             dates-list))
+            (if do-intervals?
+                (map 
+                 (lambda (d) (get-balance account d subacct?))
+                 dates-list)
+                (map
+                 (lambda (collector d)
+                   ((if (reverse-balance? account) - +)
+                    (collector->double collector d)))
+                 (gnc:account-get-comm-balances-at-dates
+                  account dates-list subacct?)
+                 dates-list)))
           
 	  (define (count-accounts current-depth accts)
 	    (if (< current-depth tree-depth)
@@ -212,24 +212,47 @@
     ;; settings. Uses the collector->double conversion function
     ;; above. Returns a list of doubles.
     (define (process-datelist accounts dates income?)
+      (if inc-exp?
+          (process-interval-list accounts dates income?)
+          (process-balance-list accounts dates)))
+
+    ;; The asset/liability case: look up each account's balances at
+    ;; all of the dates at once, then total them date by date.
+    (define (process-balance-list accounts dates)
+      (let loop ((dates dates)
+                 (balances (map
+                            (lambda (account)
+                              (gnc:account-get-comm-balances-at-dates
+                               account dates #f))
+                            (filter (lambda (a)
+                                      (not (gnc:account-is-inc-exp? a)))
+                                    accounts)))
+                 (result '()))
+        (if (null? dates)
+            (reverse result)
+            (let ((total (gnc:make-commodity-collector)))
+              (for-each
+               (lambda (account-balances)
+                 (gnc-commodity-collector-merge total (car account-balances)))
+               balances)
+              (loop (cdr dates)
+                    (map cdr balances)
+                    (cons (collector->double total (car dates)) result))))))
+
+    ;; The income/expense case, where each 'date' is a pair of time
+    ;; values.
+    (define (process-interval-list accounts dates income?)
       (map 
        (lambda (date)
          (collector->double
-          ((if inc-exp?
-               (if income?
-                   gnc:accounts-get-comm-total-income
-                   gnc:accounts-get-comm-total-expense)
-               gnc:accounts-get-comm-total-assets)
+          ((if income?
+               gnc:accounts-get-comm-total-income
+               gnc:accounts-get-comm-total-expense)
            accounts 
            (lambda (account)
-             (if inc-exp?
-                 ;; for inc-exp, 'date' is a pair of time values, else
-                 ;; it is a time value.
-                 (gnc:account-get-comm-balance-interval 
-                  account (first date) (second date) #f)
-                 (gnc:account-get-comm-balance-at-date 
-                  account date #f))))
-          (if inc-exp? (second date) date)))
+             (gnc:account-get-comm-balance-interval 
+              account (first date) (second date) #f)))
+          (second date)))
        dates))
 
     (gnc:report-percent-done 1)